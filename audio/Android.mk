@@ -76,6 +76,13 @@ ifeq ($(strip $(TINYHAL_COMPRESS_PLAYBACK)),true)
 LOCAL_CFLAGS += -DTINYHAL_COMPRESS_PLAYBACK
 endif
 
+ifeq ($(strip $(TINYHAL_HAL_RECORD)),true)
+LOCAL_CFLAGS += -DTINYHAL_HAL_RECORD
+ifneq ($(strip $(TINYHAL_HAL_RECORD_FILE)),)
+LOCAL_CFLAGS += -DTINYHAL_HAL_RECORD_FILE=\"$(strip $(TINYHAL_HAL_RECORD_FILE))\"
+endif
+endif
+
 include $(BUILD_SHARED_LIBRARY)
 
 endif
@@ -25,6 +25,7 @@
 #include <errno.h>
 #include <pthread.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <sys/time.h>
 
@@ -51,6 +52,13 @@
 
 #include <tinyhal/audio_config.h>
 
+#ifdef TINYHAL_HAL_RECORD
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <tinyhal/hal_record.h>
+#endif
+
 #include <math.h>
 
 #ifdef ENABLE_STHAL_STREAMS
@@ -83,6 +91,23 @@
 #define ETC_PATH "/system/etc"
 #endif
 
+/* adev_set_parameters() key that reloads the configuration file */
+#define TINYHAL_RELOAD_CONFIG_KEY "tinyhal_reload_config"
+
+#ifdef TINYHAL_HAL_RECORD
+#ifndef TINYHAL_HAL_RECORD_FILE
+#define TINYHAL_HAL_RECORD_FILE "/data/vendor/audio/tinyhal_record.bin"
+#endif
+
+/* Records are buffered and written to the file when this fills */
+#define HAL_RECORD_BUFFER_SIZE  (64 * 1024)
+
+/* Longer string arguments are truncated */
+#define HAL_RECORD_MAX_STRING   1024
+
+struct hal_recorder;
+#endif
+
 #ifdef TINYHAL_COMPRESS_PLAYBACK
 enum async_mode {
     ASYNC_NONE,
@@ -113,6 +138,10 @@ struct audio_device {
     struct config_mgr *cm;
 
     const struct hw_stream *global_stream;
+
+#ifdef TINYHAL_HAL_RECORD
+    struct hal_recorder *recorder;
+#endif
 };
 
 
@@ -149,6 +178,11 @@ struct stream_out_common {
     bool use_async;
     async_common_t async_common;
 #endif
+
+#ifdef TINYHAL_HAL_RECORD
+    struct audio_stream_out rec_orig;   /* functions wrapped by recorder */
+    uint16_t rec_stream;
+#endif
 };
 
 struct stream_out_pcm {
@@ -222,6 +256,11 @@ struct stream_in_common {
     int input_source;
 
     nsecs_t last_read_ns;
+
+#ifdef TINYHAL_HAL_RECORD
+    struct audio_stream_in rec_orig;    /* functions wrapped by recorder */
+    uint16_t rec_stream;
+#endif
 };
 
 struct stream_in_pcm {
@@ -286,6 +325,23 @@ static int stream_invoke_usecases(const struct hw_stream *stream, const char *kv
     return ret;
 }
 
+/*
+ * If the config has <mixer parameters="batch"> the route and use-case
+ * changes of one set_parameters() call are written together by a
+ * transaction. Returns true if a transaction was opened.
+ */
+static bool begin_parameters_change(struct config_mgr *cm)
+{
+    return config_batch_parameters(cm) && (config_begin_transaction(cm) == 0);
+}
+
+static void end_parameters_change(struct config_mgr *cm, bool txn)
+{
+    if (txn) {
+        config_commit(cm);
+    }
+}
+
 static int common_get_routing_param(uint32_t *vout, const char *kvpairs)
 {
     struct str_parms *parms;
@@ -373,18 +429,23 @@ static int out_set_parameters(struct audio_stream *stream, const char *kvpairs)
     struct stream_out_common *out = (struct stream_out_common *)stream;
     struct audio_device *adev = out->dev;
     uint32_t v;
+    bool txn;
     int ret;
 
     ret = common_get_routing_param(&v, kvpairs);
 
     pthread_mutex_lock(&adev->lock);
 
+    txn = begin_parameters_change(adev->cm);
+
     if (ret >= 0) {
         apply_route(out->hw, v);
     }
 
     stream_invoke_usecases(out->hw, kvpairs);
 
+    end_parameters_change(adev->cm, txn);
+
     pthread_mutex_unlock(&adev->lock);
 
     ALOGV("-out_set_parameters(%p)", out);
@@ -1955,6 +2016,7 @@ static int in_pcm_set_parameters(struct audio_stream *stream, const char *kvpair
     bool routing_changed;
     uint32_t devices;
     bool input_was_changed;
+    bool txn;
     int ret;
 
     ALOGV("+in_pcm_set_parameters(%p) '%s'", stream, kvpairs);
@@ -1987,6 +2049,8 @@ static int in_pcm_set_parameters(struct audio_stream *stream, const char *kvpair
         routing_changed = true;
     }
 
+    txn = begin_parameters_change(in->common.dev->cm);
+
     if (routing_changed) {
         in->common.devices = new_routing;
 
@@ -1998,6 +2062,8 @@ static int in_pcm_set_parameters(struct audio_stream *stream, const char *kvpair
 
     stream_invoke_usecases(in->common.hw, kvpairs);
 
+    end_parameters_change(in->common.dev->cm, txn);
+
 out:
     pthread_mutex_unlock(&in->common.lock);
     str_parms_destroy(parms);
@@ -2224,11 +2290,26 @@ static int adev_set_parameters(struct audio_hw_device *dev, const char *kvpairs)
     struct str_parms *parms;
     char *str;
     char value[32];
+    bool txn;
+    int ret;
 
     ALOGW("adev_set_parameters '%s'", kvpairs);
 
+    /* Only the file that was loaded at boot can be reloaded */
+    parms = str_parms_create_str(kvpairs);
+    if (parms != NULL) {
+        if (str_parms_has_key(parms, TINYHAL_RELOAD_CONFIG_KEY)) {
+            ALOGI("Reloading config");
+            ret = reload_audio_config(adev->cm, NULL);
+            ALOGE_IF(ret != 0, "Failed to reload config: %d", ret);
+        }
+        str_parms_destroy(parms);
+    }
+
     if (adev->global_stream != NULL) {
+        txn = begin_parameters_change(adev->cm);
         stream_invoke_usecases(adev->global_stream, kvpairs);
+        end_parameters_change(adev->cm, txn);
     }
 
     return 0;
@@ -2292,8 +2373,762 @@ static size_t adev_get_input_buffer_size(const struct audio_hw_device *dev,
     return s;
 }
 
+#ifdef TINYHAL_HAL_RECORD
+/*********************************************************************
+ * HAL call recorder
+ *
+ * Every call into the HAL that changes state or moves data is logged
+ * with its arguments and timing so that it can be replayed on the host
+ * build of the HAL by audio/host/thal_replay. The recorder is installed by
+ * replacing the function pointers of the device and of each stream with
+ * wrappers that call the original functions. Pure getters are not
+ * recorded.
+ *
+ * Records are appended when a call returns so a stream's open is always
+ * before any of its other calls in the file.
+ *********************************************************************/
+struct hal_recorder {
+    pthread_mutex_t lock;
+    int fd;
+    uint16_t next_stream;
+    size_t used;
+    struct audio_hw_device orig;    /* functions wrapped by recorder */
+    uint8_t buf[HAL_RECORD_BUFFER_SIZE];
+};
+
+static void rec_flush_l(struct hal_recorder *rec)
+{
+    size_t done = 0;
+    ssize_t n;
+
+    while (done < rec->used) {
+        n = write(rec->fd, rec->buf + done, rec->used - done);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ALOGE("Failed to write HAL record (%d)", -errno);
+            break;
+        }
+        done += n;
+    }
+
+    rec->used = 0;
+}
+
+static void rec_flush(struct hal_recorder *rec)
+{
+    pthread_mutex_lock(&rec->lock);
+    rec_flush_l(rec);
+    pthread_mutex_unlock(&rec->lock);
+}
+
+static uint32_t rec_float(float f)
+{
+    uint32_t u;
+
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static uint16_t rec_new_stream(struct hal_recorder *rec)
+{
+    uint16_t id;
+
+    pthread_mutex_lock(&rec->lock);
+    id = rec->next_stream++;
+    if (rec->next_stream == HAL_RECORD_NO_STREAM) {
+        rec->next_stream = 0;
+    }
+    pthread_mutex_unlock(&rec->lock);
+
+    return id;
+}
+
+/* r->arg must already be filled in, the other fields are set here */
+static void rec_add(struct hal_recorder *rec, struct hal_record *r,
+                    enum hal_record_call call, uint16_t stream,
+                    nsecs_t start_ns, int ret, const char *str)
+{
+    nsecs_t duration_ns = systemTime(SYSTEM_TIME_MONOTONIC) - start_ns;
+    size_t str_len = (str != NULL) ? strlen(str) : 0;
+
+    if (str_len > HAL_RECORD_MAX_STRING) {
+        str_len = HAL_RECORD_MAX_STRING;
+    }
+
+    r->timestamp_ns = start_ns;
+    r->duration_ns = (duration_ns > UINT32_MAX) ? UINT32_MAX : duration_ns;
+    r->call = call;
+    r->stream = stream;
+    r->ret = ret;
+    r->str_len = str_len;
+
+    pthread_mutex_lock(&rec->lock);
+    if (rec->used + sizeof(*r) + str_len > sizeof(rec->buf)) {
+        rec_flush_l(rec);
+    }
+    memcpy(rec->buf + rec->used, r, sizeof(*r));
+    rec->used += sizeof(*r);
+    if (str_len > 0) {
+        memcpy(rec->buf + rec->used, str, str_len);
+        rec->used += str_len;
+    }
+    pthread_mutex_unlock(&rec->lock);
+}
+
+static int rec_out_set_parameters(struct audio_stream *stream,
+                                  const char *kvpairs)
+{
+    struct stream_out_common *out = (struct stream_out_common *)stream;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    int ret;
+
+    ret = out->rec_orig.common.set_parameters(stream, kvpairs);
+    rec_add(out->dev->recorder, &r, e_hal_record_out_set_parameters,
+            out->rec_stream, start_ns, ret, kvpairs);
+    return ret;
+}
+
+static int rec_out_set_volume(struct audio_stream_out *stream,
+                              float left, float right)
+{
+    struct stream_out_common *out = (struct stream_out_common *)stream;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    int ret;
+
+    ret = out->rec_orig.set_volume(stream, left, right);
+    r.arg[0] = rec_float(left);
+    r.arg[1] = rec_float(right);
+    rec_add(out->dev->recorder, &r, e_hal_record_out_set_volume,
+            out->rec_stream, start_ns, ret, NULL);
+    return ret;
+}
+
+static ssize_t rec_out_write(struct audio_stream_out *stream,
+                             const void *buffer, size_t bytes)
+{
+    struct stream_out_common *out = (struct stream_out_common *)stream;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    ssize_t ret;
+
+    ret = out->rec_orig.write(stream, buffer, bytes);
+    r.arg[0] = bytes;
+    rec_add(out->dev->recorder, &r, e_hal_record_out_write,
+            out->rec_stream, start_ns, ret, NULL);
+    return ret;
+}
+
+static int rec_out_standby(struct audio_stream *stream)
+{
+    struct stream_out_common *out = (struct stream_out_common *)stream;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    int ret;
+
+    ret = out->rec_orig.common.standby(stream);
+    rec_add(out->dev->recorder, &r, e_hal_record_out_standby,
+            out->rec_stream, start_ns, ret, NULL);
+    return ret;
+}
+
+static int rec_out_pause(struct audio_stream_out *stream)
+{
+    struct stream_out_common *out = (struct stream_out_common *)stream;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    int ret;
+
+    ret = out->rec_orig.pause(stream);
+    rec_add(out->dev->recorder, &r, e_hal_record_out_pause,
+            out->rec_stream, start_ns, ret, NULL);
+    return ret;
+}
+
+static int rec_out_resume(struct audio_stream_out *stream)
+{
+    struct stream_out_common *out = (struct stream_out_common *)stream;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    int ret;
+
+    ret = out->rec_orig.resume(stream);
+    rec_add(out->dev->recorder, &r, e_hal_record_out_resume,
+            out->rec_stream, start_ns, ret, NULL);
+    return ret;
+}
+
+static int rec_out_drain(struct audio_stream_out *stream,
+                         audio_drain_type_t type)
+{
+    struct stream_out_common *out = (struct stream_out_common *)stream;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    int ret;
+
+    ret = out->rec_orig.drain(stream, type);
+    r.arg[0] = type;
+    rec_add(out->dev->recorder, &r, e_hal_record_out_drain,
+            out->rec_stream, start_ns, ret, NULL);
+    return ret;
+}
+
+static int rec_out_flush(struct audio_stream_out *stream)
+{
+    struct stream_out_common *out = (struct stream_out_common *)stream;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    int ret;
+
+    ret = out->rec_orig.flush(stream);
+    rec_add(out->dev->recorder, &r, e_hal_record_out_flush,
+            out->rec_stream, start_ns, ret, NULL);
+    return ret;
+}
+
+static void rec_wrap_out(struct stream_out_common *out, uint16_t id)
+{
+    out->rec_stream = id;
+    out->rec_orig = out->stream;
+
+    out->stream.common.set_parameters = rec_out_set_parameters;
+    out->stream.common.standby = rec_out_standby;
+    out->stream.set_volume = rec_out_set_volume;
+    out->stream.write = rec_out_write;
+    if (out->rec_orig.pause) {
+        out->stream.pause = rec_out_pause;
+    }
+    if (out->rec_orig.resume) {
+        out->stream.resume = rec_out_resume;
+    }
+    if (out->rec_orig.drain) {
+        out->stream.drain = rec_out_drain;
+    }
+    if (out->rec_orig.flush) {
+        out->stream.flush = rec_out_flush;
+    }
+}
+
+static int rec_in_set_parameters(struct audio_stream *stream,
+                                 const char *kvpairs)
+{
+    struct stream_in_common *in = (struct stream_in_common *)stream;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    int ret;
+
+    ret = in->rec_orig.common.set_parameters(stream, kvpairs);
+    rec_add(in->dev->recorder, &r, e_hal_record_in_set_parameters,
+            in->rec_stream, start_ns, ret, kvpairs);
+    return ret;
+}
+
+static ssize_t rec_in_read(struct audio_stream_in *stream, void *buffer,
+                           size_t bytes)
+{
+    struct stream_in_common *in = (struct stream_in_common *)stream;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    ssize_t ret;
+
+    ret = in->rec_orig.read(stream, buffer, bytes);
+    r.arg[0] = bytes;
+    rec_add(in->dev->recorder, &r, e_hal_record_in_read,
+            in->rec_stream, start_ns, ret, NULL);
+    return ret;
+}
+
+static int rec_in_standby(struct audio_stream *stream)
+{
+    struct stream_in_common *in = (struct stream_in_common *)stream;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    int ret;
+
+    ret = in->rec_orig.common.standby(stream);
+    rec_add(in->dev->recorder, &r, e_hal_record_in_standby,
+            in->rec_stream, start_ns, ret, NULL);
+    return ret;
+}
+
+static int rec_in_set_gain(struct audio_stream_in *stream, float gain)
+{
+    struct stream_in_common *in = (struct stream_in_common *)stream;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    int ret;
+
+    ret = in->rec_orig.set_gain(stream, gain);
+    r.arg[0] = rec_float(gain);
+    rec_add(in->dev->recorder, &r, e_hal_record_in_set_gain,
+            in->rec_stream, start_ns, ret, NULL);
+    return ret;
+}
+
+static void rec_wrap_in(struct stream_in_common *in, uint16_t id)
+{
+    in->rec_stream = id;
+    in->rec_orig = in->stream;
+
+    in->stream.common.set_parameters = rec_in_set_parameters;
+    in->stream.common.standby = rec_in_standby;
+    in->stream.set_gain = rec_in_set_gain;
+    in->stream.read = rec_in_read;
+}
+
+static int rec_adev_set_parameters(struct audio_hw_device *dev,
+                                   const char *kvpairs)
+{
+    struct hal_recorder *rec = ((struct audio_device *)dev)->recorder;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    int ret;
+
+    ret = rec->orig.set_parameters(dev, kvpairs);
+    rec_add(rec, &r, e_hal_record_adev_set_parameters, HAL_RECORD_NO_STREAM,
+            start_ns, ret, kvpairs);
+    return ret;
+}
+
+static int rec_adev_set_voice_volume(struct audio_hw_device *dev, float volume)
+{
+    struct hal_recorder *rec = ((struct audio_device *)dev)->recorder;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    int ret;
+
+    ret = rec->orig.set_voice_volume(dev, volume);
+    r.arg[0] = rec_float(volume);
+    rec_add(rec, &r, e_hal_record_adev_set_voice_volume, HAL_RECORD_NO_STREAM,
+            start_ns, ret, NULL);
+    return ret;
+}
+
+static int rec_adev_set_master_volume(struct audio_hw_device *dev,
+                                      float volume)
+{
+    struct hal_recorder *rec = ((struct audio_device *)dev)->recorder;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    int ret;
+
+    ret = rec->orig.set_master_volume(dev, volume);
+    r.arg[0] = rec_float(volume);
+    rec_add(rec, &r, e_hal_record_adev_set_master_volume, HAL_RECORD_NO_STREAM,
+            start_ns, ret, NULL);
+    return ret;
+}
+
+static int rec_adev_set_mode(struct audio_hw_device *dev, audio_mode_t mode)
+{
+    struct hal_recorder *rec = ((struct audio_device *)dev)->recorder;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    int ret;
+
+    ret = rec->orig.set_mode(dev, mode);
+    r.arg[0] = mode;
+    rec_add(rec, &r, e_hal_record_adev_set_mode, HAL_RECORD_NO_STREAM,
+            start_ns, ret, NULL);
+    return ret;
+}
+
+static int rec_adev_set_mic_mute(struct audio_hw_device *dev, bool state)
+{
+    struct hal_recorder *rec = ((struct audio_device *)dev)->recorder;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    int ret;
+
+    ret = rec->orig.set_mic_mute(dev, state);
+    r.arg[0] = state;
+    rec_add(rec, &r, e_hal_record_adev_set_mic_mute, HAL_RECORD_NO_STREAM,
+            start_ns, ret, NULL);
+    return ret;
+}
+
+static int rec_adev_open_output_stream(struct audio_hw_device *dev,
+                                       audio_io_handle_t handle,
+                                       audio_devices_t devices,
+                                       audio_output_flags_t flags,
+                                       struct audio_config *config,
+                                       struct audio_stream_out **stream_out
+#ifdef AUDIO_DEVICE_API_VERSION_3_0
+                                       , const char *address
+#endif
+                                       )
+{
+    struct hal_recorder *rec = ((struct audio_device *)dev)->recorder;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    uint16_t id = HAL_RECORD_NO_STREAM;
+    int ret;
+
+    /* Record what was requested, config is updated by the open */
+    r.arg[0] = devices;
+    r.arg[1] = flags;
+    r.arg[2] = config->format;
+    r.arg[3] = config->sample_rate;
+    r.arg[4] = config->channel_mask;
+    r.arg[5] = handle;
+
+    ret = rec->orig.open_output_stream(dev, handle, devices, flags, config,
+                                       stream_out
+#ifdef AUDIO_DEVICE_API_VERSION_3_0
+                                       , address
+#endif
+                                       );
+    if (ret == 0) {
+        id = rec_new_stream(rec);
+        rec_wrap_out((struct stream_out_common *)*stream_out, id);
+    }
+
+    rec_add(rec, &r, e_hal_record_adev_open_output_stream, id,
+            start_ns, ret, NULL);
+    return ret;
+}
+
+static void rec_adev_close_output_stream(struct audio_hw_device *dev,
+                                         struct audio_stream_out *stream)
+{
+    struct hal_recorder *rec = ((struct audio_device *)dev)->recorder;
+    struct stream_out_common *out = (struct stream_out_common *)stream;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    uint16_t id = out->rec_stream;
+
+    /* Don't record calls the HAL makes to itself while closing */
+    out->stream = out->rec_orig;
+
+    rec->orig.close_output_stream(dev, stream);
+    rec_add(rec, &r, e_hal_record_adev_close_output_stream, id,
+            start_ns, 0, NULL);
+}
+
+static int rec_adev_open_input_stream(struct audio_hw_device *dev,
+                                      audio_io_handle_t handle,
+                                      audio_devices_t devices,
+                                      struct audio_config *config,
+                                      struct audio_stream_in **stream_in
+#ifdef AUDIO_DEVICE_API_VERSION_3_0
+                                      , audio_input_flags_t flags,
+                                      const char *address,
+                                      audio_source_t source
+#endif
+                                      )
+{
+    struct hal_recorder *rec = ((struct audio_device *)dev)->recorder;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    uint16_t id = HAL_RECORD_NO_STREAM;
+    int ret;
+
+    r.arg[0] = devices;
+#ifdef AUDIO_DEVICE_API_VERSION_3_0
+    r.arg[1] = flags;
+#endif
+    r.arg[2] = config->format;
+    r.arg[3] = config->sample_rate;
+    r.arg[4] = config->channel_mask;
+    r.arg[5] = handle;
+
+    ret = rec->orig.open_input_stream(dev, handle, devices, config, stream_in
+#ifdef AUDIO_DEVICE_API_VERSION_3_0
+                                      , flags, address, source
+#endif
+                                      );
+    if (ret == 0) {
+#ifdef ENABLE_STHAL_STREAMS
+        /* SCC streams are not ours so are not recorded */
+        if (cirrus_is_scc_stream(*stream_in)) {
+            return ret;
+        }
+#endif
+        id = rec_new_stream(rec);
+        rec_wrap_in((struct stream_in_common *)*stream_in, id);
+    }
+
+    rec_add(rec, &r, e_hal_record_adev_open_input_stream, id,
+            start_ns, ret, NULL);
+    return ret;
+}
+
+static void rec_adev_close_input_stream(struct audio_hw_device *dev,
+                                        struct audio_stream_in *stream)
+{
+    struct hal_recorder *rec = ((struct audio_device *)dev)->recorder;
+    struct stream_in_common *in = (struct stream_in_common *)stream;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+    uint16_t id;
+
+#ifdef ENABLE_STHAL_STREAMS
+    if (cirrus_is_scc_stream(stream)) {
+        rec->orig.close_input_stream(dev, stream);
+        return;
+    }
+#endif
+
+    id = in->rec_stream;
+
+    /* Don't record calls the HAL makes to itself while closing */
+    in->stream = in->rec_orig;
+
+    rec->orig.close_input_stream(dev, stream);
+    rec_add(rec, &r, e_hal_record_adev_close_input_stream, id,
+            start_ns, 0, NULL);
+}
+
+static int rec_adev_close(hw_device_t *device)
+{
+    struct audio_device *adev = (struct audio_device *)device;
+    struct hal_recorder *rec = adev->recorder;
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+    struct hal_record r = { 0 };
+
+    rec_add(rec, &r, e_hal_record_adev_close, HAL_RECORD_NO_STREAM,
+            start_ns, 0, NULL);
+    rec_flush(rec);
+    close(rec->fd);
+    pthread_mutex_destroy(&rec->lock);
+    adev->recorder = NULL;
+
+    adev->hw_device.common.close = rec->orig.common.close;
+    free(rec);
+
+    return adev->hw_device.common.close(device);
+}
+
+/*
+ * Start recording. The open itself is recorded with the time that
+ * adev_open() started. Failure to start recording is not fatal.
+ */
+static void rec_start(struct audio_device *adev, const char *config_file,
+                      nsecs_t start_ns)
+{
+    const struct hal_record_file_header header = {
+        .magic = { 'T', 'H', 'R', 'C' },
+        .version = HAL_RECORD_VERSION,
+        .record_size = sizeof(struct hal_record),
+    };
+    struct hal_recorder *rec;
+    struct hal_record r = { 0 };
+
+    rec = calloc(1, sizeof(*rec));
+    if (!rec) {
+        return;
+    }
+
+    rec->fd = open(TINYHAL_HAL_RECORD_FILE,
+                   O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (rec->fd < 0) {
+        ALOGE("Failed to open HAL record file %s (%d)",
+              TINYHAL_HAL_RECORD_FILE, -errno);
+        free(rec);
+        return;
+    }
+
+    pthread_mutex_init(&rec->lock, NULL);
+    memcpy(rec->buf, &header, sizeof(header));
+    rec->used = sizeof(header);
+
+    rec->orig = adev->hw_device;
+    adev->recorder = rec;
+
+    adev->hw_device.common.close = rec_adev_close;
+    adev->hw_device.set_voice_volume = rec_adev_set_voice_volume;
+    adev->hw_device.set_master_volume = rec_adev_set_master_volume;
+    adev->hw_device.set_mode = rec_adev_set_mode;
+    adev->hw_device.set_mic_mute = rec_adev_set_mic_mute;
+    adev->hw_device.set_parameters = rec_adev_set_parameters;
+    adev->hw_device.open_output_stream = rec_adev_open_output_stream;
+    adev->hw_device.close_output_stream = rec_adev_close_output_stream;
+    adev->hw_device.open_input_stream = rec_adev_open_input_stream;
+    adev->hw_device.close_input_stream = rec_adev_close_input_stream;
+
+    rec_add(rec, &r, e_hal_record_adev_open, HAL_RECORD_NO_STREAM,
+            start_ns, 0, config_file);
+
+    ALOGI("Recording HAL calls to %s", TINYHAL_HAL_RECORD_FILE);
+}
+#endif /* TINYHAL_HAL_RECORD */
+
+static void dump_phase_stats(int fd, const char *name,
+                             const struct config_phase_stats *phase)
+{
+    dprintf(fd, "  %-12s %8llu us %6u writes %8u bytes %6u unchanged\n",
+            name,
+            (unsigned long long)(phase->time_ns / 1000),
+            phase->ctl_writes,
+            phase->bytes_written,
+            phase->ctl_unchanged);
+}
+
+static void dump_boot_stats(int fd, const struct config_mgr *cm)
+{
+    struct config_mgr_boot_stats stats;
+    char name[16];
+    unsigned int i, n;
+
+    if (get_config_mgr_boot_stats(cm, &stats) != 0) {
+        return;
+    }
+
+    dprintf(fd, "Config load: %llu us\n",
+            (unsigned long long)(stats.total_ns / 1000));
+    dump_phase_stats(fd, "open", &stats.open);
+    dump_phase_stats(fd, "parse", &stats.parse);
+    dump_phase_stats(fd, "resolve", &stats.resolve);
+    dump_phase_stats(fd, "new_ctls", &stats.new_ctls);
+
+    n = stats.preinit_count;
+    if (n > CONFIG_MGR_MAX_PREINIT_STATS) {
+        n = CONFIG_MGR_MAX_PREINIT_STATS;
+    }
+    for (i = 0; i < n; ++i) {
+        snprintf(name, sizeof(name), "pre_init[%u]", i);
+        dump_phase_stats(fd, name, &stats.preinit[i]);
+    }
+
+    dump_phase_stats(fd, "init", &stats.init);
+}
+
+static void dump_ctl_write_stats(int fd, struct config_mgr *cm)
+{
+    struct ctl_write_stats *stats;
+    int count, max_count, i;
+    unsigned int b;
+
+    count = get_ctl_write_stats(cm, NULL, 0);
+    if (count <= 0) {
+        /* Not enabled, or nothing written */
+        return;
+    }
+
+    stats = calloc(count, sizeof(*stats));
+    if (!stats) {
+        return;
+    }
+
+    /* More controls might have been written since the count was taken,
+     * only the first count are copied
+     */
+    max_count = count;
+    count = get_ctl_write_stats(cm, stats, max_count);
+    if (count > max_count) {
+        count = max_count;
+    }
+
+    dprintf(fd, "Control writes (histogram bucket n is < 2^n us):\n");
+    for (i = 0; i < count; ++i) {
+        dprintf(fd, "  '%s' writes=%u avg=%lluus max=%lluus hist=",
+                stats[i].name ? stats[i].name : "?",
+                stats[i].writes,
+                (unsigned long long)(stats[i].total_ns / stats[i].writes / 1000),
+                (unsigned long long)(stats[i].max_ns / 1000));
+
+        for (b = 0; b < CTL_WRITE_HIST_BUCKETS; ++b) {
+            if (stats[i].hist[b] != 0) {
+                dprintf(fd, " %u:%u", b, stats[i].hist[b]);
+            }
+        }
+        dprintf(fd, "\n");
+    }
+
+    free(stats);
+}
+
+static void dump_lock_stats(int fd, struct config_mgr *cm)
+{
+    static const char * const names[e_config_lock_api_count] = {
+        [e_config_lock_get_stream] = "get_stream",
+        [e_config_lock_get_named_stream] = "get_named_stream",
+        [e_config_lock_release_stream] = "release_stream",
+        [e_config_lock_apply_route] = "apply_route",
+        [e_config_lock_apply_use_case] = "apply_use_case",
+        [e_config_lock_transaction] = "transaction",
+        [e_config_lock_reload] = "reload",
+        [e_config_lock_set_hw_volume] = "set_hw_volume",
+        [e_config_lock_get_constant] = "get_constant",
+    };
+    struct config_lock_stats stats[e_config_lock_api_count];
+    int count, i;
+
+    count = get_config_lock_stats(cm, stats, e_config_lock_api_count);
+    if (count <= 0) {
+        /* Not enabled */
+        return;
+    }
+
+    dprintf(fd, "Config manager lock:\n");
+    for (i = 0; i < count; ++i) {
+        if (stats[i].count == 0) {
+            continue;
+        }
+
+        dprintf(fd, "  %s count=%u wait avg=%lluns max=%lluns"
+                    " hold avg=%lluns max=%lluns\n",
+                names[i], stats[i].count,
+                (unsigned long long)(stats[i].wait_ns / stats[i].count),
+                (unsigned long long)stats[i].max_wait_ns,
+                (unsigned long long)(stats[i].hold_ns / stats[i].count),
+                (unsigned long long)stats[i].max_hold_ns);
+    }
+}
+
+/*
+ * The trace is dumped as raw records in hex so that it can be extracted
+ * from a bugreport and decoded on the host by tools/tinyhal_trace_decode
+ */
+static void dump_trace(int fd, struct config_mgr *cm)
+{
+    struct config_trace_record *records;
+    const unsigned char *p;
+    int count, i;
+    size_t b;
+
+    records = calloc(CONFIG_TRACE_RECORDS, sizeof(*records));
+    if (!records) {
+        return;
+    }
+
+    count = get_config_trace(cm, records, CONFIG_TRACE_RECORDS);
+
+    dprintf(fd, "%s %d %zu %lld\n", CONFIG_TRACE_DUMP_TAG,
+            CONFIG_TRACE_VERSION, sizeof(*records),
+            (long long)systemTime(SYSTEM_TIME_MONOTONIC));
+
+    for (i = 0; i < count; ++i) {
+        p = (const unsigned char *)&records[i];
+        for (b = 0; b < sizeof(*records); ++b) {
+            dprintf(fd, "%02x", p[b]);
+        }
+        dprintf(fd, "\n");
+    }
+
+    dprintf(fd, "%s end\n", CONFIG_TRACE_DUMP_TAG);
+
+    free(records);
+}
+
 static int adev_dump(const audio_hw_device_t *device, int fd)
 {
+    const struct audio_device *adev = (const struct audio_device *)device;
+
+    dump_boot_stats(fd, adev->cm);
+    dump_ctl_write_stats(fd, adev->cm);
+    dump_lock_stats(fd, adev->cm);
+    dump_trace(fd, adev->cm);
+
+#ifdef TINYHAL_HAL_RECORD
+    /* Make the recording so far available without closing the HAL */
+    if (adev->recorder) {
+        rec_flush(adev->recorder);
+    }
+#endif
     return 0;
 }
 
@@ -2314,6 +3149,9 @@ static int adev_open(const hw_module_t *module, const char *name,
     char file_name[80];
     char property[PROPERTY_VALUE_MAX];
     int ret;
+#ifdef TINYHAL_HAL_RECORD
+    nsecs_t start_ns = systemTime(SYSTEM_TIME_MONOTONIC);
+#endif
 
     if (strcmp(name, AUDIO_HARDWARE_INTERFACE) != 0) {
         return -EINVAL;
@@ -2357,6 +3195,10 @@ static int adev_open(const hw_module_t *module, const char *name,
 
     adev->global_stream = get_named_stream(adev->cm, "global");
 
+#ifdef TINYHAL_HAL_RECORD
+    rec_start(adev, file_name, start_ns);
+#endif
+
     *device = &adev->hw_device.common;
 
 #ifdef ENABLE_STHAL_STREAMS
@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host implementations of the libcutils functions used by the HAL.
+ * Properties are held in a small table that the benchmark fills with
+ * property_set().
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/properties.h>
+#include <cutils/str_parms.h>
+
+#define MAX_PROPERTIES 32
+
+struct property {
+    char key[PROPERTY_KEY_MAX];
+    char value[PROPERTY_VALUE_MAX];
+};
+
+static struct property properties[MAX_PROPERTIES];
+static int num_properties;
+
+static struct property *find_property(const char *key)
+{
+    int i;
+
+    for (i = 0; i < num_properties; ++i) {
+        if (strcmp(properties[i].key, key) == 0) {
+            return &properties[i];
+        }
+    }
+
+    return NULL;
+}
+
+int property_get(const char *key, char *value, const char *default_value)
+{
+    const struct property *p = find_property(key);
+    const char *v = p ? p->value : default_value;
+
+    if (!v) {
+        value[0] = '\0';
+        return 0;
+    }
+
+    snprintf(value, PROPERTY_VALUE_MAX, "%s", v);
+    return strlen(value);
+}
+
+int property_set(const char *key, const char *value)
+{
+    struct property *p = find_property(key);
+
+    if (strlen(key) >= PROPERTY_KEY_MAX || strlen(value) >= PROPERTY_VALUE_MAX) {
+        return -EINVAL;
+    }
+
+    if (!p) {
+        if (num_properties == MAX_PROPERTIES) {
+            return -ENOMEM;
+        }
+        p = &properties[num_properties++];
+        strcpy(p->key, key);
+    }
+
+    strcpy(p->value, value);
+    return 0;
+}
+
+/*
+ * str_parms is a list of key=value pairs separated by ';'. Lookups are
+ * linear, which is fine for the handful of keys the HAL is sent.
+ */
+struct str_parm {
+    struct str_parm *next;
+    char *key;
+    char *value;
+};
+
+struct str_parms {
+    struct str_parm *head;
+};
+
+struct str_parms *str_parms_create(void)
+{
+    return calloc(1, sizeof(struct str_parms));
+}
+
+static struct str_parm *find_parm(struct str_parms *str_parms, const char *key)
+{
+    struct str_parm *p;
+
+    for (p = str_parms->head; p; p = p->next) {
+        if (strcmp(p->key, key) == 0) {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+int str_parms_add_str(struct str_parms *str_parms, const char *key,
+                      const char *value)
+{
+    struct str_parm *p = find_parm(str_parms, key);
+    char *v = strdup(value);
+
+    if (!v) {
+        return -ENOMEM;
+    }
+
+    if (p) {
+        free(p->value);
+        p->value = v;
+        return 0;
+    }
+
+    p = calloc(1, sizeof(*p));
+    if (!p || !(p->key = strdup(key))) {
+        free(p);
+        free(v);
+        return -ENOMEM;
+    }
+    p->value = v;
+    p->next = str_parms->head;
+    str_parms->head = p;
+    return 0;
+}
+
+struct str_parms *str_parms_create_str(const char *_string)
+{
+    struct str_parms *str_parms = str_parms_create();
+    char *str, *kvpair, *save, *eq;
+
+    if (!str_parms) {
+        return NULL;
+    }
+
+    str = strdup(_string);
+    if (!str) {
+        str_parms_destroy(str_parms);
+        return NULL;
+    }
+
+    for (kvpair = strtok_r(str, ";", &save); kvpair;
+         kvpair = strtok_r(NULL, ";", &save)) {
+        eq = strchr(kvpair, '=');
+        if (eq) {
+            *eq = '\0';
+            str_parms_add_str(str_parms, kvpair, eq + 1);
+        } else {
+            str_parms_add_str(str_parms, kvpair, "");
+        }
+    }
+
+    free(str);
+    return str_parms;
+}
+
+void str_parms_destroy(struct str_parms *str_parms)
+{
+    struct str_parm *p, *next;
+
+    if (!str_parms) {
+        return;
+    }
+
+    for (p = str_parms->head; p; p = next) {
+        next = p->next;
+        free(p->key);
+        free(p->value);
+        free(p);
+    }
+    free(str_parms);
+}
+
+int str_parms_get_str(struct str_parms *str_parms, const char *key,
+                      char *out_val, int len)
+{
+    const struct str_parm *p = find_parm(str_parms, key);
+
+    if (!p) {
+        return -ENOENT;
+    }
+
+    snprintf(out_val, len, "%s", p->value);
+    return strlen(out_val);
+}
+
+bool str_parms_has_key(struct str_parms *str_parms, const char *key)
+{
+    return find_parm(str_parms, key) != NULL;
+}
+
+char *str_parms_to_str(struct str_parms *str_parms)
+{
+    const struct str_parm *p;
+    size_t len = 1;
+    char *str;
+
+    for (p = str_parms->head; p; p = p->next) {
+        len += strlen(p->key) + strlen(p->value) + 2;
+    }
+
+    str = malloc(len);
+    if (!str) {
+        return NULL;
+    }
+
+    str[0] = '\0';
+    for (p = str_parms->head; p; p = p->next) {
+        if (str[0] != '\0') {
+            strcat(str, ";");
+        }
+        strcat(str, p->key);
+        strcat(str, "=");
+        strcat(str, p->value);
+    }
+
+    return str;
+}
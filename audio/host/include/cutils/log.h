@@ -0,0 +1,27 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* Host stub: log to stdout/stderr as the config manager does off-device */
+
+#ifndef HOST_CUTILS_LOG_H
+#define HOST_CUTILS_LOG_H
+
+#include "../../../../configmgr/audio_logging.h"
+
+#endif /* HOST_CUTILS_LOG_H */
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/* Host stub of the subset of the str_parms API used by the HAL */
+
+#ifndef HOST_CUTILS_STR_PARMS_H
+#define HOST_CUTILS_STR_PARMS_H
+
+#include <stdbool.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+struct str_parms;
+
+struct str_parms *str_parms_create(void);
+struct str_parms *str_parms_create_str(const char *_string);
+void str_parms_destroy(struct str_parms *str_parms);
+int str_parms_add_str(struct str_parms *str_parms, const char *key,
+                      const char *value);
+int str_parms_get_str(struct str_parms *str_parms, const char *key,
+                      char *out_val, int len);
+bool str_parms_has_key(struct str_parms *str_parms, const char *key);
+char *str_parms_to_str(struct str_parms *str_parms);
+
+#if defined(__cplusplus)
+}  /* extern "C" */
+#endif
+
+#endif /* HOST_CUTILS_STR_PARMS_H */
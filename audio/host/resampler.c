@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host implementation of the audio_utils resampler API. This is a linear
+ * interpolator, not the speex resampler used on Android, so it is cheaper
+ * than the real one. It is only here so that the input resampling path
+ * of the HAL can run.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <audio_utils/resampler.h>
+
+#define MAX_CHANNELS 8
+
+/* Input frames requested from the provider at a time */
+#define PROVIDER_FRAMES 256
+
+struct linear_resampler {
+    struct resampler_itfe itfe;
+    struct resampler_buffer_provider *provider;
+    uint32_t channels;
+    uint64_t step;              /* input frames per output frame, Q32 */
+    uint64_t frac;              /* position between prev and next, Q32 */
+    int16_t prev[MAX_CHANNELS];
+    int16_t next[MAX_CHANNELS];
+};
+
+static void lr_reset(struct resampler_itfe *resampler)
+{
+    struct linear_resampler *rsp = (struct linear_resampler *)resampler;
+
+    rsp->frac = 1ULL << 32;     /* first output loads the first frame */
+    memset(rsp->prev, 0, sizeof(rsp->prev));
+    memset(rsp->next, 0, sizeof(rsp->next));
+}
+
+static int lr_resample_from_provider(struct resampler_itfe *resampler,
+                                     int16_t *out, size_t *outFrameCount)
+{
+    struct linear_resampler *rsp = (struct linear_resampler *)resampler;
+    struct resampler_buffer buf = { { NULL }, 0 };
+    size_t used = 0;
+    size_t done;
+    uint32_t c;
+    int ret = 0;
+
+    for (done = 0; done < *outFrameCount; ++done) {
+        while (rsp->frac >= (1ULL << 32)) {
+            if (used == buf.frame_count) {
+                if (buf.raw) {
+                    rsp->provider->release_buffer(rsp->provider, &buf);
+                }
+                buf.raw = NULL;
+                buf.frame_count = PROVIDER_FRAMES;
+                used = 0;
+                ret = rsp->provider->get_next_buffer(rsp->provider, &buf);
+                if (ret != 0 || !buf.raw || buf.frame_count == 0) {
+                    buf.raw = NULL;
+                    goto exit;
+                }
+            }
+
+            memcpy(rsp->prev, rsp->next, sizeof(rsp->prev));
+            memcpy(rsp->next, buf.i16 + (used * rsp->channels),
+                   rsp->channels * sizeof(int16_t));
+            ++used;
+            rsp->frac -= 1ULL << 32;
+        }
+
+        for (c = 0; c < rsp->channels; ++c) {
+            int32_t d = rsp->next[c] - rsp->prev[c];
+            *out++ = rsp->prev[c] + (int16_t)((d * (int64_t)rsp->frac) >> 32);
+        }
+        rsp->frac += rsp->step;
+    }
+
+exit:
+    if (buf.raw) {
+        buf.frame_count = used;
+        rsp->provider->release_buffer(rsp->provider, &buf);
+    }
+
+    *outFrameCount = done;
+    return ret;
+}
+
+static int lr_resample_from_input(struct resampler_itfe *resampler,
+                                  int16_t *in, size_t *inFrameCount,
+                                  int16_t *out, size_t *outFrameCount)
+{
+    (void)resampler;
+    (void)in;
+    (void)out;
+    *inFrameCount = 0;
+    *outFrameCount = 0;
+    return -ENOSYS;
+}
+
+static int32_t lr_delay_ns(struct resampler_itfe *resampler)
+{
+    (void)resampler;
+    return 0;
+}
+
+int create_resampler(uint32_t inSampleRate,
+                     uint32_t outSampleRate,
+                     uint32_t channelCount,
+                     uint32_t quality,
+                     struct resampler_buffer_provider *provider,
+                     struct resampler_itfe **resampler)
+{
+    struct linear_resampler *rsp;
+
+    (void)quality;
+
+    if (channelCount == 0 || channelCount > MAX_CHANNELS ||
+        inSampleRate == 0 || outSampleRate == 0 || !resampler) {
+        return -EINVAL;
+    }
+
+    rsp = calloc(1, sizeof(*rsp));
+    if (!rsp) {
+        return -ENOMEM;
+    }
+
+    rsp->itfe.reset = lr_reset;
+    rsp->itfe.resample_from_provider = lr_resample_from_provider;
+    rsp->itfe.resample_from_input = lr_resample_from_input;
+    rsp->itfe.delay_ns = lr_delay_ns;
+    rsp->provider = provider;
+    rsp->channels = channelCount;
+    rsp->step = ((uint64_t)inSampleRate << 32) / outSampleRate;
+    lr_reset(&rsp->itfe);
+
+    *resampler = &rsp->itfe;
+    return 0;
+}
+
+void release_resampler(struct resampler_itfe *resampler)
+{
+    free(resampler);
+}
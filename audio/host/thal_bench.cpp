@@ -0,0 +1,529 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host benchmark of the stream paths of audio_hw.c. The HAL is linked
+ * statically and runs on CAlsaMock, CPcmMock and CCompressMock. Each
+ * scenario streams a fixed duration of audio through one stream and the
+ * wall and CPU time of every HAL call is reported as JSON.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#include <cutils/properties.h>
+#include <hardware/audio.h>
+#include <hardware/hardware.h>
+
+#include "CAlsaMock.h"
+#include "CCompressMock.h"
+#include "CPcmMock.h"
+
+extern "C" struct audio_module HAL_MODULE_INFO_SYM;
+
+namespace {
+
+using cirrus::CCompressMock;
+using cirrus::CCompressMockFaults;
+using cirrus::CPcmMock;
+using cirrus::CPcmMockFaults;
+using cirrus::CSimClock;
+
+const char* const kDefaultProduct = "bench_phone";
+const char* const kDefaultControls = "../../configmgr/test/bench/data/bench_phone.csv";
+const unsigned int kDefaultDurationMs = 10000;
+
+// Size of each compressed write, as AudioFlinger's offload thread
+const size_t kCompressWriteBytes = 4096;
+
+uint64_t clockNs(clockid_t clock)
+{
+    struct timespec ts;
+
+    clock_gettime(clock, &ts);
+    return (static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL) + ts.tv_nsec;
+}
+
+// Wall and CPU time of all calls of one type
+class CCallStats
+{
+public:
+    explicit CCallStats(const char* name) : mName(name) {}
+
+    const std::string& name() const { return mName; }
+
+    void add(uint64_t wallNs, uint64_t cpuNs)
+    {
+        mWall.push_back(wallNs);
+        mCpuTotal += cpuNs;
+    }
+
+    void writeJson(std::ostream& os)
+    {
+        std::sort(mWall.begin(), mWall.end());
+
+        uint64_t total = 0;
+        for (auto ns : mWall) {
+            total += ns;
+        }
+
+        os << "        { \"name\": \"" << mName << "\""
+           << ", \"count\": " << mWall.size()
+           << ", \"mean_ns\": " << total / mWall.size()
+           << ", \"p50_ns\": " << percentile(50)
+           << ", \"p99_ns\": " << percentile(99)
+           << ", \"max_ns\": " << mWall.back()
+           << ", \"cpu_mean_ns\": " << mCpuTotal / mWall.size()
+           << " }";
+    }
+
+private:
+    uint64_t percentile(unsigned int pc) const
+    {
+        size_t i = (mWall.size() * pc) / 100;
+        if (i >= mWall.size()) {
+            i = mWall.size() - 1;
+        }
+        return mWall[i];
+    }
+
+private:
+    std::string             mName;
+    std::vector<uint64_t>   mWall;
+    uint64_t                mCpuTotal = 0;
+};
+
+class CScenario
+{
+public:
+    explicit CScenario(const char* name)
+        : mName(name)
+    {
+        CPcmMock::clearStats();
+        CCompressMock::clearStats();
+        mStartSimNs = CSimClock::nowNs();
+    }
+
+    // Time one call to the HAL
+    template<typename F>
+    auto time(const char* call, F f) -> decltype(f())
+    {
+        const uint64_t cpu = clockNs(CLOCK_THREAD_CPUTIME_ID);
+        const uint64_t wall = clockNs(CLOCK_MONOTONIC);
+        auto ret = f();
+        stats(call).add(clockNs(CLOCK_MONOTONIC) - wall,
+                        clockNs(CLOCK_THREAD_CPUTIME_ID) - cpu);
+        return ret;
+    }
+
+    void stop(uint64_t audioFrames, unsigned int rate)
+    {
+        mSimulatedNs = CSimClock::nowNs() - mStartSimNs;
+        mAudioMs = (audioFrames * 1000) / rate;
+        mPcm = CPcmMock::stats();
+        mCompress = CCompressMock::stats();
+    }
+
+    void writeJson(std::ostream& os)
+    {
+        os << "    { \"name\": \"" << mName << "\""
+           << ", \"audio_ms\": " << mAudioMs
+           << ", \"simulated_ms\": " << mSimulatedNs / 1000000
+           << ", \"pcm_transfers\": " << mPcm.transfers
+           << ", \"xruns\": " << mPcm.xruns
+           << ", \"compress_writes\": " << mCompress.writes
+           << ", \"blocked_ms\": "
+           << (mPcm.blockedNs + mCompress.blockedNs) / 1000000
+           << ",\n      \"calls\": [\n";
+
+        for (size_t i = 0; i < mCalls.size(); ++i) {
+            mCalls[i].writeJson(os);
+            os << ((i + 1 < mCalls.size()) ? ",\n" : "\n");
+        }
+
+        os << "      ]\n    }";
+    }
+
+private:
+    CCallStats& stats(const char* call)
+    {
+        for (auto& c : mCalls) {
+            if (c.name() == call) {
+                return c;
+            }
+        }
+
+        mCalls.emplace_back(call);
+        return mCalls.back();
+    }
+
+private:
+    std::string                 mName;
+    std::vector<CCallStats>     mCalls;
+    uint64_t                    mStartSimNs = 0;
+    uint64_t                    mSimulatedNs = 0;
+    uint64_t                    mAudioMs = 0;
+    cirrus::CPcmMockStats       mPcm;
+    cirrus::CCompressMockStats  mCompress;
+};
+
+class CBench
+{
+public:
+    CBench(struct audio_hw_device* dev, unsigned int durationMs)
+        : mDev(dev), mDurationMs(durationMs) {}
+
+    int runPcmOut();
+    int runPcmIn();
+    int runCompressOut();
+
+    void writeJson(std::ostream& os, const char* product);
+
+private:
+    struct audio_hw_device*     mDev;
+    unsigned int                mDurationMs;
+    std::vector<CScenario>      mScenarios;
+};
+
+int CBench::runPcmOut()
+{
+    CScenario s("pcm_out");
+    struct audio_config config;
+    struct audio_stream_out* out = nullptr;
+
+    memset(&config, 0, sizeof(config));
+    config.sample_rate = 44100;
+    config.channel_mask = AUDIO_CHANNEL_OUT_STEREO;
+    config.format = AUDIO_FORMAT_PCM_16_BIT;
+
+    int ret = s.time("open_output_stream", [&] {
+        return mDev->open_output_stream(mDev, 1, AUDIO_DEVICE_OUT_SPEAKER,
+                                        AUDIO_OUTPUT_FLAG_PRIMARY, &config,
+                                        &out, "");
+    });
+    if (ret != 0) {
+        fprintf(stderr, "pcm_out: open_output_stream failed: %d\n", ret);
+        return ret;
+    }
+
+    s.time("set_parameters", [&] {
+        return out->common.set_parameters(&out->common, "routing=2");
+    });
+
+    const size_t bytes = out->common.get_buffer_size(&out->common);
+    const size_t frameBytes = audio_stream_out_frame_size(out);
+    const uint64_t frames = (static_cast<uint64_t>(mDurationMs) * config.sample_rate) / 1000;
+    std::vector<char> buf(bytes);
+
+    uint64_t written = 0;
+    while (written < frames) {
+        s.time("write", [&] {
+            return out->write(out, buf.data(), bytes);
+        });
+        written += bytes / frameBytes;
+    }
+
+    s.time("standby", [&] { return out->common.standby(&out->common); });
+    s.time("close_output_stream", [&] {
+        mDev->close_output_stream(mDev, out);
+        return 0;
+    });
+
+    s.stop(written, config.sample_rate);
+    mScenarios.push_back(std::move(s));
+    return 0;
+}
+
+// Capture at 16kHz so that the HAL resamples from the 44.1kHz PCM
+int CBench::runPcmIn()
+{
+    CScenario s("pcm_in_resampled");
+    struct audio_config config;
+    struct audio_stream_in* in = nullptr;
+
+    memset(&config, 0, sizeof(config));
+    config.sample_rate = 16000;
+    config.channel_mask = AUDIO_CHANNEL_IN_MONO;
+    config.format = AUDIO_FORMAT_PCM_16_BIT;
+
+    int ret = s.time("open_input_stream", [&] {
+        return mDev->open_input_stream(mDev, 2, AUDIO_DEVICE_IN_BUILTIN_MIC,
+                                       &config, &in, AUDIO_INPUT_FLAG_NONE,
+                                       "", AUDIO_SOURCE_MIC);
+    });
+    if (ret != 0) {
+        fprintf(stderr, "pcm_in: open_input_stream failed: %d\n", ret);
+        return ret;
+    }
+
+    s.time("set_parameters", [&] {
+        return in->common.set_parameters(&in->common,
+                                         "input_source=1;routing=-2147483644");
+    });
+
+    const size_t bytes = in->common.get_buffer_size(&in->common);
+    const size_t frameBytes = audio_stream_in_frame_size(in);
+    const uint64_t frames = (static_cast<uint64_t>(mDurationMs) * config.sample_rate) / 1000;
+    std::vector<char> buf(bytes);
+
+    uint64_t done = 0;
+    while (done < frames) {
+        ssize_t n = s.time("read", [&] {
+            return in->read(in, buf.data(), bytes);
+        });
+        if (n <= 0) {
+            fprintf(stderr, "pcm_in: read failed: %zd\n", n);
+            break;
+        }
+        done += n / frameBytes;
+    }
+
+    s.time("standby", [&] { return in->common.standby(&in->common); });
+    s.time("close_input_stream", [&] {
+        mDev->close_input_stream(mDev, in);
+        return 0;
+    });
+
+    s.stop(done, config.sample_rate);
+    mScenarios.push_back(std::move(s));
+    return 0;
+}
+
+// Blocking offload of a 128kbit/s MP3 stream, ending with a full drain
+int CBench::runCompressOut()
+{
+    CScenario s("compress_out");
+    struct audio_config config;
+    struct audio_stream_out* out = nullptr;
+
+    memset(&config, 0, sizeof(config));
+    config.sample_rate = 44100;
+    config.channel_mask = AUDIO_CHANNEL_OUT_STEREO;
+    config.format = AUDIO_FORMAT_MP3;
+    config.offload_info.sample_rate = config.sample_rate;
+    config.offload_info.channel_mask = config.channel_mask;
+    config.offload_info.format = config.format;
+    config.offload_info.bit_rate = 128000;
+
+    int ret = s.time("open_output_stream", [&] {
+        return mDev->open_output_stream(mDev, 3, AUDIO_DEVICE_OUT_SPEAKER,
+                                        static_cast<audio_output_flags_t>(
+                                            AUDIO_OUTPUT_FLAG_DIRECT |
+                                            AUDIO_OUTPUT_FLAG_COMPRESS_OFFLOAD),
+                                        &config, &out, "");
+    });
+    if (ret != 0) {
+        fprintf(stderr, "compress_out: open_output_stream failed: %d\n", ret);
+        return ret;
+    }
+
+    s.time("set_parameters", [&] {
+        return out->common.set_parameters(&out->common,
+                                          "routing=2;delay_samples=576;padding_samples=1152");
+    });
+
+    const uint64_t total = (static_cast<uint64_t>(mDurationMs)
+                            * (config.offload_info.bit_rate / 8)) / 1000;
+    std::vector<char> buf(kCompressWriteBytes);
+
+    uint64_t written = 0;
+    while (written < total) {
+        ssize_t n = s.time("write", [&] {
+            return out->write(out, buf.data(), buf.size());
+        });
+        if (n < 0) {
+            fprintf(stderr, "compress_out: write failed: %zd\n", n);
+            break;
+        }
+        written += n;
+    }
+
+    uint32_t dspFrames = 0;
+    s.time("get_render_position", [&] {
+        return out->get_render_position(out, &dspFrames);
+    });
+
+    s.time("drain", [&] { return out->drain(out, AUDIO_DRAIN_ALL); });
+
+    s.time("standby", [&] { return out->common.standby(&out->common); });
+    s.time("close_output_stream", [&] {
+        mDev->close_output_stream(mDev, out);
+        return 0;
+    });
+
+    s.stop((written * 8 * config.sample_rate) / config.offload_info.bit_rate,
+           config.sample_rate);
+    mScenarios.push_back(std::move(s));
+    return 0;
+}
+
+void CBench::writeJson(std::ostream& os, const char* product)
+{
+    const CPcmMockFaults& pf = CPcmMock::faults();
+
+    os << "{\n"
+       << "  \"product\": \"" << product << "\",\n"
+       << "  \"clock\": \""
+       << ((CSimClock::mode() == CSimClock::eVirtual) ? "virtual" : "realtime")
+       << "\",\n"
+       << "  \"duration_ms\": " << mDurationMs << ",\n"
+       << "  \"xrun_interval\": " << pf.xrunInterval << ",\n"
+       << "  \"transfer_latency_ns\": " << pf.transferLatencyNs << ",\n"
+       << "  \"scenarios\": [\n";
+
+    for (size_t i = 0; i < mScenarios.size(); ++i) {
+        mScenarios[i].writeJson(os);
+        os << ((i + 1 < mScenarios.size()) ? ",\n" : "\n");
+    }
+
+    os << "  ]\n"
+       << "}\n";
+}
+
+void usage(const char* argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -p <name>   product, the HAL reads etc/audio.<name>.xml\n"
+            "              (default %s)\n"
+            "  -c <file>   CAlsaMock controls file (default %s)\n"
+            "  -d <ms>     duration of audio in each scenario (default %u)\n"
+            "  -r          run on the real clock instead of virtual time\n"
+            "  -X <n>      inject a PCM xrun every n transfers\n"
+            "  -L <us>     extra latency of each PCM transfer and compressed\n"
+            "              write\n"
+            "  -s <us>     extra latency of the first PCM transfer and\n"
+            "              compress_start\n"
+            "  -o <file>   write JSON results to file instead of stdout\n",
+            argv0, kDefaultProduct, kDefaultControls, kDefaultDurationMs);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const char* product = kDefaultProduct;
+    const char* controlsFile = kDefaultControls;
+    const char* outFile = nullptr;
+    unsigned int durationMs = kDefaultDurationMs;
+    CSimClock::EMode clockMode = CSimClock::eVirtual;
+    CPcmMockFaults pcmFaults;
+    CCompressMockFaults compressFaults;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:c:d:rX:L:s:o:h")) != -1) {
+        switch (opt) {
+        case 'p':
+            product = optarg;
+            break;
+        case 'c':
+            controlsFile = optarg;
+            break;
+        case 'd':
+            durationMs = strtoul(optarg, nullptr, 0);
+            break;
+        case 'r':
+            clockMode = CSimClock::eRealtime;
+            break;
+        case 'X':
+            pcmFaults.xrunInterval = strtoul(optarg, nullptr, 0);
+            break;
+        case 'L':
+            pcmFaults.transferLatencyNs = strtoul(optarg, nullptr, 0) * 1000;
+            compressFaults.writeLatencyNs = pcmFaults.transferLatencyNs;
+            break;
+        case 's':
+            pcmFaults.startLatencyNs = strtoul(optarg, nullptr, 0) * 1000;
+            compressFaults.startLatencyNs = pcmFaults.startLatencyNs;
+            break;
+        case 'o':
+            outFile = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (durationMs == 0) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    cirrus::CAlsaMock mixer(0);
+    if (mixer.readFromFile(controlsFile) != 0) {
+        fprintf(stderr, "Failed to read controls from %s\n", controlsFile);
+        return 1;
+    }
+
+    CSimClock::setMode(clockMode);
+    CPcmMock::setFaults(pcmFaults);
+    CCompressMock::setFaults(compressFaults);
+    property_set("ro.product.device", product);
+
+    struct hw_device_t* device = nullptr;
+    int ret = HAL_MODULE_INFO_SYM.common.methods->open(&HAL_MODULE_INFO_SYM.common,
+                                                       AUDIO_HARDWARE_INTERFACE,
+                                                       &device);
+    if (ret != 0) {
+        fprintf(stderr, "Failed to open HAL: %d\n", ret);
+        return 1;
+    }
+
+    struct audio_hw_device* dev = reinterpret_cast<struct audio_hw_device*>(device);
+    CBench bench(dev, durationMs);
+
+    ret = bench.runPcmOut();
+    if (ret == 0) {
+        ret = bench.runPcmIn();
+    }
+    if (ret == 0) {
+        ret = bench.runCompressOut();
+    }
+
+    device->close(device);
+
+    if (ret != 0) {
+        return 1;
+    }
+
+    if (outFile != nullptr) {
+        std::ofstream fout(outFile);
+        if (!fout) {
+            fprintf(stderr, "Failed to create %s\n", outFile);
+            return 1;
+        }
+        bench.writeJson(fout, product);
+    } else {
+        std::ostringstream s;
+        bench.writeJson(s, product);
+        fputs(s.str().c_str(), stdout);
+    }
+
+    return 0;
+}
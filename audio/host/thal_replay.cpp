@@ -0,0 +1,711 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays a recording of HAL calls, made by a HAL built with
+ * TINYHAL_HAL_RECORD, against the host build of audio_hw.c running on
+ * CAlsaMock, CPcmMock and CCompressMock. Every recorded call, including the
+ * writes and reads of audio data, is made on the same HAL entry point with
+ * the recorded arguments, in the order they were recorded, from one thread.
+ * The recorded and replayed time of each type of call is written as JSON.
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+
+#include <cutils/properties.h>
+#include <hardware/audio.h>
+#include <hardware/hardware.h>
+#include <tinyhal/hal_record.h>
+
+#include "CAlsaMock.h"
+#include "CCompressMock.h"
+#include "CPcmMock.h"
+
+extern "C" struct audio_module HAL_MODULE_INFO_SYM;
+
+namespace {
+
+using cirrus::CSimClock;
+
+const char* const kDefaultProduct = "bench_phone";
+const char* const kDefaultControls = "../../configmgr/test/bench/data/bench_phone.csv";
+
+const char* const kCallNames[e_hal_record_call_count] = {
+    nullptr,
+    "adev_open",
+    "adev_close",
+    "adev_set_parameters",
+    "adev_set_voice_volume",
+    "adev_set_master_volume",
+    "adev_set_mode",
+    "adev_set_mic_mute",
+    "adev_open_output_stream",
+    "adev_close_output_stream",
+    "adev_open_input_stream",
+    "adev_close_input_stream",
+    "out_set_parameters",
+    "out_set_volume",
+    "out_write",
+    "out_standby",
+    "out_pause",
+    "out_resume",
+    "out_drain",
+    "out_flush",
+    "in_set_parameters",
+    "in_read",
+    "in_standby",
+    "in_set_gain",
+};
+
+struct CRecord
+{
+    struct hal_record   rec;
+    std::string         str;
+};
+
+struct CCallStats
+{
+    uint64_t count = 0;
+    uint64_t replayed = 0;
+    uint64_t mismatched = 0;    // failed when recorded or replayed, not both
+    uint64_t recordedNs = 0;
+    uint64_t recordedMaxNs = 0;
+    uint64_t replayNs = 0;
+    uint64_t replayMaxNs = 0;
+    uint64_t ctlWrites = 0;
+};
+
+uint64_t nowNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL) + ts.tv_nsec;
+}
+
+float floatArg(uint32_t bits)
+{
+    float f;
+
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+int readRecording(const char* fileName, std::vector<CRecord>& records)
+{
+    std::ifstream fin(fileName, std::ios::binary);
+    if (!fin) {
+        fprintf(stderr, "Failed to open %s\n", fileName);
+        return -ENOENT;
+    }
+
+    struct hal_record_file_header header;
+    if (!fin.read(reinterpret_cast<char*>(&header), sizeof(header))
+            || (memcmp(header.magic, HAL_RECORD_MAGIC, sizeof(header.magic)) != 0)) {
+        fprintf(stderr, "%s is not a HAL recording\n", fileName);
+        return -EINVAL;
+    }
+
+    if ((header.version != HAL_RECORD_VERSION)
+            || (header.record_size != sizeof(struct hal_record))) {
+        fprintf(stderr, "%s: unsupported version %u (record size %u)\n",
+                fileName, header.version, header.record_size);
+        return -EINVAL;
+    }
+
+    CRecord r;
+    while (fin.read(reinterpret_cast<char*>(&r.rec), sizeof(r.rec))) {
+        r.str.resize(r.rec.str_len);
+        if ((r.rec.str_len > 0) && !fin.read(&r.str[0], r.rec.str_len)) {
+            break;
+        }
+        records.push_back(r);
+    }
+
+    // A recording taken from a running HAL can end part way into a record
+    if (fin.gcount() != 0) {
+        fprintf(stderr, "%s: ignoring truncated last record\n", fileName);
+    }
+
+    return 0;
+}
+
+const char* callName(uint16_t call)
+{
+    if ((call == 0) || (call >= e_hal_record_call_count)) {
+        return "unknown";
+    }
+
+    return kCallNames[call];
+}
+
+void dumpRecord(const CRecord& r, uint64_t startNs)
+{
+    printf("%12.6f %8u %-26s", (r.rec.timestamp_ns - startNs) / 1e9,
+           r.rec.duration_ns, callName(r.rec.call));
+
+    if (r.rec.stream != HAL_RECORD_NO_STREAM) {
+        printf(" stream=%u", r.rec.stream);
+    }
+
+    printf(" ret=%d args=%x,%x,%x,%x,%x,%x", r.rec.ret,
+           r.rec.arg[0], r.rec.arg[1], r.rec.arg[2],
+           r.rec.arg[3], r.rec.arg[4], r.rec.arg[5]);
+
+    if (!r.str.empty()) {
+        printf(" '%s'", r.str.c_str());
+    }
+    printf("\n");
+}
+
+/*
+ * Makes each recorded call on the HAL. The HAL always reads
+ * etc/audio.<ro.product.device>.xml, the config file named in the recording
+ * is only informational.
+ */
+class CReplayer
+{
+public:
+    CReplayer() = default;
+    ~CReplayer();
+
+    // Returns 1 if the call was replayed, 0 if it was not because it failed
+    // when it was recorded, or a negative error if it could not be replayed.
+    // ret is the value returned by the HAL.
+    int replay(const CRecord& r, int& ret);
+
+private:
+    struct CStream
+    {
+        struct audio_stream_out*    out = nullptr;
+        struct audio_stream_in*     in = nullptr;
+    };
+
+    int open();
+    void close();
+    int openOutput(const CRecord& r, int& ret);
+    int openInput(const CRecord& r, int& ret);
+    struct audio_stream_out* findOut(const CRecord& r);
+    struct audio_stream_in* findIn(const CRecord& r);
+    char* buffer(size_t bytes);
+
+private:
+    struct audio_hw_device*     mDev = nullptr;
+    std::map<uint16_t, CStream> mStreams;
+    std::vector<char>           mBuffer;
+};
+
+CReplayer::~CReplayer()
+{
+    close();
+}
+
+int CReplayer::open()
+{
+    struct hw_device_t* device = nullptr;
+
+    close();
+
+    int ret = HAL_MODULE_INFO_SYM.common.methods->open(&HAL_MODULE_INFO_SYM.common,
+                                                       AUDIO_HARDWARE_INTERFACE,
+                                                       &device);
+    if (ret != 0) {
+        fprintf(stderr, "Failed to open HAL: %d\n", ret);
+        return ret;
+    }
+
+    mDev = reinterpret_cast<struct audio_hw_device*>(device);
+    return 0;
+}
+
+// Close the streams that the recording left open, then the HAL
+void CReplayer::close()
+{
+    if (mDev == nullptr) {
+        return;
+    }
+
+    for (auto& s : mStreams) {
+        if (s.second.out != nullptr) {
+            mDev->close_output_stream(mDev, s.second.out);
+        } else {
+            mDev->close_input_stream(mDev, s.second.in);
+        }
+    }
+    mStreams.clear();
+
+    mDev->common.close(&mDev->common);
+    mDev = nullptr;
+}
+
+struct audio_stream_out* CReplayer::findOut(const CRecord& r)
+{
+    auto it = mStreams.find(r.rec.stream);
+    if ((it == mStreams.end()) || (it->second.out == nullptr)) {
+        fprintf(stderr, "%s on unknown stream %u\n", callName(r.rec.call),
+                r.rec.stream);
+        return nullptr;
+    }
+
+    return it->second.out;
+}
+
+struct audio_stream_in* CReplayer::findIn(const CRecord& r)
+{
+    auto it = mStreams.find(r.rec.stream);
+    if ((it == mStreams.end()) || (it->second.in == nullptr)) {
+        fprintf(stderr, "%s on unknown stream %u\n", callName(r.rec.call),
+                r.rec.stream);
+        return nullptr;
+    }
+
+    return it->second.in;
+}
+
+// Silence for writes, space for reads
+char* CReplayer::buffer(size_t bytes)
+{
+    if (mBuffer.size() < bytes) {
+        mBuffer.resize(bytes);
+    }
+
+    return mBuffer.data();
+}
+
+int CReplayer::openOutput(const CRecord& r, int& ret)
+{
+    const struct hal_record& rec = r.rec;
+    struct audio_config config;
+    CStream s;
+
+    memset(&config, 0, sizeof(config));
+    config.format = static_cast<audio_format_t>(rec.arg[2]);
+    config.sample_rate = rec.arg[3];
+    config.channel_mask = rec.arg[4];
+
+    ret = mDev->open_output_stream(mDev, rec.arg[5], rec.arg[0],
+                                   static_cast<audio_output_flags_t>(rec.arg[1]),
+                                   &config, &s.out, "");
+    if (ret != 0) {
+        fprintf(stderr, "Failed to open output stream %u: %d\n",
+                rec.stream, ret);
+        return ret;
+    }
+
+    mStreams[rec.stream] = s;
+    return 1;
+}
+
+int CReplayer::openInput(const CRecord& r, int& ret)
+{
+    const struct hal_record& rec = r.rec;
+    struct audio_config config;
+    CStream s;
+
+    memset(&config, 0, sizeof(config));
+    config.format = static_cast<audio_format_t>(rec.arg[2]);
+    config.sample_rate = rec.arg[3];
+    config.channel_mask = rec.arg[4];
+
+    // The source is not recorded, the HAL takes it from input_source
+    ret = mDev->open_input_stream(mDev, rec.arg[5], rec.arg[0], &config, &s.in,
+                                  static_cast<audio_input_flags_t>(rec.arg[1]),
+                                  "", AUDIO_SOURCE_DEFAULT);
+    if (ret != 0) {
+        fprintf(stderr, "Failed to open input stream %u: %d\n",
+                rec.stream, ret);
+        return ret;
+    }
+
+    mStreams[rec.stream] = s;
+    return 1;
+}
+
+int CReplayer::replay(const CRecord& r, int& ret)
+{
+    const struct hal_record& rec = r.rec;
+    struct audio_stream_out* out;
+    struct audio_stream_in* in;
+
+    ret = 0;
+
+    if (rec.call == e_hal_record_adev_open) {
+        ret = open();
+        return (ret == 0) ? 1 : ret;
+    }
+
+    if (mDev == nullptr) {
+        fprintf(stderr, "%s before adev_open\n", callName(rec.call));
+        return -EINVAL;
+    }
+
+    switch (rec.call) {
+    case e_hal_record_adev_close:
+        close();
+        return 1;
+
+    case e_hal_record_adev_set_parameters:
+        ret = mDev->set_parameters(mDev, r.str.c_str());
+        return 1;
+
+    case e_hal_record_adev_set_voice_volume:
+        ret = mDev->set_voice_volume(mDev, floatArg(rec.arg[0]));
+        return 1;
+
+    case e_hal_record_adev_set_master_volume:
+        ret = mDev->set_master_volume(mDev, floatArg(rec.arg[0]));
+        return 1;
+
+    case e_hal_record_adev_set_mode:
+        ret = mDev->set_mode(mDev, static_cast<audio_mode_t>(rec.arg[0]));
+        return 1;
+
+    case e_hal_record_adev_set_mic_mute:
+        ret = mDev->set_mic_mute(mDev, rec.arg[0] != 0);
+        return 1;
+
+    // A failed open has no stream for later calls to refer to
+    case e_hal_record_adev_open_output_stream:
+        return (rec.ret == 0) ? openOutput(r, ret) : 0;
+
+    case e_hal_record_adev_open_input_stream:
+        return (rec.ret == 0) ? openInput(r, ret) : 0;
+
+    case e_hal_record_adev_close_output_stream:
+        if ((out = findOut(r)) == nullptr) {
+            return -EINVAL;
+        }
+        mDev->close_output_stream(mDev, out);
+        mStreams.erase(rec.stream);
+        return 1;
+
+    case e_hal_record_adev_close_input_stream:
+        if ((in = findIn(r)) == nullptr) {
+            return -EINVAL;
+        }
+        mDev->close_input_stream(mDev, in);
+        mStreams.erase(rec.stream);
+        return 1;
+
+    case e_hal_record_out_set_parameters:
+        if ((out = findOut(r)) == nullptr) {
+            return -EINVAL;
+        }
+        ret = out->common.set_parameters(&out->common, r.str.c_str());
+        return 1;
+
+    case e_hal_record_out_set_volume:
+        if ((out = findOut(r)) == nullptr) {
+            return -EINVAL;
+        }
+        ret = out->set_volume(out, floatArg(rec.arg[0]), floatArg(rec.arg[1]));
+        return 1;
+
+    case e_hal_record_out_write:
+        if ((out = findOut(r)) == nullptr) {
+            return -EINVAL;
+        }
+        ret = out->write(out, buffer(rec.arg[0]), rec.arg[0]);
+        return 1;
+
+    case e_hal_record_out_standby:
+        if ((out = findOut(r)) == nullptr) {
+            return -EINVAL;
+        }
+        ret = out->common.standby(&out->common);
+        return 1;
+
+    case e_hal_record_out_pause:
+    case e_hal_record_out_resume:
+    case e_hal_record_out_drain:
+    case e_hal_record_out_flush:
+        if ((out = findOut(r)) == nullptr) {
+            return -EINVAL;
+        }
+        if (rec.call == e_hal_record_out_pause) {
+            ret = out->pause ? out->pause(out) : -ENOSYS;
+        } else if (rec.call == e_hal_record_out_resume) {
+            ret = out->resume ? out->resume(out) : -ENOSYS;
+        } else if (rec.call == e_hal_record_out_drain) {
+            ret = out->drain ? out->drain(out, static_cast<audio_drain_type_t>(rec.arg[0]))
+                             : -ENOSYS;
+        } else {
+            ret = out->flush ? out->flush(out) : -ENOSYS;
+        }
+        return 1;
+
+    case e_hal_record_in_set_parameters:
+        if ((in = findIn(r)) == nullptr) {
+            return -EINVAL;
+        }
+        ret = in->common.set_parameters(&in->common, r.str.c_str());
+        return 1;
+
+    case e_hal_record_in_read:
+        if ((in = findIn(r)) == nullptr) {
+            return -EINVAL;
+        }
+        ret = in->read(in, buffer(rec.arg[0]), rec.arg[0]);
+        return 1;
+
+    case e_hal_record_in_standby:
+        if ((in = findIn(r)) == nullptr) {
+            return -EINVAL;
+        }
+        ret = in->common.standby(&in->common);
+        return 1;
+
+    case e_hal_record_in_set_gain:
+        if ((in = findIn(r)) == nullptr) {
+            return -EINVAL;
+        }
+        ret = in->set_gain(in, floatArg(rec.arg[0]));
+        return 1;
+
+    default:
+        fprintf(stderr, "Unknown call %u\n", rec.call);
+        return -EINVAL;
+    }
+}
+
+void writeJson(std::ostream& os, const char* recordingFile,
+               const char* product, bool realtime, size_t numRecords,
+               uint64_t recordedSpanNs, uint64_t replayNs,
+               const std::vector<CCallStats>& stats)
+{
+    bool first = true;
+
+    os << "{\n"
+       << "  \"recording\": \"" << recordingFile << "\",\n"
+       << "  \"product\": \"" << product << "\",\n"
+       << "  \"realtime\": " << (realtime ? "true" : "false") << ",\n"
+       << "  \"records\": " << numRecords << ",\n"
+       << "  \"recorded_span_ns\": " << recordedSpanNs << ",\n"
+       << "  \"replay_ns\": " << replayNs << ",\n"
+       << "  \"results\": [";
+
+    for (int call = 1; call < e_hal_record_call_count; ++call) {
+        const CCallStats& c = stats[call];
+        if (c.count == 0) {
+            continue;
+        }
+
+        os << (first ? "\n" : ",\n")
+           << "    { \"name\": \"" << kCallNames[call] << "\""
+           << ", \"count\": " << c.count
+           << ", \"replayed\": " << c.replayed
+           << ", \"mismatched\": " << c.mismatched
+           << ", \"recorded_mean_ns\": " << c.recordedNs / c.count
+           << ", \"recorded_max_ns\": " << c.recordedMaxNs
+           << ", \"replay_mean_ns\": "
+           << (c.replayed ? c.replayNs / c.replayed : 0)
+           << ", \"replay_max_ns\": " << c.replayMaxNs
+           << ", \"ctl_writes\": " << c.ctlWrites << " }";
+        first = false;
+    }
+
+    os << "\n  ]\n"
+       << "}\n";
+}
+
+void usage(const char* argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options] <recording>\n"
+            "  -p <name>   product, the HAL reads etc/audio.<name>.xml\n"
+            "              (default %s)\n"
+            "  -c <file>   CAlsaMock controls file (default %s)\n"
+            "  -o <file>   write JSON results to file instead of stdout\n"
+            "  -t          replay with the recorded timing on the real clock\n"
+            "              instead of as fast as possible on virtual time\n"
+            "  -d          print the recording and exit\n"
+            "  -C <bool>,<int>,<enum>,<byte>,<per byte>\n"
+            "              simulated ioctl cost in ns of each control type\n"
+            "  -S          spin for the simulated cost\n",
+            argv0, kDefaultProduct, kDefaultControls);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const char* product = kDefaultProduct;
+    const char* controlsFile = kDefaultControls;
+    const char* outFile = nullptr;
+    bool realtime = false;
+    bool dumpOnly = false;
+    cirrus::CMockIoctlCost cost;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:c:o:tdC:Sh")) != -1) {
+        switch (opt) {
+        case 'p':
+            product = optarg;
+            break;
+        case 'c':
+            controlsFile = optarg;
+            break;
+        case 'o':
+            outFile = optarg;
+            break;
+        case 't':
+            realtime = true;
+            break;
+        case 'd':
+            dumpOnly = true;
+            break;
+        case 'C':
+            if (sscanf(optarg, "%u,%u,%u,%u,%u", &cost.boolNs, &cost.intNs,
+                       &cost.enumNs, &cost.byteNs, &cost.perByteNs) != 5) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'S':
+            cost.spin = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind + 1 != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+    const char* recordingFile = argv[optind];
+
+    std::vector<CRecord> records;
+    if (readRecording(recordingFile, records) != 0) {
+        return 1;
+    }
+
+    if (records.empty()) {
+        fprintf(stderr, "%s is empty\n", recordingFile);
+        return 1;
+    }
+
+    const uint64_t firstNs = records.front().rec.timestamp_ns;
+
+    if (dumpOnly) {
+        for (const auto& r : records) {
+            dumpRecord(r, firstNs);
+        }
+        return 0;
+    }
+
+    cirrus::CAlsaMock mixer(0);
+    if (mixer.readFromFile(controlsFile) != 0) {
+        fprintf(stderr, "Failed to read controls from %s\n", controlsFile);
+        return 1;
+    }
+    mixer.setIoctlCost(cost);
+
+    CSimClock::setMode(realtime ? CSimClock::eRealtime : CSimClock::eVirtual);
+    property_set("ro.product.device", product);
+
+    std::vector<CCallStats> stats(e_hal_record_call_count);
+    uint64_t replayNs = 0;
+    int errors = 0;
+
+    // The replayer must close the HAL before the mixer is destroyed
+    {
+        CReplayer replayer;
+
+        const uint64_t startNs = nowNs();
+        for (const auto& r : records) {
+            if ((r.rec.call == 0) || (r.rec.call >= e_hal_record_call_count)) {
+                fprintf(stderr, "Unknown call %u\n", r.rec.call);
+                ++errors;
+                continue;
+            }
+
+            if (realtime) {
+                const uint64_t due = startNs + (r.rec.timestamp_ns - firstNs);
+                const uint64_t now = nowNs();
+                if (due > now) {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+                }
+            }
+
+            const uint64_t writes = mixer.totalWrites();
+            const uint64_t t0 = nowNs();
+            int callRet;
+            const int ret = replayer.replay(r, callRet);
+            const uint64_t ns = nowNs() - t0;
+
+            CCallStats& c = stats[r.rec.call];
+            ++c.count;
+            c.recordedNs += r.rec.duration_ns;
+            if (r.rec.duration_ns > c.recordedMaxNs) {
+                c.recordedMaxNs = r.rec.duration_ns;
+            }
+
+            if (ret < 0) {
+                ++errors;
+            } else if (ret > 0) {
+                ++c.replayed;
+                c.replayNs += ns;
+                if (ns > c.replayMaxNs) {
+                    c.replayMaxNs = ns;
+                }
+                c.ctlWrites += mixer.totalWrites() - writes;
+                replayNs += ns;
+
+                if ((callRet < 0) != (r.rec.ret < 0)) {
+                    ++c.mismatched;
+                }
+            }
+        }
+    }
+
+    const CRecord& last = records.back();
+    const uint64_t spanNs = last.rec.timestamp_ns + last.rec.duration_ns - firstNs;
+
+    if (outFile != nullptr) {
+        std::ofstream fout(outFile);
+        if (!fout) {
+            fprintf(stderr, "Failed to create %s\n", outFile);
+            return 1;
+        }
+        writeJson(fout, recordingFile, product, realtime, records.size(),
+                  spanNs, replayNs, stats);
+    } else {
+        std::ostringstream s;
+        writeJson(s, recordingFile, product, realtime, records.size(),
+                  spanNs, replayNs, stats);
+        fputs(s.str().c_str(), stdout);
+    }
+
+    return (errors == 0) ? 0 : 2;
+}
@@ -29,9 +29,14 @@
 #include <errno.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <assert.h>
 #include <ctype.h>
 #include <dirent.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/inotify.h>
+#include <sys/syscall.h>
 #include <linux/limits.h>
 #ifdef ANDROID
 #include <cutils/log.h>
@@ -63,11 +68,36 @@ typedef struct effect_interface_s **effect_handle_t;
 
 #define MIXER_CARD_DEFAULT 0
 
-/* The dynamic arrays are extended in multiples of this number of objects */
+/* Maximum number of ALSA cards whose controls can be used. The first is
+ * the card of the <mixer> element
+ */
+#define MAX_MIXERS 4
+
+/*
+ * The dynamic arrays are first allocated with this number of objects and
+ * double in size each time they are full
+ */
 #define DYN_ARRAY_GRANULE 16
 
 #define INVALID_CTL_INDEX 0xFFFFFFFFUL
 
+#if defined(TINYHAL_CTL_WRITE_STATS) && defined(TINYALSA_NO_CTL_GET_ID)
+#error "TINYHAL_CTL_WRITE_STATS requires mixer_ctl_get_id()"
+#endif
+
+/* Timeout value meaning wait forever */
+#define WAIT_FOREVER UINT32_MAX
+
+/* Interval between re-checks while waiting for a file to appear. inotify
+ * normally wakes us as soon as the file is created but sysfs and procfs
+ * do not generate events for kernel-created entries so we still have to
+ * poll them, at a much lower rate.
+ */
+#define PATH_WAIT_POLL_MS 10
+
+/* Directory where the device nodes of newly registered cards appear */
+#define SND_DEV_PATH "/dev/snd"
+
 #ifdef ANDROID
 #ifndef ETC_PATH
 #define ETC_PATH "/system/etc"
@@ -77,18 +107,21 @@ typedef struct effect_interface_s **effect_handle_t;
 struct config_mgr;
 struct stream;
 struct path;
+struct txn_write;
+struct ctl_segment;
 struct device;
 struct usecase;
 struct scase;
 struct codec_probe;
 struct codec_case;
 struct constant;
+struct path_def;
 
 /* Dynamically extended array of fixed-size objects */
 struct dyn_array {
     uint                count;
-    uint16_t            max_count; /* current maximum size of allocated array */
-    uint16_t            elem_size;  /* size of array elements */
+    uint32_t            max_count; /* current maximum size of allocated array */
+    uint32_t            elem_size;  /* size of array elements */
     union {
         void               *data;
         struct device      *devices;
@@ -100,6 +133,12 @@ struct dyn_array {
         struct codec_case  *codec_cases;
         struct constant    *constants;
         const char         **path_names;
+        struct card_name   *card_names;
+        struct txn_write   *txn_writes;
+        struct ctl_segment *segments;
+        struct ctl_info    *ctl_infos;
+        struct path_def    *path_defs;
+        struct dyn_array   *arrays;
     };
 };
 
@@ -117,16 +156,35 @@ struct ctl_ref {
 #else
     uint                id;
 #endif
+    uint8_t             mixer;  /* index into config_mgr.mixers */
+};
+
+/*
+ * The parts of a <ctl> that are only needed to open it, or for BYTE
+ * controls. They are kept in an array parallel to the struct ctl array so
+ * that applying a path reads as few cache lines as possible.
+ */
+struct ctl_info {
+    const char          *name;
+    const char          *data_file_name;
+    uint8_t             *buffer;
+
+    /* val string of a lazy BYTE control, kept so that its data can be
+     * loaded again after it has been evicted
+     */
+    const char          *lazy_val;
+    enum mixer_ctl_type type;
+
+    /* BYTE data of a case that is only loaded while the case is in the
+     * case_cache
+     */
+    bool                lazy;
 };
 
 struct ctl {
     struct ctl_ref      ref;
-    const char          *name;
     uint32_t            index;
     uint32_t            array_count;
-    enum mixer_ctl_type type;
-    uint8_t             *buffer;
-    const char          *data_file_name;
 
     /* If the control couldn't be opened during boot the value will hold
      * a pointer to the original value string from the config file and will
@@ -137,6 +195,8 @@ struct ctl {
         const uint8_t   *data;
         const char      *string;
     } value;
+
+    struct ctl_info     *info;
 };
 
 struct constant {
@@ -147,6 +207,18 @@ struct constant {
 struct path {
     int                 id;         /* Integer identifier of this path */
     struct dyn_array    ctl_array;
+    struct dyn_array    ctl_info_array;
+
+    /* Runs of controls in the order they are applied, only used if the
+     * path has a <path_ref>. Otherwise the path is just its ctl_array.
+     */
+    struct dyn_array    segment_array;
+};
+
+/* A <path_def>, a block of controls shared by paths and cases */
+struct path_def {
+    const char          *name;
+    struct path         path;
 };
 
 struct codec_case {
@@ -154,9 +226,15 @@ struct codec_case {
     const char *file;
 };
 
+struct card_name {
+    uint32_t        number;
+    const char      *name;
+};
+
 struct codec_probe {
     const char *file;
     const char *new_xml_file;
+    uint32_t timeout_ms;    /* how long to wait for file to appear */
     struct dyn_array codec_case_array;
 };
 
@@ -169,6 +247,14 @@ struct device {
 struct scase {
     const char          *name;
     struct dyn_array    ctl_array;
+    struct dyn_array    ctl_info_array;
+    struct dyn_array    segment_array;  /* as in struct path */
+
+    /* Entry in the case_cache, only used while the lazy data is loaded */
+    bool                loaded;
+    uint32_t            data_bytes;
+    struct scase        *lru_prev;      /* more recently used */
+    struct scase        *lru_next;      /* less recently used */
 };
 
 struct usecase {
@@ -195,6 +281,9 @@ struct stream {
     int     enable_path;    /* id of paths to invoke when enabled */
     int     disable_path;   /* id of paths to invoke when disabled */
 
+    /* Enable new devices before disabling old devices on a route change */
+    bool    make_before_break;
+
     uint32_t current_devices;   /* devices currently active for this stream */
 
     struct {
@@ -206,17 +295,202 @@ struct stream {
     struct dyn_array    constants_array;
 };
 
+#ifdef TINYHAL_CTL_WRITE_STATS
+/* Write statistics for every control that has been written, indexed by
+ * the tinyalsa control id
+ */
+struct ctl_write_stats_table {
+    pthread_mutex_t         lock;
+    unsigned int            count;
+    struct ctl_write_stats  *entries;
+};
+#endif
+
+/* A control write queued by a transaction */
+struct txn_write {
+    struct ctl_ref      ref;
+    uint32_t            seq;    /* order of the last write to this control */
+    uint32_t            count;  /* number of times it was written */
+    enum mixer_ctl_type type;
+    uint32_t            index;  /* value index of a BOOL or INT control */
+    union {
+        int             integer;
+        const char      *string;    /* owned by the struct ctl */
+        uint8_t         *data;      /* work buffer of a struct ctl */
+    } value;
+};
+
+/* One slot of a txn_write_index */
+struct txn_write_slot {
+    uint32_t            gen;        /* empty unless txn_write_index.gen */
+    uint32_t            write;      /* index into config_txn.write_array */
+};
+
+/*
+ * Hash table of the queued writes, keyed by control and value index, so
+ * that queuing a write doesn't search all the writes already queued. The
+ * table is emptied for the next transaction by advancing gen instead of
+ * clearing every slot.
+ */
+struct txn_write_index {
+    struct txn_write_slot *slots;
+    uint32_t            size;       /* power of 2, or 0 if not allocated */
+    uint32_t            gen;
+};
+
+struct config_txn {
+    bool                active;
+    uint32_t            seq;        /* number of writes queued */
+    uint64_t            locked_ns;
+    struct dyn_array    write_array;
+    struct txn_write_index write_index;
+};
+
+/*
+ * Cases whose lazy BYTE data is loaded, most recently used first. Cases
+ * are evicted from the tail when the data of all cases exceeds budget.
+ */
+struct case_cache {
+    uint32_t            budget;     /* 0 if all data is loaded at boot */
+    uint32_t            bytes;
+    struct scase        *head;
+    struct scase        *tail;
+};
+
+/* Controls of a path applied by a route change on more than one card */
+struct ctl_segment {
+    struct ctl          *ctls;
+    int                 count;
+};
+
+/* One slot of a ctl_name_index */
+struct ctl_name_slot {
+    uint32_t            hash;
+    uint32_t            id_plus_one;    /* 0 if the slot is empty */
+};
+
+/*
+ * Hash table of the names of the controls of a mixer, so that a <ctl> is
+ * resolved without the linear search of mixer_get_ctl_by_name(). The
+ * controls 0..count-1 are in the table. Controls added to the mixer are
+ * appended by mixer_add_new_ctls() so only the new ones need to be added.
+ */
+struct ctl_name_index {
+    struct ctl_name_slot *slots;
+    uint32_t            size;       /* power of 2, or 0 if not built */
+    uint32_t            count;
+};
+
+struct config_mixer {
+    struct mixer        *mixer;
+    uint32_t            card;
+    struct ctl_name_index name_index;
+
+    /* Worker thread that writes the controls of this card when a route
+     * change writes to more than one card. The first card is written by
+     * the calling thread.
+     */
+    struct config_mgr   *cm;
+    pthread_t           thread;
+    bool                has_thread;
+    bool                run;        /* protected by card_jobs.lock */
+    int                 written;
+    int                 result;
+};
+
+/* Writes of a route change that are deferred so that each card can be
+ * written in parallel
+ */
+struct card_batch {
+    bool                active;
+    uint32_t            mixer_mask; /* cards with writes */
+    struct dyn_array    segment_array;
+};
+
+struct card_jobs {
+    pthread_mutex_t     lock;
+    pthread_cond_t      start;
+    pthread_cond_t      done;
+    unsigned int        pending;
+    bool                exit;
+    void                (*fn)(struct config_mgr *cm, unsigned int mixer);
+};
+
+/* Value of trace_slot.seq while the slot is being written */
+#define TRACE_SLOT_BUSY UINT_MAX
+
+struct trace_slot {
+    atomic_uint                 seq;    /* TRACE_SLOT_BUSY while being written */
+    struct config_trace_record  rec;
+};
+
+/* Lock-free ring of the most recent events */
+struct trace_ring {
+    atomic_uint         head;
+    struct trace_slot   slots[CONFIG_TRACE_RECORDS];
+};
+
 struct config_mgr {
     pthread_mutex_t lock;
 
-    struct mixer    *mixer;
+    /* Thread id of the owner of an open transaction, 0 if none. Only the
+     * owner sets this, while holding lock, so another thread can never see
+     * its own id here
+     */
+    atomic_uint     txn_tid;
+
+    /* Protected by lock */
+    struct config_txn txn;
+    struct card_batch batch;
+    struct case_cache case_cache;
+
+    struct config_mixer mixers[MAX_MIXERS];
+    unsigned int    mixer_count;
+    struct card_jobs card_jobs;
+
+    /* Route changes only write controls whose value changes */
+    bool            net_routes;
+
+    /* The HAL makes the changes of each set_parameters() call in one
+     * transaction. Read by the HAL without the lock, so not reloaded
+     */
+    bool            batch_parameters;
+
+    /* Absolute path of the root configuration file, for reloading */
+    char            *config_file;
+
+    /* Constants arrays replaced by a reload. A caller can still hold a
+     * value from them so they are only freed with the config_mgr.
+     * Protected by lock
+     */
+    struct dyn_array retired_constants_array;
 
     uint32_t        supported_output_devices;
     uint32_t        supported_input_devices;
 
     struct dyn_array device_array;
+    struct dyn_array path_def_array;
     struct dyn_array anon_stream_array;
     struct dyn_array named_stream_array;
+
+    struct config_mgr_boot_stats boot_stats;
+
+    /* Phase of init_audio_config() currently being timed, NULL once
+     * initialization is complete
+     */
+    struct config_phase_stats *cur_phase;
+    uint64_t        cur_phase_start_ns;
+
+#ifdef TINYHAL_CTL_WRITE_STATS
+    struct ctl_write_stats_table write_stats;
+#endif
+
+#ifdef TINYHAL_LOCK_STATS
+    /* Protected by lock */
+    struct config_lock_stats lock_stats[e_config_lock_api_count];
+#endif
+
+    struct trace_ring trace;
 };
 
 /*********************************************************************
@@ -243,6 +517,8 @@ enum element_index {
     e_elem_audiohal,
     e_elem_codec_probe,
     e_elem_codec_case,
+    e_elem_path_def,
+    e_elem_path_ref,
 
     e_elem_count
 };
@@ -266,6 +542,12 @@ enum attrib_index {
     e_attrib_min,
     e_attrib_max,
     e_attrib_file,
+    e_attrib_timeout,
+    e_attrib_route,
+    e_attrib_write,
+    e_attrib_refresh,
+    e_attrib_case_cache,
+    e_attrib_parameters,
 
     e_attrib_count
 };
@@ -279,7 +561,7 @@ struct parse_element {
     const char      *name;
     uint32_t        valid_attribs;  /* bitflags of valid attribs for this element */
     uint32_t        required_attribs;   /* bitflags of attribs that must be present */
-    uint16_t        valid_subelem;  /* bitflags of valid sub-elements */
+    uint32_t        valid_subelem;  /* bitflags of valid sub-elements */
     elem_fn         start_fn;
     elem_fn         end_fn;
 };
@@ -295,7 +577,7 @@ struct parse_device {
 
 struct parse_stack_entry {
     uint16_t            elem_index;
-    uint16_t            valid_subelem;
+    uint32_t            valid_subelem;
 };
 
 /* Temporary state info for config file parser */
@@ -309,6 +591,11 @@ struct parse_state {
     int                 error_line;
     unsigned int        mixer_card_number;
 
+    /* Parsing for reload_audio_config() so <pre_init> and <init> are not
+     * applied
+     */
+    bool                reload;
+
     struct {
         const char      *value[e_attrib_count];
         const XML_Char  **all;
@@ -331,12 +618,27 @@ struct parse_state {
     /* This array hold a de-duplicated list of all path names encountered */
     struct dyn_array    path_name_array;
 
+    /* Snapshot of the ALSA card ids, shared by all card name lookups */
+    struct dyn_array    card_name_array;
+    bool                card_names_valid;
+
     /* These are temporary path objects used to collect the initial
      * mixer setup control settings under <pre_init> and <init>
      */
     struct path         preinit_path;
     struct path         init_path;
 
+    /* Only write the <pre_init> and <init> controls that don't already
+     * hold their value
+     */
+    bool                preinit_write_changed;
+    bool                init_write_changed;
+
+    /* After a <pre_init> add the new controls instead of re-opening the
+     * mixers
+     */
+    bool                refresh_add;
+
     struct codec_probe  init_probe;
 
     struct {
@@ -352,7 +654,11 @@ static int get_value_from_file(struct ctl *c, uint32_t vnum);
 static int make_byte_work_buffer(struct ctl *pctl, uint32_t buffer_size);
 static int make_byte_array(struct ctl *c, uint32_t vnum);
 static const char *debug_device_to_name(uint32_t device);
-static void free_ctl_array(struct dyn_array *ctl_array);
+static int dyn_array_extend(struct dyn_array *array);
+static void free_ctl_array(struct dyn_array *ctl_array,
+                           struct dyn_array *info_array);
+static bool route_uses_device(const struct config_mgr *cm, uint32_t devices,
+                              const struct device *target);
 
 /*
  * Utility function to join a filename to a base path. This doesn't bother to
@@ -390,12 +696,170 @@ static char *join_paths(const char *base, const char *file, int strip_leaf)
     return p;
 }
 
+static uint64_t time_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * An inotify watch on the deepest existing ancestor directory of a path,
+ * kept open across the re-checks of one wait so that each re-check does
+ * not have to create the watch again.
+ */
+struct path_wait {
+    int     fd;                 /* inotify instance, -1 if none */
+    int     wd;                 /* watch, -1 if none */
+    bool    started;
+    bool    watching_ancestor;  /* wd is on an ancestor of the path */
+    bool    appeared;           /* path existed when the watch was added */
+};
+
+#define PATH_WAIT_INIT { .fd = -1, .wd = -1 }
+
+/* Watch the deepest existing ancestor directory of path, or path itself */
+static void path_wait_watch(struct path_wait *w, const char *path)
+{
+    char dir[PATH_MAX];
+    char *p;
+
+    if (w->wd >= 0) {
+        inotify_rm_watch(w->fd, w->wd);
+        w->wd = -1;
+    }
+    w->watching_ancestor = false;
+
+    if ((w->fd < 0) || (strlen(path) >= sizeof(dir))) {
+        return;
+    }
+
+    strcpy(dir, path);
+    w->wd = inotify_add_watch(w->fd, dir, IN_CREATE | IN_MOVED_TO);
+
+    /* Walk up the path until we find a directory that exists */
+    while ((w->wd < 0) && ((p = strrchr(dir, '/')) != NULL)) {
+        w->watching_ancestor = true;
+
+        if (p == dir) {
+            p[1] = '\0';    /* root directory */
+        } else {
+            *p = '\0';
+        }
+
+        w->wd = inotify_add_watch(w->fd, dir, IN_CREATE | IN_MOVED_TO);
+        if ((w->wd >= 0) || (p == dir)) {
+            break;
+        }
+    }
+
+    /* It might have appeared before the watch was added */
+    w->appeared = (w->wd >= 0) && w->watching_ancestor
+                  && (access(path, F_OK) == 0);
+}
+
+/*
+ * Discard the queued events, returns true if anything was created. Removing
+ * a watch queues an IN_IGNORED event, which must not count.
+ */
+static bool path_wait_drain(struct path_wait *w)
+{
+    char buf[sizeof(struct inotify_event) + NAME_MAX + 1]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    const struct inotify_event *ev;
+    bool created = false;
+    ssize_t len, i;
+
+    while ((len = read(w->fd, buf, sizeof(buf))) > 0) {
+        for (i = 0; i < len; i += sizeof(*ev) + ev->len) {
+            ev = (const struct inotify_event *)&buf[i];
+            if ((ev->mask & (IN_CREATE | IN_MOVED_TO)) != 0) {
+                created = true;
+            }
+        }
+    }
+
+    return created;
+}
+
+static void path_wait_close(struct path_wait *w)
+{
+    if (w->fd >= 0) {
+        close(w->fd);
+    }
+
+    w->fd = -1;
+    w->wd = -1;
+    w->started = false;
+}
+
+/*
+ * Sleep until something is created in the deepest existing ancestor directory
+ * of path, or until PATH_WAIT_POLL_MS has elapsed, whichever is first. If path
+ * is itself an existing directory, wait for something to be created inside it.
+ * The caller must re-check whether the thing it wants now exists, and call
+ * path_wait_close() when it has finished waiting.
+ *
+ * The watch is created by the first call and moved deeper when an ancestor
+ * directory of path is created.
+ *
+ * deadline_ns is an absolute CLOCK_MONOTONIC time, 0 means no deadline.
+ * Returns -ETIMEDOUT if the deadline has passed.
+ */
+static int wait_for_path_change(struct path_wait *w, const char *path,
+                                uint64_t deadline_ns)
+{
+    struct pollfd pfd;
+    int timeout_ms = PATH_WAIT_POLL_MS;
+    uint64_t now, remaining_ms;
+
+    if (deadline_ns != 0) {
+        now = time_now_ns();
+        if (now >= deadline_ns) {
+            return -ETIMEDOUT;
+        }
+
+        remaining_ms = (deadline_ns - now + 999999) / 1000000;
+        if (remaining_ms < (uint64_t)timeout_ms) {
+            timeout_ms = (int)remaining_ms;
+        }
+    }
+
+    if (!w->started) {
+        w->started = true;
+        w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        path_wait_watch(w, path);
+    }
+
+    if (w->appeared) {
+        w->appeared = false;
+        return 0;
+    }
+
+    if (w->fd < 0) {
+        usleep(timeout_ms * 1000);
+        return 0;
+    }
+
+    pfd.fd = w->fd;
+    pfd.events = POLLIN;
+    if ((poll(&pfd, 1, timeout_ms) > 0) && path_wait_drain(w)
+            && w->watching_ancestor) {
+        /* A directory on the way to path might have been created */
+        path_wait_watch(w, path);
+    }
+
+    return 0;
+}
+
 /*********************************************************************
  * Routing control
  *********************************************************************/
 
 static inline void ctl_ref_init(struct ctl_ref *pctl_ref)
 {
+    pctl_ref->mixer = 0;
 #ifdef TINYALSA_NO_CTL_GET_ID
     pctl_ref->ctl = NULL;
 #else
@@ -403,7 +867,7 @@ static inline void ctl_ref_init(struct ctl_ref *pctl_ref)
 #endif
 }
 
-static inline bool ctl_ref_valid(struct ctl_ref *pctl_ref)
+static inline bool ctl_ref_valid(const struct ctl_ref *pctl_ref)
 {
 #ifdef TINYALSA_NO_CTL_GET_ID
     return pctl_ref->ctl != NULL;
@@ -429,661 +893,2228 @@ static inline struct mixer_ctl *ctl_get_ptr(const struct config_mgr *cm,
     (void)cm;
     return pctl_ref->ctl;
 #else
-    return mixer_get_ctl(cm->mixer, pctl_ref->id);
+    return mixer_get_ctl(cm->mixers[pctl_ref->mixer].mixer, pctl_ref->id);
 #endif
 }
 
-static int ctl_open(struct config_mgr *cm, struct ctl *pctl)
+/*********************************************************************
+ * Control name index
+ *********************************************************************/
+
+/* FNV-1a */
+static uint32_t ctl_name_hash(const char *name)
 {
-    enum mixer_ctl_type ctl_type;
-    const char *val_str = pctl->value.string;
-    struct mixer_ctl *ctl;
-    int ret;
+    uint32_t h = 2166136261U;
 
-    if (ctl_ref_valid(&pctl->ref)) {
-        /* control already populated on boot */
-        return 0;
+    while (*name != '\0') {
+        h ^= (unsigned char)*name++;
+        h *= 16777619U;
     }
 
-   /* Control wasn't found on boot, try to get it now */
+    return h;
+}
 
-    ctl = mixer_get_ctl_by_name(cm->mixer, pctl->name);
-#if !defined(TINYALSA_NO_ADD_NEW_CTRLS) || !defined(TINYALSA_NO_CTL_GET_ID)
-    if (!ctl) {
-        /* Update tinyalsa with any new controls that have been added
-         * and try again. NOTE: only safe if mixer_ctl_get_id() supported
-         * because the pointers are likely to change as the list is updated.
-         */
-        mixer_add_new_ctls(cm->mixer);
-        ctl = mixer_get_ctl_by_name(cm->mixer, pctl->name);
-    }
-#endif
+static struct mixer_ctl *ctl_name_index_find(struct mixer *mixer,
+                                             const struct ctl_name_index *idx,
+                                             const char *name, uint32_t hash)
+{
+    const uint32_t mask = idx->size - 1;
+    const struct ctl_name_slot *slot;
+    struct mixer_ctl *ctl;
+    uint32_t i;
 
-    if (!ctl) {
-        ALOGW("Control '%s' not found", pctl->name);
-        return -ENOENT;
+    if (idx->size == 0) {
+        /* Not built, the mixer has no controls */
+        return NULL;
     }
 
-    ctl_type = mixer_ctl_get_type(ctl);
-    switch(ctl_type) {
-        case MIXER_CTL_TYPE_BYTE:
-            if (pctl->index == INVALID_CTL_INDEX) {
-                pctl->index = 0;
-            }
-            const unsigned int vnum = mixer_ctl_get_num_values(ctl);
-            ret = make_byte_work_buffer(pctl, vnum);
-            if (ret != 0) {
-                return ret;
-            }
-            break;
+    for (i = hash & mask; ; i = (i + 1) & mask) {
+        slot = &idx->slots[i];
+        if (slot->id_plus_one == 0) {
+            return NULL;
+        }
 
-        case MIXER_CTL_TYPE_BOOL:
-        case MIXER_CTL_TYPE_INT:
-            if (string_to_int(&pctl->value.integer, val_str) == -EINVAL) {
-                return -EINVAL;
+        if (slot->hash == hash) {
+            ctl = mixer_get_ctl(mixer, slot->id_plus_one - 1);
+            if ((ctl != NULL) && (strcmp(mixer_ctl_get_name(ctl), name) == 0)) {
+                return ctl;
             }
+        }
+    }
+}
 
-            free((void*)val_str);  /* no need to keep this string now */
-
-            /* This log statement is just to aid to debugging */
-            ALOGE_IF((ctl_type == MIXER_CTL_TYPE_BOOL)
-                     && ((unsigned int)pctl->value.integer > 1),
-                     "WARNING: Illegal value for bool control");
-            ALOGV("Added ctl '%s' value 0x%x", pctl->name, pctl->value.integer);
-            break;
-
-        case MIXER_CTL_TYPE_ENUM:
-            ALOGV("Added ctl '%s' value '%s'", pctl->name, pctl->value.string);
-            break;
+static void ctl_name_index_insert(struct ctl_name_index *idx, uint32_t hash,
+                                  uint32_t id)
+{
+    const uint32_t mask = idx->size - 1;
+    uint32_t i;
 
-        case MIXER_CTL_TYPE_IEC958:
-        case MIXER_CTL_TYPE_INT64:
-        case MIXER_CTL_TYPE_UNKNOWN:
-        default:
-            ALOGE("Mixer control '%s' has unsupported type", pctl->name);
-            return -EINVAL;
+    for (i = hash & mask; idx->slots[i].id_plus_one != 0; i = (i + 1) & mask) {
+        ;
     }
 
-    pctl->type = ctl_type;
-    ctl_set_ref(&pctl->ref, ctl);
+    idx->slots[i].hash = hash;
+    idx->slots[i].id_plus_one = id + 1;
+}
 
-    return 0;
+static void ctl_name_index_free(struct ctl_name_index *idx)
+{
+    free(idx->slots);
+    idx->slots = NULL;
+    idx->size = 0;
+    idx->count = 0;
 }
 
-static void apply_ctls_l(struct config_mgr *cm, struct ctl *pctl, const int ctl_count)
+/*
+ * Add the controls that the mixer has gained since the index was last
+ * updated. The table is kept at most half full.
+ */
+static int ctl_name_index_update(struct mixer *mixer,
+                                 struct ctl_name_index *idx)
 {
+    const uint32_t num_ctls = mixer_get_num_ctls(mixer);
+    struct ctl_name_slot *old_slots = idx->slots;
+    uint32_t old_size = idx->size;
     struct mixer_ctl *ctl;
-    int i;
-    unsigned int vnum;
-    unsigned int value_count;
-    int err = 0;
+    const char *name;
+    uint32_t size, hash, i;
 
-    ALOGV("+apply_ctls_l");
+    if (num_ctls < idx->count) {
+        /* Controls have gone, the ids have changed */
+        ctl_name_index_free(idx);
+        old_slots = NULL;
+        old_size = idx->size;
+    }
 
-    for (i = 0; i < ctl_count; ++i, ++pctl) {
-        if (ctl_open(cm, pctl) != 0) {
-            break;
+    if (old_size < 2 * num_ctls) {
+        for (size = 64; size < 2 * num_ctls; size <<= 1) {
+            ;
         }
 
-        ctl = ctl_get_ptr(cm, &pctl->ref);
+        idx->slots = calloc(size, sizeof(struct ctl_name_slot));
+        if (!idx->slots) {
+            idx->slots = old_slots;
+            return -ENOMEM;
+        }
+        idx->size = size;
 
-        switch (mixer_ctl_get_type(ctl)) {
-            case MIXER_CTL_TYPE_BOOL:
-            case MIXER_CTL_TYPE_INT:
-                value_count = mixer_ctl_get_num_values(ctl);
+        for (i = 0; i < old_size; ++i) {
+            if ((old_slots != NULL) && (old_slots[i].id_plus_one != 0)) {
+                ctl_name_index_insert(idx, old_slots[i].hash,
+                                      old_slots[i].id_plus_one - 1);
+            }
+        }
+        free(old_slots);
+    }
 
-                ALOGV("apply ctl '%s' = 0x%x (%d values)",
-                                        mixer_ctl_get_name(ctl),
-                                        pctl->value.integer,
-                                        value_count);
-
-                if (pctl->index == INVALID_CTL_INDEX) {
-                    for (vnum = 0; vnum < value_count; ++vnum) {
-                        err = mixer_ctl_set_value(ctl, vnum, pctl->value.integer);
-                        if (err < 0) {
-                            break;
-                        }
-                    }
-                } else {
-                    err = mixer_ctl_set_value(ctl, pctl->index, pctl->value.integer);
-                }
-                ALOGE_IF(err < 0, "Failed to set ctl '%s' to 0x%x",
-                                        mixer_ctl_get_name(ctl),
-                                        pctl->value.integer);
-                break;
-
-            case MIXER_CTL_TYPE_BYTE:
-                /* byte array */
-                vnum = mixer_ctl_get_num_values(ctl);
-
-                ALOGV("apply ctl '%s' = byte data (%d bytes)",
-                                        mixer_ctl_get_name(ctl),
-                                        vnum);
-
-                if ((pctl->index == 0) && (pctl->array_count == vnum)) {
-                    err = mixer_ctl_set_array(ctl, pctl->value.data, pctl->array_count);
-                } else {
-                    /* read-modify-write */
-                    err = mixer_ctl_get_array(ctl, pctl->buffer, vnum);
-                    if (err >= 0) {
-                        memcpy(&pctl->buffer[pctl->index], pctl->value.data, pctl->array_count);
-                        err = mixer_ctl_set_array(ctl, pctl->buffer, vnum);
-                    }
-                }
-
-                ALOGE_IF(err < 0, "Failed to set ctl '%s'",
-                                            mixer_ctl_get_name(ctl));
-                break;
+    for (i = idx->count; i < num_ctls; ++i) {
+        ctl = mixer_get_ctl(mixer, i);
+        name = (ctl != NULL) ? mixer_ctl_get_name(ctl) : NULL;
+        if (name == NULL) {
+            continue;
+        }
 
-            case MIXER_CTL_TYPE_ENUM:
-                ALOGV("apply ctl '%s' to '%s'",
-                                            mixer_ctl_get_name(ctl),
-                                            pctl->value.string);
+        /* mixer_get_ctl_by_name() finds the first of controls that have
+         * the same name
+         */
+        hash = ctl_name_hash(name);
+        if (ctl_name_index_find(mixer, idx, name, hash) == NULL) {
+            ctl_name_index_insert(idx, hash, i);
+        }
+    }
+    idx->count = num_ctls;
 
-                err = mixer_ctl_set_enum_by_string(ctl, pctl->value.string);
+    return 0;
+}
 
-                ALOGE_IF(err < 0, "Failed to set ctl '%s' to '%s'",
-                                            mixer_ctl_get_name(ctl),
-                                            pctl->value.string);
-                break;
+/* Find a control by name on one of the mixers of cm */
+static struct mixer_ctl *find_ctl_by_name(struct config_mgr *cm,
+                                          unsigned int mixer_idx,
+                                          const char *name)
+{
+    struct config_mixer *m = &cm->mixers[mixer_idx];
 
-            default:
-                break;
+    if (mixer_get_num_ctls(m->mixer) != m->name_index.count) {
+        if (ctl_name_index_update(m->mixer, &m->name_index) != 0) {
+            return mixer_get_ctl_by_name(m->mixer, name);
         }
     }
 
-    ALOGV("-apply_ctls_l");
+    return ctl_name_index_find(m->mixer, &m->name_index, name,
+                               ctl_name_hash(name));
 }
 
-static void apply_path_l(struct config_mgr *cm, struct path *path)
+static inline bool ctl_ref_equal(const struct ctl_ref *a,
+                                 const struct ctl_ref *b)
 {
-    ALOGV("+apply_path_l(%p) id=%u", path, path->id);
+#ifdef TINYALSA_NO_CTL_GET_ID
+    return a->ctl == b->ctl;
+#else
+    return (a->id == b->id) && (a->mixer == b->mixer);
+#endif
+}
 
-    apply_ctls_l(cm, path->ctl_array.ctls, path->ctl_array.count);
+/*********************************************************************
+ * Event trace
+ *********************************************************************/
 
-    ALOGV("-apply_path_l(%p)", path);
+static uint32_t trace_tid(void)
+{
+    static __thread uint32_t tid;
+
+    if (tid == 0) {
+        tid = (uint32_t)syscall(SYS_gettid);
+    }
+
+    return tid;
 }
 
-static void apply_device_path_l(struct config_mgr *cm, struct device *pdev,
-                                    struct path *path)
+static uint16_t trace_stream_id(const struct stream *s)
 {
-    ALOGV("+apply_device_path_l(%p) id=%u", path, path->id);
-
-    /* The on and off paths for a device are reference-counted */
-    switch (path->id) {
-    case e_path_id_off:
-        if (--pdev->use_count > 0) {
-            ALOGV("Device still in use - not applying 'off' path");
-            return;
-        }
-        break;
+    const struct config_mgr *cm;
+    const struct dyn_array *array;
 
-     case e_path_id_on:
-        if (++pdev->use_count > 1) {
-            ALOGV("Device already enabled - not applying 'on' path");
-            return;
-        }
-        break;
+    if (s == NULL) {
+        return CONFIG_TRACE_NO_STREAM;
+    }
 
-    default:
-        break;
+    cm = s->cm;
+    array = &cm->named_stream_array;
+    if ((s >= array->streams) && (s < array->streams + array->count)) {
+        return CONFIG_TRACE_NAMED_STREAM | (uint16_t)(s - array->streams);
     }
 
-    apply_path_l(cm, path);
+    array = &cm->anon_stream_array;
+    return (uint16_t)(s - array->streams);
+}
 
-    ALOGV("-apply_device_path_l(%p)", path);
+/*
+ * Append a record to the trace. Writers claim a slot by incrementing the
+ * head and mark it valid by storing the sequence number last, so no lock
+ * is needed. A reader that sees a different sequence number before and
+ * after copying a slot discards the copy. If the ring has wrapped and
+ * another writer is still writing the same slot the record is dropped.
+ */
+static void trace_event4(struct config_mgr *cm,
+                         enum config_trace_event event,
+                         uint16_t stream_id,
+                         uint64_t start_ns,
+                         uint32_t arg0,
+                         uint32_t arg1,
+                         uint32_t arg2,
+                         uint32_t arg3)
+{
+    const uint64_t elapsed_ns = time_now_ns() - start_ns;
+    const unsigned int seq = atomic_fetch_add_explicit(&cm->trace.head, 1,
+                                                       memory_order_relaxed) + 1;
+    struct trace_slot *slot =
+                    &cm->trace.slots[(seq - 1) & (CONFIG_TRACE_RECORDS - 1)];
+    unsigned int old_seq = atomic_load_explicit(&slot->seq,
+                                                memory_order_relaxed);
+
+    if ((old_seq == TRACE_SLOT_BUSY) ||
+            !atomic_compare_exchange_strong_explicit(&slot->seq, &old_seq,
+                                                     TRACE_SLOT_BUSY,
+                                                     memory_order_acquire,
+                                                     memory_order_relaxed)) {
+        return;
+    }
+    atomic_thread_fence(memory_order_release);
+
+    slot->rec.timestamp_ns = start_ns;
+    slot->rec.seq = seq;
+    slot->rec.tid = trace_tid();
+    slot->rec.duration_ns = (elapsed_ns > UINT32_MAX) ?
+                                UINT32_MAX : (uint32_t)elapsed_ns;
+    slot->rec.event = event;
+    slot->rec.stream = stream_id;
+    slot->rec.arg[0] = arg0;
+    slot->rec.arg[1] = arg1;
+    slot->rec.arg[2] = arg2;
+    slot->rec.arg[3] = arg3;
+
+    atomic_store_explicit(&slot->seq, seq, memory_order_release);
 }
 
-static void apply_paths_by_id_l(struct config_mgr *cm, struct device *pdev,
-                                int first_id, int second_id)
+static inline void trace_event(struct config_mgr *cm,
+                               enum config_trace_event event,
+                               uint16_t stream_id,
+                               uint64_t start_ns,
+                               uint32_t arg0,
+                               uint32_t arg1,
+                               uint32_t arg2)
 {
-    struct path *ppath = pdev->path_array.paths;
-    struct path *found_paths[2] = {0};
-    int path_count = pdev->path_array.count;
+    trace_event4(cm, event, stream_id, start_ns, arg0, arg1, arg2, 0);
+}
 
-    ALOGV("Applying paths [first=%u second=%u] to device(@%p, mask=0x%x '%s')",
-                first_id, second_id, ppath, pdev->type, debug_device_to_name(pdev->type));
+int get_config_trace(struct config_mgr *cm,
+                     struct config_trace_record *records,
+                     unsigned int max_count)
+{
+    const struct trace_slot *slot;
+    unsigned int head, seq, first;
+    unsigned int n = 0;
 
-    /* To save time we find both paths in a single walk of the list */
-    for (; path_count > 0; --path_count, ++ppath) {
-        if (ppath->id == first_id) {
-            found_paths[0] = ppath;
-            if ((found_paths[1] != NULL) || (first_id == second_id)) {
-                /* We have both paths or there is only one path to find */
-                break;
-            }
-        } else if (ppath->id == second_id) {
-            found_paths[1] = ppath;
-            if (found_paths[0] != NULL) {
-                break;
-            }
-        }
+    if ((cm == NULL) || (records == NULL)) {
+        return -EINVAL;
     }
 
-    if (found_paths[0] != NULL) {
-        apply_device_path_l(cm, pdev, found_paths[0]);
+    head = atomic_load_explicit(&cm->trace.head, memory_order_acquire);
+    first = (head > CONFIG_TRACE_RECORDS) ? head - CONFIG_TRACE_RECORDS : 0;
+    if (head - first > max_count) {
+        first = head - max_count;
     }
 
-    if (found_paths[1] != NULL) {
-        apply_device_path_l(cm, pdev, found_paths[1]);
+    for (seq = first + 1; seq <= head; ++seq) {
+        slot = &cm->trace.slots[(seq - 1) & (CONFIG_TRACE_RECORDS - 1)];
+
+        if (atomic_load_explicit(&slot->seq, memory_order_acquire) != seq) {
+            continue;   /* being written or already overwritten */
+        }
+
+        records[n] = slot->rec;
+        atomic_thread_fence(memory_order_acquire);
+
+        if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == seq) {
+            ++n;
+        }
     }
+
+    return n;
 }
 
-static void apply_paths_to_devices_l(struct config_mgr *cm, uint32_t devices,
-                                    int first_id, int second_id)
+/*
+ * Switch boot timing to a new phase, charging the time since the last
+ * switch to the phase being left. Returns the phase being left so that a
+ * nested phase can restore it. Does nothing once boot timing has stopped.
+ */
+static struct config_phase_stats *enter_phase(struct config_mgr *cm,
+                                              struct config_phase_stats *phase)
 {
-    struct device *pdev = cm->device_array.devices;
-    int dev_count = cm->device_array.count;
-    const uint32_t input_flag = devices & AUDIO_DEVICE_BIT_IN;
+    struct config_phase_stats *prev = cm->cur_phase;
+    uint64_t now;
 
-    /* invoke path path_id on all struct device matching devices */
-    ALOGV("Apply paths [first=%u second=%u] to devices in 0x%x",
-            first_id, second_id, devices);
+    if ((prev == NULL) || (prev == phase)) {
+        return prev;
+    }
 
-    devices &= ~AUDIO_DEVICE_BIT_IN;
+    now = time_now_ns();
+    prev->time_ns += now - cm->cur_phase_start_ns;
+    cm->cur_phase = phase;
+    cm->cur_phase_start_ns = now;
 
-    while ((dev_count > 0) && (devices != 0)) {
-        if (((pdev->type & input_flag) == input_flag)
-                    && ((pdev->type & devices) != 0)) {
-            devices &= ~pdev->type;
-            apply_paths_by_id_l(cm, pdev, first_id, second_id);
-        }
+    return prev;
+}
 
-        --dev_count;
-        ++pdev;
+#ifdef TINYHAL_CTL_WRITE_STATS
+static unsigned int ctl_write_bucket(uint64_t elapsed_ns)
+{
+    uint64_t us = elapsed_ns / 1000;
+    unsigned int bucket = 0;
+
+    while ((us != 0) && (bucket < CTL_WRITE_HIST_BUCKETS - 1)) {
+        us >>= 1;
+        ++bucket;
     }
+
+    return bucket;
 }
 
-static void apply_paths_to_global_l(struct config_mgr *cm,
-                                    int first_id, int second_id)
+static void record_ctl_write_stats(struct config_mgr *cm,
+                                   struct mixer_ctl *ctl,
+                                   uint64_t elapsed_ns)
 {
-    struct device *pdev = cm->device_array.devices;
-    struct device * const pend = pdev + cm->device_array.count;
+    struct ctl_write_stats_table *table = &cm->write_stats;
+    const unsigned int id = mixer_ctl_get_id(ctl);
+    struct ctl_write_stats *entry;
+    unsigned int new_count;
+    void *p;
 
-    ALOGV("Apply global paths [first=%u second=%u]", first_id, second_id);
+    pthread_mutex_lock(&table->lock);
 
-    while (pdev < pend) {
-        if (pdev->type == 0) {
-            apply_paths_by_id_l(cm, pdev, first_id, second_id);
-            break;
+    if (id >= table->count) {
+        /* New controls can be added after boot so grow on demand */
+        new_count = id + 1;
+        if (new_count < mixer_get_num_ctls(cm->mixers[0].mixer)) {
+            new_count = mixer_get_num_ctls(cm->mixers[0].mixer);
         }
-        ++pdev;
+
+        p = realloc(table->entries, new_count * sizeof(*table->entries));
+        if (!p) {
+            pthread_mutex_unlock(&table->lock);
+            return;
+        }
+
+        table->entries = p;
+        memset(&table->entries[table->count], 0,
+               (new_count - table->count) * sizeof(*table->entries));
+        table->count = new_count;
+    }
+
+    entry = &table->entries[id];
+    if (entry->name == NULL) {
+        entry->name = strdup(mixer_ctl_get_name(ctl));
+    }
+
+    ++entry->writes;
+    entry->total_ns += elapsed_ns;
+    if (elapsed_ns > entry->max_ns) {
+        entry->max_ns = elapsed_ns;
     }
+    ++entry->hist[ctl_write_bucket(elapsed_ns)];
+
+    pthread_mutex_unlock(&table->lock);
 }
+#endif /* TINYHAL_CTL_WRITE_STATS */
 
-uint32_t get_current_routes( const struct hw_stream *stream )
+/* True if the calling thread already holds cm->lock for a transaction */
+static inline bool in_transaction(struct config_mgr *cm)
 {
-    struct stream *s = (struct stream *)stream;
-    ALOGV("get_current_routes(%p) 0x%x", stream, s->current_devices);
-    return s->current_devices;
+    return atomic_load_explicit(&cm->txn_tid, memory_order_relaxed)
+                == trace_tid();
 }
 
-void apply_route( const struct hw_stream *stream, uint32_t devices )
+#ifdef TINYHAL_LOCK_STATS
+/* Take cm->lock on behalf of an API and count the time spent waiting.
+ * Returns the time the lock was taken, to be passed to unlock_cm().
+ */
+static uint64_t lock_cm(struct config_mgr *cm, enum config_lock_api api)
 {
-    struct stream *s = (struct stream *)stream;
-    struct config_mgr *cm = s->cm;
+    const uint64_t start_ns = time_now_ns();
+    struct config_lock_stats *stats = &cm->lock_stats[api];
+    uint64_t locked_ns, wait_ns;
 
-    ALOGV("apply_route(%p) devices=0x%x", stream, devices);
-
-    if (devices != 0) {
-        if (devices & AUDIO_DEVICE_BIT_IN) {
-            if (!stream_is_input(stream)) {
-                ALOGE("Attempting to set input routing %x on output stream %p",
-                        devices, stream);
-                return;
-            }
-            devices &= AUDIO_DEVICE_IN_ALL;
-            devices |= AUDIO_DEVICE_BIT_IN;
-        } else {
-            if (stream_is_input(stream)) {
-                ALOGE("Attempting to set output routing %x on input stream %p",
-                        devices, stream);
-                return;
-            }
-            devices &= AUDIO_DEVICE_OUT_ALL;
-        }
+    if (in_transaction(cm)) {
+        return 0;
     }
 
     pthread_mutex_lock(&cm->lock);
 
-    /*
-     * Only apply routes to devices that have changed state on this stream.
-     * The input bit will be stripped as unchanged so restore it after.
-     */
-    uint32_t enabling = devices & ~s->current_devices;
-    uint32_t disabling = ~devices & s->current_devices;
-    enabling |= devices & AUDIO_DEVICE_BIT_IN;
-    disabling |= devices & AUDIO_DEVICE_BIT_IN;
-
-    apply_paths_to_devices_l(cm, disabling, s->disable_path, e_path_id_off);
-    apply_paths_to_devices_l(cm, enabling, e_path_id_on, s->enable_path);
+    locked_ns = time_now_ns();
+    wait_ns = locked_ns - start_ns;
 
-    /* Save new set of devices for this stream */
-    s->current_devices = devices;
+    ++stats->count;
+    stats->wait_ns += wait_ns;
+    if (wait_ns > stats->max_wait_ns) {
+        stats->max_wait_ns = wait_ns;
+    }
 
-    pthread_mutex_unlock(&cm->lock);
+    return locked_ns;
 }
 
-/*********************************************************************
- * Stream control
- *********************************************************************/
-
-static int set_vol_ctl(struct stream *stream,
-                       const struct stream_control *volctl,
-                       int percent)
+static void unlock_cm(struct config_mgr *cm, enum config_lock_api api,
+                      uint64_t locked_ns)
 {
-    struct mixer_ctl *ctl = ctl_get_ptr(stream->cm, &volctl->ref);
-    int val;
-    long long lmin;
-    long long lmax;
-    long long lval;
-
-    switch (percent) {
-    case 0:
-        val = volctl->min;
-        break;
+    struct config_lock_stats *stats = &cm->lock_stats[api];
+    const uint64_t hold_ns = time_now_ns() - locked_ns;
 
-    case 100:
-        val = volctl->max;
-        break;
+    if (in_transaction(cm)) {
+        return;
+    }
 
-    default:
-        lmin = volctl->min;
-        lmax = volctl->max;
-        lval = lmin + (((lmax - lmin) * percent) / 100LL);
-        val = (int)lval;
-        break;
+    stats->hold_ns += hold_ns;
+    if (hold_ns > stats->max_hold_ns) {
+        stats->max_hold_ns = hold_ns;
     }
 
-    mixer_ctl_set_value(ctl, volctl->index, val);
+    pthread_mutex_unlock(&cm->lock);
+}
+#else
+static inline uint64_t lock_cm(struct config_mgr *cm, enum config_lock_api api)
+{
+    (void)api;
+    if (!in_transaction(cm)) {
+        pthread_mutex_lock(&cm->lock);
+    }
     return 0;
 }
 
-int set_hw_volume( const struct hw_stream *stream, int left_pc, int right_pc)
+static inline void unlock_cm(struct config_mgr *cm, enum config_lock_api api,
+                             uint64_t locked_ns)
 {
-    struct stream *s = (struct stream *)stream;
-    int ret = -ENOSYS;
-
-    if ((left_pc < 0) || (left_pc > 100)) {
-        ALOGE("Volume percent %d is out of range 0..100", left_pc);
-        return -EINVAL;
+    (void)api;
+    (void)locked_ns;
+    if (!in_transaction(cm)) {
+        pthread_mutex_unlock(&cm->lock);
     }
+}
+#endif /* TINYHAL_LOCK_STATS */
 
-    if ((right_pc < 0) || (right_pc > 100)) {
-        ALOGE("Volume percent %d is out of range 0..100", right_pc);
-        return -EINVAL;
-    }
+static inline uint64_t ctl_write_begin(void)
+{
+    return time_now_ns();
+}
 
-    if (ctl_ref_valid(&s->controls.volume_left.ref)) {
-        if (!ctl_ref_valid(&s->controls.volume_right.ref)) {
-            /* Control is mono so average left and right */
-            left_pc = (left_pc + right_pc) / 2;
-        }
+static void ctl_write_end(struct config_mgr *cm, const struct ctl_ref *ref,
+                          struct mixer_ctl *ctl, uint64_t start_ns,
+                          uint32_t arg, int ret)
+{
+#ifdef TINYALSA_NO_CTL_GET_ID
+    const uint32_t id = CONFIG_TRACE_NO_CTL;
 
-        ret = set_vol_ctl(s, &s->controls.volume_left, left_pc);
+    (void)ctl;
+#else
+    const uint32_t id = mixer_ctl_get_id(ctl);
+#endif
+
+    trace_event4(cm, e_config_trace_ctl_write, CONFIG_TRACE_NO_STREAM,
+                 start_ns, id, arg, (uint32_t)ret,
+                 cm->mixers[ref->mixer].card);
+
+#ifdef TINYHAL_CTL_WRITE_STATS
+    /* The table is indexed by control id so only holds the first card */
+    if (ref->mixer == 0) {
+        record_ctl_write_stats(cm, ctl, time_now_ns() - start_ns);
     }
+#endif
+}
 
-    if (ctl_ref_valid(&s->controls.volume_right.ref)) {
-        ret = set_vol_ctl(s, &s->controls.volume_right, right_pc);
+/*
+ * All writes to mixer controls go through these functions so that they
+ * can be accounted to the current boot phase and timed
+ */
+static inline void count_ctl_write(struct config_mgr *cm, uint32_t bytes)
+{
+    if (cm->cur_phase != NULL) {
+        ++cm->cur_phase->ctl_writes;
+        cm->cur_phase->bytes_written += bytes;
     }
+}
 
-    ALOGV_IF(ret == 0, "set_hw_volume: L=%d%% R=%d%%", left_pc, right_pc);
+static int ctl_write_value(struct config_mgr *cm, const struct ctl_ref *ref,
+                           struct mixer_ctl *ctl, unsigned int id, int value)
+{
+    const uint64_t start_ns = ctl_write_begin();
+    int ret;
+
+    count_ctl_write(cm, sizeof(value));
+    ret = mixer_ctl_set_value(ctl, id, value);
+    ctl_write_end(cm, ref, ctl, start_ns, (uint32_t)value, ret);
 
     return ret;
 }
 
-static struct stream *find_named_stream(struct config_mgr *cm,
-                                   const char *name)
+static int ctl_write_array(struct config_mgr *cm, const struct ctl_ref *ref,
+                           struct mixer_ctl *ctl, const void *data,
+                           size_t count)
 {
-    struct stream *s = cm->named_stream_array.streams;
-    int i;
+    const uint64_t start_ns = ctl_write_begin();
+    int ret;
 
-    for (i = cm->named_stream_array.count - 1; i >= 0; --i) {
-        if (s->name) {
-            if (strcmp(s->name, name) == 0) {
-                return s;
-            }
-        }
-        s++;
-    }
-    return NULL;
+    count_ctl_write(cm, count);
+    ret = mixer_ctl_set_array(ctl, data, count);
+    ctl_write_end(cm, ref, ctl, start_ns, (uint32_t)count, ret);
+
+    return ret;
 }
 
-static bool open_stream_l(struct config_mgr *cm, struct stream *s)
+static int ctl_write_enum(struct config_mgr *cm, const struct ctl_ref *ref,
+                          struct mixer_ctl *ctl, const char *string)
 {
-    if (s->ref_count < s->max_ref_count) {
-        ++s->ref_count;
-        if (s->ref_count == 1) {
-            apply_paths_to_global_l(cm, e_path_id_on, s->enable_path);
-        }
-        return true;
-    } else {
-        ALOGV("stream at maximum refcount %d", s->ref_count);
-        return false;
+    const uint64_t start_ns = ctl_write_begin();
+    int ret;
+
+    count_ctl_write(cm, sizeof(unsigned int));
+    ret = mixer_ctl_set_enum_by_string(ctl, string);
+    ctl_write_end(cm, ref, ctl, start_ns, 0, ret);
+
+    return ret;
+}
+
+/*
+ * Write a BYTE control, reading the current value first if pctl only
+ * changes part of it
+ */
+static int ctl_write_bytes(struct config_mgr *cm, struct ctl *pctl,
+                           struct mixer_ctl *ctl, unsigned int vnum)
+{
+    int err;
+
+    if ((pctl->index == 0) && (pctl->array_count == vnum)) {
+        return ctl_write_array(cm, &pctl->ref, ctl, pctl->value.data,
+                               pctl->array_count);
     }
+
+    /* read-modify-write */
+    err = mixer_ctl_get_array(ctl, pctl->info->buffer, vnum);
+    if (err >= 0) {
+        memcpy(&pctl->info->buffer[pctl->index], pctl->value.data, pctl->array_count);
+        err = ctl_write_array(cm, &pctl->ref, ctl, pctl->info->buffer, vnum);
+    }
+
+    return err;
 }
 
-const struct hw_stream *get_stream(struct config_mgr *cm,
-                                   const audio_devices_t devices,
-                                   const audio_output_flags_t flags,
-                                   const struct audio_config *config )
+/*********************************************************************
+ * Transactions
+ *
+ * While a transaction is open apply_ctls_l() queues writes in cm->txn
+ * instead of writing the controls. There is one queued write for each
+ * value of a BOOL or INT control and one for each ENUM or BYTE control,
+ * holding the last value written to it. The seq of a write is updated
+ * each time it is written so that the commit order is the order of the
+ * last write to each control. The writes are found by a hash table
+ * of the control and value index, see txn_write_index.
+ *********************************************************************/
+
+static uint32_t txn_write_hash(const struct ctl_ref *ref, uint32_t index)
 {
-    int i;
-    struct stream *s = cm->anon_stream_array.streams;
-    const bool pcm = audio_is_linear_pcm(config->format);
-    enum stream_type type;
+#ifdef TINYALSA_NO_CTL_GET_ID
+    uint32_t h = (uint32_t)((uintptr_t)ref->ctl >> 3);
+#else
+    uint32_t h = ref->id ^ ((uint32_t)ref->mixer << 24);
+#endif
 
-    ALOGV("+get_stream devices=0x%x flags=0x%x format=0x%x",
-                            devices, flags, config->format );
+    /* Finalizer of MurmurHash3, ids and indexes are small and dense */
+    h ^= index * 0x9e3779b9U;
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+}
 
-    if (devices & AUDIO_DEVICE_BIT_IN) {
-        type = pcm ? e_stream_in_pcm : e_stream_in_compress;
-    } else {
-        type = pcm ? e_stream_out_pcm : e_stream_out_compress;
+static struct txn_write *txn_find_write_l(struct config_mgr *cm,
+                                          const struct ctl_ref *ref,
+                                          uint32_t index)
+{
+    const struct txn_write_index *idx = &cm->txn.write_index;
+    const uint32_t mask = idx->size - 1;
+    const struct txn_write_slot *slot;
+    struct txn_write *w;
+    uint32_t i;
+
+    if (idx->size == 0) {
+        return NULL;
     }
 
-    pthread_mutex_lock(&cm->lock);
-    for (i = cm->anon_stream_array.count - 1; i >= 0; --i) {
-        ALOGV("get_stream: require type=%d; try type=%d refcount=%d refmax=%d",
-                    type, s[i].info.type, s[i].ref_count, s[i].max_ref_count );
-        if (s[i].info.type == type) {
-            if (open_stream_l(cm, &s[i])) {
-                break;
-            }
+    for (i = txn_write_hash(ref, index) & mask; ; i = (i + 1) & mask) {
+        slot = &idx->slots[i];
+        if (slot->gen != idx->gen) {
+            return NULL;
+        }
+
+        w = &cm->txn.write_array.txn_writes[slot->write];
+        if ((w->index == index) && ctl_ref_equal(&w->ref, ref)) {
+            return w;
         }
     }
-    pthread_mutex_unlock(&cm->lock);
+}
 
-    if (i >= 0) {
-        // apply initial routing
-        apply_route(&s[i].info, devices);
+static void txn_write_index_insert(struct txn_write_index *idx,
+                                   const struct txn_write *w, uint32_t write)
+{
+    const uint32_t mask = idx->size - 1;
+    uint32_t i;
 
-        ALOGV("-get_stream =%p (refcount=%d)", &s[i].info,
-                                                s[i].ref_count );
-        return &s[i].info;
-    } else {
-        ALOGE("-get_stream no suitable stream" );
-        return NULL;
+    for (i = txn_write_hash(&w->ref, w->index) & mask;
+            idx->slots[i].gen == idx->gen;
+            i = (i + 1) & mask) {
+        ;
     }
+
+    idx->slots[i].gen = idx->gen;
+    idx->slots[i].write = write;
 }
 
-const struct hw_stream *get_named_stream(struct config_mgr *cm,
-                                   const char *name)
+/* Empty the index for the next transaction */
+static void txn_write_index_reset(struct txn_write_index *idx)
 {
-    struct stream *s;
+    if (++idx->gen == 0) {
+        /* Wrapped, old slots could look current */
+        if (idx->slots != NULL) {
+            memset(idx->slots, 0, idx->size * sizeof(struct txn_write_slot));
+        }
+        idx->gen = 1;
+    }
+}
 
-    ALOGV("+get_named_stream '%s'", name);
+/* Make room for count writes, the table is kept at most half full */
+static int txn_write_index_reserve(struct config_mgr *cm, uint32_t count)
+{
+    struct txn_write_index *idx = &cm->txn.write_index;
+    const struct txn_write *w = cm->txn.write_array.txn_writes;
+    const uint32_t queued = cm->txn.write_array.count;
+    struct txn_write_slot *slots;
+    uint32_t size, i;
 
-    /* Streams can't be deleted so don't need to hold the lock during search */
-    s = find_named_stream(cm, name);
+    if ((idx->size / 2) >= count) {
+        return 0;
+    }
 
-    pthread_mutex_lock(&cm->lock);
-    if (s != NULL) {
-        if (!open_stream_l(cm, s)) {
-            s = NULL;
-        }
+    if (count > (UINT32_MAX / 4)) {
+        return -ENOMEM;
     }
-    pthread_mutex_unlock(&cm->lock);
 
-    if (s != NULL) {
-        ALOGV("-get_named_stream =%p (refcount=%d)", &s->info, s->ref_count );
-        return &s->info;
-    } else {
-        ALOGE("-get_named_stream no suitable stream" );
-        return NULL;
+    for (size = (idx->size != 0) ? idx->size : 64; (size / 2) < count; size <<= 1) {
+        ;
+    }
+
+    slots = calloc(size, sizeof(struct txn_write_slot));
+    if (!slots) {
+        return -ENOMEM;
     }
+
+    free(idx->slots);
+    idx->slots = slots;
+    idx->size = size;
+    idx->gen = 1;
+
+    for (i = 0; i < queued; ++i) {
+        txn_write_index_insert(idx, &w[i], i);
+    }
+
+    return 0;
 }
 
-bool is_named_stream_defined(struct config_mgr *cm, const char *name)
+static void txn_write_index_free(struct txn_write_index *idx)
 {
-    struct stream *s;
+    free(idx->slots);
+    idx->slots = NULL;
+    idx->size = 0;
+    idx->gen = 0;
+}
 
-    /* Streams can't be deleted so don't need to hold the lock during search */
-    s = find_named_stream(cm, name);
+static struct txn_write *txn_add_write_l(struct config_mgr *cm,
+                                         const struct ctl_ref *ref,
+                                         enum mixer_ctl_type type,
+                                         uint32_t index)
+{
+    struct dyn_array *array = &cm->txn.write_array;
+    struct txn_write *w;
 
-    ALOGV("is_named_stream_defined '%s' = %d", name, (s != NULL));
-    return (s != NULL);
+    if (txn_write_index_reserve(cm, array->count + 1) < 0) {
+        return NULL;
+    }
+
+    if (dyn_array_extend(array) < 0) {
+        return NULL;
+    }
+
+    w = &array->txn_writes[array->count - 1];
+    w->ref = *ref;
+    w->count = 0;
+    w->type = type;
+    w->index = index;
+    txn_write_index_insert(&cm->txn.write_index, w, array->count - 1);
+    return w;
 }
 
-void release_stream( const struct hw_stream* stream )
+static int txn_queue_value_l(struct config_mgr *cm, const struct ctl *pctl,
+                             struct mixer_ctl *ctl, enum mixer_ctl_type type,
+                             unsigned int id)
 {
-    struct stream *s = (struct stream *)stream;
+    struct txn_write *w = txn_find_write_l(cm, &pctl->ref, id);
+
+    if (w == NULL) {
+        w = txn_add_write_l(cm, &pctl->ref, type, id);
+        if (w == NULL) {
+            /* Can't queue, so write now rather than lose the value */
+            return ctl_write_value(cm, &pctl->ref, ctl, id,
+                                   pctl->value.integer);
+        }
+    }
 
-    ALOGV("release_stream %p", stream );
+    w->value.integer = pctl->value.integer;
+    w->seq = ++cm->txn.seq;
+    ++w->count;
+    return 0;
+}
 
-    if (s) {
-        pthread_mutex_lock(&s->cm->lock);
-        if (--s->ref_count == 0) {
-            /* Ensure all paths it was using are disabled */
-            apply_paths_to_devices_l(s->cm, s->current_devices,
-                                    e_path_id_off, s->disable_path);
-            apply_paths_to_global_l(s->cm, s->disable_path, e_path_id_off);
-            s->current_devices = 0;
+static int txn_queue_enum_l(struct config_mgr *cm, const struct ctl *pctl,
+                            struct mixer_ctl *ctl)
+{
+    struct txn_write *w = txn_find_write_l(cm, &pctl->ref, 0);
+
+    if (w == NULL) {
+        w = txn_add_write_l(cm, &pctl->ref, MIXER_CTL_TYPE_ENUM, 0);
+        if (w == NULL) {
+            return ctl_write_enum(cm, &pctl->ref, ctl, pctl->value.string);
         }
-        pthread_mutex_unlock(&s->cm->lock);
     }
+
+    w->value.string = pctl->value.string;
+    w->seq = ++cm->txn.seq;
+    ++w->count;
+    return 0;
 }
 
-uint32_t get_supported_output_devices( struct config_mgr *cm )
+/*
+ * The whole value of a BYTE control is built up in the work buffer of the
+ * first struct ctl that writes it in the transaction, so a partial write
+ * only has to read the control if nothing has been queued for it yet
+ */
+static int txn_queue_bytes_l(struct config_mgr *cm, struct ctl *pctl,
+                             struct mixer_ctl *ctl, unsigned int vnum)
 {
-    const uint32_t d = cm->supported_output_devices;
+    struct txn_write *w = txn_find_write_l(cm, &pctl->ref, 0);
+    int err;
+
+    if (w == NULL) {
+        if ((pctl->index != 0) || (pctl->array_count != vnum)) {
+            err = mixer_ctl_get_array(ctl, pctl->info->buffer, vnum);
+            if (err < 0) {
+                return err;
+            }
+        }
 
-    ALOGV("get_supported_output_devices=0x%x", d);
-    return d;
+        w = txn_add_write_l(cm, &pctl->ref, MIXER_CTL_TYPE_BYTE, 0);
+        if (w == NULL) {
+            return ctl_write_bytes(cm, pctl, ctl, vnum);
+        }
+        w->value.data = pctl->info->buffer;
+    }
+
+    memcpy(&w->value.data[pctl->index], pctl->value.data, pctl->array_count);
+    w->seq = ++cm->txn.seq;
+    ++w->count;
+    return 0;
 }
 
-uint32_t get_supported_input_devices( struct config_mgr *cm )
+static int txn_compare_seq(const void *a, const void *b)
 {
-    const uint32_t d = cm->supported_input_devices;
+    const struct txn_write *wa = a;
+    const struct txn_write *wb = b;
 
-    ALOGV("get_supported_input_devices=0x%x", d);
-    return d;
+    return (wa->seq > wb->seq) - (wa->seq < wb->seq);
 }
 
-/*********************************************************************
- * Use-case control
- *********************************************************************/
-int apply_use_case( const struct hw_stream* stream,
-                    const char *setting,
-                    const char *case_name)
+/* True if an ENUM control is currently set to string */
+static bool ctl_enum_unchanged(struct mixer_ctl *ctl, const char *string)
 {
-    struct stream *s = (struct stream *)stream;
-    struct usecase *puc = s->usecase_array.usecases;
-    int usecase_count = s->usecase_array.count;
-    struct scase *pcase;
-    int case_count;
-    int ret;
-
-    ALOGV("apply_use_case(%p) %s=%s", stream, setting, case_name);
+    const char *cur_str;
+    int cur;
 
-    for (; usecase_count > 0; usecase_count--, puc++) {
-        if (0 == strcmp(puc->name, setting)) {
-            pcase = puc->case_array.cases;
-            case_count = puc->case_array.count;
-            for(; case_count > 0; case_count--, pcase++) {
-                if (0 == strcmp(pcase->name, case_name)) {
-                    pthread_mutex_lock(&s->cm->lock);
-                    apply_ctls_l(s->cm, pcase->ctl_array.ctls, pcase->ctl_array.count);
-                    pthread_mutex_unlock(&s->cm->lock);
-                    ret = 0;
-                    goto exit;
-                }
-            }
-        }
+    cur = mixer_ctl_get_value(ctl, 0);
+    if (cur < 0) {
+        return false;
     }
 
-    ret = -ENOSYS;      /* use-case not implemented */
+    cur_str = mixer_ctl_get_enum_string(ctl, cur);
+    return (cur_str != NULL) && (strcmp(cur_str, string) == 0);
+}
 
-exit:
-    return ret;
+/*
+ * True if the control already holds the queued value. Only BOOL, INT and
+ * ENUM controls are compared, BYTE controls are always written
+ */
+static bool txn_write_unchanged_l(struct mixer_ctl *ctl,
+                                  const struct txn_write *w)
+{
+    switch (w->type) {
+    case MIXER_CTL_TYPE_BOOL:
+    case MIXER_CTL_TYPE_INT:
+        return mixer_ctl_get_value(ctl, w->index) == w->value.integer;
+    case MIXER_CTL_TYPE_ENUM:
+        return ctl_enum_unchanged(ctl, w->value.string);
+    default:
+        return false;
+    }
 }
 
-/*********************************************************************
- * Constants
- *********************************************************************/
-int get_stream_constant_string(const struct hw_stream *stream,
-                                const char *name, char const **value)
+/*
+ * Run fn once for each card in mixer_mask and wait for them all to finish.
+ * Cards with a worker thread run in parallel with the first card, which is
+ * run by the calling thread. Returns the total written and the first error
+ * in *result.
+ */
+static int run_card_jobs_l(struct config_mgr *cm, uint32_t mixer_mask,
+                           void (*fn)(struct config_mgr *, unsigned int),
+                           int *result)
 {
-    struct stream *s = (struct stream *)stream;
-    struct constant *pc = s->constants_array.constants;
-    const int count = s->constants_array.count;
-    int i;
+    struct card_jobs *jobs = &cm->card_jobs;
+    struct config_mixer *m;
+    unsigned int i;
+    int written = 0;
 
-    for (i = 0; i < count; ++i) {
-        if (0 == strcmp(pc[i].name, name)) {
-            *value = pc[i].value;
-            return 0;
+    *result = 0;
+
+    if ((mixer_mask & (mixer_mask - 1)) == 0) {
+        /* Only one card so no need to wake a worker */
+        for (i = 0; mixer_mask > 1U; mixer_mask >>= 1) {
+            ++i;
+        }
+        cm->mixers[i].written = 0;
+        cm->mixers[i].result = 0;
+        fn(cm, i);
+        *result = cm->mixers[i].result;
+        return cm->mixers[i].written;
+    }
+
+    pthread_mutex_lock(&jobs->lock);
+    jobs->fn = fn;
+    for (i = 0; i < cm->mixer_count; ++i) {
+        m = &cm->mixers[i];
+        m->written = 0;
+        m->result = 0;
+        if ((i > 0) && m->has_thread && (mixer_mask & BIT(i))) {
+            m->run = true;
+            ++jobs->pending;
         }
     }
-    return -ENOSYS;
-}
+    pthread_cond_broadcast(&jobs->start);
+    pthread_mutex_unlock(&jobs->lock);
 
-int get_stream_constant_uint32(const struct hw_stream *stream,
-                                const char *name, uint32_t *value)
-{
-    const char *string = NULL;
-    uint32_t val = 0;
-    int ret = get_stream_constant_string(stream, name, &string);
+    for (i = 0; i < cm->mixer_count; ++i) {
+        m = &cm->mixers[i];
+        if ((mixer_mask & BIT(i)) && ((i == 0) || !m->has_thread)) {
+            fn(cm, i);
+        }
+    }
 
-    if (!ret) {
-        ret = string_to_uint(&val, string);
-        if (!ret) {
-            *value = val;
+    pthread_mutex_lock(&jobs->lock);
+    while (jobs->pending > 0) {
+        pthread_cond_wait(&jobs->done, &jobs->lock);
+    }
+    pthread_mutex_unlock(&jobs->lock);
+
+    for (i = 0; i < cm->mixer_count; ++i) {
+        if (mixer_mask & BIT(i)) {
+            written += cm->mixers[i].written;
+            if (*result == 0) {
+                *result = cm->mixers[i].result;
+            }
         }
     }
 
-    return ret;
+    return written;
 }
 
-int get_stream_constant_int32(const struct hw_stream *stream,
-                              const char *name, int32_t *value)
+static void *card_worker(void *arg)
 {
-    const char *string = NULL;
-    int val = 0;
-    int ret = get_stream_constant_string(stream, name, &string);
+    struct config_mixer *m = arg;
+    struct config_mgr *cm = m->cm;
+    struct card_jobs *jobs = &cm->card_jobs;
+    const unsigned int index = m - cm->mixers;
+
+    pthread_mutex_lock(&jobs->lock);
+    for (;;) {
+        while (!m->run && !jobs->exit) {
+            pthread_cond_wait(&jobs->start, &jobs->lock);
+        }
 
-    if (!ret) {
-        ret = string_to_int(&val, string);
-        if (ret != 0) {
-            return ret;
+        if (jobs->exit) {
+            break;
         }
-        /* pick up out-of-range on 64-bit machines */
-        if ((sizeof(int) > sizeof(int32_t)) &&
-            ((val > 0x7FFFFFFF) || (-val > 0x7FFFFFFF))) {
-            return -EINVAL;
+
+        pthread_mutex_unlock(&jobs->lock);
+        jobs->fn(cm, index);
+        pthread_mutex_lock(&jobs->lock);
+
+        m->run = false;
+        if (--jobs->pending == 0) {
+            pthread_cond_signal(&jobs->done);
         }
-        *value = val;
     }
+    pthread_mutex_unlock(&jobs->lock);
 
-    return ret;
+    return NULL;
 }
 
-/*********************************************************************
- * Config file parsing
- *
- * To keep this simple we restrict the order that config file entries
- * may appear:
- * - The <mixer> section must always appear first
+static void start_card_workers(struct config_mgr *cm)
+{
+    struct config_mixer *m;
+    unsigned int i;
+
+    for (i = 1; i < cm->mixer_count; ++i) {
+        m = &cm->mixers[i];
+        m->cm = cm;
+        if (pthread_create(&m->thread, NULL, card_worker, m) == 0) {
+            m->has_thread = true;
+        } else {
+            /* Not fatal, the calling thread writes this card instead */
+            ALOGW("Failed to create worker for card %u", m->card);
+        }
+    }
+}
+
+static void stop_card_workers(struct config_mgr *cm)
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&cm->card_jobs.lock);
+    cm->card_jobs.exit = true;
+    pthread_cond_broadcast(&cm->card_jobs.start);
+    pthread_mutex_unlock(&cm->card_jobs.lock);
+
+    for (i = 1; i < cm->mixer_count; ++i) {
+        if (cm->mixers[i].has_thread) {
+            pthread_join(cm->mixers[i].thread, NULL);
+            cm->mixers[i].has_thread = false;
+        }
+    }
+}
+
+static inline bool have_card_workers(const struct config_mgr *cm)
+{
+    return (cm->mixer_count > 1) && cm->mixers[1].has_thread;
+}
+
+/*
+ * Write the queued writes to one card in order.
+ * With net_routes a control that was written more than once, for example
+ * turned off by one path and on again by another, is only written if its
+ * final value is different from its current value
+ */
+static void txn_flush_card(struct config_mgr *cm, unsigned int mixer)
+{
+    struct dyn_array *array = &cm->txn.write_array;
+    struct txn_write *w = array->txn_writes;
+    const int count = array->count;
+    struct config_mixer *m = &cm->mixers[mixer];
+    struct mixer_ctl *ctl;
+    int i, err;
+
+    for (i = 0; i < count; ++i, ++w) {
+        if (w->ref.mixer != mixer) {
+            continue;
+        }
+
+        ctl = ctl_get_ptr(cm, &w->ref);
+
+        if (cm->net_routes && (w->count > 1) && txn_write_unchanged_l(ctl, w)) {
+            ALOGV("ctl '%s' unchanged", mixer_ctl_get_name(ctl));
+            continue;
+        }
+
+        ++m->written;
+
+        switch (w->type) {
+        case MIXER_CTL_TYPE_BOOL:
+        case MIXER_CTL_TYPE_INT:
+            err = ctl_write_value(cm, &w->ref, ctl, w->index,
+                                  w->value.integer);
+            break;
+        case MIXER_CTL_TYPE_BYTE:
+            err = ctl_write_array(cm, &w->ref, ctl, w->value.data,
+                                  mixer_ctl_get_num_values(ctl));
+            break;
+        case MIXER_CTL_TYPE_ENUM:
+            err = ctl_write_enum(cm, &w->ref, ctl, w->value.string);
+            break;
+        default:
+            err = -EINVAL;
+            break;
+        }
+
+        ALOGE_IF(err < 0, "Failed to set ctl '%s'", mixer_ctl_get_name(ctl));
+        if ((err < 0) && (m->result == 0)) {
+            m->result = err;
+        }
+    }
+}
+
+/*
+ * Write all queued writes, returns the number written. The writes to each
+ * card are made in the order they were queued, and the cards are written
+ * in parallel
+ */
+static int txn_flush_l(struct config_mgr *cm, int *result)
+{
+    struct dyn_array *array = &cm->txn.write_array;
+    struct txn_write *w = array->txn_writes;
+    const int count = array->count;
+    uint32_t mixer_mask = BIT(0);
+    int written;
+    int i;
+
+    if (count > 1) {
+        qsort(w, count, sizeof(*w), txn_compare_seq);
+    }
+
+    if (have_card_workers(cm)) {
+        for (mixer_mask = 0, i = 0; i < count; ++i) {
+            mixer_mask |= BIT(w[i].ref.mixer);
+        }
+    }
+
+    written = run_card_jobs_l(cm, mixer_mask, txn_flush_card, result);
+
+    array->count = 0;
+    txn_write_index_reset(&cm->txn.write_index);
+    return written;
+}
+
+static int ctl_open(struct config_mgr *cm, struct ctl *pctl)
+{
+    enum mixer_ctl_type ctl_type;
+    const char *val_str = pctl->value.string;
+    struct mixer_ctl *ctl;
+    int ret;
+
+    if (ctl_ref_valid(&pctl->ref)) {
+        /* control already populated on boot */
+        return 0;
+    }
+
+   /* Control wasn't found on boot, try to get it now */
+
+    ctl = find_ctl_by_name(cm, pctl->ref.mixer, pctl->info->name);
+#if !defined(TINYALSA_NO_ADD_NEW_CTRLS) || !defined(TINYALSA_NO_CTL_GET_ID)
+    if (!ctl) {
+        /* Update tinyalsa with any new controls that have been added
+         * and try again. NOTE: only safe if mixer_ctl_get_id() supported
+         * because the pointers are likely to change as the list is updated.
+         */
+        struct config_phase_stats *prev_phase;
+
+        prev_phase = enter_phase(cm, &cm->boot_stats.new_ctls);
+        mixer_add_new_ctls(cm->mixers[pctl->ref.mixer].mixer);
+        enter_phase(cm, prev_phase);
+        ctl = find_ctl_by_name(cm, pctl->ref.mixer, pctl->info->name);
+    }
+#endif
+
+    if (!ctl) {
+        ALOGW("Control '%s' not found", pctl->info->name);
+        return -ENOENT;
+    }
+
+    ctl_type = mixer_ctl_get_type(ctl);
+    switch(ctl_type) {
+        case MIXER_CTL_TYPE_BYTE:
+            if (pctl->index == INVALID_CTL_INDEX) {
+                pctl->index = 0;
+            }
+            if (pctl->info->lazy) {
+                /* The data is loaded when the case is selected */
+                pctl->info->lazy_val = pctl->value.string;
+                pctl->value.data = NULL;
+                break;
+            }
+            const unsigned int vnum = mixer_ctl_get_num_values(ctl);
+            ret = make_byte_work_buffer(pctl, vnum);
+            if (ret != 0) {
+                return ret;
+            }
+            break;
+
+        case MIXER_CTL_TYPE_BOOL:
+        case MIXER_CTL_TYPE_INT:
+            if (string_to_int(&pctl->value.integer, val_str) == -EINVAL) {
+                return -EINVAL;
+            }
+
+            free((void*)val_str);  /* no need to keep this string now */
+
+            /* This log statement is just to aid to debugging */
+            ALOGE_IF((ctl_type == MIXER_CTL_TYPE_BOOL)
+                     && ((unsigned int)pctl->value.integer > 1),
+                     "WARNING: Illegal value for bool control");
+            ALOGV("Added ctl '%s' value 0x%x", pctl->info->name, pctl->value.integer);
+            break;
+
+        case MIXER_CTL_TYPE_ENUM:
+            ALOGV("Added ctl '%s' value '%s'", pctl->info->name, pctl->value.string);
+            break;
+
+        case MIXER_CTL_TYPE_IEC958:
+        case MIXER_CTL_TYPE_INT64:
+        case MIXER_CTL_TYPE_UNKNOWN:
+        default:
+            ALOGE("Mixer control '%s' has unsupported type", pctl->info->name);
+            return -EINVAL;
+    }
+
+    pctl->info->type = ctl_type;
+    ctl_set_ref(&pctl->ref, ctl);
+
+    return 0;
+}
+
+/* Write one control, which must already have been opened */
+static int apply_ctl_l(struct config_mgr *cm, struct ctl *pctl)
+{
+    struct mixer_ctl *ctl = ctl_get_ptr(cm, &pctl->ref);
+    const enum mixer_ctl_type ctl_type = mixer_ctl_get_type(ctl);
+    unsigned int vnum;
+    unsigned int value_count;
+    int err = 0;
+
+    switch (ctl_type) {
+        case MIXER_CTL_TYPE_BOOL:
+        case MIXER_CTL_TYPE_INT:
+            value_count = mixer_ctl_get_num_values(ctl);
+
+            ALOGV("apply ctl '%s' = 0x%x (%d values)",
+                                    mixer_ctl_get_name(ctl),
+                                    pctl->value.integer,
+                                    value_count);
+
+            if (pctl->index == INVALID_CTL_INDEX) {
+                for (vnum = 0; vnum < value_count; ++vnum) {
+                    if (cm->txn.active) {
+                        err = txn_queue_value_l(cm, pctl, ctl,
+                                                ctl_type, vnum);
+                    } else {
+                        err = ctl_write_value(cm, &pctl->ref, ctl, vnum,
+                                              pctl->value.integer);
+                    }
+                    if (err < 0) {
+                        break;
+                    }
+                }
+            } else if (cm->txn.active) {
+                err = txn_queue_value_l(cm, pctl, ctl, ctl_type,
+                                        pctl->index);
+            } else {
+                err = ctl_write_value(cm, &pctl->ref, ctl, pctl->index,
+                                      pctl->value.integer);
+            }
+            ALOGE_IF(err < 0, "Failed to set ctl '%s' to 0x%x",
+                                    mixer_ctl_get_name(ctl),
+                                    pctl->value.integer);
+            break;
+
+        case MIXER_CTL_TYPE_BYTE:
+            /* byte array */
+            vnum = mixer_ctl_get_num_values(ctl);
+
+            ALOGV("apply ctl '%s' = byte data (%d bytes)",
+                                    mixer_ctl_get_name(ctl),
+                                    vnum);
+
+            if (cm->txn.active) {
+                err = txn_queue_bytes_l(cm, pctl, ctl, vnum);
+            } else {
+                err = ctl_write_bytes(cm, pctl, ctl, vnum);
+            }
+
+            ALOGE_IF(err < 0, "Failed to set ctl '%s'",
+                                        mixer_ctl_get_name(ctl));
+            break;
+
+        case MIXER_CTL_TYPE_ENUM:
+            ALOGV("apply ctl '%s' to '%s'",
+                                        mixer_ctl_get_name(ctl),
+                                        pctl->value.string);
+
+            if (cm->txn.active) {
+                err = txn_queue_enum_l(cm, pctl, ctl);
+            } else {
+                err = ctl_write_enum(cm, &pctl->ref, ctl,
+                                     pctl->value.string);
+            }
+
+            ALOGE_IF(err < 0, "Failed to set ctl '%s' to '%s'",
+                                        mixer_ctl_get_name(ctl),
+                                        pctl->value.string);
+            break;
+
+        default:
+            break;
+    }
+
+    return err;
+}
+
+static int apply_ctls_l(struct config_mgr *cm, struct ctl *pctl, const int ctl_count)
+{
+    int i;
+    int ret = 0;
+
+    ALOGV("+apply_ctls_l");
+
+    for (i = 0; i < ctl_count; ++i, ++pctl) {
+        ret = ctl_open(cm, pctl);
+        if (ret != 0) {
+            break;
+        }
+
+        apply_ctl_l(cm, pctl);
+    }
+
+    ALOGV("-apply_ctls_l");
+    return ret;
+}
+
+/*
+ * Get the runs of controls of a path or case in the order they are applied.
+ * Without a <path_ref> this is a single run of its own controls, in own.
+ */
+static int get_ctl_segments(const struct dyn_array *ctl_array,
+                            const struct dyn_array *segment_array,
+                            struct ctl_segment *own,
+                            const struct ctl_segment **segs)
+{
+    if (segment_array->count > 0) {
+        *segs = segment_array->segments;
+        return segment_array->count;
+    }
+
+    own->ctls = ctl_array->ctls;
+    own->count = ctl_array->count;
+    *segs = own;
+    return 1;
+}
+
+/* As apply_ctls_l() a control that can't be opened ends the path */
+static void apply_segments_l(struct config_mgr *cm,
+                             const struct ctl_segment *segs, int count)
+{
+    for (; count > 0; --count, ++segs) {
+        if (apply_ctls_l(cm, segs->ctls, segs->count) != 0) {
+            break;
+        }
+    }
+}
+
+/*
+ * True if the control already holds the value that pctl writes. A BYTE
+ * control is read into the work buffer of pctl and compared. A control that
+ * can't be read is treated as changed.
+ */
+static bool ctl_value_unchanged(struct ctl *pctl, struct mixer_ctl *ctl)
+{
+    unsigned int vnum, value_count;
+
+    switch (pctl->info->type) {
+    case MIXER_CTL_TYPE_BOOL:
+    case MIXER_CTL_TYPE_INT:
+        if (pctl->index != INVALID_CTL_INDEX) {
+            return mixer_ctl_get_value(ctl, pctl->index) == pctl->value.integer;
+        }
+
+        value_count = mixer_ctl_get_num_values(ctl);
+        for (vnum = 0; vnum < value_count; ++vnum) {
+            if (mixer_ctl_get_value(ctl, vnum) != pctl->value.integer) {
+                return false;
+            }
+        }
+        return true;
+
+    case MIXER_CTL_TYPE_ENUM:
+        return ctl_enum_unchanged(ctl, pctl->value.string);
+
+    case MIXER_CTL_TYPE_BYTE:
+        vnum = mixer_ctl_get_num_values(ctl);
+        if (mixer_ctl_get_array(ctl, pctl->info->buffer, vnum) < 0) {
+            return false;
+        }
+        return memcmp(&pctl->info->buffer[pctl->index], pctl->value.data,
+                      pctl->array_count) == 0;
+
+    default:
+        return false;
+    }
+}
+
+/*
+ * Apply a path, reading each control first and only writing it if its value
+ * is different. For a warm restart of the HAL, when the codec still holds
+ * the state written by the last <init>.
+ */
+static void apply_changed_ctls_l(struct config_mgr *cm, struct path *path)
+{
+    struct ctl *pctl = path->ctl_array.ctls;
+    int i;
+
+    for (i = path->ctl_array.count; i > 0; --i, ++pctl) {
+        if (ctl_open(cm, pctl) != 0) {
+            break;
+        }
+
+        if (ctl_value_unchanged(pctl, ctl_get_ptr(cm, &pctl->ref))) {
+            if (cm->cur_phase != NULL) {
+                ++cm->cur_phase->ctl_unchanged;
+            }
+            continue;
+        }
+
+        apply_ctl_l(cm, pctl);
+    }
+}
+
+static void batch_flush_card(struct config_mgr *cm, unsigned int mixer)
+{
+    const struct dyn_array *array = &cm->batch.segment_array;
+    const struct ctl_segment *seg = array->segments;
+    const struct ctl_segment * const seg_end = seg + array->count;
+    struct config_mixer *m = &cm->mixers[mixer];
+    struct ctl *pctl;
+    int i, err;
+
+    for (; seg < seg_end; ++seg) {
+        for (i = 0, pctl = seg->ctls; i < seg->count; ++i, ++pctl) {
+            if (pctl->ref.mixer != mixer) {
+                continue;
+            }
+
+            ++m->written;
+            err = apply_ctl_l(cm, pctl);
+            if ((err < 0) && (m->result == 0)) {
+                m->result = err;
+            }
+        }
+    }
+}
+
+/*
+ * Apply the paths batched by a route change, writing each card in
+ * parallel. The order of the writes to each card is unchanged.
+ */
+static int batch_flush_l(struct config_mgr *cm)
+{
+    int written = 0;
+    int err;
+
+    if (cm->batch.segment_array.count > 0) {
+        written = run_card_jobs_l(cm, cm->batch.mixer_mask, batch_flush_card,
+                                  &err);
+    }
+
+    cm->batch.segment_array.count = 0;
+    cm->batch.mixer_mask = 0;
+    return written;
+}
+
+/*
+ * Open a run of controls and add them to the batch. The controls are
+ * opened now because opening can add new controls to the mixer, which
+ * must not happen while the workers are writing. Returns false if a
+ * control couldn't be opened.
+ */
+static bool batch_ctls_l(struct config_mgr *cm, struct ctl *ctls,
+                         const int ctl_count)
+{
+    struct dyn_array *array = &cm->batch.segment_array;
+    struct ctl *pctl = ctls;
+    uint32_t mixer_mask = 0;
+    int i;
+
+    for (i = 0; i < ctl_count; ++i, ++pctl) {
+        if (ctl_open(cm, pctl) != 0) {
+            break;
+        }
+        mixer_mask |= BIT(pctl->ref.mixer);
+    }
+
+    if (i == 0) {
+        return (ctl_count == 0);
+    }
+
+    if (dyn_array_extend(array) < 0) {
+        /* Can't batch, so write everything in order now */
+        batch_flush_l(cm);
+        apply_ctls_l(cm, ctls, i);
+        return (i == ctl_count);
+    }
+
+    array->segments[array->count - 1].ctls = ctls;
+    array->segments[array->count - 1].count = i;
+    cm->batch.mixer_mask |= mixer_mask;
+    return (i == ctl_count);
+}
+
+static void apply_path_l(struct config_mgr *cm, struct path *path)
+{
+    const struct ctl_segment *segs;
+    struct ctl_segment own;
+    int count;
+
+    ALOGV("+apply_path_l(%p) id=%u", path, path->id);
+
+    count = get_ctl_segments(&path->ctl_array, &path->segment_array,
+                             &own, &segs);
+
+    if (cm->batch.active) {
+        for (; count > 0; --count, ++segs) {
+            if (!batch_ctls_l(cm, segs->ctls, segs->count)) {
+                break;
+            }
+        }
+    } else {
+        apply_segments_l(cm, segs, count);
+    }
+
+    ALOGV("-apply_path_l(%p)", path);
+}
+
+static void apply_device_path_l(struct config_mgr *cm, struct device *pdev,
+                                    struct path *path)
+{
+    ALOGV("+apply_device_path_l(%p) id=%u", path, path->id);
+
+    /* The on and off paths for a device are reference-counted */
+    switch (path->id) {
+    case e_path_id_off:
+        if (--pdev->use_count > 0) {
+            ALOGV("Device still in use - not applying 'off' path");
+            return;
+        }
+        break;
+
+     case e_path_id_on:
+        if (++pdev->use_count > 1) {
+            ALOGV("Device already enabled - not applying 'on' path");
+            return;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    apply_path_l(cm, path);
+
+    ALOGV("-apply_device_path_l(%p)", path);
+}
+
+static void apply_paths_by_id_l(struct config_mgr *cm, struct device *pdev,
+                                int first_id, int second_id)
+{
+    struct path *ppath = pdev->path_array.paths;
+    struct path *found_paths[2] = {0};
+    int path_count = pdev->path_array.count;
+
+    ALOGV("Applying paths [first=%u second=%u] to device(@%p, mask=0x%x '%s')",
+                first_id, second_id, ppath, pdev->type, debug_device_to_name(pdev->type));
+
+    /* To save time we find both paths in a single walk of the list */
+    for (; path_count > 0; --path_count, ++ppath) {
+        if (ppath->id == first_id) {
+            found_paths[0] = ppath;
+            if ((found_paths[1] != NULL) || (first_id == second_id)) {
+                /* We have both paths or there is only one path to find */
+                break;
+            }
+        } else if (ppath->id == second_id) {
+            found_paths[1] = ppath;
+            if (found_paths[0] != NULL) {
+                break;
+            }
+        }
+    }
+
+    if (found_paths[0] != NULL) {
+        apply_device_path_l(cm, pdev, found_paths[0]);
+    }
+
+    if (found_paths[1] != NULL) {
+        apply_device_path_l(cm, pdev, found_paths[1]);
+    }
+}
+
+static void apply_paths_to_devices_l(struct config_mgr *cm, uint32_t devices,
+                                    int first_id, int second_id)
+{
+    struct device *pdev = cm->device_array.devices;
+    int dev_count = cm->device_array.count;
+    const uint32_t input_flag = devices & AUDIO_DEVICE_BIT_IN;
+
+    /* invoke path path_id on all struct device matching devices */
+    ALOGV("Apply paths [first=%u second=%u] to devices in 0x%x",
+            first_id, second_id, devices);
+
+    devices &= ~AUDIO_DEVICE_BIT_IN;
+
+    while ((dev_count > 0) && (devices != 0)) {
+        if (((pdev->type & input_flag) == input_flag)
+                    && ((pdev->type & devices) != 0)) {
+            devices &= ~pdev->type;
+            apply_paths_by_id_l(cm, pdev, first_id, second_id);
+        }
+
+        --dev_count;
+        ++pdev;
+    }
+}
+
+static void apply_paths_to_global_l(struct config_mgr *cm,
+                                    int first_id, int second_id)
+{
+    struct device *pdev = cm->device_array.devices;
+    struct device * const pend = pdev + cm->device_array.count;
+
+    ALOGV("Apply global paths [first=%u second=%u]", first_id, second_id);
+
+    while (pdev < pend) {
+        if (pdev->type == 0) {
+            apply_paths_by_id_l(cm, pdev, first_id, second_id);
+            break;
+        }
+        ++pdev;
+    }
+}
+
+uint32_t get_current_routes( const struct hw_stream *stream )
+{
+    struct stream *s = (struct stream *)stream;
+    ALOGV("get_current_routes(%p) 0x%x", stream, s->current_devices);
+    return s->current_devices;
+}
+
+void apply_route( const struct hw_stream *stream, uint32_t devices )
+{
+    struct stream *s = (struct stream *)stream;
+    struct config_mgr *cm = s->cm;
+    const uint64_t start_ns = time_now_ns();
+    uint64_t locked_ns;
+    uint32_t old_devices;
+    uint64_t enabled_ns;
+    bool net_txn;
+    bool batch;
+    int written;
+    int err;
+
+    ALOGV("apply_route(%p) devices=0x%x", stream, devices);
+
+    if (devices != 0) {
+        if (devices & AUDIO_DEVICE_BIT_IN) {
+            if (!stream_is_input(stream)) {
+                ALOGE("Attempting to set input routing %x on output stream %p",
+                        devices, stream);
+                return;
+            }
+            devices &= AUDIO_DEVICE_IN_ALL;
+            devices |= AUDIO_DEVICE_BIT_IN;
+        } else {
+            if (stream_is_input(stream)) {
+                ALOGE("Attempting to set output routing %x on input stream %p",
+                        devices, stream);
+                return;
+            }
+            devices &= AUDIO_DEVICE_OUT_ALL;
+        }
+    }
+
+    locked_ns = lock_cm(cm, e_config_lock_apply_route);
+
+    /*
+     * To write only the net change of the whole route change the writes
+     * are queued in a transaction, unless the caller has already opened one
+     */
+    net_txn = cm->net_routes && !cm->txn.active;
+    if (net_txn) {
+        cm->txn.active = true;
+        cm->txn.seq = 0;
+    }
+
+    /*
+     * With more than one card the paths are batched so that the writes to
+     * each card can be made in parallel. A transaction already does this.
+     */
+    batch = !cm->txn.active && have_card_workers(cm);
+    cm->batch.active = batch;
+
+    /*
+     * Only apply routes to devices that have changed state on this stream.
+     * The input bit will be stripped as unchanged so restore it after.
+     */
+    uint32_t enabling = devices & ~s->current_devices;
+    uint32_t disabling = ~devices & s->current_devices;
+    enabling |= devices & AUDIO_DEVICE_BIT_IN;
+    disabling |= devices & AUDIO_DEVICE_BIT_IN;
+
+    if (s->make_before_break) {
+        apply_paths_to_devices_l(cm, enabling, e_path_id_on, s->enable_path);
+        enabled_ns = time_now_ns();
+        apply_paths_to_devices_l(cm, disabling, s->disable_path, e_path_id_off);
+    } else {
+        apply_paths_to_devices_l(cm, disabling, s->disable_path, e_path_id_off);
+        apply_paths_to_devices_l(cm, enabling, e_path_id_on, s->enable_path);
+        enabled_ns = time_now_ns();
+    }
+
+    if (net_txn) {
+        written = txn_flush_l(cm, &err);
+        cm->txn.active = false;
+        ALOGV("apply_route: %u writes queued, %d written", cm->txn.seq, written);
+
+        /* The new devices are only enabled once the writes are made */
+        enabled_ns = time_now_ns();
+    } else if (batch) {
+        written = batch_flush_l(cm);
+        cm->batch.active = false;
+        ALOGV("apply_route: %d written", written);
+
+        enabled_ns = time_now_ns();
+    }
+
+    /* Save new set of devices for this stream */
+    old_devices = s->current_devices;
+    s->current_devices = devices;
+
+    unlock_cm(cm, e_config_lock_apply_route, locked_ns);
+
+    enabled_ns -= start_ns;
+    trace_event(cm, e_config_trace_route, trace_stream_id(s), start_ns,
+                old_devices, devices,
+                (enabled_ns > UINT32_MAX) ? UINT32_MAX : (uint32_t)enabled_ns);
+}
+
+/*********************************************************************
+ * Stream control
+ *********************************************************************/
+
+static int set_vol_ctl(struct stream *stream,
+                       const struct stream_control *volctl,
+                       int percent)
+{
+    struct mixer_ctl *ctl = ctl_get_ptr(stream->cm, &volctl->ref);
+    int val;
+    long long lmin;
+    long long lmax;
+    long long lval;
+
+    switch (percent) {
+    case 0:
+        val = volctl->min;
+        break;
+
+    case 100:
+        val = volctl->max;
+        break;
+
+    default:
+        lmin = volctl->min;
+        lmax = volctl->max;
+        lval = lmin + (((lmax - lmin) * percent) / 100LL);
+        val = (int)lval;
+        break;
+    }
+
+    ctl_write_value(stream->cm, &volctl->ref, ctl, volctl->index, val);
+    return 0;
+}
+
+int set_hw_volume( const struct hw_stream *stream, int left_pc, int right_pc)
+{
+    struct stream *s = (struct stream *)stream;
+    const uint64_t start_ns = time_now_ns();
+    uint64_t locked_ns;
+    int ret = -ENOSYS;
+
+    if ((left_pc < 0) || (left_pc > 100)) {
+        ALOGE("Volume percent %d is out of range 0..100", left_pc);
+        return -EINVAL;
+    }
+
+    if ((right_pc < 0) || (right_pc > 100)) {
+        ALOGE("Volume percent %d is out of range 0..100", right_pc);
+        return -EINVAL;
+    }
+
+    locked_ns = lock_cm(s->cm, e_config_lock_set_hw_volume);
+
+    if (ctl_ref_valid(&s->controls.volume_left.ref)) {
+        if (!ctl_ref_valid(&s->controls.volume_right.ref)) {
+            /* Control is mono so average left and right */
+            left_pc = (left_pc + right_pc) / 2;
+        }
+
+        ret = set_vol_ctl(s, &s->controls.volume_left, left_pc);
+    }
+
+    if (ctl_ref_valid(&s->controls.volume_right.ref)) {
+        ret = set_vol_ctl(s, &s->controls.volume_right, right_pc);
+    }
+
+    unlock_cm(s->cm, e_config_lock_set_hw_volume, locked_ns);
+
+    ALOGV_IF(ret == 0, "set_hw_volume: L=%d%% R=%d%%", left_pc, right_pc);
+
+    trace_event(s->cm, e_config_trace_volume, trace_stream_id(s), start_ns,
+                left_pc, right_pc, ret);
+
+    return ret;
+}
+
+static struct stream *find_named_stream(struct config_mgr *cm,
+                                   const char *name)
+{
+    struct stream *s = cm->named_stream_array.streams;
+    int i;
+
+    for (i = cm->named_stream_array.count - 1; i >= 0; --i) {
+        if (s->name) {
+            if (strcmp(s->name, name) == 0) {
+                return s;
+            }
+        }
+        s++;
+    }
+    return NULL;
+}
+
+static bool open_stream_l(struct config_mgr *cm, struct stream *s)
+{
+    if (s->ref_count < s->max_ref_count) {
+        ++s->ref_count;
+        if (s->ref_count == 1) {
+            apply_paths_to_global_l(cm, e_path_id_on, s->enable_path);
+        }
+        return true;
+    } else {
+        ALOGV("stream at maximum refcount %d", s->ref_count);
+        return false;
+    }
+}
+
+const struct hw_stream *get_stream(struct config_mgr *cm,
+                                   const audio_devices_t devices,
+                                   const audio_output_flags_t flags,
+                                   const struct audio_config *config )
+{
+    int i;
+    struct stream *s = cm->anon_stream_array.streams;
+    const bool pcm = audio_is_linear_pcm(config->format);
+    const uint64_t start_ns = time_now_ns();
+    uint64_t locked_ns;
+    int ref_count = 0;
+    enum stream_type type;
+
+    ALOGV("+get_stream devices=0x%x flags=0x%x format=0x%x",
+                            devices, flags, config->format );
+
+    if (devices & AUDIO_DEVICE_BIT_IN) {
+        type = pcm ? e_stream_in_pcm : e_stream_in_compress;
+    } else {
+        type = pcm ? e_stream_out_pcm : e_stream_out_compress;
+    }
+
+    locked_ns = lock_cm(cm, e_config_lock_get_stream);
+    for (i = cm->anon_stream_array.count - 1; i >= 0; --i) {
+        ALOGV("get_stream: require type=%d; try type=%d refcount=%d refmax=%d",
+                    type, s[i].info.type, s[i].ref_count, s[i].max_ref_count );
+        if (s[i].info.type == type) {
+            if (open_stream_l(cm, &s[i])) {
+                ref_count = s[i].ref_count;
+                break;
+            }
+        }
+    }
+    unlock_cm(cm, e_config_lock_get_stream, locked_ns);
+
+    if (i >= 0) {
+        // apply initial routing
+        apply_route(&s[i].info, devices);
+
+        ALOGV("-get_stream =%p (refcount=%d)", &s[i].info, ref_count );
+        trace_event(cm, e_config_trace_get_stream, trace_stream_id(&s[i]),
+                    start_ns, devices, ref_count, 0);
+        return &s[i].info;
+    } else {
+        ALOGE("-get_stream no suitable stream" );
+        trace_event(cm, e_config_trace_get_stream, CONFIG_TRACE_NO_STREAM,
+                    start_ns, devices, 0, (uint32_t)-ENOENT);
+        return NULL;
+    }
+}
+
+const struct hw_stream *get_named_stream(struct config_mgr *cm,
+                                   const char *name)
+{
+    struct stream *s;
+    const uint64_t start_ns = time_now_ns();
+    uint64_t locked_ns;
+    int ref_count = 0;
+
+    ALOGV("+get_named_stream '%s'", name);
+
+    /* Streams can't be deleted so don't need to hold the lock during search */
+    s = find_named_stream(cm, name);
+
+    locked_ns = lock_cm(cm, e_config_lock_get_named_stream);
+    if (s != NULL) {
+        if (open_stream_l(cm, s)) {
+            ref_count = s->ref_count;
+        } else {
+            s = NULL;
+        }
+    }
+    unlock_cm(cm, e_config_lock_get_named_stream, locked_ns);
+
+    if (s != NULL) {
+        ALOGV("-get_named_stream =%p (refcount=%d)", &s->info, ref_count );
+        trace_event(cm, e_config_trace_get_stream, trace_stream_id(s),
+                    start_ns, 0, ref_count, 0);
+        return &s->info;
+    } else {
+        ALOGE("-get_named_stream no suitable stream" );
+        return NULL;
+    }
+}
+
+bool is_named_stream_defined(struct config_mgr *cm, const char *name)
+{
+    struct stream *s;
+
+    /* Streams can't be deleted so don't need to hold the lock during search */
+    s = find_named_stream(cm, name);
+
+    ALOGV("is_named_stream_defined '%s' = %d", name, (s != NULL));
+    return (s != NULL);
+}
+
+void release_stream( const struct hw_stream* stream )
+{
+    struct stream *s = (struct stream *)stream;
+    const uint64_t start_ns = time_now_ns();
+    uint64_t locked_ns;
+    int ref_count;
+
+    ALOGV("release_stream %p", stream );
+
+    if (s) {
+        locked_ns = lock_cm(s->cm, e_config_lock_release_stream);
+        ref_count = --s->ref_count;
+        if (ref_count == 0) {
+            /* Ensure all paths it was using are disabled */
+            apply_paths_to_devices_l(s->cm, s->current_devices,
+                                    e_path_id_off, s->disable_path);
+            apply_paths_to_global_l(s->cm, s->disable_path, e_path_id_off);
+            s->current_devices = 0;
+        }
+        unlock_cm(s->cm, e_config_lock_release_stream, locked_ns);
+
+        trace_event(s->cm, e_config_trace_release_stream, trace_stream_id(s),
+                    start_ns, 0, ref_count, 0);
+    }
+}
+
+uint32_t get_supported_output_devices( struct config_mgr *cm )
+{
+    const uint32_t d = cm->supported_output_devices;
+
+    ALOGV("get_supported_output_devices=0x%x", d);
+    return d;
+}
+
+uint32_t get_supported_input_devices( struct config_mgr *cm )
+{
+    const uint32_t d = cm->supported_input_devices;
+
+    ALOGV("get_supported_input_devices=0x%x", d);
+    return d;
+}
+
+/*********************************************************************
+ * Use-case control
+ *********************************************************************/
+
+static bool lazy_data_loaded(const struct ctl *c)
+{
+    return (c->info->type == MIXER_CTL_TYPE_BYTE) && (c->value.data != NULL);
+}
+
+/* Free the lazy data of the controls of a case */
+static void free_case_data(struct scase *sc)
+{
+    struct ctl *c = sc->ctl_array.ctls;
+    int i;
+
+    for (i = 0; i < (int)sc->ctl_array.count; ++i, ++c) {
+        if (c->info->lazy && lazy_data_loaded(c)) {
+            free((void *)c->value.data);
+            free(c->info->buffer);
+            c->value.data = NULL;
+            c->info->buffer = NULL;
+            c->array_count = 0;
+        }
+    }
+}
+
+static void case_cache_unlink_l(struct case_cache *cc, struct scase *sc)
+{
+    if (sc->lru_prev) {
+        sc->lru_prev->lru_next = sc->lru_next;
+    } else {
+        cc->head = sc->lru_next;
+    }
+
+    if (sc->lru_next) {
+        sc->lru_next->lru_prev = sc->lru_prev;
+    } else {
+        cc->tail = sc->lru_prev;
+    }
+
+    sc->lru_prev = NULL;
+    sc->lru_next = NULL;
+}
+
+static void case_cache_push_l(struct case_cache *cc, struct scase *sc)
+{
+    sc->lru_next = cc->head;
+    if (cc->head) {
+        cc->head->lru_prev = sc;
+    } else {
+        cc->tail = sc;
+    }
+    cc->head = sc;
+}
+
+/*
+ * Evict the least recently used cases until the data fits the budget.
+ * The most recently used case is always kept, even if its own data is
+ * over budget. Nothing is evicted during a transaction because the
+ * queued writes point to the work buffers of the controls.
+ */
+static void case_cache_trim_l(struct config_mgr *cm)
+{
+    struct case_cache *cc = &cm->case_cache;
+    struct scase *sc;
+
+    if (cm->txn.active) {
+        return;
+    }
+
+    while ((cc->bytes > cc->budget) && (cc->tail != cc->head)) {
+        sc = cc->tail;
+        ALOGV("Evict case '%s' (%u bytes)", sc->name, sc->data_bytes);
+        case_cache_unlink_l(cc, sc);
+        free_case_data(sc);
+        cc->bytes -= sc->data_bytes;
+        sc->data_bytes = 0;
+        sc->loaded = false;
+    }
+}
+
+/*
+ * Load the lazy data of a case and make it the most recently used. The
+ * controls of a cached case are checked again because a control that was
+ * not found before may have been added since.
+ */
+static int case_cache_load_l(struct config_mgr *cm, struct scase *sc)
+{
+    struct case_cache *cc = &cm->case_cache;
+    struct ctl *c = sc->ctl_array.ctls;
+    uint32_t bytes = 0;
+    unsigned int vnum;
+    int i;
+    int ret = 0;
+
+    for (i = 0; i < (int)sc->ctl_array.count; ++i, ++c) {
+        if (!c->info->lazy || lazy_data_loaded(c)) {
+            continue;
+        }
+
+        ret = ctl_open(cm, c);
+        if (ret == -ENOENT) {
+            ret = 0;    /* skipped when the case is applied */
+            continue;
+        } else if (ret != 0) {
+            break;
+        }
+
+        if (c->info->type != MIXER_CTL_TYPE_BYTE) {
+            continue;
+        }
+
+        vnum = mixer_ctl_get_num_values(ctl_get_ptr(cm, &c->ref));
+        ret = make_byte_work_buffer(c, vnum);
+        if (ret != 0) {
+            break;
+        }
+        bytes += c->array_count + vnum;
+    }
+
+    ALOGE_IF(ret != 0, "Failed to load data of case '%s'", sc->name);
+    ALOGV_IF(bytes != 0, "Loaded %u bytes of case '%s'", bytes, sc->name);
+
+    /* Data loaded before a failure is kept, it is valid */
+    if (sc->loaded) {
+        case_cache_unlink_l(cc, sc);
+    }
+    sc->loaded = true;
+    sc->data_bytes += bytes;
+    cc->bytes += bytes;
+    case_cache_push_l(cc, sc);
+    case_cache_trim_l(cm);
+    return ret;
+}
+
+int apply_use_case( const struct hw_stream* stream,
+                    const char *setting,
+                    const char *case_name)
+{
+    struct stream *s = (struct stream *)stream;
+    struct usecase *puc;
+    int usecase_count;
+    struct scase *pcase;
+    int case_count;
+    const struct ctl_segment *segs;
+    struct ctl_segment own;
+    int seg_count;
+    const uint64_t start_ns = time_now_ns();
+    uint32_t usecase_index = UINT32_MAX;
+    uint32_t case_index = UINT32_MAX;
+    uint64_t locked_ns;
+    int ret;
+
+    ALOGV("apply_use_case(%p) %s=%s", stream, setting, case_name);
+
+    /* A reload replaces the use-cases so they are only looked at locked */
+    locked_ns = lock_cm(s->cm, e_config_lock_apply_use_case);
+    puc = s->usecase_array.usecases;
+    usecase_count = s->usecase_array.count;
+
+    for (; usecase_count > 0; usecase_count--, puc++) {
+        if (0 == strcmp(puc->name, setting)) {
+            pcase = puc->case_array.cases;
+            case_count = puc->case_array.count;
+            for(; case_count > 0; case_count--, pcase++) {
+                if (0 == strcmp(pcase->name, case_name)) {
+                    seg_count = get_ctl_segments(&pcase->ctl_array,
+                                                 &pcase->segment_array,
+                                                 &own, &segs);
+                    ret = 0;
+                    if (s->cm->case_cache.budget != 0) {
+                        ret = case_cache_load_l(s->cm, pcase);
+                    }
+                    if (ret == 0) {
+                        apply_segments_l(s->cm, segs, seg_count);
+                    }
+                    usecase_index = puc - s->usecase_array.usecases;
+                    case_index = pcase - puc->case_array.cases;
+                    goto exit;
+                }
+            }
+        }
+    }
+
+    ret = -ENOSYS;      /* use-case not implemented */
+
+exit:
+    unlock_cm(s->cm, e_config_lock_apply_use_case, locked_ns);
+
+    trace_event(s->cm, e_config_trace_use_case, trace_stream_id(s), start_ns,
+                usecase_index, case_index, ret);
+    return ret;
+}
+
+int config_begin_transaction(struct config_mgr *cm)
+{
+    uint64_t locked_ns;
+
+    if (cm == NULL) {
+        return -EINVAL;
+    }
+
+    if (in_transaction(cm)) {
+        ALOGE("Transaction already open");
+        return -EBUSY;
+    }
+
+    locked_ns = lock_cm(cm, e_config_lock_transaction);
+
+    cm->txn.active = true;
+    cm->txn.seq = 0;
+    cm->txn.locked_ns = locked_ns;
+    atomic_store_explicit(&cm->txn_tid, trace_tid(), memory_order_relaxed);
+
+    ALOGV("config_begin_transaction");
+    return 0;
+}
+
+int config_commit(struct config_mgr *cm)
+{
+    const uint64_t start_ns = time_now_ns();
+    uint32_t queued;
+    int written;
+    int ret;
+
+    if ((cm == NULL) || !in_transaction(cm)) {
+        ALOGE("config_commit without a transaction");
+        return -EINVAL;
+    }
+
+    queued = cm->txn.seq;
+    written = txn_flush_l(cm, &ret);
+
+    cm->txn.active = false;
+    case_cache_trim_l(cm);
+    atomic_store_explicit(&cm->txn_tid, 0, memory_order_relaxed);
+    unlock_cm(cm, e_config_lock_transaction, cm->txn.locked_ns);
+
+    ALOGV("config_commit: %u writes queued, %d written", queued, written);
+
+    trace_event(cm, e_config_trace_commit, CONFIG_TRACE_NO_STREAM, start_ns,
+                queued, (uint32_t)written, (uint32_t)ret);
+    return ret;
+}
+
+bool config_batch_parameters(const struct config_mgr *cm)
+{
+    return (cm != NULL) && cm->batch_parameters;
+}
+
+/*********************************************************************
+ * Constants
+ *********************************************************************/
+int get_stream_constant_string(const struct hw_stream *stream,
+                                const char *name, char const **value)
+{
+    struct stream *s = (struct stream *)stream;
+    const struct constant *pc;
+    uint64_t locked_ns;
+    int count;
+    int ret = -ENOSYS;
+
+    /* A reload replaces the array but keeps the old one, see
+     * reload_move_streams(), so the value stays valid after unlocking
+     */
+    locked_ns = lock_cm(s->cm, e_config_lock_get_constant);
+    pc = s->constants_array.constants;
+    for (count = s->constants_array.count; count > 0; --count, ++pc) {
+        if (0 == strcmp(pc->name, name)) {
+            *value = pc->value;
+            ret = 0;
+            break;
+        }
+    }
+    unlock_cm(s->cm, e_config_lock_get_constant, locked_ns);
+
+    return ret;
+}
+
+int get_stream_constant_uint32(const struct hw_stream *stream,
+                                const char *name, uint32_t *value)
+{
+    const char *string = NULL;
+    uint32_t val = 0;
+    int ret = get_stream_constant_string(stream, name, &string);
+
+    if (!ret) {
+        ret = string_to_uint(&val, string);
+        if (!ret) {
+            *value = val;
+        }
+    }
+
+    return ret;
+}
+
+int get_stream_constant_int32(const struct hw_stream *stream,
+                              const char *name, int32_t *value)
+{
+    const char *string = NULL;
+    int val = 0;
+    int ret = get_stream_constant_string(stream, name, &string);
+
+    if (!ret) {
+        ret = string_to_int(&val, string);
+        if (ret != 0) {
+            return ret;
+        }
+        /* pick up out-of-range on 64-bit machines */
+        if ((sizeof(int) > sizeof(int32_t)) &&
+            ((val > 0x7FFFFFFF) || (-val > 0x7FFFFFFF))) {
+            return -EINVAL;
+        }
+        *value = val;
+    }
+
+    return ret;
+}
+
+/*********************************************************************
+ * Config file parsing
+ *
+ * To keep this simple we restrict the order that config file entries
+ * may appear:
+ * - The <mixer> section must always appear first
  * - Paths must be defined before they can be referred to
  *********************************************************************/
 static int parse_mixer_start(struct parse_state *state);
@@ -1110,1970 +3141,3692 @@ static int parse_codec_probe_start(struct parse_state *state);
 static int parse_codec_probe_end(struct parse_state *state);
 static int parse_codec_case_start(struct parse_state *state);
 static int parse_set_start(struct parse_state *state);
+static int parse_path_def_start(struct parse_state *state);
+static int parse_path_def_end(struct parse_state *state);
+static int parse_path_ref_start(struct parse_state *state);
+
+static const struct parse_element elem_table[e_elem_count] = {
+    [e_elem_ctl] =    {
+        .name = "ctl",
+        .valid_attribs = BIT(e_attrib_name) | BIT(e_attrib_val)
+                            | BIT(e_attrib_index) | BIT(e_attrib_file)
+                            | BIT(e_attrib_card),
+        .required_attribs = BIT(e_attrib_name),
+        .valid_subelem = 0,
+        .start_fn = parse_ctl_start,
+        .end_fn = NULL
+        },
+
+    [e_elem_path] =    {
+        .name = "path",
+        .valid_attribs = BIT(e_attrib_name),
+        .required_attribs = BIT(e_attrib_name),
+        .valid_subelem = BIT(e_elem_ctl) | BIT(e_elem_path_ref),
+        .start_fn = parse_path_start,
+        .end_fn = parse_path_end
+        },
+
+    [e_elem_device] =    {
+        .name = "device",
+        .valid_attribs = BIT(e_attrib_name),
+        .required_attribs = BIT(e_attrib_name),
+        .valid_subelem = BIT(e_elem_path),
+        .start_fn = parse_device_start,
+        .end_fn = parse_device_end
+        },
+
+    [e_elem_stream] =    {
+        .name = "stream",
+        .valid_attribs = BIT(e_attrib_name) | BIT(e_attrib_type)
+                            | BIT(e_attrib_dir) | BIT(e_attrib_card) | BIT(e_attrib_cardname)
+                            | BIT(e_attrib_device) | BIT(e_attrib_instances)
+                            | BIT(e_attrib_rate) | BIT(e_attrib_period_size)
+                            | BIT(e_attrib_period_count) | BIT(e_attrib_timeout)
+                            | BIT(e_attrib_route),
+        .required_attribs = BIT(e_attrib_type),
+        .valid_subelem = BIT(e_elem_stream_ctl)
+                            | BIT(e_elem_enable) | BIT(e_elem_disable)
+                            | BIT(e_elem_usecase) | BIT(e_elem_set),
+        .start_fn = parse_stream_start,
+        .end_fn = parse_stream_end
+        },
+
+    [e_elem_enable] =    {
+        .name = "enable",
+        .valid_attribs = BIT(e_attrib_path),
+        .required_attribs = BIT(e_attrib_path),
+        .valid_subelem = 0,
+        .start_fn = parse_enable_start,
+        .end_fn = NULL
+        },
+
+    [e_elem_disable] =    {
+        .name = "disable",
+        .valid_attribs = BIT(e_attrib_path),
+        .required_attribs = BIT(e_attrib_path),
+        .valid_subelem = 0,
+        .start_fn = parse_disable_start,
+        .end_fn = NULL
+        },
+
+    [e_elem_case] =    {
+        .name = "case",
+        .valid_attribs = BIT(e_attrib_name),
+        .required_attribs = BIT(e_attrib_name),
+        .valid_subelem = BIT(e_elem_ctl) | BIT(e_elem_path_ref),
+        .start_fn = parse_case_start,
+        .end_fn = parse_case_end
+        },
+
+    [e_elem_usecase] =    {
+        .name = "usecase",
+        .valid_attribs = BIT(e_attrib_name),
+        .required_attribs = BIT(e_attrib_name),
+        .valid_subelem = BIT(e_elem_case),
+        .start_fn = parse_usecase_start,
+        .end_fn = parse_usecase_end
+        },
+
+    [e_elem_set] =    {
+        .name = "set",
+        .valid_attribs = BIT(e_attrib_name) | BIT(e_attrib_val),
+        .required_attribs = BIT(e_attrib_name) | BIT(e_attrib_val),
+        .valid_subelem = 0,
+        .start_fn = parse_set_start
+        },
+
+    [e_elem_stream_ctl] =    {
+        .name = "ctl",
+        .valid_attribs = BIT(e_attrib_name) | BIT(e_attrib_function)
+                            | BIT(e_attrib_index) | BIT(e_attrib_card)
+                            | BIT(e_attrib_min) | BIT(e_attrib_max),
+        .required_attribs = BIT(e_attrib_name) | BIT(e_attrib_function),
+        .valid_subelem = 0,
+        .start_fn = parse_stream_ctl_start,
+        .end_fn = NULL
+        },
+
+    [e_elem_init] =     {
+        .name = "init",
+        .valid_attribs = BIT(e_attrib_write),
+        .required_attribs = 0,
+        .valid_subelem = BIT(e_elem_ctl),
+        .start_fn = parse_init_start,
+        .end_fn = parse_init_end
+        },
+
+    [e_elem_pre_init] =     {
+        .name = "pre_init",
+        .valid_attribs = BIT(e_attrib_write),
+        .required_attribs = 0,
+        .valid_subelem = BIT(e_elem_ctl),
+        .start_fn = parse_preinit_start,
+        .end_fn = parse_preinit_end
+        },
+
+    [e_elem_mixer] =    {
+        .name = "mixer",
+        .valid_attribs = BIT(e_attrib_name) | BIT(e_attrib_card)
+                            | BIT(e_attrib_timeout) | BIT(e_attrib_route)
+                            | BIT(e_attrib_refresh)
+                            | BIT(e_attrib_case_cache)
+                            | BIT(e_attrib_parameters),
+        .required_attribs = 0,
+        .valid_subelem = BIT(e_elem_pre_init) | BIT(e_elem_init),
+        .start_fn = parse_mixer_start,
+        .end_fn = parse_mixer_end
+        },
+
+    [e_elem_audiohal] =    {
+        .name = "audiohal",
+        .valid_attribs = 0,
+        .required_attribs = 0,
+        .valid_subelem = BIT(e_elem_mixer) | BIT(e_elem_codec_probe),
+        .start_fn = NULL,
+        .end_fn = NULL
+        },
+
+    [e_elem_codec_probe] =    {
+        .name = "codec_probe",
+        .valid_attribs = BIT(e_attrib_file) | BIT(e_attrib_timeout),
+        .required_attribs = BIT(e_attrib_file),
+        .valid_subelem = BIT(e_elem_codec_case),
+        .start_fn = parse_codec_probe_start,
+        .end_fn = parse_codec_probe_end
+        },
+
+    [e_elem_codec_case] =    {
+        .name = "case",
+        .valid_attribs = BIT(e_attrib_name) | BIT(e_attrib_file),
+        .required_attribs = BIT(e_attrib_name) | BIT(e_attrib_file),
+        .valid_subelem = 0,
+        .start_fn = parse_codec_case_start,
+        .end_fn = NULL
+        },
+
+    [e_elem_path_def] =    {
+        .name = "path_def",
+        .valid_attribs = BIT(e_attrib_name),
+        .required_attribs = BIT(e_attrib_name),
+        .valid_subelem = BIT(e_elem_ctl) | BIT(e_elem_path_ref),
+        .start_fn = parse_path_def_start,
+        .end_fn = parse_path_def_end
+        },
+
+    [e_elem_path_ref] =    {
+        .name = "path_ref",
+        .valid_attribs = BIT(e_attrib_name),
+        .required_attribs = BIT(e_attrib_name),
+        .valid_subelem = 0,
+        .start_fn = parse_path_ref_start,
+        .end_fn = NULL
+        }
+};
+
+static const struct parse_attrib attrib_table[e_attrib_count] = {
+    [e_attrib_name] =       {"name"},
+    [e_attrib_val] =        {"val"},
+    [e_attrib_path] =       {"path"},
+    [e_attrib_function] =   {"function"},
+    [e_attrib_type] =       {"type"},
+    [e_attrib_index] =      {"index"},
+    [e_attrib_dir] =        {"dir"},
+    [e_attrib_card] =       {"card"},
+    [e_attrib_cardname] =   {"cardname"},
+    [e_attrib_device] =     {"device"},
+    [e_attrib_instances] =  {"instances"},
+    [e_attrib_rate] =       {"rate"},
+    [e_attrib_period_size] = {"period_size"},
+    [e_attrib_period_count] = {"period_count"},
+    [e_attrib_min] = {"min"},
+    [e_attrib_max] = {"max"},
+    [e_attrib_file] = {"file"},
+    [e_attrib_timeout] = {"timeout"},
+    [e_attrib_route] = {"route"},
+    [e_attrib_write] = {"write"},
+    [e_attrib_refresh] = {"refresh"},
+    [e_attrib_case_cache] = {"case_cache"},
+    [e_attrib_parameters] = {"parameters"}
+ };
+
+static const struct parse_device device_table[] = {
+    {"global",      0}, /* special dummy device for global settings */
+    {"speaker",     AUDIO_DEVICE_OUT_SPEAKER},
+    {"earpiece",    AUDIO_DEVICE_OUT_EARPIECE},
+    {"headset",     AUDIO_DEVICE_OUT_WIRED_HEADSET},
+    {"headset_in",  AUDIO_DEVICE_IN_WIRED_HEADSET},
+    {"headphone",   AUDIO_DEVICE_OUT_WIRED_HEADPHONE},
+    {"sco",         AUDIO_DEVICE_OUT_ALL_SCO},
+    {"sco_in",      AUDIO_DEVICE_IN_ALL_SCO},
+    {"a2dp",        AUDIO_DEVICE_OUT_ALL_A2DP},
+    {"usb",         AUDIO_DEVICE_OUT_ALL_USB},
+    {"mic",         AUDIO_DEVICE_IN_BUILTIN_MIC},
+    {"back mic",    AUDIO_DEVICE_IN_BACK_MIC},
+    {"voice",       AUDIO_DEVICE_IN_VOICE_CALL},
+    {"aux",         AUDIO_DEVICE_IN_AUX_DIGITAL}
+};
+
+static const char *predefined_path_name_table[] = {
+    [e_path_id_off] = "off",
+    [e_path_id_on] = "on"
+};
+
+static int dyn_array_extend(struct dyn_array *array)
+{
+    const size_t elem_size = array->elem_size;
+    const uint new_count = array->count + 1;
+    uint32_t max_count = array->max_count;
+    size_t old_size, new_size;
+    void *p;
+    uint8_t *pbyte;
+
+    if (new_count > max_count) {
+        /* Growing geometrically keeps the total copying linear in the
+         * final size of the array. Elements are indexed with int so the
+         * capacity is kept within INT_MAX */
+        if (max_count < DYN_ARRAY_GRANULE) {
+            max_count = DYN_ARRAY_GRANULE;
+        } else if (max_count > (INT_MAX / 2)) {
+            return -ENOMEM;
+        } else {
+            max_count *= 2;
+        }
+
+        if (max_count > (SIZE_MAX / elem_size)) {
+            return -ENOMEM;
+        }
+
+        old_size = (size_t)array->max_count * elem_size;
+        new_size = (size_t)max_count * elem_size;
+
+        p = realloc(array->data, new_size);
+        if (!p) {
+            return -ENOMEM;
+        }
+
+        pbyte = p;
+        memset(pbyte + old_size, 0, new_size - old_size);
+
+        array->data = p;
+        array->max_count = max_count;
+    }
+
+    array->count = new_count;
+    return 0;
+}
+
+static void dyn_array_fix(struct dyn_array *array)
+{
+    /* Fixes the allocated memory to exactly the required length
+     * This will always be a shrink, discarding the spare space left
+     * by the geometric growth */
+    const size_t size = (size_t)array->count * array->elem_size;
+    void *p;
+
+    if (array->count == array->max_count) {
+        return;
+    }
+
+    if (size == 0) {
+        free(array->data);
+        array->data = NULL;
+        array->max_count = 0;
+        return;
+    }
+
+    p = realloc(array->data, size);
+    if (p) {
+        array->data = p;
+        array->max_count = array->count;
+    }
+}
+
+static void dyn_array_free(struct dyn_array *array)
+{
+    free(array->data);
+}
+
+/* Point each struct ctl at its entry in the info array, which may move */
+static void link_ctl_infos(struct dyn_array *array,
+                           struct dyn_array *info_array)
+{
+    uint i;
+
+    for (i = 0; i < array->count; ++i) {
+        array->ctls[i].info = &info_array->ctl_infos[i];
+    }
+}
+
+static struct ctl* new_ctl(struct dyn_array *array,
+                           struct dyn_array *info_array, const char *name)
+{
+    const struct ctl_info *old_infos = info_array->ctl_infos;
+    struct ctl *c;
+
+    if (dyn_array_extend(info_array) < 0) {
+        return NULL;
+    }
+
+    if (dyn_array_extend(array) < 0) {
+        --info_array->count;
+        return NULL;
+    }
+
+    if (info_array->ctl_infos != old_infos) {
+        link_ctl_infos(array, info_array);
+    }
+
+    /* The entries may have been used by a ctl that failed to parse */
+    c = &array->ctls[array->count - 1];
+    memset(c, 0, sizeof(*c));
+    c->info = &info_array->ctl_infos[info_array->count - 1];
+    memset(c->info, 0, sizeof(*c->info));
+    ctl_ref_init(&c->ref);
+    c->index = INVALID_CTL_INDEX;
+    c->info->name = name;
+    c->info->type = MIXER_CTL_TYPE_UNKNOWN;
+    return c;
+}
+
+static void compress_ctl_arrays(struct dyn_array *array,
+                                struct dyn_array *info_array)
+{
+    dyn_array_fix(array);
+    dyn_array_fix(info_array);
+    link_ctl_infos(array, info_array);
+}
+
+/*
+ * While parsing, a run of the own controls of a path or case is held in
+ * its segment_array with a NULL ctls because the ctl array can still move.
+ * Add the run of the controls since the last <path_ref>.
+ */
+static int add_own_ctl_segment(const struct dyn_array *ctl_array,
+                               struct dyn_array *segment_array)
+{
+    const struct ctl_segment *seg = segment_array->segments;
+    int own = 0;
+    uint i;
+
+    for (i = 0; i < segment_array->count; ++i) {
+        if (seg[i].ctls == NULL) {
+            own += seg[i].count;
+        }
+    }
+
+    if ((int)ctl_array->count == own) {
+        return 0;
+    }
+
+    if (dyn_array_extend(segment_array) < 0) {
+        return -ENOMEM;
+    }
+
+    segment_array->segments[segment_array->count - 1].ctls = NULL;
+    segment_array->segments[segment_array->count - 1].count =
+                                                ctl_array->count - own;
+    return 0;
+}
+
+/* Point the runs of own controls into the final ctl array */
+static void fix_ctl_segments(struct dyn_array *ctl_array,
+                             struct dyn_array *segment_array)
+{
+    struct ctl_segment *seg = segment_array->segments;
+    int own = 0;
+    uint i;
+
+    for (i = 0; i < segment_array->count; ++i) {
+        if (seg[i].ctls == NULL) {
+            seg[i].ctls = &ctl_array->ctls[own];
+            own += seg[i].count;
+        }
+    }
+
+    dyn_array_fix(segment_array);
+}
+
+static struct codec_case* new_codec_case(struct dyn_array *array, const char *codec, const char *file)
+{
+    struct codec_case *cc;
+
+    if (dyn_array_extend(array) < 0) {
+        return NULL;
+    }
+
+    cc = &array->codec_cases[array->count - 1];
+    cc->codec_name = codec;
+    cc->file = file;
+
+    return cc;
+}
+
+static void setup_path(struct path *path, int id)
+{
+    path->ctl_array.elem_size = sizeof(struct ctl);
+    path->ctl_info_array.elem_size = sizeof(struct ctl_info);
+    path->segment_array.elem_size = sizeof(struct ctl_segment);
+    path->id = id;
+}
+
+static struct path* new_path(struct dyn_array *array, int id)
+{
+    struct path *path;
+
+    if (dyn_array_extend(array) < 0) {
+        return NULL;
+    }
+
+    path = &array->paths[array->count - 1];
+    setup_path(path, id);
+    return path;
+}
+
+static void compress_path(struct path *path)
+{
+    compress_ctl_arrays(&path->ctl_array, &path->ctl_info_array);
+    fix_ctl_segments(&path->ctl_array, &path->segment_array);
+}
+
+static struct path_def* new_path_def(struct dyn_array *array,
+                                     const char *name)
+{
+    struct path_def *def;
+
+    if (dyn_array_extend(array) < 0) {
+        return NULL;
+    }
+
+    def = &array->path_defs[array->count - 1];
+    setup_path(&def->path, -1);
+    def->name = strdup(name);
+    if (!def->name) {
+        return NULL;
+    }
+
+    return def;
+}
+
+static struct scase* new_case(struct dyn_array *array, const char *name)
+{
+    struct scase *sc;
+
+    if (dyn_array_extend(array) < 0) {
+        return NULL;
+    }
+
+    sc = &array->cases[array->count - 1];
+    sc->ctl_array.elem_size = sizeof(struct ctl);
+    sc->ctl_info_array.elem_size = sizeof(struct ctl_info);
+    sc->segment_array.elem_size = sizeof(struct ctl_segment);
+    sc->name = strdup(name);
+    if (!sc->name) {
+        return NULL;
+    }
+
+    return sc;
+}
+
+static void compress_probe(struct codec_probe *cp)
+{
+    dyn_array_fix(&cp->codec_case_array);
+}
+
+static void compress_case(struct scase *sc)
+{
+    compress_ctl_arrays(&sc->ctl_array, &sc->ctl_info_array);
+    fix_ctl_segments(&sc->ctl_array, &sc->segment_array);
+}
+
+static struct usecase* new_usecase(struct dyn_array *array, const char *name)
+{
+    struct usecase *puc;
+
+    if (dyn_array_extend(array) < 0) {
+        return NULL;
+    }
+
+    puc = &array->usecases[array->count - 1];
+    puc->case_array.elem_size = sizeof(struct scase);
+    puc->name = strdup(name);
+    if (!puc->name) {
+        return NULL;
+    }
+
+    return puc;
+}
+
+static void compress_usecase(struct usecase *puc)
+{
+    dyn_array_fix(&puc->case_array);
+}
+
+static struct constant* new_constant(struct dyn_array *array,
+                                     const char *name, const char *val)
+{
+    struct constant *pc;
+
+    if (dyn_array_extend(array) < 0) {
+        return NULL;
+    }
+
+    pc = &array->constants[array->count - 1];
+    pc->name = name;
+    pc->value = val;
+    return pc;
+}
+
+static struct device* new_device(struct dyn_array *array, uint32_t type)
+{
+    struct device *d;
+
+    if (dyn_array_extend(array) < 0) {
+        return NULL;
+    }
+
+    d = &array->devices[array->count - 1];
+    d->path_array.elem_size = sizeof(struct path);
+    d->type = type;
+    return d;
+}
+
+static void compress_device(struct device *d)
+{
+    dyn_array_fix(&d->path_array);
+}
+
+static struct stream* new_stream(struct dyn_array *array, struct config_mgr *cm)
+{
+    struct stream *s;
+
+    if (dyn_array_extend(array) < 0) {
+        return NULL;
+    }
+
+    s = &array->streams[array->count - 1];
+    s->usecase_array.elem_size = sizeof(struct usecase);
+    s->constants_array.elem_size = sizeof(struct constant);
+    s->cm = cm;
+    s->enable_path = -1;    /* by default no special path to invoke */
+    s->disable_path = -1;
+    ctl_ref_init(&s->controls.volume_left.ref);
+    ctl_ref_init(&s->controls.volume_right.ref);
+    return s;
+}
+
+static void compress_stream(struct stream *s)
+{
+    dyn_array_fix(&s->usecase_array);
+    dyn_array_fix(&s->constants_array);
+}
+
+static int new_name(struct dyn_array *array, const char* name)
+{
+    int i;
+
+    if (dyn_array_extend(array) < 0) {
+        return -ENOMEM;
+    }
+
+    i = array->count - 1;
+    array->path_names[i] = strdup(name);
+    if (!array->path_names[i]) {
+        return -ENOMEM;
+    }
+
+    return i;
+}
+
+static struct config_mgr* new_config_mgr()
+{
+    struct config_mgr* mgr = calloc(1, sizeof(struct config_mgr));
+    if (!mgr) {
+        return NULL;
+    }
+    mgr->device_array.elem_size = sizeof(struct device);
+    mgr->path_def_array.elem_size = sizeof(struct path_def);
+    mgr->anon_stream_array.elem_size = sizeof(struct stream);
+    mgr->named_stream_array.elem_size = sizeof(struct stream);
+    mgr->txn.write_array.elem_size = sizeof(struct txn_write);
+    mgr->retired_constants_array.elem_size = sizeof(struct dyn_array);
+    mgr->batch.segment_array.elem_size = sizeof(struct ctl_segment);
+    pthread_mutex_init(&mgr->lock, NULL);
+    pthread_mutex_init(&mgr->card_jobs.lock, NULL);
+    pthread_cond_init(&mgr->card_jobs.start, NULL);
+    pthread_cond_init(&mgr->card_jobs.done, NULL);
+#ifdef TINYHAL_CTL_WRITE_STATS
+    pthread_mutex_init(&mgr->write_stats.lock, NULL);
+#endif
+    return mgr;
+}
+
+static void compress_config_mgr(struct config_mgr *mgr)
+{
+    dyn_array_fix(&mgr->device_array);
+    dyn_array_fix(&mgr->path_def_array);
+    dyn_array_fix(&mgr->anon_stream_array);
+    dyn_array_fix(&mgr->named_stream_array);
+}
+
+static int find_path_name(struct parse_state *state, const char *name)
+{
+    struct dyn_array *array = &state->path_name_array;
+    int i;
+
+    for (i = array->count - 1; i >= 0; --i) {
+        if (0 == strcmp(array->path_names[i], name)) {
+            ALOGV("Existing path '%s' id=%d", name, i);
+            return i;   /* found - return existing index */
+        }
+    }
+    return -EINVAL;
+}
+
+static int add_path_name(struct parse_state *state, const char *name)
+{
+    struct dyn_array *array = &state->path_name_array;
+    int index;
+
+    /* Check if already in array */
+    index = find_path_name(state, name);
+    if (index >= 0) {
+        return index;   /* already exists */
+    }
+
+    index = new_name(array, name);
+    if (index < 0) {
+        return -ENOMEM;
+    }
+
+    ALOGV("New path '%s' id=%d", name, index);
+    return index;
+}
+
+static void path_names_free(struct parse_state *state)
+{
+    struct dyn_array *array = &state->path_name_array;
+    int i;
+
+    for (i = array->count - 1; i >= 0; --i) {
+        free((void*)array->path_names[i]);
+    }
+    dyn_array_free(array);
+}
+
+static void codec_probe_free(struct parse_state *state)
+{
+    struct dyn_array *array = &state->init_probe.codec_case_array;
+    int i;
+
+    for (i = array->count - 1; i >= 0; --i) {
+        free((void*)array->codec_cases[i].codec_name);
+        array->codec_cases[i].codec_name = NULL;
+        free((void*)array->codec_cases[i].file);
+        array->codec_cases[i].file = NULL;
+    }
+
+    free((void*)state->init_probe.file);
+    state->init_probe.file = NULL;
+
+    free((void*)state->cur_xml_file);
+    state->cur_xml_file = NULL;
+
+    state->init_probe.new_xml_file = NULL;
+
+    dyn_array_free(array);
+}
+
+static int string_to_uint(uint32_t *result, const char *str)
+{
+    char *endptr;
+    unsigned long int v;
+
+    if (!str) {
+        return -ENOENT;
+    }
+
+    /* return error if not a valid decimal or hex number */
+    v = strtoul(str, &endptr, 0);
+    if ((endptr[0] == '\0') && (endptr != str) && (v <= 0xFFFFFFFF)) {
+        *result = (uint32_t)v;
+        return 0;
+    } else {
+        ALOGE("'%s' not a valid number", str);
+        return -EINVAL;
+    }
+}
+
+static int string_to_int(int *result, const char *str)
+{
+    char *endptr;
+    unsigned long int v;
+
+    if (!str) {
+        return -ENOENT;
+    }
+
+    /* return error if not a valid decimal or hex number */
+    v = strtol(str, &endptr, 0);
+    if ((endptr[0] == '\0') && (endptr != str)) {
+        *result = v;
+        return 0;
+    } else {
+        ALOGE("'%s' not a valid signed integer", str);
+        return -EINVAL;
+    }
+}
+
+static int attrib_to_uint(uint32_t *result, struct parse_state *state,
+                                enum attrib_index index)
+{
+    const char *str = state->attribs.value[index];
+    return string_to_uint(result, str);
+}
+
+static int attrib_to_int(int *result, struct parse_state *state,
+                                enum attrib_index index)
+{
+    const char *str = state->attribs.value[index];
+    return string_to_int(result, str);
+}
+
+static int make_byte_work_buffer(struct ctl *c,
+                                 uint32_t buffer_size)
+{
+    int ret = 0;
+
+    c->info->buffer = malloc(buffer_size);
+    if (!c->info->buffer) {
+        ALOGE("Failed to allocate work buffer");
+        return -ENOMEM;
+    }
+
+    if (c->info->data_file_name) {
+        ret = get_value_from_file(c, buffer_size);
+    } else {
+        ret = make_byte_array(c, buffer_size);
+    }
+    if (ret != 0) {
+        free(c->info->buffer);
+        c->info->buffer = NULL;
+        return ret;
+    }
+
+    ALOGV("Added ctl '%s' byte array len %d", c->info->name, c->array_count);
+    return 0;
+}
+
+static int get_value_from_file(struct ctl *c, uint32_t vnum)
+{
+    uint32_t data_size;
+    FILE *fp;
+
+    fp = fopen(c->info->data_file_name, "rb");
+    if (fp == 0) {
+        ALOGE("Failed to open %s", c->info->data_file_name);
+        return -EIO;
+    }
+    fseek(fp, 0L, SEEK_END);
+    data_size = (uint32_t) ftell(fp);
+    rewind(fp);
+
+    if (data_size > vnum) {
+        ALOGE("Data size %d exceeded max control size, the first %d bytes are kept",
+               data_size, vnum);
+        c->array_count = vnum;
+    } else {
+        c->array_count = data_size;
+    }
+
+    uint8_t *buffer = malloc(c->array_count);
+    if (!buffer) {
+        ALOGE("Failed to allocate read buffer");
+        fclose(fp);
+        return -ENOMEM;
+    }
+
+    int read = fread((void *)buffer, 1, c->array_count, fp);
+    fclose(fp);
+    if (read < (int)c->array_count) {
+        ALOGE("Failed to get control value: %d", -errno);
+        free(buffer);
+        return -EIO;
+    }
+
+    c->value.data = buffer;
+
+    return 0;
+}
+
+/* Whitespace in a val, XML has already replaced newlines and tabs by spaces */
+static inline bool is_val_space(char c)
+{
+    return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r');
+}
+
+/* Value of each character as a hex digit, 0xFF if it is not one */
+static const uint8_t hex_digit_table[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+/* Value of each character as a base64 digit, 0xFF if it is not one */
+static const uint8_t base64_digit_table[256] = {
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x3E, 0xFF, 0xFF, 0xFF, 0x3F,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E,
+    0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, 0x30, 0x31, 0x32, 0x33, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+static inline int hex_digit_value(char c)
+{
+    const uint8_t v = hex_digit_table[(unsigned char)c];
+    return (v == 0xFF) ? -1 : v;
+}
+
+/*
+ * Parse one entry of a comma-separated byte list in the same forms as
+ * string_to_uint(): decimal, hex with a 0x prefix or octal with a leading
+ * 0. Whitespace around the number is skipped. On success *str points to
+ * the ',' or '\0' after the entry.
+ */
+static int parse_byte_list_entry(const char **str, uint32_t *result)
+{
+    const char *p = *str;
+    const char *digits;
+    uint64_t v = 0;
+    int d;
+
+    while (is_val_space(*p)) {
+        ++p;
+    }
+
+    if ((p[0] == '0') && ((p[1] | 0x20) == 'x') && (hex_digit_value(p[2]) >= 0)) {
+        for (p += 2; (d = hex_digit_value(*p)) >= 0; ++p) {
+            v = (v << 4) | (uint64_t)d;
+            if (v > 0xFFFFFFFF) {
+                return -EINVAL;
+            }
+        }
+    } else if (p[0] == '0') {
+        for (; (*p >= '0') && (*p <= '7'); ++p) {
+            v = (v << 3) | (uint64_t)(*p - '0');
+            if (v > 0xFFFFFFFF) {
+                return -EINVAL;
+            }
+        }
+    } else {
+        for (digits = p; (*p >= '0') && (*p <= '9'); ++p) {
+            v = (v * 10) + (uint64_t)(*p - '0');
+            if (v > 0xFFFFFFFF) {
+                return -EINVAL;
+            }
+        }
+        if (p == digits) {
+            return -EINVAL;
+        }
+    }
+
+    while (is_val_space(*p)) {
+        ++p;
+    }
+
+    if ((*p != ',') && (*p != '\0')) {
+        return -EINVAL;
+    }
+
+    *str = p;
+    *result = (uint32_t)v;
+    return 0;
+}
+
+/*
+ * Parse a val of comma-separated numbers into data. Empty entries are
+ * ignored. Returns the number of bytes, or -E2BIG if there are more than
+ * max.
+ */
+static int parse_byte_list(const char *str, uint8_t *data, uint32_t max)
+{
+    const char *p = str;
+    uint32_t count = 0;
+    uint32_t v;
+
+    while (*p != '\0') {
+        if (*p == ',') {
+            ++p;
+            continue;
+        }
+
+        if (parse_byte_list_entry(&p, &v) != 0) {
+            ALOGE("Invalid byte at offset %u of '%.32s'",
+                  (unsigned int)(p - str), str);
+            return -EINVAL;
+        }
+
+        if (count == max) {
+            return -E2BIG;
+        }
+
+        ALOGE_IF(v > 0xFF, "Byte out of range");
+        data[count++] = (uint8_t)v;
+    }
+
+    return (int)count;
+}
+
+/* Parse a val="hex:..." of pairs of hex digits, whitespace is ignored */
+static int parse_byte_hex(const char *str, uint8_t *data, uint32_t max)
+{
+    const char *p = str;
+    uint32_t count = 0;
+    uint8_t hi, lo;
+
+    for (;;) {
+        while (is_val_space(*p)) {
+            ++p;
+        }
+        if (*p == '\0') {
+            break;
+        }
+
+        /* p[1] is at most the terminating '\0' because p[0] is not */
+        hi = hex_digit_table[(unsigned char)p[0]];
+        lo = hex_digit_table[(unsigned char)p[1]];
+        if ((hi | lo) & 0xF0) {
+            ALOGE("Invalid hex at offset %u of '%.32s'",
+                  (unsigned int)(p - str), str);
+            return -EINVAL;
+        }
+
+        if (count == max) {
+            return -E2BIG;
+        }
+
+        data[count++] = (uint8_t)((hi << 4) | lo);
+        p += 2;
+    }
+
+    return (int)count;
+}
+
+/* Parse a val="base64:..." with optional '=' padding, whitespace is ignored */
+static int parse_byte_base64(const char *str, uint8_t *data, uint32_t max)
+{
+    const char *p = str;
+    uint32_t count = 0;
+    uint32_t bits = 0;
+    uint32_t nbits = 0;
+    uint32_t d0, d1, d2, d3;
+    uint8_t d;
+
+    while ((*p != '\0') && (*p != '=')) {
+        /* Whole groups of 4 digits are decoded together. The lookups stop
+         * at the terminating '\0', which is not a digit.
+         */
+        if ((nbits == 0) && (max - count >= 3)) {
+            d0 = base64_digit_table[(unsigned char)p[0]];
+            d1 = (d0 != 0xFF) ? base64_digit_table[(unsigned char)p[1]] : 0xFF;
+            d2 = (d1 != 0xFF) ? base64_digit_table[(unsigned char)p[2]] : 0xFF;
+            d3 = (d2 != 0xFF) ? base64_digit_table[(unsigned char)p[3]] : 0xFF;
+            if (d3 != 0xFF) {
+                bits = (d0 << 18) | (d1 << 12) | (d2 << 6) | d3;
+                data[count++] = (uint8_t)(bits >> 16);
+                data[count++] = (uint8_t)(bits >> 8);
+                data[count++] = (uint8_t)bits;
+                bits = 0;
+                p += 4;
+                continue;
+            }
+        }
+
+        d = base64_digit_table[(unsigned char)*p];
+        if (d == 0xFF) {
+            if (!is_val_space(*p)) {
+                ALOGE("Invalid base64 at offset %u of '%.32s'",
+                      (unsigned int)(p - str), str);
+                return -EINVAL;
+            }
+            ++p;
+            continue;
+        }
+
+        bits = (bits << 6) | d;
+        nbits += 6;
+        if (nbits >= 8) {
+            if (count == max) {
+                return -E2BIG;
+            }
+            nbits -= 8;
+            data[count++] = (uint8_t)(bits >> nbits);
+            bits &= (1u << nbits) - 1;
+        }
+        ++p;
+    }
+
+    /* a single digit left over is not a whole byte */
+    if (nbits >= 6) {
+        ALOGE("Truncated base64 '%.32s'", str);
+        return -EINVAL;
+    }
+
+    for (; *p != '\0'; ++p) {
+        if ((*p != '=') && !is_val_space(*p)) {
+            ALOGE("Invalid base64 padding '%.32s'", str);
+            return -EINVAL;
+        }
+    }
+
+    return (int)count;
+}
+
+/*
+ * Convert the val string of a BYTE control to its data. The string is
+ * parsed in place in a single pass into a buffer the size of the longest
+ * array that both the string and the control could hold.
+ */
+static int make_byte_array(struct ctl *c, uint32_t vnum)
+{
+    const char *val_str = c->info->lazy ? c->info->lazy_val : c->value.string;
+    int (*parse)(const char *str, uint8_t *data, uint32_t max);
+    const char *p;
+    uint32_t max;
+    size_t len;
+    uint8_t *pdatablock;
+    int count;
+
+    if (c->index >= vnum) {
+        ALOGE("Control index out of range(%u>%u)", c->index, vnum);
+        return -EINVAL;
+    }
+
+    max = vnum - c->index;
+    len = strlen(val_str);
+
+    if (strncmp(val_str, "hex:", 4) == 0) {
+        parse = parse_byte_hex;
+        p = val_str + 4;
+        len = (len - 4) / 2;
+    } else if (strncmp(val_str, "base64:", 7) == 0) {
+        parse = parse_byte_base64;
+        p = val_str + 7;
+        len = ((len - 7) / 4) * 3 + 2;
+    } else {
+        parse = parse_byte_list;
+        p = val_str;
+        len = (len + 1) / 2;    /* every entry but the last has a ',' */
+    }
+
+    if (len < max) {
+        max = len;
+    }
+
+    pdatablock = malloc(max ? max : 1);
+    if (!pdatablock) {
+        ALOGE("Out of memory for control data");
+        return -ENOMEM;
+    }
+
+    count = parse(p, pdatablock, max);
+    if (count == -E2BIG) {
+        ALOGE("Array overflows control (index %u, size %u)", c->index, vnum);
+        count = -EINVAL;
+    } else if (count == 0) {
+        ALOGE("No values for byte array");
+        count = -EINVAL;
+    }
+
+    if (count < 0) {
+        free(pdatablock);
+        return count;
+    }
+
+    c->array_count = (uint32_t)count;
+    if (!c->info->lazy) {
+        free((void *)val_str); /* no need to keep this string now */
+    }
+    c->value.data = pdatablock;
+    return 0;
+}
+
+static const struct parse_device *parse_match_device(const char *name)
+{
+    const struct parse_device *p = &device_table[0];
+    const struct parse_device *p_end =
+            &device_table[ sizeof(device_table) / sizeof(device_table[0]) ];
+
+    for (; p < p_end; ++p) {
+        if (0 == strcmp(name, p->name)) {
+            return p;
+        }
+    }
+
+    return NULL;
+}
+
+static const char *debug_device_to_name(uint32_t device)
+{
+    const struct parse_device *p = &device_table[0];
+    const struct parse_device *p_end =
+            &device_table[ sizeof(device_table) / sizeof(device_table[0]) ];
+
+    /* Assumes device contains a single bitflag plus direction bit */
+
+    for (; p < p_end; ++p) {
+        if (device == p->device) {
+            return p->name;
+        }
+    }
 
-static const struct parse_element elem_table[e_elem_count] = {
-    [e_elem_ctl] =    {
-        .name = "ctl",
-        .valid_attribs = BIT(e_attrib_name) | BIT(e_attrib_val)
-                            | BIT(e_attrib_index) | BIT(e_attrib_file),
-        .required_attribs = BIT(e_attrib_name),
-        .valid_subelem = 0,
-        .start_fn = parse_ctl_start,
-        .end_fn = NULL
-        },
+    return "unknown";
+}
 
-    [e_elem_path] =    {
-        .name = "path",
-        .valid_attribs = BIT(e_attrib_name),
-        .required_attribs = BIT(e_attrib_name),
-        .valid_subelem = BIT(e_elem_ctl),
-        .start_fn = parse_path_start,
-        .end_fn = parse_path_end
-        },
 
-    [e_elem_device] =    {
-        .name = "device",
-        .valid_attribs = BIT(e_attrib_name),
-        .required_attribs = BIT(e_attrib_name),
-        .valid_subelem = BIT(e_elem_path),
-        .start_fn = parse_device_start,
-        .end_fn = parse_device_end
-        },
+/*
+ * Get the index in cm->mixers of the card named by the 'card' attribute of
+ * a <ctl>, opening the card if this is its first control. Without the
+ * attribute the control is on the card of the <mixer> element.
+ */
+static int parse_ctl_card(struct parse_state *state, uint8_t *mixer_idx)
+{
+    struct config_mgr *cm = state->cm;
+    uint32_t card;
+    unsigned int i;
 
-    [e_elem_stream] =    {
-        .name = "stream",
-        .valid_attribs = BIT(e_attrib_name) | BIT(e_attrib_type)
-                            | BIT(e_attrib_dir) | BIT(e_attrib_card) | BIT(e_attrib_cardname)
-                            | BIT(e_attrib_device) | BIT(e_attrib_instances)
-                            | BIT(e_attrib_rate) | BIT(e_attrib_period_size)
-                            | BIT(e_attrib_period_count),
-        .required_attribs = BIT(e_attrib_type),
-        .valid_subelem = BIT(e_elem_stream_ctl)
-                            | BIT(e_elem_enable) | BIT(e_elem_disable)
-                            | BIT(e_elem_usecase) | BIT(e_elem_set),
-        .start_fn = parse_stream_start,
-        .end_fn = parse_stream_end
-        },
+    *mixer_idx = 0;
 
-    [e_elem_enable] =    {
-        .name = "enable",
-        .valid_attribs = BIT(e_attrib_path),
-        .required_attribs = BIT(e_attrib_path),
-        .valid_subelem = 0,
-        .start_fn = parse_enable_start,
-        .end_fn = NULL
-        },
+    switch (attrib_to_uint(&card, state, e_attrib_card)) {
+    case -ENOENT:
+        return 0;
+    case 0:
+        break;
+    default:
+        ALOGE("Invalid ctl card");
+        return -EINVAL;
+    }
 
-    [e_elem_disable] =    {
-        .name = "disable",
-        .valid_attribs = BIT(e_attrib_path),
-        .required_attribs = BIT(e_attrib_path),
-        .valid_subelem = 0,
-        .start_fn = parse_disable_start,
-        .end_fn = NULL
-        },
+    if (cm->mixer_count == 0) {
+        ALOGE("ctl card %u used before <mixer>", card);
+        return -EINVAL;
+    }
 
-    [e_elem_case] =    {
-        .name = "case",
-        .valid_attribs = BIT(e_attrib_name),
-        .required_attribs = BIT(e_attrib_name),
-        .valid_subelem = BIT(e_elem_ctl),
-        .start_fn = parse_case_start,
-        .end_fn = parse_case_end
-        },
+    for (i = 0; i < cm->mixer_count; ++i) {
+        if (cm->mixers[i].card == card) {
+            *mixer_idx = i;
+            return 0;
+        }
+    }
+
+    if (cm->mixer_count == MAX_MIXERS) {
+        ALOGE("Too many cards, max %u", MAX_MIXERS);
+        return -EINVAL;
+    }
+
+    ALOGV("Opening mixer card %u", card);
+
+    cm->mixers[i].mixer = mixer_open(card);
+    if (!cm->mixers[i].mixer) {
+        ALOGE("Failed to open mixer card %u", card);
+        return -EINVAL;
+    }
+
+    cm->mixers[i].card = card;
+    cm->mixer_count = i + 1;
+    *mixer_idx = i;
+    return 0;
+}
+
+static int parse_ctl_start(struct parse_state *state)
+{
+    const char *name = strdup(state->attribs.value[e_attrib_name]);
+    struct dyn_array *array;
+    struct dyn_array *info_array;
+    struct config_phase_stats *prev_phase;
+    struct ctl *c = NULL;
+    uint8_t mixer_idx;
+    int ret;
+
+    if (state->current.path) {
+        ALOGV("parse_ctl_start:path ctl");
+        array = &state->current.path->ctl_array;
+        info_array = &state->current.path->ctl_info_array;
+    } else {
+        ALOGV("parse_ctl_start:case ctl");
+        array = &state->current.scase->ctl_array;
+        info_array = &state->current.scase->ctl_info_array;
+    }
+
+    if (!name) {
+        return -ENOMEM;
+    }
+
+    ret = parse_ctl_card(state, &mixer_idx);
+    if (ret != 0) {
+        goto fail;
+    }
+
+    c = new_ctl(array, info_array, name);
+    if (c == NULL) {
+        ret = -ENOMEM;
+        goto fail;
+    }
+    c->ref.mixer = mixer_idx;
+    c->info->lazy = !state->current.path && (state->cm->case_cache.budget != 0);
+
+    if (attrib_to_uint(&c->index, state, e_attrib_index) == -EINVAL) {
+        ALOGE("Invalid ctl index");
+        ret = -EINVAL;
+        goto fail;
+    }
+
+    const char *filename = state->attribs.value[e_attrib_file];
+    if (filename) {
+        c->info->data_file_name = strdup(filename);
+        if (!c->info->data_file_name) {
+            ret = -ENOMEM;
+            goto fail;
+        }
+    } else {
+        c->value.string = strdup(state->attribs.value[e_attrib_val]);
+        if(!c->value.string) {
+            ret = -ENOMEM;
+            goto fail;
+        }
+    }
+
+    prev_phase = enter_phase(state->cm, &state->cm->boot_stats.resolve);
+    ret = ctl_open(state->cm, c);
+    enter_phase(state->cm, prev_phase);
+
+    if (ret == -ENOENT) {
+        /* control not found, just ignore and do lazy open when it's used */
+        return 0;
+    } else {
+        return ret;
+    }
+
+fail:
+    if (c) {
+        /* c is the last entry of the arrays, remove it again */
+        free((void *)c->info->data_file_name);
+        free((void *)c->value.string);
+        --array->count;
+        --info_array->count;
+    }
+    free((void *)name);
+    return ret;
+}
+
+static int parse_codec_case_start(struct parse_state * state)
+{
+    const char *codec = strdup(state->attribs.value[e_attrib_name]);
+    const char *file = state->attribs.value[e_attrib_file];
+    struct dyn_array *array = &state->current.codec_probe->codec_case_array;
+    struct codec_case  *cc = NULL;
+    int ret = 0;
+
+    while (isspace(*file)) {
+        ++file;
+    }
+
+    if (file[0] == '/') {
+        /* Absolute path: use as-is. */
+        file = strdup(file);
+    } else {
+        /* Relative to location of current XML file: get full path. */
+        file = join_paths(state->cur_xml_file, file, 1);
+    }
+
+    if (!file) {
+        return -ENOMEM;
+    }
+
+    cc = new_codec_case(array, codec, file);
+    if (cc == NULL) {
+        ret = -ENOMEM;
+        free((void*)codec);
+        free((void*)file);
+    }
+
+    return ret;
+}
+
+/* Parse the write attribute of <init> and <pre_init> */
+static int parse_init_write(struct parse_state *state, bool *write_changed)
+{
+    const char *write = state->attribs.value[e_attrib_write];
+
+    *write_changed = false;
+
+    if (write == NULL) {
+        return 0;
+    }
+
+    if (strcmp(write, "changed") == 0) {
+        *write_changed = true;
+    } else if (strcmp(write, "always") != 0) {
+        ALOGE("'%s' is not a valid write", write);
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+static int parse_init_start(struct parse_state *state)
+{
+    /* The <init> section inside <mixer> is really just a
+     * path that we only use once. We re-use the parsing of
+     * <ctl> entries by creating a temporary path which we
+     * apply at the end of parsing and then discard
+     */
+    if (parse_init_write(state, &state->init_write_changed) != 0) {
+        return -EINVAL;
+    }
+
+    state->current.path = &state->init_path;
+
+    /* Don't allow <pre_init> or another <init> to follow this */
+    state->stack.entry[state->stack.index - 1].valid_subelem &=
+        ~(BIT(e_elem_pre_init) | BIT(e_elem_init));
+
+    ALOGV("Added init path");
+    return 0;
+}
+
+static int parse_init_end(struct parse_state *state)
+{
+    compress_path(state->current.path);
+    state->current.path = NULL;
+    return 0;
+}
+
+static int parse_preinit_start(struct parse_state *state)
+{
+    /* This is handled the same way as <init> section except that
+     * when we get the end tag we immediately process the settings
+     * before parsing the rest of the config.
+     */
+    if (parse_init_write(state, &state->preinit_write_changed) != 0) {
+        return -EINVAL;
+    }
+
+    state->current.path = &state->preinit_path;
+
+    ALOGV("Started <pre_init>");
+    return 0;
+}
+
+static int parse_preinit_end(struct parse_state *state)
+{
+    struct config_mgr_boot_stats *stats = &state->cm->boot_stats;
+    struct config_phase_stats *prev_phase;
+    struct config_mixer *m;
+    unsigned int i, n;
+    int ret = 0;
+
+    state->current.path = NULL;
+
+    if (state->reload) {
+        return 0;
+    }
+
+    ALOGV("Applying <pre_init>");
 
-    [e_elem_usecase] =    {
-        .name = "usecase",
-        .valid_attribs = BIT(e_attrib_name),
-        .required_attribs = BIT(e_attrib_name),
-        .valid_subelem = BIT(e_elem_case),
-        .start_fn = parse_usecase_start,
-        .end_fn = parse_usecase_end
-        },
+    n = stats->preinit_count++;
+    if (n >= CONFIG_MGR_MAX_PREINIT_STATS) {
+        n = CONFIG_MGR_MAX_PREINIT_STATS - 1;
+    }
 
-    [e_elem_set] =    {
-        .name = "set",
-        .valid_attribs = BIT(e_attrib_name) | BIT(e_attrib_val),
-        .required_attribs = BIT(e_attrib_name) | BIT(e_attrib_val),
-        .valid_subelem = 0,
-        .start_fn = parse_set_start
-        },
+    /* Execute the pre_init commands now */
+    prev_phase = enter_phase(state->cm, &stats->preinit[n]);
+    if (state->preinit_write_changed) {
+        apply_changed_ctls_l(state->cm, &state->preinit_path);
+    } else {
+        apply_path_l(state->cm, &state->preinit_path);
+    }
 
-    [e_elem_stream_ctl] =    {
-        .name = "ctl",
-        .valid_attribs = BIT(e_attrib_name) | BIT(e_attrib_function)
-                            | BIT(e_attrib_index)
-                            | BIT(e_attrib_min) | BIT(e_attrib_max),
-        .required_attribs = BIT(e_attrib_name) | BIT(e_attrib_function),
-        .valid_subelem = 0,
-        .start_fn = parse_stream_ctl_start,
-        .end_fn = NULL
-        },
+    enter_phase(state->cm, &stats->new_ctls);
+#if !defined(TINYALSA_NO_ADD_NEW_CTRLS) && !defined(TINYALSA_NO_CTL_GET_ID)
+    if (state->refresh_add) {
+        /* Only fetch the controls added by the pre_init. The controls
+         * already known keep their ids
+         */
+        for (i = 0; i < state->cm->mixer_count; ++i) {
+            mixer_add_new_ctls(state->cm->mixers[i].mixer);
+        }
+        enter_phase(state->cm, prev_phase);
+        return 0;
+    }
+#endif
 
-    [e_elem_init] =     {
-        .name = "init",
-        .valid_attribs = 0,
-        .required_attribs = 0,
-        .valid_subelem = BIT(e_elem_ctl),
-        .start_fn = parse_init_start,
-        .end_fn = parse_init_end
-        },
+    /* Re-open tinyalsa to pick up any controls added by the pre_init */
+    for (i = 0; i < state->cm->mixer_count; ++i) {
+        m = &state->cm->mixers[i];
+        ctl_name_index_free(&m->name_index);
+        mixer_close(m->mixer);
+        m->mixer = mixer_open(m->card);
+        if (!m->mixer) {
+            ALOGE("Failed to re-open mixer card %u", m->card);
+            ret = -EINVAL;
+            break;
+        }
+    }
+    enter_phase(state->cm, prev_phase);
 
-    [e_elem_pre_init] =     {
-        .name = "pre_init",
-        .valid_attribs = 0,
-        .required_attribs = 0,
-        .valid_subelem = BIT(e_elem_ctl),
-        .start_fn = parse_preinit_start,
-        .end_fn = parse_preinit_end
-        },
+    return ret;
+}
 
-    [e_elem_mixer] =    {
-        .name = "mixer",
-        .valid_attribs = BIT(e_attrib_name) | BIT(e_attrib_card),
-        .required_attribs = 0,
-        .valid_subelem = BIT(e_elem_pre_init) | BIT(e_elem_init),
-        .start_fn = parse_mixer_start,
-        .end_fn = parse_mixer_end
-        },
+static char *probe_trim_spaces(char *str)
+{
+    int len;
+    char *end;
 
-    [e_elem_audiohal] =    {
-        .name = "audiohal",
-        .valid_attribs = 0,
-        .required_attribs = 0,
-        .valid_subelem = BIT(e_elem_mixer) | BIT(e_elem_codec_probe),
-        .start_fn = NULL,
-        .end_fn = NULL
-        },
+    while(isspace(*str))
+        ++str;
 
-    [e_elem_codec_probe] =    {
-        .name = "codec_probe",
-        .valid_attribs = BIT(e_attrib_file),
-        .required_attribs = BIT(e_attrib_file),
-        .valid_subelem = BIT(e_elem_codec_case),
-        .start_fn = parse_codec_probe_start,
-        .end_fn = parse_codec_probe_end
-        },
+    len = strlen(str);
 
-    [e_elem_codec_case] =    {
-        .name = "case",
-        .valid_attribs = BIT(e_attrib_name) | BIT(e_attrib_file),
-        .required_attribs = BIT(e_attrib_name) | BIT(e_attrib_file),
-        .valid_subelem = 0,
-        .start_fn = parse_codec_case_start,
-        .end_fn = NULL
-        }
-};
+    if(!len)
+        return str;
 
-static const struct parse_attrib attrib_table[e_attrib_count] = {
-    [e_attrib_name] =       {"name"},
-    [e_attrib_val] =        {"val"},
-    [e_attrib_path] =       {"path"},
-    [e_attrib_function] =   {"function"},
-    [e_attrib_type] =       {"type"},
-    [e_attrib_index] =      {"index"},
-    [e_attrib_dir] =        {"dir"},
-    [e_attrib_card] =       {"card"},
-    [e_attrib_cardname] =   {"cardname"},
-    [e_attrib_device] =     {"device"},
-    [e_attrib_instances] =  {"instances"},
-    [e_attrib_rate] =       {"rate"},
-    [e_attrib_period_size] = {"period_size"},
-    [e_attrib_period_count] = {"period_count"},
-    [e_attrib_min] = {"min"},
-    [e_attrib_max] = {"max"},
-    [e_attrib_file] = {"file"}
- };
+    end = str + len -1;
+    while ((end > str) && isspace(*end))
+        end--;
+    *(end + 1) = '\0';
 
-static const struct parse_device device_table[] = {
-    {"global",      0}, /* special dummy device for global settings */
-    {"speaker",     AUDIO_DEVICE_OUT_SPEAKER},
-    {"earpiece",    AUDIO_DEVICE_OUT_EARPIECE},
-    {"headset",     AUDIO_DEVICE_OUT_WIRED_HEADSET},
-    {"headset_in",  AUDIO_DEVICE_IN_WIRED_HEADSET},
-    {"headphone",   AUDIO_DEVICE_OUT_WIRED_HEADPHONE},
-    {"sco",         AUDIO_DEVICE_OUT_ALL_SCO},
-    {"sco_in",      AUDIO_DEVICE_IN_ALL_SCO},
-    {"a2dp",        AUDIO_DEVICE_OUT_ALL_A2DP},
-    {"usb",         AUDIO_DEVICE_OUT_ALL_USB},
-    {"mic",         AUDIO_DEVICE_IN_BUILTIN_MIC},
-    {"back mic",    AUDIO_DEVICE_IN_BACK_MIC},
-    {"voice",       AUDIO_DEVICE_IN_VOICE_CALL},
-    {"aux",         AUDIO_DEVICE_IN_AUX_DIGITAL}
-};
+    return str;
+}
 
-static const char *predefined_path_name_table[] = {
-    [e_path_id_off] = "off",
-    [e_path_id_on] = "on"
-};
 
-static int dyn_array_extend(struct dyn_array *array)
+static int probe_config_file(struct parse_state *state)
 {
-    const uint elem_size = array->elem_size;
-    const uint new_count = array->count + 1;
-    uint max_count = array->max_count;
-    uint old_size, new_size;
-    void *p;
-    uint8_t *pbyte;
+    int i;
+    char buf[40], *codec;
+    FILE *fp;
+    struct path_wait wait = PATH_WAIT_INIT;
+    uint64_t deadline_ns = 0;
+    int ret;
 
-    if (new_count > max_count) {
-        if (max_count > 0xFFFF - DYN_ARRAY_GRANULE) {
-            return -ENOMEM;
+    ALOGV("+probe_config_file");
+
+    if (state->init_probe.timeout_ms != WAIT_FOREVER) {
+        deadline_ns = time_now_ns() +
+                      ((uint64_t)state->init_probe.timeout_ms * 1000000ULL);
+    }
+
+    /* The file might not exist yet if the driver is still probing */
+    fp = fopen(state->init_probe.file, "r");
+    while (fp == NULL) {
+        if (wait_for_path_change(&wait, state->init_probe.file,
+                                 deadline_ns) != 0) {
+            ALOGE("Timed out waiting for codec probe file %s",
+                  state->init_probe.file);
+            path_wait_close(&wait);
+            return -ETIMEDOUT;
         }
+        fp = fopen(state->init_probe.file, "r");
+    }
+    path_wait_close(&wait);
+
+    if (fgets(buf,sizeof(buf),fp) == NULL) {
+        ALOGE("I/O error reading codec probe file");
+        ret = -EIO;
+        goto exit;
+    }
 
-        old_size = max_count * elem_size;
-        max_count += DYN_ARRAY_GRANULE;
-        new_size = max_count * elem_size;
+    codec = probe_trim_spaces(buf);
+    state->init_probe.new_xml_file = NULL;
 
-        p = realloc(array->data, new_size);
-        if (!p) {
-            return -ENOMEM;
+    for (i = 0; i < (int)state->init_probe.codec_case_array.count; ++i)
+    {
+        if (strcmp(codec, state->init_probe.codec_case_array.codec_cases[i].codec_name) == 0)
+        {
+            break;
         }
+    }
 
-        pbyte = p;
-        memset(pbyte + old_size, 0, new_size - old_size);
+    if (i == (int)state->init_probe.codec_case_array.count) {
+        ALOGE("Codec probe file not found");
+        ret = 0;
+        goto exit;
+    }
 
-        array->data = p;
-        array->max_count = max_count;
+    state->init_probe.new_xml_file = state->init_probe.codec_case_array.codec_cases[i].file;
+
+    if (strcmp(state->init_probe.new_xml_file, state->cur_xml_file) == 0) {
+        /* There is no new xml file to redirect */
+        state->init_probe.new_xml_file = NULL;
+        XML_StopParser(state->parser,false);
+        ALOGE("A codec probe case can't redirect to its own config file");
+        ret = -EINVAL;
+    } else {
+        /*
+         * We are stopping the Parser as we got new codec xml file
+         * and we will restart the parser with that new file
+         */
+        ALOGV("Got new config file %s", state->init_probe.new_xml_file);
+        XML_StopParser(state->parser,XML_TRUE);
+        ret = 0;
     }
 
-    array->count = new_count;
-    return 0;
+exit:
+    fclose(fp);
+
+    return ret;
 }
 
-static void dyn_array_fix(struct dyn_array *array)
+static int parse_codec_probe_start(struct parse_state *state)
 {
-    /* Fixes the allocated memory to exactly the required length
-     * This will always be a shrink, discarding granular allocations
-     * that we don't need */
-    const uint size = array->count * array->elem_size;
-    void *p = realloc(array->data, size);
+    const char *file = state->attribs.value[e_attrib_file];
+    uint32_t timeout_ms = WAIT_FOREVER;
+    int ret = 0;
 
-    if (p) {
-        array->data = p;
-        array->max_count = array->count;
+    if (attrib_to_uint(&timeout_ms, state, e_attrib_timeout) == -EINVAL) {
+        ALOGE("Invalid codec_probe timeout");
+        return -EINVAL;
     }
-}
 
-static void dyn_array_free(struct dyn_array *array)
-{
-    free(array->data);
+    while (isspace(*file)) {
+        ++file;
+    }
+
+    if (file[0] == '/') {
+        /* Absolute path: use as-is. */
+        file = strdup(file);
+    } else {
+        /* Relative to location of current XML file: get full path. */
+        file = join_paths(state->cur_xml_file, file, 1);
+    }
+
+    if (!file) {
+        return -ENOMEM;
+    }
+
+    if (state->init_probe.file == NULL) {
+        state->init_probe.file = file;
+        state->init_probe.timeout_ms = timeout_ms;
+        state->current.codec_probe = &state->init_probe;
+        ret = 0;
+    } else {
+        ALOGE("The codec_probe block redefined");
+        free((void*)file);
+        ret = -EINVAL;
+    }
+    return ret;
 }
 
-static struct ctl* new_ctl(struct dyn_array *array, const char *name)
+static int parse_codec_probe_end(struct parse_state *state)
 {
-    struct ctl *c;
+    struct config_phase_stats *prev_phase;
+    int ret;
 
-    if (dyn_array_extend(array) < 0) {
-        return NULL;
+    compress_probe(state->current.codec_probe);
+    state->current.codec_probe = NULL;
+
+    /* If the probe file could not be read we fall back to parsing the
+     * current file, but if it never appeared we cannot continue
+     */
+    prev_phase = enter_phase(state->cm, &state->cm->boot_stats.open);
+    ret = probe_config_file(state);
+    enter_phase(state->cm, prev_phase);
+    if (ret == -ETIMEDOUT) {
+        return ret;
     }
 
-    c = &array->ctls[array->count - 1];
-    ctl_ref_init(&c->ref);
-    c->index = INVALID_CTL_INDEX;
-    c->name = name;
-    c->type = MIXER_CTL_TYPE_UNKNOWN;
-    return c;
+    return 0;
 }
 
-static struct codec_case* new_codec_case(struct dyn_array *array, const char *codec, const char *file)
+static int parse_path_start(struct parse_state *state)
 {
-    struct codec_case *cc;
+    const char *name = state->attribs.value[e_attrib_name];
+    struct device *device = state->current.device;
+    struct dyn_array *array = &device->path_array;
+    struct path *path;
+    int id;
 
-    if (dyn_array_extend(array) < 0) {
-        return NULL;
+    id = add_path_name(state, name);
+    if (id < 0) {
+        return id;
     }
 
-    cc = &array->codec_cases[array->count - 1];
-    cc->codec_name = codec;
-    cc->file = file;
+    path = new_path(array, id);
+    if (path == NULL) {
+        return -ENOMEM;
+    }
 
-    return cc;
+    state->current.path = path;
+
+    ALOGV("Added path '%s' id=%d", name, id);
+    return 0;
 }
 
-static struct path* new_path(struct dyn_array *array, int id)
+static int parse_path_end(struct parse_state *state)
 {
-    struct path *path;
+    struct path *path = state->current.path;
 
-    if (dyn_array_extend(array) < 0) {
-        return NULL;
+    if (path->segment_array.count > 0) {
+        if (add_own_ctl_segment(&path->ctl_array,
+                                &path->segment_array) < 0) {
+            return -ENOMEM;
+        }
     }
 
-    path = &array->paths[array->count - 1];
-    path->ctl_array.elem_size = sizeof(struct ctl);
-    path->id = id;
-    return path;
+    /* Free unused memory in the ctl array */
+    compress_path(path);
+    state->current.path = NULL;
+    return 0;
 }
 
-static void compress_path(struct path *path)
+static struct path_def *find_path_def(const struct config_mgr *cm,
+                                      const char *name)
 {
-    dyn_array_fix(&path->ctl_array);
+    struct path_def *def = cm->path_def_array.path_defs;
+    int i;
+
+    for (i = cm->path_def_array.count; i > 0; --i, ++def) {
+        if (strcmp(def->name, name) == 0) {
+            return def;
+        }
+    }
+
+    return NULL;
 }
 
-static struct scase* new_case(struct dyn_array *array, const char *name)
+static int parse_path_def_start(struct parse_state *state)
 {
-    struct scase *sc;
+    const char *name = state->attribs.value[e_attrib_name];
+    struct path_def *def;
 
-    if (dyn_array_extend(array) < 0) {
-        return NULL;
+    if (find_path_def(state->cm, name) != NULL) {
+        ALOGE("Duplicate path_def '%s'", name);
+        return -EINVAL;
     }
 
-    sc = &array->cases[array->count - 1];
-    sc->ctl_array.elem_size = sizeof(struct ctl);
-    sc->name = strdup(name);
-    if (!sc->name) {
-        return NULL;
+    def = new_path_def(&state->cm->path_def_array, name);
+    if (def == NULL) {
+        return -ENOMEM;
     }
 
-    return sc;
-}
+    state->current.path = &def->path;
 
-static void compress_probe(struct codec_probe *cp)
-{
-    dyn_array_fix(&cp->codec_case_array);
+    ALOGV("Added path_def '%s'", name);
+    return 0;
 }
 
-static void compress_case(struct scase *sc)
+static int parse_path_def_end(struct parse_state *state)
 {
-    dyn_array_fix(&sc->ctl_array);
+    /* The controls of a <path_def> must not move after this because they
+     * are referenced by the paths and cases that follow
+     */
+    return parse_path_end(state);
 }
 
-static struct usecase* new_usecase(struct dyn_array *array, const char *name)
+/*
+ * A <path_ref> adds the controls of a <path_def> at this point of a path
+ * or case. The controls are not copied, the path holds a run pointing to
+ * the controls of the <path_def>.
+ */
+static int parse_path_ref_start(struct parse_state *state)
 {
-    struct usecase *puc;
+    const char *name = state->attribs.value[e_attrib_name];
+    const struct path_def *def = find_path_def(state->cm, name);
+    const struct ctl_segment *segs;
+    struct ctl_segment own;
+    struct dyn_array *ctl_array;
+    struct dyn_array *segment_array;
+    int count;
 
-    if (dyn_array_extend(array) < 0) {
-        return NULL;
+    if (def == NULL) {
+        ALOGE("path_def '%s' not defined", name);
+        return -EINVAL;
     }
 
-    puc = &array->usecases[array->count - 1];
-    puc->case_array.elem_size = sizeof(struct scase);
-    puc->name = strdup(name);
-    if (!puc->name) {
-        return NULL;
+    if (&def->path == state->current.path) {
+        ALOGE("path_def '%s' refers to itself", name);
+        return -EINVAL;
     }
 
-    return puc;
-}
+    if (state->current.path) {
+        ctl_array = &state->current.path->ctl_array;
+        segment_array = &state->current.path->segment_array;
+    } else {
+        ctl_array = &state->current.scase->ctl_array;
+        segment_array = &state->current.scase->segment_array;
+    }
 
-static void compress_usecase(struct usecase *puc)
-{
-    dyn_array_fix(&puc->case_array);
-}
+    if (add_own_ctl_segment(ctl_array, segment_array) < 0) {
+        return -ENOMEM;
+    }
 
-static struct constant* new_constant(struct dyn_array *array,
-                                     const char *name, const char *val)
-{
-    struct constant *pc;
+    count = get_ctl_segments(&def->path.ctl_array, &def->path.segment_array,
+                             &own, &segs);
+    for (; count > 0; --count, ++segs) {
+        if (segs->count == 0) {
+            continue;
+        }
 
-    if (dyn_array_extend(array) < 0) {
-        return NULL;
+        if (dyn_array_extend(segment_array) < 0) {
+            return -ENOMEM;
+        }
+        segment_array->segments[segment_array->count - 1] = *segs;
     }
 
-    pc = &array->constants[array->count - 1];
-    pc->name = name;
-    pc->value = val;
-    return pc;
+    ALOGV("Added path_ref '%s'", name);
+    return 0;
 }
 
-static struct device* new_device(struct dyn_array *array, uint32_t type)
+static int parse_case_start(struct parse_state *state)
 {
-    struct device *d;
+    const char *name = state->attribs.value[e_attrib_name];
+    struct usecase *puc = state->current.usecase;
+    struct dyn_array *array = &puc->case_array;
+    struct scase *sc;
 
-    if (dyn_array_extend(array) < 0) {
-        return NULL;
+    sc = new_case(array, name);
+    if (sc == NULL) {
+        return -ENOMEM;
     }
 
-    d = &array->devices[array->count - 1];
-    d->path_array.elem_size = sizeof(struct path);
-    d->type = type;
-    return d;
+    state->current.scase = sc;
+
+    ALOGV("Added case '%s' to '%s'", name, puc->name);
+    return 0;
 }
 
-static void compress_device(struct device *d)
+static int parse_case_end(struct parse_state *state)
 {
-    dyn_array_fix(&d->path_array);
+    struct scase *sc = state->current.scase;
+
+    if (sc->segment_array.count > 0) {
+        if (add_own_ctl_segment(&sc->ctl_array, &sc->segment_array) < 0) {
+            return -ENOMEM;
+        }
+    }
+
+    /* Free unused memory in the ctl array */
+    compress_case(sc);
+    state->current.scase = NULL;
+    return 0;
 }
 
-static struct stream* new_stream(struct dyn_array *array, struct config_mgr *cm)
+static int parse_usecase_start(struct parse_state *state)
 {
-    struct stream *s;
+    const char *name = state->attribs.value[e_attrib_name];
+    struct dyn_array *array = &state->current.stream->usecase_array;
+    struct usecase *puc;
 
-    if (dyn_array_extend(array) < 0) {
-        return NULL;
+    puc = new_usecase(array, name);
+    if (puc == NULL) {
+        return -ENOMEM;
     }
 
-    s = &array->streams[array->count - 1];
-    s->usecase_array.elem_size = sizeof(struct usecase);
-    s->constants_array.elem_size = sizeof(struct constant);
-    s->cm = cm;
-    s->enable_path = -1;    /* by default no special path to invoke */
-    s->disable_path = -1;
-    ctl_ref_init(&s->controls.volume_left.ref);
-    ctl_ref_init(&s->controls.volume_right.ref);
-    return s;
+    state->current.usecase = puc;
+
+    ALOGV("Added usecase '%s'", name);
+
+    return 0;
 }
 
-static void compress_stream(struct stream *s)
+static int parse_usecase_end(struct parse_state *state)
 {
-    dyn_array_fix(&s->usecase_array);
+    /* Free unused memory in the case array */
+    compress_usecase(state->current.usecase);
+    return 0;
 }
 
-static int new_name(struct dyn_array *array, const char* name)
+static int parse_set_start(struct parse_state *state)
 {
-    int i;
+    const char *name = strdup(state->attribs.value[e_attrib_name]);
+    struct dyn_array *array = &state->current.stream->constants_array;
+    struct constant *pc;
+    const char *val = NULL;
 
-    if (dyn_array_extend(array) < 0) {
+    if (!name) {
         return -ENOMEM;
     }
 
-    i = array->count - 1;
-    array->path_names[i] = strdup(name);
-    if (!array->path_names[i]) {
+    val = strdup(state->attribs.value[e_attrib_val]);
+    if (!val) {
+        free((void *)name);
         return -ENOMEM;
     }
 
-    return i;
-}
-
-static struct config_mgr* new_config_mgr()
-{
-    struct config_mgr* mgr = calloc(1, sizeof(struct config_mgr));
-    if (!mgr) {
-        return NULL;
+    pc = new_constant(array, name, val);
+    if (pc == NULL) {
+        free((void *)name);
+        free((void *)val);
+        return -ENOMEM;
     }
-    mgr->device_array.elem_size = sizeof(struct device);
-    mgr->anon_stream_array.elem_size = sizeof(struct stream);
-    mgr->named_stream_array.elem_size = sizeof(struct stream);
-    pthread_mutex_init(&mgr->lock, NULL);
-    return mgr;
-}
-
-static void compress_config_mgr(struct config_mgr *mgr)
-{
-    dyn_array_fix(&mgr->device_array);
-    dyn_array_fix(&mgr->anon_stream_array);
-    dyn_array_fix(&mgr->named_stream_array);
-}
 
-static int find_path_name(struct parse_state *state, const char *name)
-{
-    struct dyn_array *array = &state->path_name_array;
-    int i;
+    ALOGV("Added constant '%s'=%s", name, val);
 
-    for (i = array->count - 1; i >= 0; --i) {
-        if (0 == strcmp(array->path_names[i], name)) {
-            ALOGV("Existing path '%s' id=%d", name, i);
-            return i;   /* found - return existing index */
-        }
-    }
-    return -EINVAL;
+    return 0;
 }
 
-static int add_path_name(struct parse_state *state, const char *name)
+static int parse_enable_disable_start(struct parse_state *state, bool is_enable)
 {
-    struct dyn_array *array = &state->path_name_array;
-    int index;
+    /* Handling of <enable> and <disable> is almost identical so
+     * they are both handled in this function
+     */
 
-    /* Check if already in array */
-    index = find_path_name(state, name);
-    if (index >= 0) {
-        return index;   /* already exists */
+    const char *path_name = state->attribs.value[e_attrib_path];
+    int i;
+
+    i = find_path_name(state,path_name);
+    if (i < 0) {
+        ALOGE("Path '%s' not defined", path_name);
+        return -EINVAL;
     }
 
-    index = new_name(array, name);
-    if (index < 0) {
-        return -ENOMEM;
+    if (is_enable) {
+        ALOGV("Add enable path '%s' (id=%d)",
+                                state->path_name_array.path_names[i], i);
+        state->current.stream->enable_path = i;
+    } else {
+        ALOGV("Add disable path '%s' (id=%d)",
+                                state->path_name_array.path_names[i], i);
+        state->current.stream->disable_path = i;
     }
 
-    ALOGV("New path '%s' id=%d", name, index);
-    return index;
+    return 0;
 }
 
-static void path_names_free(struct parse_state *state)
+static int parse_enable_start(struct parse_state *state)
 {
-    struct dyn_array *array = &state->path_name_array;
-    int i;
-
-    for (i = array->count - 1; i >= 0; --i) {
-        free((void*)array->path_names[i]);
-    }
-    dyn_array_free(array);
+    return parse_enable_disable_start(state, true);
 }
 
-static void codec_probe_free(struct parse_state *state)
+static int parse_disable_start(struct parse_state *state)
 {
-    struct dyn_array *array = &state->init_probe.codec_case_array;
-    int i;
+    return parse_enable_disable_start(state, false);
+}
 
-    for (i = array->count - 1; i >= 0; --i) {
-        free((void*)array->codec_cases[i].codec_name);
-        array->codec_cases[i].codec_name = NULL;
-        free((void*)array->codec_cases[i].file);
-        array->codec_cases[i].file = NULL;
-    }
+static int parse_stream_ctl_start(struct parse_state *state)
+{
+    /* Parse a <ctl> element within a stream which defines
+     * mixer controls - currently only supports volume controls
+     */
 
-    free((void*)state->init_probe.file);
-    state->init_probe.file = NULL;
+    const char *name = state->attribs.value[e_attrib_name];
+    const char *function = state->attribs.value[e_attrib_function];
+    const char *index = state->attribs.value[e_attrib_index];
+    struct mixer_ctl *ctl;
+    struct stream_control *streamctl;
+    struct config_phase_stats *prev_phase;
+    uint idx_val = 0;
+    uint8_t mixer_idx;
+    int v;
 
-    free((void*)state->cur_xml_file);
-    state->cur_xml_file = NULL;
+    if (parse_ctl_card(state, &mixer_idx) != 0) {
+        return -EINVAL;
+    }
 
-    state->init_probe.new_xml_file = NULL;
+    prev_phase = enter_phase(state->cm, &state->cm->boot_stats.resolve);
+    ctl = find_ctl_by_name(state->cm, mixer_idx, name);
+    enter_phase(state->cm, prev_phase);
 
-    dyn_array_free(array);
-}
+    if (!ctl) {
+        ALOGE("Control '%s' not found", name);
+        return -EINVAL;
+    }
 
-static int string_to_uint(uint32_t *result, const char *str)
-{
-    char *endptr;
-    unsigned long int v;
+    /*
+     * Tinyalsa mixer_ctl_get_range_min()/mixer_ctl_get_range_max()
+     * return negative error if the control isn't valid. As the minimum
+     * value could be negative we can't check for errors so check in advance
+     * that the control will not cause an error from these functions.
+     */
+    if (mixer_ctl_get_type(ctl) != MIXER_CTL_TYPE_INT) {
+        ALOGE("Control '%s' is not an integer", name);
+        return -EINVAL;
+    }
 
-    if (!str) {
-        return -ENOENT;
+    if (index != NULL) {
+        if (attrib_to_uint(&idx_val, state, e_attrib_index) == -EINVAL) {
+            return -EINVAL;
+        }
     }
 
-    /* return error if not a valid decimal or hex number */
-    v = strtoul(str, &endptr, 0);
-    if ((endptr[0] == '\0') && (endptr != str) && (v <= 0xFFFFFFFF)) {
-        *result = (uint32_t)v;
-        return 0;
+    if (0 == strcmp(function, "leftvol")) {
+        ALOGE_IF(ctl_ref_valid(&state->current.stream->controls.volume_left.ref),
+                                "Left volume control specified again");
+        streamctl = &(state->current.stream->controls.volume_left);
+    } else if (0 == strcmp(function, "rightvol")) {
+        ALOGE_IF(ctl_ref_valid(&state->current.stream->controls.volume_right.ref),
+                                "Right volume control specified again");
+        streamctl = &(state->current.stream->controls.volume_right);
     } else {
-        ALOGE("'%s' not a valid number", str);
+        ALOGE("'%s' is not a valid control function", function);
         return -EINVAL;
     }
-}
 
-static int string_to_int(int *result, const char *str)
-{
-    char *endptr;
-    unsigned long int v;
+    streamctl->index = idx_val;
 
-    if (!str) {
-        return -ENOENT;
+    switch (attrib_to_int(&v, state, e_attrib_min)) {
+    case -EINVAL:
+        ALOGE("Invalid min for '%s'", name);
+        return -EINVAL;
+
+    case -ENOENT:
+        /* Not specified, get control's min value */
+        streamctl->min = mixer_ctl_get_range_min(ctl);
+        break;
+
+    default:
+        streamctl->min = v;
+        break;
     }
 
-    /* return error if not a valid decimal or hex number */
-    v = strtol(str, &endptr, 0);
-    if ((endptr[0] == '\0') && (endptr != str)) {
-        *result = v;
-        return 0;
-    } else {
-        ALOGE("'%s' not a valid signed integer", str);
+    switch (attrib_to_int(&v, state, e_attrib_max)) {
+    case -EINVAL:
+        ALOGE("Invalid max for '%s'", name);
         return -EINVAL;
+
+    case -ENOENT:
+        /* Not specified, get control's max value */
+        streamctl->max = mixer_ctl_get_range_max(ctl);
+        break;
+
+    default:
+        streamctl->max = v;
+        break;
     }
-}
 
-static int attrib_to_uint(uint32_t *result, struct parse_state *state,
-                                enum attrib_index index)
-{
-    const char *str = state->attribs.value[index];
-    return string_to_uint(result, str);
-}
+    streamctl->ref.mixer = mixer_idx;
+    ctl_set_ref(&streamctl->ref, ctl);
 
-static int attrib_to_int(int *result, struct parse_state *state,
-                                enum attrib_index index)
-{
-    const char *str = state->attribs.value[index];
-    return string_to_int(result, str);
+    ALOGV("(%p) Added control '%s' function '%s' range %d-%d",
+                state->current.stream,
+                name, function, streamctl->min, streamctl->max);
+
+    return 0;
 }
 
-static int make_byte_work_buffer(struct ctl *c,
-                                 uint32_t buffer_size)
+static int get_card_id_for_name(struct parse_state *state,
+                                const char* name,
+                                uint32_t timeout_ms,
+                                uint32_t *id);
+
+static int parse_stream_start(struct parse_state *state)
 {
-    int ret = 0;
+    const char *type = state->attribs.value[e_attrib_type];
+    const char *dir = state->attribs.value[e_attrib_dir];
+    const char *name = state->attribs.value[e_attrib_name];
+    const char *route = state->attribs.value[e_attrib_route];
+    bool out;
+    bool global;
+    uint32_t card = state->mixer_card_number;
+    uint32_t card_timeout_ms = 0;
+    uint32_t device = UINT_MAX;
+    uint32_t maxref = INT_MAX;
+    struct stream *s;
 
-    c->buffer = malloc(buffer_size);
-    if (!c->buffer) {
-        ALOGE("Failed to allocate work buffer");
+    if (name != NULL) {
+        if (find_named_stream(state->cm, name) != NULL) {
+            ALOGE("Stream '%s' already declared", name);
+            return -EINVAL;
+        }
+        s = new_stream(&state->cm->named_stream_array, state->cm);
+    } else {
+        s = new_stream(&state->cm->anon_stream_array, state->cm);
+    }
+
+    if (s == NULL) {
         return -ENOMEM;
     }
 
-    if (c->data_file_name) {
-        ret = get_value_from_file(c, buffer_size);
+    if (!name) {
+        global = false;
     } else {
-        ret = make_byte_array(c, buffer_size);
-    }
-    if (ret != 0) {
-        return ret;
+        global = (strcmp(name, "global") == 0);
     }
 
-    ALOGV("Added ctl '%s' byte array len %d", c->name, c->array_count);
-    return 0;
-}
-
-static int get_value_from_file(struct ctl *c, uint32_t vnum)
-{
-    uint32_t data_size;
-    FILE *fp;
-
-    fp = fopen(c->data_file_name, "rb");
-    if (fp == 0) {
-        ALOGE("Failed to open %s", c->data_file_name);
-        return -EIO;
+    if (dir == NULL) {
+        if (!global) {
+            ALOGE("'dir' is required");
+            return -EINVAL;
+        }
+    } else if (0 == strcmp(dir, "out")) {
+        out = true;
+    } else if (0 == strcmp(dir, "in")) {
+        out = false;
+    } else {
+        ALOGE("'%s' is not a valid direction", dir);
+        return -EINVAL;
     }
-    fseek(fp, 0L, SEEK_END);
-    data_size = (uint32_t) ftell(fp);
-    rewind(fp);
 
-    if (data_size > vnum) {
-        ALOGE("Data size %d exceeded max control size, the first %d bytes are kept",
-               data_size, vnum);
-        c->array_count = vnum;
+    if (global) {
+        s->info.type = e_stream_global;
+    } else if (0 == strcmp(type, "hw")) {
+        if (name == NULL) {
+            ALOGE("Anonymous stream cannot be type hw");
+            return -EINVAL;
+        }
+        s->info.type = out ? e_stream_out_hw : e_stream_in_hw;
+    } else if (0 == strcmp(type, "pcm")) {
+        s->info.type = out ? e_stream_out_pcm : e_stream_in_pcm;
+    } else if (0 == strcmp(type, "compress")) {
+        s->info.type = out ? e_stream_out_compress : e_stream_in_compress;
     } else {
-        c->array_count = data_size;
+        ALOGE("'%s' not a valid stream type", type);
+        return -EINVAL;
     }
 
-    uint8_t *buffer = malloc(c->array_count);
-    if (!buffer) {
-        ALOGE("Failed to allocate read buffer");
-        fclose(fp);
-        return -ENOMEM;
+    if (state->attribs.value[e_attrib_cardname] != NULL &&
+        state->attribs.value[e_attrib_card] != NULL) {
+        ALOGE("stream must be configured by only one of 'card' OR 'cardname'. Both provided.");
+        return -EINVAL;
     }
 
-    int read = fread((void *)buffer, 1, c->array_count, fp);
-    fclose(fp);
-    if (read < (int)c->array_count) {
-        ALOGE("Failed to get control value: %d", -errno);
-        free(buffer);
-        return -EIO;
+    if (attrib_to_uint(&card, state, e_attrib_card) == -EINVAL) {
+        return -EINVAL;
     }
 
-    c->value.data = buffer;
+    if (attrib_to_uint(&card_timeout_ms, state, e_attrib_timeout) == -EINVAL) {
+        return -EINVAL;
+    }
 
-    return 0;
-}
+    if (state->attribs.value[e_attrib_cardname] != NULL &&
+        get_card_id_for_name(state,
+                             state->attribs.value[e_attrib_cardname],
+                             card_timeout_ms,
+                             &card) != 0) {
+        return -EINVAL;
+    }
 
-static int make_byte_array(struct ctl *c, uint32_t vnum)
-{
-    const char *val_str = c->value.string;
-    char *str;
-    uint8_t *pdatablock = NULL;
-    uint8_t *bytes;
-    int count;
-    char *p, *savep;
-    uint32_t v;
-    int ret;
+    if (attrib_to_uint(&device, state, e_attrib_device) == -EINVAL) {
+        return -EINVAL;
+    }
 
-    if (c->index >= vnum) {
-        ALOGE("Control index out of range(%u>%u)", c->index, vnum);
+    if (attrib_to_uint(&maxref, state, e_attrib_instances) == -EINVAL) {
         return -EINVAL;
     }
 
-    str = strdup(val_str);
-    if (!str) {
-        return -ENOMEM;
+    if (attrib_to_uint(&s->info.rate, state, e_attrib_rate) == -EINVAL) {
+        return -EINVAL;
     }
 
-    /* get number of entries in value string by counting commas */
-    p = strtok_r(str, ",", &savep);
-    for (count = 0; p != NULL; count++) {
-        p = strtok_r(NULL, ",", &savep);
+    if (attrib_to_uint(&s->info.period_count, state,
+                        e_attrib_period_count) == -EINVAL) {
+        return -EINVAL;
     }
 
-    if (count == 0) {
-        ALOGE("No values for byte array");
-        ret = -EINVAL;
-        goto fail;
+    if (attrib_to_uint(&s->info.period_size, state,
+                        e_attrib_period_size) == -EINVAL) {
+        return -EINVAL;
     }
 
-    if ((c->index + count) > vnum) {
-        ALOGE("Array overflows control (%u+%u > %u)",
-                    c->index, count, vnum);
-        ret = -EINVAL;
-        goto fail;
+    if (route != NULL) {
+        if (strcmp(route, "make_before_break") == 0) {
+            s->make_before_break = true;
+        } else if (strcmp(route, "break_before_make") != 0) {
+            ALOGE("'%s' is not a valid stream route", route);
+            return -EINVAL;
+        }
     }
-    c->array_count = count;
 
-    pdatablock = malloc(count);
-    if (!pdatablock) {
-        ALOGE("Out of memory for control data");
-        ret = -ENOMEM;
-        goto fail;
+    if (name != NULL) {
+        s->name = strdup(name);
+        if (!s->name) {
+            return -ENOMEM;
+        }
     }
+    s->info.card_number = card;
+    s->info.device_number = device;
+    s->max_ref_count = maxref;
 
-    strcpy(str,val_str);
-    bytes = pdatablock;
-
-    for (p = strtok_r(str, ",", &savep); p != NULL;) {
-        ret = string_to_uint(&v, p);
-        if (ret != 0) {
-            goto fail;
-        }
-        ALOGE_IF(v > 0xFF, "Byte out of range");
+    ALOGV("Added stream %s type=%u card=%u device=%u max_ref=%u",
+                    s->name ? s->name : "",
+                    s->info.type, s->info.card_number, s->info.device_number,
+                    s->max_ref_count );
 
-        *bytes++ = (uint8_t)v;
-        p = strtok_r(NULL, ",", &savep);
-    }
+    state->current.stream = s;
 
-    free(str);
-    free((void *)val_str); /* no need to keep this string now */
-    c->value.data = pdatablock;
     return 0;
-
-fail:
-    free(pdatablock);
-    free(str);
-    return ret;
 }
 
-static const struct parse_device *parse_match_device(const char *name)
+static int parse_stream_end(struct parse_state *state)
 {
-    const struct parse_device *p = &device_table[0];
-    const struct parse_device *p_end =
-            &device_table[ sizeof(device_table) / sizeof(device_table[0]) ];
-
-    for (; p < p_end; ++p) {
-        if (0 == strcmp(name, p->name)) {
-            return p;
-        }
-    }
-
-    return NULL;
+    /* Free unused memory in the ctl array */
+    compress_stream(state->current.stream);
+    return 0;
 }
 
-static const char *debug_device_to_name(uint32_t device)
+static int parse_device_start(struct parse_state *state)
 {
-    const struct parse_device *p = &device_table[0];
-    const struct parse_device *p_end =
-            &device_table[ sizeof(device_table) / sizeof(device_table[0]) ];
+    const char *dev_name = state->attribs.value[e_attrib_name];
+    struct dyn_array *array = &state->cm->device_array;
+    uint32_t device_flag;
+    uint32_t *existing_devices;
+    const struct parse_device *p;
+    struct device* d;
 
-    /* Assumes device contains a single bitflag plus direction bit */
+    p = parse_match_device(dev_name);
 
-    for (; p < p_end; ++p) {
-        if (device == p->device) {
-            return p->name;
-        }
+    if (p == NULL) {
+        ALOGE("'%s' is not a valid device", dev_name);
+        return -EINVAL;
     }
 
-    return "unknown";
-}
-
-
-static int parse_ctl_start(struct parse_state *state)
-{
-    const char *name = strdup(state->attribs.value[e_attrib_name]);
-    struct dyn_array *array;
-    struct ctl *c = NULL;
-    int ret;
-
-    if (state->current.path) {
-        ALOGV("parse_ctl_start:path ctl");
-        array = &state->current.path->ctl_array;
-    } else {
-        ALOGV("parse_ctl_start:case ctl");
-        array = &state->current.scase->ctl_array;
-    }
+    device_flag = p->device;
 
-    if (!name) {
-        return -ENOMEM;
-    }
+    if (device_flag != 0) {
+        /* not the global device - add it to list of available devices */
+        if (device_flag & AUDIO_DEVICE_BIT_IN) {
+                existing_devices = &state->cm->supported_input_devices;
+        } else {
+                existing_devices = &state->cm->supported_output_devices;
+        }
 
-    c = new_ctl(array, name);
-    if (c == NULL) {
-        ret = -ENOMEM;
-        goto fail;
+        if ((device_flag & *existing_devices) == device_flag) {
+            ALOGE("Device '%s' already defined", dev_name);
+            ALOGE("Device = 0x%x extisting_devices = 0x%x", device_flag, *existing_devices);
+            ALOGE("supported_output_devices=0x%x supported_input_devices=0x%x",
+                            state->cm->supported_output_devices,
+                            state->cm->supported_input_devices );
+            return -EINVAL;
+        }
+        *existing_devices |= device_flag;
     }
 
-    if (attrib_to_uint(&c->index, state, e_attrib_index) == -EINVAL) {
-        ALOGE("Invalid ctl index");
-        ret = -EINVAL;
-        goto fail;
-    }
+    ALOGV("Add device '%s'", dev_name);
 
-    const char *filename = state->attribs.value[e_attrib_file];
-    if (filename) {
-        c->data_file_name = strdup(filename);
-        if (!c->data_file_name) {
-            ret = -ENOMEM;
-            goto fail;
-        }
-    } else {
-        c->value.string = strdup(state->attribs.value[e_attrib_val]);
-        if(!c->value.string) {
-            ret = -ENOMEM;
-            goto fail;
-        }
+    d = new_device(array, device_flag);
+    if (d == NULL) {
+        return -ENOMEM;
     }
+    state->current.device = d;
 
-    ret = ctl_open(state->cm, c);
-    if (ret == -ENOENT) {
-        /* control not found, just ignore and do lazy open when it's used */
-        return 0;
-    } else {
-        return ret;
-    }
+    return 0;
+}
 
-fail:
-    free(c);
-    free((void *)name);
-    return ret;
+static int parse_device_end(struct parse_state *state)
+{
+    /* Free unused memory in the path array */
+    compress_device(state->current.device);
+    return 0;
 }
 
-static int parse_codec_case_start(struct parse_state * state)
+static int get_card_name_for_id(unsigned int id, char* name, int len)
 {
-    const char *codec = strdup(state->attribs.value[e_attrib_name]);
-    const char *file = state->attribs.value[e_attrib_file];
-    struct dyn_array *array = &state->current.codec_probe->codec_case_array;
-    struct codec_case  *cc = NULL;
+    char cardInfoFile[32];
+    FILE *fp;
     int ret = 0;
+    snprintf(cardInfoFile, sizeof(cardInfoFile), "/proc/asound/card%u/id", id);
 
-    while (isspace(*file)) {
-        ++file;
-    }
-
-    if (file[0] == '/') {
-        /* Absolute path: use as-is. */
-        file = strdup(file);
-    } else {
-        /* Relative to location of current XML file: get full path. */
-        file = join_paths(state->cur_xml_file, file, 1);
-    }
-
-    if (!file) {
-        return -ENOMEM;
+    fp = fopen(cardInfoFile, "r");
+    if (fp == NULL) {
+        ALOGE("Failed to open file: %s", cardInfoFile);
+        return -EINVAL;
     }
 
-    cc = new_codec_case(array, codec, file);
-    if (cc == NULL) {
-        ret = -ENOMEM;
-        free((void*)codec);
-        free((void*)file);
+    if (fgets(name, len, fp) == NULL) {
+        ALOGE("Failed to read name from file: %s", cardInfoFile);
+        ret = -EINVAL;
+        goto read_fail;
     }
-
+    //Only return first line of file, without new lines.
+    name[strcspn(name, "\n")] = 0;
+read_fail:
+    fclose(fp);
     return ret;
 }
 
-static int parse_init_start(struct parse_state *state)
+static void card_names_free(struct parse_state *state)
 {
-    /* The <init> section inside <mixer> is really just a
-     * path that we only use once. We re-use the parsing of
-     * <ctl> entries by creating a temporary path which we
-     * apply at the end of parsing and then discard
-     */
-    state->current.path = &state->init_path;
+    struct dyn_array *array = &state->card_name_array;
+    int i;
 
-    /* Don't allow <pre_init> or another <init> to follow this */
-    state->stack.entry[state->stack.index - 1].valid_subelem &=
-        ~(BIT(e_elem_pre_init) | BIT(e_elem_init));
+    for (i = array->count - 1; i >= 0; --i) {
+        free((void*)array->card_names[i].name);
+    }
+    dyn_array_free(array);
 
-    ALOGV("Added init path");
-    return 0;
+    array->data = NULL;
+    array->count = 0;
+    array->max_count = 0;
+    state->card_names_valid = false;
 }
 
-static int parse_init_end(struct parse_state *state)
+/* Take a snapshot of the ids of all currently registered cards */
+static int load_card_names(struct parse_state *state)
 {
-    compress_path(state->current.path);
-    state->current.path = NULL;
-    return 0;
-}
+    struct dyn_array *array = &state->card_name_array;
+    struct card_name *cn;
+    DIR* dir;
+    struct dirent* entry;
+    unsigned int t_id;
+    char t_name[128];
+    int ret = 0;
 
-static int parse_preinit_start(struct parse_state *state)
-{
-    /* This is handled the same way as <init> section except that
-     * when we get the end tag we immediately process the settings
-     * before parsing the rest of the config.
-     */
-    state->current.path = &state->preinit_path;
+    card_names_free(state);
 
-    ALOGV("Started <pre_init>");
-    return 0;
-}
+    dir = opendir("/proc/asound");
+    if (dir == NULL) {
+        /* No cards registered yet */
+        state->card_names_valid = true;
+        return 0;
+    }
 
-static int parse_preinit_end(struct parse_state *state)
-{
-    ALOGV("Applying <pre_init>");
+    while ((entry = readdir(dir)) != NULL) {
+        if (sscanf(entry->d_name, "card%u", &t_id) != 1) {
+            continue;
+        }
 
-    state->current.path = NULL;
+        if (get_card_name_for_id(t_id, t_name, sizeof(t_name)) != 0) {
+            continue;
+        }
 
-    /* Execute the pre_init commands now */
-    apply_path_l(state->cm, &state->preinit_path);
+        if (dyn_array_extend(array) < 0) {
+            ret = -ENOMEM;
+            break;
+        }
+
+        cn = &array->card_names[array->count - 1];
+        cn->number = t_id;
+        cn->name = strdup(t_name);
+        if (!cn->name) {
+            ret = -ENOMEM;
+            break;
+        }
+    }
+    closedir(dir);
+
+    state->card_names_valid = (ret == 0);
+    return ret;
+}
 
-    /* Re-open tinyalsa to pick up any controls added by the pre_init */
-    mixer_close(state->cm->mixer);
-    state->cm->mixer = mixer_open(state->mixer_card_number);
+/*
+ * Lookup the card number for the given name. If the card is not registered
+ * wait up to timeout_ms for it to appear (0 means don't wait, WAIT_FOREVER
+ * means no limit).
+ */
+static int get_card_id_for_name(struct parse_state *state,
+                                const char* name,
+                                uint32_t timeout_ms,
+                                uint32_t *id)
+{
+    const struct dyn_array *array = &state->card_name_array;
+    struct path_wait wait = PATH_WAIT_INIT;
+    uint64_t deadline_ns = 0;
+    uint i;
+    int ret;
 
-    if (!state->cm->mixer) {
-        ALOGE("Failed to re-open mixer card %u", state->mixer_card_number);
+    if (name == NULL) {
         return -EINVAL;
     }
 
-    return 0;
-}
+    if (timeout_ms != WAIT_FOREVER) {
+        deadline_ns = time_now_ns() + ((uint64_t)timeout_ms * 1000000ULL);
+    }
 
-static char *probe_trim_spaces(char *str)
-{
-    int len;
-    char *end;
+    for (;;) {
+        if (!state->card_names_valid) {
+            ret = load_card_names(state);
+            if (ret < 0) {
+                goto out;
+            }
+        }
 
-    while(isspace(*str))
-        ++str;
+        for (i = 0; i < array->count; ++i) {
+            if (strcmp(array->card_names[i].name, name) == 0) {
+                ALOGV("Found card %u with name %s",
+                      array->card_names[i].number, name);
+                *id = array->card_names[i].number;
+                ret = 0;
+                goto out;
+            }
+        }
 
-    len = strlen(str);
+        if (timeout_ms == 0) {
+            break;
+        }
 
-    if(!len)
-        return str;
+        /* New cards create nodes in /dev/snd, procfs doesn't notify */
+        if (wait_for_path_change(&wait, SND_DEV_PATH, deadline_ns) != 0) {
+            ALOGE("Timed out waiting for card '%s'", name);
+            break;
+        }
 
-    end = str + len -1;
-    while ((end > str) && isspace(*end))
-        end--;
-    *(end + 1) = '\0';
+        state->card_names_valid = false;
+    }
 
-    return str;
-}
+    ret = -EINVAL;
 
+out:
+    path_wait_close(&wait);
+    return ret;
+}
 
-static int probe_config_file(struct parse_state *state)
+static int parse_mixer_start(struct parse_state *state)
 {
-    int i;
-    char buf[40], *codec;
-    FILE *fp;
-    int ret;
+    const char *route = state->attribs.value[e_attrib_route];
+    const char *refresh = state->attribs.value[e_attrib_refresh];
+    const char *parameters = state->attribs.value[e_attrib_parameters];
+    uint32_t card = MIXER_CARD_DEFAULT;
+    uint32_t card_timeout_ms = 0;
 
-    ALOGV("+probe_config_file");
+    ALOGV("parse_mixer_start");
 
-    fp = fopen(state->init_probe.file, "r");
-    while (fp == NULL) {
-        usleep(50000);
-        fp = fopen(state->init_probe.file, "r");
+    if (attrib_to_uint(&card_timeout_ms, state, e_attrib_timeout) == -EINVAL) {
+        return -EINVAL;
     }
 
-    if (fgets(buf,sizeof(buf),fp) == NULL) {
-        ALOGE("I/O error reading codec probe file");
-        ret = -EIO;
-        goto exit;
+    if (attrib_to_uint(&state->cm->case_cache.budget, state,
+                       e_attrib_case_cache) == -EINVAL) {
+        ALOGE("Invalid case_cache");
+        return -EINVAL;
     }
 
-    codec = probe_trim_spaces(buf);
-    state->init_probe.new_xml_file = NULL;
+    if (route != NULL) {
+        if (strcmp(route, "net") == 0) {
+            state->cm->net_routes = true;
+        } else if (strcmp(route, "sequential") != 0) {
+            ALOGE("'%s' is not a valid route", route);
+            return -EINVAL;
+        }
+    }
 
-    for (i = 0; i < (int)state->init_probe.codec_case_array.count; ++i)
-    {
-        if (strcmp(codec, state->init_probe.codec_case_array.codec_cases[i].codec_name) == 0)
-        {
-            break;
+    if (parameters != NULL) {
+        if (strcmp(parameters, "batch") == 0) {
+            state->cm->batch_parameters = true;
+        } else if (strcmp(parameters, "sequential") != 0) {
+            ALOGE("'%s' is not a valid parameters", parameters);
+            return -EINVAL;
         }
     }
 
-    if (i == (int)state->init_probe.codec_case_array.count) {
-        ALOGE("Codec probe file not found");
-        ret = 0;
-        goto exit;
+    if (refresh != NULL) {
+        if (strcmp(refresh, "add") == 0) {
+            state->refresh_add = true;
+#if defined(TINYALSA_NO_ADD_NEW_CTRLS) || defined(TINYALSA_NO_CTL_GET_ID)
+            ALOGW("refresh=\"add\" needs mixer_add_new_ctls() and mixer_ctl_get_id()");
+#endif
+        } else if (strcmp(refresh, "reopen") != 0) {
+            ALOGE("'%s' is not a valid refresh", refresh);
+            return -EINVAL;
+        }
     }
 
-    state->init_probe.new_xml_file = state->init_probe.codec_case_array.codec_cases[i].file;
+    if (attrib_to_uint(&card, state, e_attrib_card) == 0) {
+        if (state->attribs.value[e_attrib_name] != NULL) {
+            ALOGE("Mixer must be configured by only one of 'card' OR 'name'. Both provided.");
+            return -EINVAL;
+        }
+    } else if (get_card_id_for_name(state,
+                                    state->attribs.value[e_attrib_name],
+                                    card_timeout_ms,
+                                    &card) != 0) {
+        return -EINVAL;
+    }
 
-    if (strcmp(state->init_probe.new_xml_file, state->cur_xml_file) == 0) {
-        /* There is no new xml file to redirect */
-        state->init_probe.new_xml_file = NULL;
-        XML_StopParser(state->parser,false);
-        ALOGE("A codec probe case can't redirect to its own config file");
-        ret = -EINVAL;
-    } else {
-        /*
-         * We are stopping the Parser as we got new codec xml file
-         * and we will restart the parser with that new file
-         */
-        ALOGV("Got new config file %s", state->init_probe.new_xml_file);
-        XML_StopParser(state->parser,XML_TRUE);
-        ret = 0;
+    ALOGV("Opening mixer card %u", card);
+
+    state->cm->mixers[0].mixer = mixer_open(card);
+
+    if (!state->cm->mixers[0].mixer) {
+        ALOGE("Failed to open mixer card %u", card);
+        return -EINVAL;
     }
 
-exit:
-    fclose(fp);
+    state->cm->mixers[0].card = card;
+    state->cm->mixer_count = 1;
+    state->mixer_card_number = card;
 
-    return ret;
+    return 0;
 }
 
-static int parse_codec_probe_start(struct parse_state *state)
+static int parse_mixer_end(struct parse_state *state)
 {
-    const char *file = state->attribs.value[e_attrib_file];
-    int ret = 0;
+    ALOGV("parse_mixer_end");
 
-    while (isspace(*file)) {
-        ++file;
-    }
+    /* Now we can allow all other root elements but not another <mixer> */
+    state->stack.entry[state->stack.index - 1].valid_subelem =
+                                                  BIT(e_elem_device)
+                                                | BIT(e_elem_stream)
+                                                | BIT(e_elem_path_def);
+    return 0;
+}
 
-    if (file[0] == '/') {
-        /* Absolute path: use as-is. */
-        file = strdup(file);
+static int parse_set_error(struct parse_state *state, int error)
+{
+    state->parse_error = error;
+    state->error_line = XML_GetCurrentLineNumber(state->parser);
+    return error;
+}
+
+static int parse_log_error(struct parse_state *state)
+{
+    int err = state->parse_error;
+    int xml_err = XML_GetErrorCode(state->parser);
+
+    if((err < 0) || (xml_err != XML_ERROR_NONE)) {
+        ALOGE_IF(err < 0, "Error in config file at line %d", state->error_line);
+        ALOGE_IF(xml_err != XML_ERROR_NONE,
+                            "Parse error '%s' in config file at line %u",
+                            XML_ErrorString(xml_err),
+                            (uint)XML_GetCurrentLineNumber(state->parser));
+        return -EINVAL;
     } else {
-        /* Relative to location of current XML file: get full path. */
-        file = join_paths(state->cur_xml_file, file, 1);
+        return 0;
     }
+}
 
-    if (!file) {
-        return -ENOMEM;
+static int extract_attribs(struct parse_state *state, int elem_index)
+{
+    const uint32_t valid_attribs = elem_table[elem_index].valid_attribs;
+    uint32_t required_attribs = elem_table[elem_index].required_attribs;
+    const XML_Char **attribs = state->attribs.all;
+    int i;
+
+    memset(&state->attribs.value, 0, sizeof(state->attribs.value));
+
+    while (attribs[0] != NULL) {
+        for (i = 0; i < e_attrib_count; ++i ) {
+            if ((BIT(i) & valid_attribs) != 0) {
+                if (0 == strcmp(attribs[0], attrib_table[i].name)) {
+                    state->attribs.value[i] = attribs[1];
+                    required_attribs &= ~BIT(i);
+                    break;
+                }
+            }
+        }
+        if (i >= e_attrib_count) {
+            ALOGE("Attribute '%s' not allowed here", attribs[0] );
+            return -EINVAL;
+        }
+
+        attribs += 2;
     }
 
-    if (state->init_probe.file == NULL) {
-        state->init_probe.file = file;
-        state->current.codec_probe = &state->init_probe;
-        ret = 0;
-    } else {
-        ALOGE("The codec_probe block redefined");
-        free((void*)file);
-        ret = -EINVAL;
+    if (required_attribs != 0) {
+        for (i = 0; i < e_attrib_count; ++i ) {
+            if ((required_attribs & BIT(i)) != 0) {
+                ALOGE("Attribute '%s' required", attrib_table[i].name);
+            }
+        }
+        return -EINVAL;
     }
-    return ret;
+
+    return 0;
 }
 
-static int parse_codec_probe_end(struct parse_state *state)
+static void parse_section_start(void *data, const XML_Char *name,
+                                const XML_Char **attribs)
 {
+    struct parse_state *state = (struct parse_state *)data;
+    int stack_index = state->stack.index;
+    const uint32_t valid_elems =
+                        state->stack.entry[stack_index].valid_subelem;
+    int i;
 
-    compress_probe(state->current.codec_probe);
-    state->current.codec_probe = NULL;
-    probe_config_file(state);
+    if (state->parse_error != 0) {
+        return;
+    }
 
-    return 0;
+    ALOGV("parse start <%s>", name );
+
+    /* Find element in list of elements currently valid */
+    for (i = 0; i < e_elem_count; ++i) {
+        if ((BIT(i) & valid_elems) != 0) {
+            if (0 == strcmp(name, elem_table[i].name)) {
+                break;
+            }
+        }
+    }
+
+    if ((i >= e_elem_count) || (stack_index >= MAX_PARSE_DEPTH)) {
+        ALOGE("Element '%s' not allowed here", name);
+        parse_set_error(state, -EINVAL);
+    } else {
+        /* element ok - push onto stack */
+        ++stack_index;
+        state->stack.entry[stack_index].elem_index = i;
+        state->stack.entry[stack_index].valid_subelem
+                                                = elem_table[i].valid_subelem;
+        state->stack.index = stack_index;
+
+        /* Extract attributes and call handler */
+        state->attribs.all = attribs;
+        if (extract_attribs(state, i) != 0) {
+            parse_set_error(state, -EINVAL);
+        } else {
+            if (elem_table[i].start_fn) {
+                parse_set_error(state, (*elem_table[i].start_fn)(state));
+            }
+        }
+    }
 }
 
-static int parse_path_start(struct parse_state *state)
+static void parse_section_end(void *data, const XML_Char *name)
 {
-    const char *name = state->attribs.value[e_attrib_name];
-    struct device *device = state->current.device;
-    struct dyn_array *array = &device->path_array;
-    struct path *path;
-    int id;
+    struct parse_state *state = (struct parse_state *)data;
+    const int i = state->stack.entry[state->stack.index].elem_index;
 
-    id = add_path_name(state, name);
-    if (id < 0) {
-        return id;
+    if (state->parse_error != 0) {
+        return;
     }
 
-    path = new_path(array, id);
-    if (path == NULL) {
-        return -ENOMEM;
+    ALOGV("parse end <%s>", name );
+
+    if (elem_table[i].end_fn) {
+        state->parse_error = (*elem_table[i].end_fn)(state);
     }
 
-    state->current.path = path;
-
-    ALOGV("Added path '%s' id=%d", name, id);
-    return 0;
+    --state->stack.index;
 }
 
-static int parse_path_end(struct parse_state *state)
+static int do_parse(struct parse_state *state)
 {
-    /* Free unused memory in the ctl array */
-    compress_path(state->current.path);
-    state->current.path = NULL;
-    return 0;
-}
+    bool eof = false;
+    int len;
+    int ret = 0;
 
-static int parse_case_start(struct parse_state *state)
-{
-    const char *name = state->attribs.value[e_attrib_name];
-    struct usecase *puc = state->current.usecase;
-    struct dyn_array *array = &puc->case_array;
-    struct scase *sc;
+    state->parse_error = 0;
+    state->stack.index = 0;
+    /* First element must be <audiohal> */
+    state->stack.entry[0].valid_subelem = BIT(e_elem_audiohal);
 
-    sc = new_case(array, name);
-    if (sc == NULL) {
-        return -ENOMEM;
-    }
+    while (!eof && (state->parse_error == 0) ) {
+        len = fread(state->read_buf, 1, sizeof(state->read_buf), state->file);
+        if (ferror(state->file)) {
+            ALOGE("I/O error reading config file");
+            ret = -EIO;
+            break;
+        }
 
-    state->current.scase = sc;
+        eof = feof(state->file);
 
-    ALOGV("Added case '%s' to '%s'", name, puc->name);
-    return 0;
-}
+        if (XML_Parse(state->parser,
+                      state->read_buf,
+                      len,
+                      eof) == XML_STATUS_SUSPENDED) {
+            /* A codec_probe redirection suspends parsing of the current file */
+            break;
+        }
+        if (parse_log_error(state) < 0) {
+            ret = -EINVAL;
+            break;
+        }
+    }
 
-static int parse_case_end(struct parse_state *state)
-{
-    /* Free unused memory in the ctl array */
-    compress_case(state->current.scase);
-    state->current.scase = NULL;
-    return 0;
+    return ret;
 }
 
-static int parse_usecase_start(struct parse_state *state)
+static int open_config_file(struct parse_state *state, const char *file)
 {
-    const char *name = state->attribs.value[e_attrib_name];
-    struct dyn_array *array = &state->current.stream->usecase_array;
-    struct usecase *puc;
+    struct config_phase_stats *prev_phase;
+    int ret = 0;
 
-    puc = new_usecase(array, name);
-    if (puc == NULL) {
-        return -ENOMEM;
-    }
+    free((void *)state->cur_xml_file);
 
-    state->current.usecase = puc;
+    if (file == NULL) {
+        ALOGE("Invalid file name (NULL)\n");
+        return -EINVAL;
+    }
+    state->cur_xml_file = strdup(file);
 
-    ALOGV("Added usecase '%s'", name);
+    ALOGV("Reading configuration from %s\n", file);
+    prev_phase = enter_phase(state->cm, &state->cm->boot_stats.open);
+    state->file = fopen(file, "r");
+    if (!state->file) {
+        ALOGE("Failed to open config file %s", file);
+        ret = -ENOSYS;
+    }
+    enter_phase(state->cm, prev_phase);
 
-    return 0;
+    return ret;
 }
 
-static int parse_usecase_end(struct parse_state *state)
-{
-    /* Free unused memory in the case array */
-    compress_usecase(state->current.usecase);
-    return 0;
-}
 
-static int parse_set_start(struct parse_state *state)
+static void cleanup_parser(struct parse_state *state)
 {
-    const char *name = strdup(state->attribs.value[e_attrib_name]);
-    struct dyn_array *array = &state->current.stream->constants_array;
-    struct constant *pc;
-    const char *val = NULL;
+    if (state) {
+        path_names_free(state);
 
-    if (!name) {
-        return -ENOMEM;
-    }
+        card_names_free(state);
 
-    val = strdup(state->attribs.value[e_attrib_val]);
-    if (!val) {
-        free((void *)name);
-        return -ENOMEM;
-    }
+        codec_probe_free(state);
 
-    pc = new_constant(array, name, val);
-    if (pc == NULL) {
-        free((void *)name);
-        free((void *)val);
-        return -ENOMEM;
-    }
+        free_ctl_array(&state->init_path.ctl_array,
+                       &state->init_path.ctl_info_array);
+        free_ctl_array(&state->preinit_path.ctl_array,
+                       &state->preinit_path.ctl_info_array);
 
-    ALOGV("Added constant '%s'=%s", name, val);
+        if (state->parser) {
+            XML_ParserFree(state->parser);
+        }
 
-    return 0;
+        if (state->file) {
+            fclose(state->file);
+        }
+
+        free(state);
+    }
 }
 
-static int parse_enable_disable_start(struct parse_state *state, bool is_enable)
+static int init_state(struct parse_state *state)
 {
-    /* Handling of <enable> and <disable> is almost identical so
-     * they are both handled in this function
-     */
-
-    const char *path_name = state->attribs.value[e_attrib_path];
-    int i;
+    int ret;
 
-    i = find_path_name(state,path_name);
-    if (i < 0) {
-        ALOGE("Path '%s' not defined", path_name);
+    if (state == NULL) {
+        ALOGE("Invalid argument\n");
         return -EINVAL;
     }
 
-    if (is_enable) {
-        ALOGV("Add enable path '%s' (id=%d)",
-                                state->path_name_array.path_names[i], i);
-        state->current.stream->enable_path = i;
-    } else {
-        ALOGV("Add disable path '%s' (id=%d)",
-                                state->path_name_array.path_names[i], i);
-        state->current.stream->disable_path = i;
+    state->path_name_array.elem_size = sizeof(const char *);
+    state->card_name_array.elem_size = sizeof(struct card_name);
+    state->preinit_path.ctl_array.elem_size = sizeof(struct ctl);
+    state->init_path.ctl_array.elem_size = sizeof(struct ctl);
+    state->preinit_path.ctl_info_array.elem_size = sizeof(struct ctl_info);
+    state->init_path.ctl_info_array.elem_size = sizeof(struct ctl_info);
+    state->init_probe.codec_case_array.elem_size = sizeof(struct codec_case);
+
+    /* "off" and "on" are pre-defined path names */
+    ret = add_path_name(state, predefined_path_name_table[0]);
+    if (ret < 0) {
+        return ret;
+    }
+    ret = add_path_name(state, predefined_path_name_table[1]);
+    if (ret < 0) {
+        return ret;
     }
 
     return 0;
 }
 
-static int parse_enable_start(struct parse_state *state)
-{
-    return parse_enable_disable_start(state, true);
-}
-
-static int parse_disable_start(struct parse_state *state)
+static void print_ctls(const struct config_mgr *cm)
 {
-    return parse_enable_disable_start(state, false);
-}
+    const struct dyn_array *path_array, *ctl_array;
+    const struct device *dev;
+    const struct ctl *c;
+    uint dev_idx, path_idx, ctl_idx;
 
-static int parse_stream_ctl_start(struct parse_state *state)
-{
-    /* Parse a <ctl> element within a stream which defines
-     * mixer controls - currently only supports volume controls
-     */
+    if (!cm)
+        return;
 
-    const char *name = state->attribs.value[e_attrib_name];
-    const char *function = state->attribs.value[e_attrib_function];
-    const char *index = state->attribs.value[e_attrib_index];
-    struct mixer_ctl *ctl;
-    struct stream_control *streamctl;
-    uint idx_val = 0;
-    int v;
+    ALOGV("%d devices", cm->device_array.count);
+    for (dev_idx = 0; dev_idx < cm->device_array.count; dev_idx++) {
+        dev = &cm->device_array.devices[dev_idx];
+        path_array = &dev->path_array;
+        ALOGV("Device %d: type 0x%x, %d paths",
+                dev_idx, dev->type, path_array->count);
+        for (path_idx = 0; path_idx < path_array->count; path_idx++) {
+            ctl_array = &path_array->paths[path_idx].ctl_array;
+            ALOGV("Path %d: %d ctls", path_idx, ctl_array->count);
+            for (ctl_idx = 0; ctl_idx < ctl_array->count; ctl_idx++) {
+                c = &ctl_array->ctls[ctl_idx];
+                ALOGV("Ctl %d: "
+                        "name %s, "
+                        "index %d, "
+                        "array_count %d, "
+                        "type %d ",
+                        ctl_idx,
+                        c->info->name,
+                        c->index,
+                        c->array_count,
+                        c->info->type);
 
-    ctl = mixer_get_ctl_by_name(state->cm->mixer, name);
-    if (!ctl) {
-        ALOGE("Control '%s' not found", name);
-        return -EINVAL;
+                switch (c->info->type) {
+                case MIXER_CTL_TYPE_BOOL:
+                case MIXER_CTL_TYPE_INT:
+                    ALOGV("int: 0x%x", c->value.integer);
+                    break;
+                case MIXER_CTL_TYPE_BYTE:
+                    if (c->info->data_file_name) {
+                        ALOGV("file: %s", c->info->data_file_name);
+                    } else if (c->info->lazy) {
+                        ALOGV("lazy: \"%s\"", c->info->lazy_val);
+                    } else {
+                        ALOGV("byte[0]: %d", c->value.data[0]);
+                    }
+                    break;
+                default:
+                    ALOGV("string: \"%s\"", c->value.string);
+                    break;
+                }
+            }
+        }
     }
+}
 
-    /*
-     * Tinyalsa mixer_ctl_get_range_min()/mixer_ctl_get_range_max()
-     * return negative error if the control isn't valid. As the minimum
-     * value could be negative we can't check for errors so check in advance
-     * that the control will not cause an error from these functions.
-     */
-    if (mixer_ctl_get_type(ctl) != MIXER_CTL_TYPE_INT) {
-        ALOGE("Control '%s' is not an integer", name);
-        return -EINVAL;
-    }
+static int parse_config_file(struct config_mgr *cm, const char *file_name,
+                             bool reload)
+{
+    struct parse_state *state;
+    int ret = 0;
 
-    if (index != NULL) {
-        if (attrib_to_uint(&idx_val, state, e_attrib_index) == -EINVAL) {
-            return -EINVAL;
-        }
+    state = calloc(1, sizeof(struct parse_state));
+    if (!state) {
+        return -ENOMEM;
     }
 
-    if (0 == strcmp(function, "leftvol")) {
-        ALOGE_IF(ctl_ref_valid(&state->current.stream->controls.volume_left.ref),
-                                "Left volume control specified again");
-        streamctl = &(state->current.stream->controls.volume_left);
-    } else if (0 == strcmp(function, "rightvol")) {
-        ALOGE_IF(ctl_ref_valid(&state->current.stream->controls.volume_right.ref),
-                                "Right volume control specified again");
-        streamctl = &(state->current.stream->controls.volume_right);
-    } else {
-        ALOGE("'%s' is not a valid control function", function);
-        return -EINVAL;
-    }
+    state->cm = cm;
+    state->reload = reload;
+    state->init_probe.new_xml_file = NULL;
 
-    streamctl->index = idx_val;
+    ret = init_state(state);
+    if (ret < 0) {
+         goto fail;
+    }
 
-    switch (attrib_to_int(&v, state, e_attrib_min)) {
-    case -EINVAL:
-        ALOGE("Invalid min for '%s'", name);
-        return -EINVAL;
+    state->parser = XML_ParserCreate(NULL);
+    if ( !state->parser ) {
+        goto fail;
+    }
+    ret = open_config_file(state,file_name);
+    do {
+        if (ret != 0) {
+            ALOGE("Error while opening XML file\n");
+            ret = -ENOMEM;
+            break;
+        }
 
-    case -ENOENT:
-        /* Not specified, get control's min value */
-        streamctl->min = mixer_ctl_get_range_min(ctl);
-        break;
+        if (state->init_probe.new_xml_file != NULL) {
+            free((void*)state->init_probe.file);
+            state->init_probe.file = NULL;
+            XML_ParserReset(state->parser, NULL);
+            state->init_probe.new_xml_file = NULL;
+        }
 
-    default:
-        streamctl->min = v;
-        break;
-    }
+        XML_SetUserData(state->parser, state);
+        XML_SetElementHandler(state->parser, parse_section_start, parse_section_end);
+        ret = do_parse(state);
 
-    switch (attrib_to_int(&v, state, e_attrib_max)) {
-    case -EINVAL:
-        ALOGE("Invalid max for '%s'", name);
-        return -EINVAL;
+        if (ret != 0) {
+            ALOGE("Error while parsing XML file\n");
+            break;
+        }
 
-    case -ENOENT:
-        /* Not specified, get control's max value */
-        streamctl->max = mixer_ctl_get_range_max(ctl);
-        break;
+        if (state->init_probe.new_xml_file != NULL) {
+            if (state->file) {
+                fclose(state->file);
+            }
 
-    default:
-        streamctl->max = v;
-        break;
-    }
+            ALOGV("Opening new XML file");
+            ret = open_config_file(state, state->init_probe.new_xml_file);
+        }
+    } while (state->init_probe.new_xml_file != NULL);
 
-    ctl_set_ref(&streamctl->ref, ctl);
+    if ((ret >= 0) && !reload) {
+        print_ctls(cm);
 
-    ALOGV("(%p) Added control '%s' function '%s' range %d-%d",
-                state->current.stream,
-                name, function, streamctl->min, streamctl->max);
+        /* Initialize the mixer by applying the <init> path */
+        /* No need to take mutex during initialization */
+        enter_phase(cm, &cm->boot_stats.init);
+        HARNESS_SET_ALLOC_PHASE(INIT);
+        if (state->init_write_changed) {
+            apply_changed_ctls_l(cm, &state->init_path);
+        } else {
+            apply_path_l(cm, &state->init_path);
+        }
+        HARNESS_SET_ALLOC_PHASE(PARSE);
+    }
 
-    return 0;
+fail:
+    cleanup_parser(state);
+    return ret;
 }
 
-static int get_card_id_for_name(const char* name, uint32_t *id);
+/*********************************************************************
+ * Initialization
+ *********************************************************************/
 
-static int parse_stream_start(struct parse_state *state)
+/*
+ * If path is relative, make it absolute so it can be used to
+ * create the base path for any codec_probe redirections that are
+ * specified as relative. Returns a string that must be freed, or NULL
+ * with errno set
+ */
+static char *make_config_path(const char *config_file_name)
 {
-    const char *type = state->attribs.value[e_attrib_type];
-    const char *dir = state->attribs.value[e_attrib_dir];
-    const char *name = state->attribs.value[e_attrib_name];
-    bool out;
-    bool global;
-    uint32_t card = state->mixer_card_number;
-    uint32_t device = UINT_MAX;
-    uint32_t maxref = INT_MAX;
-    struct stream *s;
+    char *cwd_path;
+    char *absolute_path;
+    int err;
 
-    if (name != NULL) {
-        if (find_named_stream(state->cm, name) != NULL) {
-            ALOGE("Stream '%s' already declared", name);
-            return -EINVAL;
-        }
-        s = new_stream(&state->cm->named_stream_array, state->cm);
-    } else {
-        s = new_stream(&state->cm->anon_stream_array, state->cm);
+    while (isspace(*config_file_name)) {
+        ++config_file_name;
     }
 
-    if (s == NULL) {
-        return -ENOMEM;
+    if (config_file_name[0] == '/') {
+        return strdup(config_file_name);
     }
 
-    if (!name) {
-        global = false;
-    } else {
-        global = (strcmp(name, "global") == 0);
+#ifdef ANDROID
+    absolute_path = join_paths(ETC_PATH, config_file_name, 0);
+#else
+    /*
+     * realpath() will cause links to be pre-resolved now, prefer getcwd()
+     * which leaves links to be resolved at the time the file is opened.
+     */
+    cwd_path = malloc(sizeof(char) * PATH_MAX);
+    if (!cwd_path) {
+        return NULL;
     }
 
-    if (dir == NULL) {
-        if (!global) {
-            ALOGE("'dir' is required");
-            return -EINVAL;
-        }
-    } else if (0 == strcmp(dir, "out")) {
-        out = true;
-    } else if (0 == strcmp(dir, "in")) {
-        out = false;
-    } else {
-        ALOGE("'%s' is not a valid direction", dir);
-        return -EINVAL;
+    if (getcwd(cwd_path, PATH_MAX) == NULL) {
+        err = errno;
+        free(cwd_path);
+        errno = err;
+        return NULL;
     }
 
-    if (global) {
-        s->info.type = e_stream_global;
-    } else if (0 == strcmp(type, "hw")) {
-        if (name == NULL) {
-            ALOGE("Anonymous stream cannot be type hw");
-            return -EINVAL;
-        }
-        s->info.type = out ? e_stream_out_hw : e_stream_in_hw;
-    } else if (0 == strcmp(type, "pcm")) {
-        s->info.type = out ? e_stream_out_pcm : e_stream_in_pcm;
-    } else if (0 == strcmp(type, "compress")) {
-        s->info.type = out ? e_stream_out_compress : e_stream_in_compress;
-    } else {
-        ALOGE("'%s' not a valid stream type", type);
-        return -EINVAL;
-    }
+    absolute_path = join_paths(cwd_path, config_file_name, 0);
+    free(cwd_path);
+#endif
 
-    if (state->attribs.value[e_attrib_cardname] != NULL &&
-        state->attribs.value[e_attrib_card] != NULL) {
-        ALOGE("stream must be configured by only one of 'card' OR 'cardname'. Both provided.");
-        return -EINVAL;
-    }
+    return absolute_path;
+}
 
-    if (attrib_to_uint(&card, state, e_attrib_card) == -EINVAL) {
-        return -EINVAL;
-    }
+struct config_mgr *init_audio_config(const char *config_file_name)
+{
+    const uint64_t start_ns = time_now_ns();
+    int ret;
+    struct config_mgr* mgr;
 
-    if (state->attribs.value[e_attrib_cardname] != NULL &&
-        get_card_id_for_name(state->attribs.value[e_attrib_cardname], &card) != 0) {
-        return -EINVAL;
-    }
+    HARNESS_SET_ALLOC_PHASE(PARSE);
 
-    if (attrib_to_uint(&device, state, e_attrib_device) == -EINVAL) {
-        return -EINVAL;
-    }
+    mgr = new_config_mgr();
 
-    if (attrib_to_uint(&maxref, state, e_attrib_instances) == -EINVAL) {
-        return -EINVAL;
+    if (!mgr) {
+        errno = ENOMEM;
+        return NULL;
     }
 
-    if (attrib_to_uint(&s->info.rate, state, e_attrib_rate) == -EINVAL) {
-        return -EINVAL;
-    }
+    mgr->cur_phase = &mgr->boot_stats.parse;
+    mgr->cur_phase_start_ns = start_ns;
 
-    if (attrib_to_uint(&s->info.period_count, state,
-                        e_attrib_period_count) == -EINVAL) {
-        return -EINVAL;
-    }
+#ifdef ENABLE_COVERAGE
+    enableCoverageSignal();
+#endif
 
-    if (attrib_to_uint(&s->info.period_size, state,
-                        e_attrib_period_size) == -EINVAL) {
-        return -EINVAL;
+    mgr->config_file = make_config_path(config_file_name);
+    if (!mgr->config_file) {
+        ret = errno ? errno : ENOMEM;
+        free_audio_config(mgr);
+        errno = ret;
+        return NULL;
     }
 
-    if (name != NULL) {
-        s->name = strdup(name);
-        if (!s->name) {
-            return -ENOMEM;
-        }
+    ret = parse_config_file(mgr, mgr->config_file, false);
+    if (ret != 0) {
+        free_audio_config(mgr);
+        errno = -ret;
+        return NULL;
     }
-    s->info.card_number = card;
-    s->info.device_number = device;
-    s->max_ref_count = maxref;
 
-    ALOGV("Added stream %s type=%u card=%u device=%u max_ref=%u",
-                    s->name ? s->name : "",
-                    s->info.type, s->info.card_number, s->info.device_number,
-                    s->max_ref_count );
+    /* Free unused memory in the device and stream arrays */
+    compress_config_mgr(mgr);
 
-    state->current.stream = s;
+    start_card_workers(mgr);
 
-    return 0;
-}
+    enter_phase(mgr, NULL);
+    mgr->boot_stats.total_ns = time_now_ns() - start_ns;
 
-static int parse_stream_end(struct parse_state *state)
-{
-    /* Free unused memory in the ctl array */
-    compress_stream(state->current.stream);
-    return 0;
+    HARNESS_SET_ALLOC_PHASE(STEADY);
+
+    return mgr;
 }
 
-static int parse_device_start(struct parse_state *state)
-{
-    const char *dev_name = state->attribs.value[e_attrib_name];
-    struct dyn_array *array = &state->cm->device_array;
-    uint32_t device_flag;
-    uint32_t *existing_devices;
-    const struct parse_device *p;
-    struct device* d;
+/*********************************************************************
+ * Reload
+ *
+ * The new configuration is parsed into a separate config_mgr and its
+ * devices, mixers and stream settings are moved into the live config_mgr.
+ * The struct stream objects are kept, because the HAL holds pointers to
+ * them, so the streams must be the same in both configurations.
+ *********************************************************************/
 
-    p = parse_match_device(dev_name);
+static bool reload_streams_match(const struct dyn_array *old_array,
+                                 const struct dyn_array *new_array)
+{
+    const struct stream *o = old_array->streams;
+    const struct stream *n = new_array->streams;
+    uint i;
 
-    if (p == NULL) {
-        ALOGE("'%s' is not a valid device", dev_name);
-        return -EINVAL;
+    if (old_array->count != new_array->count) {
+        return false;
     }
 
-    device_flag = p->device;
+    for (i = 0; i < old_array->count; ++i, ++o, ++n) {
+        if ((o->info.type != n->info.type)
+                || (o->info.card_number != n->info.card_number)
+                || (o->info.device_number != n->info.device_number)) {
+            return false;
+        }
 
-    if (device_flag != 0) {
-        /* not the global device - add it to list of available devices */
-        if (device_flag & AUDIO_DEVICE_BIT_IN) {
-                existing_devices = &state->cm->supported_input_devices;
-        } else {
-                existing_devices = &state->cm->supported_output_devices;
+        if ((o->name != NULL) != (n->name != NULL)) {
+            return false;
         }
 
-        if ((device_flag & *existing_devices) == device_flag) {
-            ALOGE("Device '%s' already defined", dev_name);
-            ALOGE("Device = 0x%x extisting_devices = 0x%x", device_flag, *existing_devices);
-            ALOGE("supported_output_devices=0x%x supported_input_devices=0x%x",
-                            state->cm->supported_output_devices,
-                            state->cm->supported_input_devices );
-            return -EINVAL;
+        if ((o->name != NULL) && (strcmp(o->name, n->name) != 0)) {
+            return false;
         }
-        *existing_devices |= device_flag;
     }
 
-    ALOGV("Add device '%s'", dev_name);
-
-    d = new_device(array, device_flag);
-    if (d == NULL) {
+    return true;
+}
+
+/* True if two <ctl> elements write the same value to the same control */
+static bool reload_ctl_equal(const struct config_mgr *ocm, const struct ctl *o,
+                             const struct config_mgr *ncm, const struct ctl *n)
+{
+    if ((strcmp(o->info->name, n->info->name) != 0) || (o->index != n->index)) {
+        return false;
+    }
+
+    if (ocm->mixers[o->ref.mixer].card != ncm->mixers[n->ref.mixer].card) {
+        return false;
+    }
+
+    /* A control that has not been opened still holds its value string */
+    if (!ctl_ref_valid(&o->ref) || !ctl_ref_valid(&n->ref)
+            || (o->info->type != n->info->type)) {
+        return false;
+    }
+
+    switch (n->info->type) {
+    case MIXER_CTL_TYPE_BOOL:
+    case MIXER_CTL_TYPE_INT:
+        return o->value.integer == n->value.integer;
+    case MIXER_CTL_TYPE_ENUM:
+        return strcmp(o->value.string, n->value.string) == 0;
+    case MIXER_CTL_TYPE_BYTE:
+        return (o->array_count == n->array_count)
+               && (memcmp(o->value.data, n->value.data, n->array_count) == 0);
+    default:
+        return false;
+    }
+}
+
+static int reload_add_ctls(struct dyn_array *array, struct ctl *ctls,
+                           int count)
+{
+    if (dyn_array_extend(array) < 0) {
         return -ENOMEM;
     }
-    state->current.device = d;
 
+    array->segments[array->count - 1].ctls = ctls;
+    array->segments[array->count - 1].count = count;
     return 0;
 }
 
-static int parse_device_end(struct parse_state *state)
+static int count_segment_ctls(const struct ctl_segment *segs, int count)
 {
-    /* Free unused memory in the path array */
-    compress_device(state->current.device);
-    return 0;
+    int total = 0;
+
+    for (; count > 0; --count, ++segs) {
+        total += segs->count;
+    }
+
+    return total;
 }
 
-static int get_card_name_for_id(unsigned int id, char* name, int len)
+/*
+ * Add the controls of an active path whose value is different in the new
+ * configuration. If controls have been added or removed the whole new path
+ * is written.
+ */
+static int reload_diff_path(const struct config_mgr *ocm,
+                            const struct path *old_path,
+                            const struct config_mgr *ncm,
+                            struct path *new_path,
+                            struct dyn_array *writes)
 {
-    char cardInfoFile[32];
-    FILE *fp;
-    int ret = 0;
-    snprintf(cardInfoFile, sizeof(cardInfoFile), "/proc/asound/card%u/id", id);
+    const struct ctl_segment *osegs, *nsegs;
+    struct ctl_segment oown, nown;
+    int ocount, ncount;
+    int i, oi, ret;
 
-    fp = fopen(cardInfoFile, "r");
-    if (fp == NULL) {
-        ALOGE("Failed to open file: %s", cardInfoFile);
-        return -EINVAL;
+    if (new_path == NULL) {
+        return 0;
     }
 
-    if (fgets(name, len, fp) == NULL) {
-        ALOGE("Failed to read name from file: %s", cardInfoFile);
-        ret = -EINVAL;
-        goto read_fail;
-    }
-    //Only return first line of file, without new lines.
-    name[strcspn(name, "\n")] = 0;
-read_fail:
-    fclose(fp);
-    return ret;
-}
+    ncount = get_ctl_segments(&new_path->ctl_array, &new_path->segment_array,
+                              &nown, &nsegs);
 
-static int get_card_id_for_name(const char* name, uint32_t *id)
-{
-    if (name == NULL) {
-        return -EINVAL;
+    if (old_path != NULL) {
+        ocount = get_ctl_segments(&old_path->ctl_array,
+                                  &old_path->segment_array, &oown, &osegs);
     }
 
-    DIR* dir;
-    struct dirent* entry;
-    int ret = -EINVAL;
+    if ((old_path == NULL) || (count_segment_ctls(osegs, ocount)
+                                != count_segment_ctls(nsegs, ncount))) {
+        for (; ncount > 0; --ncount, ++nsegs) {
+            ret = reload_add_ctls(writes, nsegs->ctls, nsegs->count);
+            if (ret < 0) {
+                return ret;
+            }
+        }
+        return 0;
+    }
 
-    dir = opendir("/proc/asound");
+    /* The runs of the two paths can be split differently */
+    for (oi = 0; ncount > 0; --ncount, ++nsegs) {
+        for (i = 0; i < nsegs->count; ++i, ++oi) {
+            while (oi == osegs->count) {
+                ++osegs;
+                oi = 0;
+            }
 
-    if (dir != NULL) {
-        while ((entry = readdir(dir)) != NULL) {
-            unsigned int t_id;
-            if (sscanf(entry->d_name, "card%u" , &t_id)) {
-                char t_name[128];
-                if (get_card_name_for_id(t_id, t_name, sizeof(t_name)) == 0 &&
-                        strcmp(t_name, name) == 0) {
-                    ALOGV("Found card %u with name %s", t_id, name);
-                    *id = t_id;
-                    ret = 0;
-                    break;
+            if (!reload_ctl_equal(ocm, &osegs->ctls[oi], ncm, &nsegs->ctls[i])) {
+                ret = reload_add_ctls(writes, &nsegs->ctls[i], 1);
+                if (ret < 0) {
+                    return ret;
                 }
             }
         }
-        closedir(dir);
     }
-    return ret;
+
+    return 0;
 }
 
-static int parse_mixer_start(struct parse_state *state)
+static struct path *find_path_by_id(const struct device *pdev, int id)
 {
-    uint32_t card = MIXER_CARD_DEFAULT;
+    struct path *ppath = pdev->path_array.paths;
+    int i;
 
-    ALOGV("parse_mixer_start");
-    if (attrib_to_uint(&card, state, e_attrib_card) == 0) {
-        if (state->attribs.value[e_attrib_name] != NULL) {
-            ALOGE("Mixer must be configured by only one of 'card' OR 'name'. Both provided.");
-            return -EINVAL;
+    for (i = pdev->path_array.count; i > 0; --i, ++ppath) {
+        if (ppath->id == id) {
+            return ppath;
         }
-    } else if (get_card_id_for_name(state->attribs.value[e_attrib_name],
-                                    &card) != 0) {
-        return -EINVAL;
     }
 
-    ALOGV("Opening mixer card %u", card);
+    return NULL;
+}
 
-    state->cm->mixer = mixer_open(card);
+static const struct device *find_device_by_type(const struct config_mgr *cm,
+                                                uint32_t type)
+{
+    const struct device *pdev = cm->device_array.devices;
+    int i;
 
-    if (!state->cm->mixer) {
-        ALOGE("Failed to open mixer card %u", card);
-        return -EINVAL;
+    for (i = cm->device_array.count; i > 0; --i, ++pdev) {
+        if (pdev->type == type) {
+            return pdev;
+        }
     }
 
-    state->mixer_card_number = card;
-
-    return 0;
+    return NULL;
 }
 
-static int parse_mixer_end(struct parse_state *state)
+/*
+ * Add the changed controls of the enable paths of the open streams that
+ * are using a device. The path ids of the two configurations can be
+ * different so the paths are matched through the streams.
+ */
+static int reload_diff_stream_paths(const struct config_mgr *cm,
+                                    const struct device *old_dev,
+                                    const struct dyn_array *old_streams,
+                                    const struct config_mgr *nc,
+                                    struct device *new_dev,
+                                    const struct dyn_array *new_streams,
+                                    struct dyn_array *writes)
 {
-    ALOGV("parse_mixer_end");
+    const struct stream *o = old_streams->streams;
+    const struct stream *n = new_streams->streams;
+    const struct stream *prev;
+    uint i, j;
+    int ret;
 
-    /* Now we can allow all other root elements but not another <mixer> */
-    state->stack.entry[state->stack.index - 1].valid_subelem =
-                                                  BIT(e_elem_device)
-                                                | BIT(e_elem_stream);
-    return 0;
-}
+    for (i = 0; i < old_streams->count; ++i) {
+        if (o[i].ref_count == 0) {
+            continue;
+        }
 
-static int parse_set_error(struct parse_state *state, int error)
-{
-    state->parse_error = error;
-    state->error_line = XML_GetCurrentLineNumber(state->parser);
-    return error;
-}
+        if ((old_dev->type != 0)
+                && !route_uses_device(cm, o[i].current_devices, old_dev)) {
+            continue;
+        }
 
-static int parse_log_error(struct parse_state *state)
-{
-    int err = state->parse_error;
-    int xml_err = XML_GetErrorCode(state->parser);
+        /* Only diff each path once if several streams use it */
+        for (j = 0, prev = o; j < i; ++j, ++prev) {
+            if ((prev->ref_count > 0) && (n[j].enable_path == n[i].enable_path)
+                    && ((old_dev->type == 0)
+                        || route_uses_device(cm, prev->current_devices,
+                                             old_dev))) {
+                break;
+            }
+        }
+        if (j < i) {
+            continue;
+        }
 
-    if((err < 0) || (xml_err != XML_ERROR_NONE)) {
-        ALOGE_IF(err < 0, "Error in config file at line %d", state->error_line);
-        ALOGE_IF(xml_err != XML_ERROR_NONE,
-                            "Parse error '%s' in config file at line %u",
-                            XML_ErrorString(xml_err),
-                            (uint)XML_GetCurrentLineNumber(state->parser));
-        return -EINVAL;
-    } else {
-        return 0;
+        ret = reload_diff_path(cm, find_path_by_id(old_dev, o[i].enable_path),
+                               nc, find_path_by_id(new_dev, n[i].enable_path),
+                               writes);
+        if (ret < 0) {
+            return ret;
+        }
     }
+
+    return 0;
 }
 
-static int extract_attribs(struct parse_state *state, int elem_index)
+/*
+ * Copy the reference counts of the devices into the new configuration and
+ * collect the controls of the active paths that have changed
+ */
+static int reload_diff_l(struct config_mgr *cm, struct config_mgr *nc,
+                         struct dyn_array *writes)
 {
-    const uint32_t valid_attribs = elem_table[elem_index].valid_attribs;
-    uint32_t required_attribs = elem_table[elem_index].required_attribs;
-    const XML_Char **attribs = state->attribs.all;
-    int i;
+    struct device *new_dev = nc->device_array.devices;
+    const struct device *old_dev;
+    int i, ret;
+
+    for (i = nc->device_array.count; i > 0; --i, ++new_dev) {
+        old_dev = find_device_by_type(cm, new_dev->type);
+        if ((old_dev == NULL) || (old_dev->use_count == 0)) {
+            continue;
+        }
 
-    memset(&state->attribs.value, 0, sizeof(state->attribs.value));
+        new_dev->use_count = old_dev->use_count;
 
-    while (attribs[0] != NULL) {
-        for (i = 0; i < e_attrib_count; ++i ) {
-            if ((BIT(i) & valid_attribs) != 0) {
-                if (0 == strcmp(attribs[0], attrib_table[i].name)) {
-                    state->attribs.value[i] = attribs[1];
-                    required_attribs &= ~BIT(i);
-                    break;
-                }
-            }
+        ret = reload_diff_path(cm, find_path_by_id(old_dev, e_path_id_on),
+                               nc, find_path_by_id(new_dev, e_path_id_on),
+                               writes);
+        if (ret < 0) {
+            return ret;
         }
-        if (i >= e_attrib_count) {
-            ALOGE("Attribute '%s' not allowed here", attribs[0] );
-            return -EINVAL;
+
+        ret = reload_diff_stream_paths(cm, old_dev, &cm->anon_stream_array,
+                                       nc, new_dev, &nc->anon_stream_array,
+                                       writes);
+        if (ret < 0) {
+            return ret;
         }
 
-        attribs += 2;
+        ret = reload_diff_stream_paths(cm, old_dev, &cm->named_stream_array,
+                                       nc, new_dev, &nc->named_stream_array,
+                                       writes);
+        if (ret < 0) {
+            return ret;
+        }
     }
 
-    if (required_attribs != 0) {
-        for (i = 0; i < e_attrib_count; ++i ) {
-            if ((required_attribs & BIT(i)) != 0) {
-                ALOGE("Attribute '%s' required", attrib_table[i].name);
-            }
-        }
-        return -EINVAL;
+    old_dev = cm->device_array.devices;
+    for (i = cm->device_array.count; i > 0; --i, ++old_dev) {
+        ALOGW_IF((old_dev->use_count > 0)
+                    && (find_device_by_type(nc, old_dev->type) == NULL),
+                 "Device 0x%x is in use but has been removed", old_dev->type);
     }
 
     return 0;
 }
 
-static void parse_section_start(void *data, const XML_Char *name,
-                                const XML_Char **attribs)
+/*
+ * Make room to retire the constants of every stream, so that the swap
+ * can't fail part way through
+ */
+static int reload_reserve_retired_l(struct config_mgr *cm)
 {
-    struct parse_state *state = (struct parse_state *)data;
-    int stack_index = state->stack.index;
-    const uint32_t valid_elems =
-                        state->stack.entry[stack_index].valid_subelem;
-    int i;
-
-    if (state->parse_error != 0) {
-        return;
-    }
-
-    ALOGV("parse start <%s>", name );
+    struct dyn_array *array = &cm->retired_constants_array;
+    const uint in_use = array->count;
+    const uint count = cm->anon_stream_array.count +
+                       cm->named_stream_array.count;
+    uint i;
+    int ret = 0;
 
-    /* Find element in list of elements currently valid */
-    for (i = 0; i < e_elem_count; ++i) {
-        if ((BIT(i) & valid_elems) != 0) {
-            if (0 == strcmp(name, elem_table[i].name)) {
-                break;
-            }
+    for (i = 0; i < count; ++i) {
+        ret = dyn_array_extend(array);
+        if (ret < 0) {
+            break;
         }
     }
 
-    if ((i >= e_elem_count) || (stack_index >= MAX_PARSE_DEPTH)) {
-        ALOGE("Element '%s' not allowed here", name);
-        parse_set_error(state, -EINVAL);
-    } else {
-        /* element ok - push onto stack */
-        ++stack_index;
-        state->stack.entry[stack_index].elem_index = i;
-        state->stack.entry[stack_index].valid_subelem
-                                                = elem_table[i].valid_subelem;
-        state->stack.index = stack_index;
+    array->count = in_use;
+    return ret;
+}
 
-        /* Extract attributes and call handler */
-        state->attribs.all = attribs;
-        if (extract_attribs(state, i) != 0) {
-            parse_set_error(state, -EINVAL);
+/* Move the settings of the new streams into the streams held by the HAL */
+static void reload_move_streams(struct config_mgr *cm,
+                                struct dyn_array *old_array,
+                                struct dyn_array *new_array)
+{
+    struct dyn_array *retired = &cm->retired_constants_array;
+    struct stream *o = old_array->streams;
+    struct stream *n = new_array->streams;
+    struct dyn_array tmp;
+    uint i;
+
+    /* o->info is read by the HAL without the lock so it is not changed */
+    for (i = 0; i < old_array->count; ++i, ++o, ++n) {
+        o->max_ref_count = n->max_ref_count;
+        o->enable_path = n->enable_path;
+        o->disable_path = n->disable_path;
+        o->make_before_break = n->make_before_break;
+        o->controls = n->controls;
+
+        /* The old use-cases are freed with the new config_mgr, they are
+         * only used with the lock held
+         */
+        tmp = o->usecase_array;
+        o->usecase_array = n->usecase_array;
+        n->usecase_array = tmp;
+
+        /* get_stream_constant_string() hands out pointers into the old
+         * constants, so keep them. Space was reserved by
+         * reload_reserve_retired_l()
+         */
+        if (o->constants_array.count > 0) {
+            retired->arrays[retired->count++] = o->constants_array;
         } else {
-            if (elem_table[i].start_fn) {
-                parse_set_error(state, (*elem_table[i].start_fn)(state));
-            }
+            dyn_array_free(&o->constants_array);
         }
+        o->constants_array = n->constants_array;
+        memset(&n->constants_array, 0, sizeof(n->constants_array));
     }
 }
 
-static void parse_section_end(void *data, const XML_Char *name)
+static void reload_swap_l(struct config_mgr *cm, struct config_mgr *nc)
 {
-    struct parse_state *state = (struct parse_state *)data;
-    const int i = state->stack.entry[state->stack.index].elem_index;
+    struct config_mixer mixers[MAX_MIXERS];
+    struct dyn_array tmp;
+    unsigned int count;
+
+    memcpy(mixers, cm->mixers, sizeof(mixers));
+    count = cm->mixer_count;
+    memcpy(cm->mixers, nc->mixers, sizeof(mixers));
+    cm->mixer_count = nc->mixer_count;
+    memcpy(nc->mixers, mixers, sizeof(mixers));
+    nc->mixer_count = count;
+
+    tmp = cm->device_array;
+    cm->device_array = nc->device_array;
+    nc->device_array = tmp;
+
+    /* The paths and cases of the new configuration refer to these */
+    tmp = cm->path_def_array;
+    cm->path_def_array = nc->path_def_array;
+    nc->path_def_array = tmp;
+
+    reload_move_streams(cm, &cm->anon_stream_array, &nc->anon_stream_array);
+    reload_move_streams(cm, &cm->named_stream_array, &nc->named_stream_array);
+
+    cm->supported_output_devices = nc->supported_output_devices;
+    cm->supported_input_devices = nc->supported_input_devices;
+    cm->net_routes = nc->net_routes;
+
+    /* The cached cases have moved to nc, and none of the new ones are
+     * loaded yet
+     */
+    memset(&cm->case_cache, 0, sizeof(cm->case_cache));
+    cm->case_cache.budget = nc->case_cache.budget;
+}
 
-    if (state->parse_error != 0) {
-        return;
+int reload_audio_config(struct config_mgr *cm, const char *config_file_name)
+{
+    const uint64_t start_ns = time_now_ns();
+    struct dyn_array writes = { .elem_size = sizeof(struct ctl_segment) };
+    struct config_mgr *nc;
+    uint64_t locked_ns;
+    char *path;
+    int written = 0;
+    uint i;
+    int ret;
+
+    if (cm == NULL) {
+        return -EINVAL;
     }
 
-    ALOGV("parse end <%s>", name );
+    if (in_transaction(cm)) {
+        ALOGE("Can't reload inside a transaction");
+        return -EBUSY;
+    }
 
-    if (elem_table[i].end_fn) {
-        state->parse_error = (*elem_table[i].end_fn)(state);
+    if (config_file_name != NULL) {
+        path = make_config_path(config_file_name);
+    } else {
+        /* Another reload can replace it */
+        locked_ns = lock_cm(cm, e_config_lock_reload);
+        path = strdup(cm->config_file);
+        unlock_cm(cm, e_config_lock_reload, locked_ns);
     }
 
-    --state->stack.index;
-}
+    if (!path) {
+        return -ENOMEM;
+    }
 
-static int do_parse(struct parse_state *state)
-{
-    bool eof = false;
-    int len;
-    int ret = 0;
+    nc = new_config_mgr();
+    if (!nc) {
+        free(path);
+        return -ENOMEM;
+    }
+    nc->config_file = path;
 
-    state->parse_error = 0;
-    state->stack.index = 0;
-    /* First element must be <audiohal> */
-    state->stack.entry[0].valid_subelem = BIT(e_elem_audiohal);
+    /* Parse without holding the lock, the live config is not touched */
+    ALOGV("Reloading configuration from %s", path);
+    ret = parse_config_file(nc, path, true);
+    if (ret != 0) {
+        free_audio_config(nc);
+        return ret;
+    }
 
-    while (!eof && (state->parse_error == 0) ) {
-        len = fread(state->read_buf, 1, sizeof(state->read_buf), state->file);
-        if (ferror(state->file)) {
-            ALOGE("I/O error reading config file");
-            ret = -EIO;
-            break;
-        }
+    compress_config_mgr(nc);
+
+    locked_ns = lock_cm(cm, e_config_lock_reload);
+
+    if (!reload_streams_match(&cm->anon_stream_array, &nc->anon_stream_array)
+            || !reload_streams_match(&cm->named_stream_array,
+                                     &nc->named_stream_array)) {
+        ALOGE("Streams have changed, reload needs a restart");
+        ret = -EINVAL;
+        goto out;
+    }
+
+    ret = reload_reserve_retired_l(cm);
+    if (ret < 0) {
+        goto out;
+    }
+
+    ret = reload_diff_l(cm, nc, &writes);
+    if (ret < 0) {
+        goto out;
+    }
+
+    stop_card_workers(cm);
+    reload_swap_l(cm, nc);
+    cm->card_jobs.exit = false;
+    start_card_workers(cm);
+
+    /* The new path is now in cm and its controls are on the new mixers */
+    for (i = 0; i < writes.count; ++i) {
+        apply_ctls_l(cm, writes.segments[i].ctls, writes.segments[i].count);
+        written += writes.segments[i].count;
+    }
+
+    /* nc now holds the old config */
+    path = cm->config_file;
+    cm->config_file = nc->config_file;
+    nc->config_file = path;
+
+out:
+    unlock_cm(cm, e_config_lock_reload, locked_ns);
+
+    ALOGV("reload_audio_config: %d controls written", written);
+    trace_event(cm, e_config_trace_reload, CONFIG_TRACE_NO_STREAM, start_ns,
+                (uint32_t)written, 0, (uint32_t)ret);
 
-        eof = feof(state->file);
+    dyn_array_free(&writes);
+    free_audio_config(nc);
+    return ret;
+}
 
-        if (XML_Parse(state->parser,
-                      state->read_buf,
-                      len,
-                      eof) == XML_STATUS_SUSPENDED) {
-            /* A codec_probe redirection suspends parsing of the current file */
-            break;
-        }
-        if (parse_log_error(state) < 0) {
-            ret = -EINVAL;
-            break;
-        }
+int get_config_mgr_boot_stats(const struct config_mgr *cm,
+                              struct config_mgr_boot_stats *stats)
+{
+    if ((cm == NULL) || (stats == NULL)) {
+        return -EINVAL;
     }
 
-    return ret;
+    *stats = cm->boot_stats;
+    return 0;
 }
 
-static int open_config_file(struct parse_state *state, const char *file)
+#ifdef TINYHAL_CTL_WRITE_STATS
+int get_ctl_write_stats(struct config_mgr *cm,
+                        struct ctl_write_stats *stats,
+                        unsigned int max_count)
 {
-    free((void *)state->cur_xml_file);
+    struct ctl_write_stats_table *table;
+    unsigned int i;
+    int n = 0;
 
-    if (file == NULL) {
-        ALOGE("Invalid file name (NULL)\n");
+    if (cm == NULL) {
         return -EINVAL;
     }
-    state->cur_xml_file = strdup(file);
 
-    ALOGV("Reading configuration from %s\n", file);
-    state->file = fopen(file, "r");
-    if (state->file) {
-        return 0;
-    } else {
-        ALOGE_IF(!state->file, "Failed to open config file %s", file);
-        return -ENOSYS;
+    table = &cm->write_stats;
+
+    pthread_mutex_lock(&table->lock);
+    for (i = 0; i < table->count; ++i) {
+        if (table->entries[i].writes == 0) {
+            continue;
+        }
+
+        if ((stats != NULL) && ((unsigned int)n < max_count)) {
+            stats[n] = table->entries[i];
+        }
+        ++n;
     }
-}
+    pthread_mutex_unlock(&table->lock);
 
+    return n;
+}
 
-static void cleanup_parser(struct parse_state *state)
+void reset_ctl_write_stats(struct config_mgr *cm)
 {
-    if (state) {
-        path_names_free(state);
+    struct ctl_write_stats_table *table;
+    struct ctl_write_stats *entry;
+    unsigned int i;
 
-        codec_probe_free(state);
+    if (cm == NULL) {
+        return;
+    }
 
-        free_ctl_array(&state->init_path.ctl_array);
-        free_ctl_array(&state->preinit_path.ctl_array);
+    table = &cm->write_stats;
 
-        if (state->parser) {
-            XML_ParserFree(state->parser);
-        }
+    pthread_mutex_lock(&table->lock);
+    for (i = 0; i < table->count; ++i) {
+        /* Keep the name, the pointer might have been given to a caller */
+        entry = &table->entries[i];
+        entry->writes = 0;
+        entry->total_ns = 0;
+        entry->max_ns = 0;
+        memset(entry->hist, 0, sizeof(entry->hist));
+    }
+    pthread_mutex_unlock(&table->lock);
+}
 
-        if (state->file) {
-            fclose(state->file);
-        }
+static void free_ctl_write_stats(struct config_mgr *cm)
+{
+    struct ctl_write_stats_table *table = &cm->write_stats;
+    unsigned int i;
 
-        free(state);
+    for (i = 0; i < table->count; ++i) {
+        free((void *)table->entries[i].name);
     }
+    free(table->entries);
+    pthread_mutex_destroy(&table->lock);
+}
+#else
+int get_ctl_write_stats(struct config_mgr *cm,
+                        struct ctl_write_stats *stats,
+                        unsigned int max_count)
+{
+    (void)cm;
+    (void)stats;
+    (void)max_count;
+    return -ENOSYS;
 }
 
-static int init_state(struct parse_state *state)
+void reset_ctl_write_stats(struct config_mgr *cm)
 {
-    int ret;
+    (void)cm;
+}
+#endif /* TINYHAL_CTL_WRITE_STATS */
 
-    if (state == NULL) {
-        ALOGE("Invalid argument\n");
+#ifdef TINYHAL_LOCK_STATS
+int get_config_lock_stats(struct config_mgr *cm,
+                          struct config_lock_stats *stats,
+                          unsigned int max_count)
+{
+    unsigned int n = e_config_lock_api_count;
+
+    if ((cm == NULL) || (stats == NULL)) {
         return -EINVAL;
     }
 
-    state->path_name_array.elem_size = sizeof(const char *);
-    state->preinit_path.ctl_array.elem_size = sizeof(struct ctl);
-    state->init_path.ctl_array.elem_size = sizeof(struct ctl);
-    state->init_probe.codec_case_array.elem_size = sizeof(struct codec_case);
-
-    /* "off" and "on" are pre-defined path names */
-    ret = add_path_name(state, predefined_path_name_table[0]);
-    if (ret < 0) {
-        return ret;
+    if (n > max_count) {
+        n = max_count;
     }
-    ret = add_path_name(state, predefined_path_name_table[1]);
-    if (ret < 0) {
-        return ret;
+
+    pthread_mutex_lock(&cm->lock);
+    memcpy(stats, cm->lock_stats, n * sizeof(*stats));
+    pthread_mutex_unlock(&cm->lock);
+
+    return n;
+}
+
+void reset_config_lock_stats(struct config_mgr *cm)
+{
+    if (cm == NULL) {
+        return;
     }
 
-    return 0;
+    pthread_mutex_lock(&cm->lock);
+    memset(cm->lock_stats, 0, sizeof(cm->lock_stats));
+    pthread_mutex_unlock(&cm->lock);
+}
+#else
+int get_config_lock_stats(struct config_mgr *cm,
+                          struct config_lock_stats *stats,
+                          unsigned int max_count)
+{
+    (void)cm;
+    (void)stats;
+    (void)max_count;
+    return -ENOSYS;
 }
 
-static void print_ctls(const struct config_mgr *cm)
+void reset_config_lock_stats(struct config_mgr *cm)
 {
-    const struct dyn_array *path_array, *ctl_array;
-    const struct device *dev;
-    const struct ctl *c;
-    uint dev_idx, path_idx, ctl_idx;
+    (void)cm;
+}
+#endif /* TINYHAL_LOCK_STATS */
 
-    if (!cm)
-        return;
+/* Whether a route uses a device, matching in the same way as
+ * apply_paths_to_devices_l()
+ */
+static bool route_uses_device(const struct config_mgr *cm, uint32_t devices,
+                              const struct device *target)
+{
+    const struct device *pdev = cm->device_array.devices;
+    int dev_count = cm->device_array.count;
+    const uint32_t input_flag = devices & AUDIO_DEVICE_BIT_IN;
 
-    ALOGV("%d devices", cm->device_array.count);
-    for (dev_idx = 0; dev_idx < cm->device_array.count; dev_idx++) {
-        dev = &cm->device_array.devices[dev_idx];
-        path_array = &dev->path_array;
-        ALOGV("Device %d: type 0x%x, %d paths",
-                dev_idx, dev->type, path_array->count);
-        for (path_idx = 0; path_idx < path_array->count; path_idx++) {
-            ctl_array = &path_array->paths[path_idx].ctl_array;
-            ALOGV("Path %d: %d ctls", path_idx, ctl_array->count);
-            for (ctl_idx = 0; ctl_idx < ctl_array->count; ctl_idx++) {
-                c = &ctl_array->ctls[ctl_idx];
-                ALOGV("Ctl %d: "
-                        "name %s, "
-                        "index %d, "
-                        "array_count %d, "
-                        "type %d ",
-                        ctl_idx,
-                        c->name,
-                        c->index,
-                        c->array_count,
-                        c->type);
+    devices &= ~AUDIO_DEVICE_BIT_IN;
 
-                switch (c->type) {
-                case MIXER_CTL_TYPE_BOOL:
-                case MIXER_CTL_TYPE_INT:
-                    ALOGV("int: 0x%x", c->value.integer);
-                    break;
-                case MIXER_CTL_TYPE_BYTE:
-                    if (c->data_file_name) {
-                        ALOGV("file: %s", c->data_file_name);
-                    } else {
-                        ALOGV("byte[0]: %d", c->value.data[0]);
-                    }
-                    break;
-                default:
-                    ALOGV("string: \"%s\"", c->value.string);
-                    break;
-                }
+    while ((dev_count > 0) && (devices != 0)) {
+        if (((pdev->type & input_flag) == input_flag)
+                    && ((pdev->type & devices) != 0)) {
+            if (pdev == target) {
+                return true;
             }
+            devices &= ~pdev->type;
         }
+
+        --dev_count;
+        ++pdev;
     }
+
+    return false;
 }
 
-static int parse_config_file(struct config_mgr *cm, const char *file_name)
+#ifdef THCM_TEST_HARNESS_CHECKS
+static bool device_has_on_off_paths(const struct device *pdev)
 {
-    struct parse_state *state;
-    int ret = 0;
+    const struct path *ppath = pdev->path_array.paths;
+    int path_count = pdev->path_array.count;
+    bool on = false;
+    bool off = false;
 
-    state = calloc(1, sizeof(struct parse_state));
-    if (!state) {
-        return -ENOMEM;
+    for (; path_count > 0; --path_count, ++ppath) {
+        if (ppath->id == e_path_id_on) {
+            on = true;
+        } else if (ppath->id == e_path_id_off) {
+            off = true;
+        }
     }
 
-    state->cm = cm;
-    state->init_probe.new_xml_file = NULL;
-
-    ret = init_state(state);
-    if (ret < 0) {
-         goto fail;
-    }
+    return on && off;
+}
 
-    state->parser = XML_ParserCreate(NULL);
-    if ( !state->parser ) {
-        goto fail;
-    }
-    ret = open_config_file(state,file_name);
-    do {
-        if (ret != 0) {
-            ALOGE("Error while opening XML file\n");
-            ret = -ENOMEM;
-            break;
+static int check_stream_array_l(const struct dyn_array *array,
+                                unsigned int *refs)
+{
+    const struct stream *s = array->streams;
+    int errors = 0;
+    unsigned int i;
+
+    for (i = 0; i < array->count; ++i, ++s) {
+        if ((s->ref_count < 0) || (s->ref_count > s->max_ref_count)) {
+            ALOGE("stream %p: ref_count %d outside 0..%d",
+                  s, s->ref_count, s->max_ref_count);
+            ++errors;
+        } else if ((s->ref_count == 0) && (s->current_devices != 0)) {
+            ALOGE("stream %p: closed but routed to 0x%x",
+                  s, s->current_devices);
+            ++errors;
         }
 
-        if (state->init_probe.new_xml_file != NULL) {
-            free((void*)state->init_probe.file);
-            state->init_probe.file = NULL;
-            XML_ParserReset(state->parser, NULL);
-            state->init_probe.new_xml_file = NULL;
+        if (s->ref_count > 0) {
+            *refs += s->ref_count;
         }
+    }
 
-        XML_SetUserData(state->parser, state);
-        XML_SetElementHandler(state->parser, parse_section_start, parse_section_end);
-        ret = do_parse(state);
-
-        if (ret != 0) {
-            ALOGE("Error while parsing XML file\n");
-            break;
-        }
+    return errors;
+}
 
-        if (state->init_probe.new_xml_file != NULL) {
-            if (state->file) {
-                fclose(state->file);
-            }
+/* Number of open streams in array that use device pdev */
+static int count_device_users_l(const struct config_mgr *cm,
+                                const struct dyn_array *array,
+                                const struct device *pdev)
+{
+    const struct stream *s = array->streams;
+    int users = 0;
+    unsigned int i;
 
-            ALOGV("Opening new XML file");
-            ret = open_config_file(state, state->init_probe.new_xml_file);
+    for (i = 0; i < array->count; ++i, ++s) {
+        if (s->ref_count <= 0) {
+            continue;
         }
-    } while (state->init_probe.new_xml_file != NULL);
-
-    if (ret >= 0) {
-        print_ctls(cm);
 
-        /* Initialize the mixer by applying the <init> path */
-        /* No need to take mutex during initialization */
-        apply_path_l(cm, &state->init_path);
+        /* The global device is enabled by every open stream */
+        if ((pdev->type == 0) || route_uses_device(cm, s->current_devices, pdev)) {
+            ++users;
+        }
     }
 
-fail:
-    cleanup_parser(state);
-    return ret;
+    return users;
 }
 
-/*********************************************************************
- * Initialization
- *********************************************************************/
-
-struct config_mgr *init_audio_config(const char *config_file_name)
+int check_config_mgr_state(struct config_mgr *cm, unsigned int *stream_refs)
 {
-    char *cwd_path;
-    char *absolute_path = NULL;
-    int ret;
+    const struct device *pdev;
+    unsigned int refs = 0;
+    int errors = 0;
+    int users;
+    unsigned int i;
 
-    struct config_mgr* mgr = new_config_mgr();
+    if (cm == NULL) {
+        return -EINVAL;
+    }
 
-#ifdef ENABLE_COVERAGE
-    enableCoverageSignal();
-#endif
+    pthread_mutex_lock(&cm->lock);
 
-    /*
-     * If path is relative, make it absolute so it can be used to
-     * create the base path for any codec_probe redirections that are
-     * specified as relative.
-     */
-    while (isspace(*config_file_name)) {
-        ++config_file_name;
-    }
+    errors += check_stream_array_l(&cm->anon_stream_array, &refs);
+    errors += check_stream_array_l(&cm->named_stream_array, &refs);
 
-    if (config_file_name[0] != '/') {
-#ifdef ANDROID
-        absolute_path = join_paths(ETC_PATH, config_file_name, 0);
-#else
-        /*
-         * realpath() will cause links to be pre-resolved now, prefer getcwd()
-         * which leaves links to be resolved at the time the file is opened.
-         */
-        cwd_path = malloc(sizeof(char) * PATH_MAX);
-        if (getcwd(cwd_path, PATH_MAX) == NULL) {
-            ret = errno;
-            free(cwd_path);
-            errno = ret;
-            return NULL;
+    pdev = cm->device_array.devices;
+    for (i = 0; i < cm->device_array.count; ++i, ++pdev) {
+        if (!device_has_on_off_paths(pdev)) {
+            continue;
         }
 
-        absolute_path = join_paths(cwd_path, config_file_name, 0);
-        free(cwd_path);
-#endif
+        users = count_device_users_l(cm, &cm->anon_stream_array, pdev)
+                + count_device_users_l(cm, &cm->named_stream_array, pdev);
 
-        config_file_name = absolute_path;
+        if (pdev->use_count != users) {
+            ALOGE("device 0x%x '%s': use_count %d but used by %d streams",
+                  pdev->type, debug_device_to_name(pdev->type),
+                  pdev->use_count, users);
+            ++errors;
+        }
     }
 
-    ret = parse_config_file(mgr, config_file_name);
-    free(absolute_path);
-    if (ret != 0) {
-        free_audio_config(mgr);
-        errno = -ret;
-        return NULL;
-    }
+    pthread_mutex_unlock(&cm->lock);
 
-    /* Free unused memory in the device and stream arrays */
-    compress_config_mgr(mgr);
+    if (stream_refs != NULL) {
+        *stream_refs = refs;
+    }
 
-    return mgr;
+    return errors;
 }
+#endif /* THCM_TEST_HARNESS_CHECKS */
 
 struct mixer *get_mixer( const struct config_mgr *cm )
 {
-    return cm->mixer;
+    return cm->mixers[0].mixer;
 }
 
-static void free_ctl_array(struct dyn_array *ctl_array)
+static void free_ctl_array(struct dyn_array *ctl_array,
+                           struct dyn_array *info_array)
 {
     struct ctl *c;
     int ctl_idx;
@@ -3081,9 +6834,9 @@ static void free_ctl_array(struct dyn_array *ctl_array)
     for (ctl_idx = ctl_array->count - 1; ctl_idx >= 0; --ctl_idx) {
         c = &ctl_array->ctls[ctl_idx];
         /* The name attribute is mandatory for controls */
-        free((void *)c->name);
+        free((void *)c->info->name);
 
-        switch (c->type) {
+        switch (c->info->type) {
         /*
          * The val attribute has been freed for the BOOL/INT
          * types of controls
@@ -3097,16 +6850,33 @@ static void free_ctl_array(struct dyn_array *ctl_array)
          */
         case MIXER_CTL_TYPE_BYTE:
             free((void *)c->value.data);
-            free((void *)c->buffer);
-            free((void *)c->data_file_name);
+            free((void *)c->info->buffer);
+            free((void *)c->info->data_file_name);
+            free((void *)c->info->lazy_val);
             break;
         default:
             free((void *)c->value.string);
+            free((void *)c->info->data_file_name);
             break;
         }
     }
 
     dyn_array_free(ctl_array);
+    dyn_array_free(info_array);
+}
+
+static void free_path_defs(struct config_mgr *cm)
+{
+    struct path_def *def = cm->path_def_array.path_defs;
+    int i;
+
+    for (i = cm->path_def_array.count; i > 0; --i, ++def) {
+        free((void *)def->name);
+        free_ctl_array(&def->path.ctl_array, &def->path.ctl_info_array);
+        dyn_array_free(&def->path.segment_array);
+    }
+
+    dyn_array_free(&cm->path_def_array);
 }
 
 static void free_usecases( struct stream *stream )
@@ -3121,7 +6891,8 @@ static void free_usecases( struct stream *stream )
         pcase = puc->case_array.cases;
         for (i = puc->case_array.count; i > 0; i--, pcase++) {
             free((void *)pcase->name);
-            free_ctl_array(&pcase->ctl_array);
+            free_ctl_array(&pcase->ctl_array, &pcase->ctl_info_array);
+            dyn_array_free(&pcase->segment_array);
         }
         dyn_array_free(&puc->case_array);
     }
@@ -3129,17 +6900,29 @@ static void free_usecases( struct stream *stream )
     dyn_array_free(&stream->usecase_array);
 }
 
-static void free_constants( struct stream *stream )
+static void free_constants( struct dyn_array *constants_array )
 {
-    struct constant *pc = stream->constants_array.constants;
-    int count = stream->constants_array.count;
+    struct constant *pc = constants_array->constants;
+    int count = constants_array->count;
 
     for (; count > 0; count--, pc++) {
         free((void *)pc->name);
         free((void *)pc->value);
     }
 
-    dyn_array_free(&stream->constants_array);
+    dyn_array_free(constants_array);
+}
+
+static void free_retired_constants( struct config_mgr *cm )
+{
+    struct dyn_array *array = &cm->retired_constants_array;
+    uint i;
+
+    for (i = 0; i < array->count; ++i) {
+        free_constants(&array->arrays[i]);
+    }
+
+    dyn_array_free(array);
 }
 
 static void free_stream_array(struct dyn_array *stream_array)
@@ -3151,7 +6934,7 @@ static void free_stream_array(struct dyn_array *stream_array)
         s = &stream_array->streams[stream_idx];
         free((void *)s->name);
         free_usecases(s);
-        free_constants(s);
+        free_constants(&s->constants_array);
     }
 
     dyn_array_free(stream_array);
@@ -3161,14 +6944,19 @@ void free_audio_config( struct config_mgr *cm )
 {
     struct dyn_array *path_array;
     int dev_idx, path_idx;
+    unsigned int i;
 
     if (cm) {
+        stop_card_workers(cm);
+
         /* Free all devices */
         for (dev_idx = cm->device_array.count - 1; dev_idx >= 0; --dev_idx) {
             /* Free all paths in device */
             path_array = &cm->device_array.devices[dev_idx].path_array;
             for (path_idx = path_array->count - 1; path_idx >= 0; --path_idx) {
-                free_ctl_array(&path_array->paths[path_idx].ctl_array);
+                free_ctl_array(&path_array->paths[path_idx].ctl_array,
+                               &path_array->paths[path_idx].ctl_info_array);
+                dyn_array_free(&path_array->paths[path_idx].segment_array);
             }
 
             dyn_array_free(path_array);
@@ -3176,12 +6964,27 @@ void free_audio_config( struct config_mgr *cm )
 
         dyn_array_free(&cm->device_array);
 
+        /* After the paths and cases that refer to them */
+        free_path_defs(cm);
+
         free_stream_array(&cm->anon_stream_array);
         free_stream_array(&cm->named_stream_array);
-
-        if (cm->mixer) {
-            mixer_close(cm->mixer);
+        free_retired_constants(cm);
+        dyn_array_free(&cm->txn.write_array);
+        txn_write_index_free(&cm->txn.write_index);
+        dyn_array_free(&cm->batch.segment_array);
+        free(cm->config_file);
+
+        for (i = 0; i < cm->mixer_count; ++i) {
+            ctl_name_index_free(&cm->mixers[i].name_index);
+            mixer_close(cm->mixers[i].mixer);
         }
+#ifdef TINYHAL_CTL_WRITE_STATS
+        free_ctl_write_stats(cm);
+#endif
+        pthread_cond_destroy(&cm->card_jobs.done);
+        pthread_cond_destroy(&cm->card_jobs.start);
+        pthread_mutex_destroy(&cm->card_jobs.lock);
         pthread_mutex_destroy(&cm->lock);
         free(cm);
     }
@@ -62,6 +62,14 @@ ifeq ($(strip $(TINYALSA_NO_CTL_GET_ID)),true)
 LOCAL_CFLAGS += -DTINYALSA_NO_CTL_GET_ID
 endif
 
+ifeq ($(strip $(TINYHAL_CTL_WRITE_STATS)),true)
+LOCAL_CFLAGS += -DTINYHAL_CTL_WRITE_STATS
+endif
+
+ifeq ($(strip $(TINYHAL_LOCK_STATS)),true)
+LOCAL_CFLAGS += -DTINYHAL_LOCK_STATS
+endif
+
 ifeq ($(strip $(BOARD_USES_VENDORIMAGE)),true)
 LOCAL_CFLAGS += -DETC_PATH=\"/vendor/etc/\"
 endif
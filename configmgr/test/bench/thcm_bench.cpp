@@ -0,0 +1,570 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Native benchmark of the config manager running on CAlsaMock.
+ * The results are written as JSON so they can be compared between builds.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#include <tinyhal/audio_config.h>
+
+#include "../harness/jni/CAlsaMock.h"
+#include "thcm_bench_util.h"
+#ifdef THCM_TEST_HARNESS_BUILD
+#include "../harness/jni/alloc_hooks.h"
+#endif
+
+namespace {
+
+using cirrus::CCacheCounters;
+using cirrus::CStreamInfo;
+using cirrus::CConfigScanner;
+using cirrus::deviceBits;
+using cirrus::nowNs;
+using cirrus::openStream;
+using cirrus::pcmConfig;
+
+const char* const kDefaultConfig = "data/bench_phone.xml";
+const char* const kDefaultControls = "data/bench_phone.csv";
+const unsigned int kDefaultIterations = 2000;
+const unsigned int kDefaultInitIterations = 50;
+
+class CResult
+{
+public:
+    CResult(const std::string& name, const cirrus::CAlsaMock& mixer,
+            const CCacheCounters& cache)
+        : mName(name),
+          mReads(mixer.totalReads()),
+          mWrites(mixer.totalWrites()),
+          mSimulatedNs(mixer.simulatedNs()),
+          mHaveCache(cache.available()),
+          mCacheRefs(cache.references()),
+          mCacheMisses(cache.misses())
+    {
+    }
+
+    void add(uint64_t ns) { mSamples.push_back(ns); }
+    bool empty() const { return mSamples.empty(); }
+
+    // Convert the mock counts at construction into counts for this result
+    void stop(const cirrus::CAlsaMock& mixer, const CCacheCounters& cache)
+    {
+        mReads = mixer.totalReads() - mReads;
+        mWrites = mixer.totalWrites() - mWrites;
+        mSimulatedNs = mixer.simulatedNs() - mSimulatedNs;
+        mCacheRefs = cache.references() - mCacheRefs;
+        mCacheMisses = cache.misses() - mCacheMisses;
+    }
+
+    void writeJson(std::ostream& os)
+    {
+        std::sort(mSamples.begin(), mSamples.end());
+
+        uint64_t total = 0;
+        for (auto ns : mSamples) {
+            total += ns;
+        }
+
+        const double mean = static_cast<double>(total) / mSamples.size();
+
+        os << "    { \"name\": \"" << mName << "\""
+           << ", \"count\": " << mSamples.size()
+           << ", \"mean_ns\": " << static_cast<uint64_t>(mean)
+           << ", \"min_ns\": " << mSamples.front()
+           << ", \"p50_ns\": " << percentile(50)
+           << ", \"p90_ns\": " << percentile(90)
+           << ", \"p99_ns\": " << percentile(99)
+           << ", \"max_ns\": " << mSamples.back()
+           << ", \"ops_per_sec\": "
+           << static_cast<uint64_t>((mean > 0) ? 1e9 / mean : 0)
+           << ", \"ctl_reads_per_op\": "
+           << static_cast<double>(mReads) / mSamples.size()
+           << ", \"ctl_writes_per_op\": "
+           << static_cast<double>(mWrites) / mSamples.size()
+           << ", \"simulated_ns_per_op\": "
+           << mSimulatedNs / mSamples.size();
+
+        // The counts include everything done between the start and stop of
+        // the result, not only the timed calls
+        if (mHaveCache) {
+            os << ", \"cache_refs_per_op\": "
+               << static_cast<double>(mCacheRefs) / mSamples.size()
+               << ", \"cache_misses_per_op\": "
+               << static_cast<double>(mCacheMisses) / mSamples.size();
+        }
+
+        os << " }";
+    }
+
+private:
+    uint64_t percentile(unsigned int pc) const
+    {
+        size_t i = (mSamples.size() * pc) / 100;
+        if (i >= mSamples.size()) {
+            i = mSamples.size() - 1;
+        }
+        return mSamples[i];
+    }
+
+private:
+    const std::string       mName;
+    std::vector<uint64_t>   mSamples;
+    uint64_t                mReads;
+    uint64_t                mWrites;
+    uint64_t                mSimulatedNs;
+    bool                    mHaveCache;
+    uint64_t                mCacheRefs;
+    uint64_t                mCacheMisses;
+};
+
+#ifdef THCM_TEST_HARNESS_BUILD
+void writeAllocStatsJson(std::ostream& os, const char* name,
+                         const cirrus::CAllocStats& stats)
+{
+    os << "    \"" << name << "\": { \"allocs\": " << stats.allocs
+       << ", \"reallocs\": " << stats.reallocs
+       << ", \"frees\": " << stats.frees
+       << ", \"alloc_bytes\": " << stats.allocBytes
+       << ", \"peak_bytes\": " << stats.peakBytes
+       << ", \"lines\": [";
+
+    const char* sep = " ";
+    for (const auto& it : stats.lines) {
+        os << sep << "[ " << it.first << ", " << it.second.count
+           << ", " << it.second.bytes << " ]";
+        sep = ", ";
+    }
+
+    os << " ] }";
+}
+#endif
+
+class CBench
+{
+public:
+    CBench(const cirrus::CAlsaMock& mixer, const char* configFile,
+           unsigned int iterations, unsigned int initIterations)
+        : mMixer(mixer),
+          mConfigFile(configFile),
+          mIterations(iterations),
+          mInitIterations(initIterations)
+    {
+    }
+
+    int run(const std::vector<CStreamInfo>& streams);
+    void writeJson(std::ostream& os, const char* controlsFile,
+                   size_t numControls);
+
+private:
+    void addResult(CResult& result);
+    void benchInit();
+    void benchRoute(struct config_mgr* cm, const char* name,
+                    audio_devices_t dirBit, uint32_t supported);
+    void benchChurn(struct config_mgr* cm, uint32_t outDevices);
+    void benchVolume(struct config_mgr* cm, uint32_t outDevices);
+    void benchUseCases(struct config_mgr* cm,
+                       const std::vector<CStreamInfo>& streams);
+
+private:
+    const cirrus::CAlsaMock& mMixer;
+    const char* const       mConfigFile;
+    const unsigned int      mIterations;
+    const unsigned int      mInitIterations;
+    std::vector<CResult>    mResults;
+    CCacheCounters          mCache;
+
+#ifdef THCM_TEST_HARNESS_BUILD
+    cirrus::CAllocStats     mParseAllocs;
+    cirrus::CAllocStats     mInitAllocs;
+    cirrus::CAllocStats     mSteadyAllocs;
+    size_t                  mLiveBytesAfterInit = 0;
+#endif
+};
+
+void CBench::addResult(CResult& result)
+{
+    result.stop(mMixer, mCache);
+    mResults.push_back(result);
+}
+
+void CBench::benchInit()
+{
+    CResult result("init_audio_config", mMixer, mCache);
+
+    for (unsigned int i = 0; i < mInitIterations; ++i) {
+        const uint64_t start = nowNs();
+        struct config_mgr* cm = init_audio_config(mConfigFile);
+        result.add(nowNs() - start);
+
+        if (cm == nullptr) {
+            return;
+        }
+
+        free_audio_config(cm);
+    }
+
+    addResult(result);
+}
+
+void CBench::benchRoute(struct config_mgr* cm, const char* name,
+                        audio_devices_t dirBit, uint32_t supported)
+{
+    const std::vector<uint32_t> bits = deviceBits(supported, dirBit);
+    if (bits.size() < 2) {
+        return;
+    }
+
+    const struct audio_config config = pcmConfig();
+    const struct hw_stream* s = get_stream(cm, bits[0],
+                                           AUDIO_OUTPUT_FLAG_NONE, &config);
+    if (s == nullptr) {
+        return;
+    }
+
+    // Switch through every single device and every pair of devices
+    std::vector<uint32_t> routes(bits);
+    for (size_t i = 0; i < bits.size(); ++i) {
+        for (size_t j = i + 1; j < bits.size(); ++j) {
+            routes.push_back(bits[i] | bits[j]);
+        }
+    }
+
+    // Time from the start of each route change until the new devices were
+    // enabled, as recorded in the trace of the route change
+    CResult result(name, mMixer, mCache);
+    CResult firstAudio(std::string(name) + "_first_audio", mMixer, mCache);
+    struct config_trace_record rec;
+
+    for (unsigned int i = 0; i < mIterations; ++i) {
+        const uint32_t devices = routes[(i + 1) % routes.size()];
+        const uint64_t start = nowNs();
+        apply_route(s, devices);
+        result.add(nowNs() - start);
+
+        if ((get_config_trace(cm, &rec, 1) == 1)
+                && (rec.event == e_config_trace_route)) {
+            firstAudio.add(rec.arg[2]);
+        }
+    }
+
+    addResult(result);
+    if (!firstAudio.empty()) {
+        addResult(firstAudio);
+    }
+    release_stream(s);
+}
+
+void CBench::benchChurn(struct config_mgr* cm, uint32_t outDevices)
+{
+    const std::vector<uint32_t> bits = deviceBits(outDevices, 0);
+    if (bits.empty()) {
+        return;
+    }
+
+    const struct audio_config config = pcmConfig();
+    CResult result("get_release_stream", mMixer, mCache);
+
+    for (unsigned int i = 0; i < mIterations; ++i) {
+        const uint32_t devices = bits[i % bits.size()];
+        const uint64_t start = nowNs();
+        const struct hw_stream* s = get_stream(cm, devices,
+                                               AUDIO_OUTPUT_FLAG_NONE, &config);
+        if (s == nullptr) {
+            return;
+        }
+        release_stream(s);
+        result.add(nowNs() - start);
+    }
+
+    addResult(result);
+}
+
+void CBench::benchVolume(struct config_mgr* cm, uint32_t outDevices)
+{
+    const std::vector<uint32_t> bits = deviceBits(outDevices, 0);
+    if (bits.empty()) {
+        return;
+    }
+
+    const struct audio_config config = pcmConfig();
+    const struct hw_stream* s = get_stream(cm, bits[0],
+                                           AUDIO_OUTPUT_FLAG_NONE, &config);
+    if (s == nullptr) {
+        return;
+    }
+
+    CResult result("set_hw_volume", mMixer, mCache);
+    for (unsigned int i = 0; i < mIterations; ++i) {
+        const uint64_t start = nowNs();
+        const int ret = set_hw_volume(s, i % 101, (i * 7) % 101);
+        result.add(nowNs() - start);
+
+        if (ret == -ENOSYS) {
+            // stream doesn't have volume controls
+            release_stream(s);
+            return;
+        }
+    }
+
+    addResult(result);
+    release_stream(s);
+}
+
+void CBench::benchUseCases(struct config_mgr* cm,
+                           const std::vector<CStreamInfo>& streams)
+{
+    for (const auto& info : streams) {
+        std::vector<std::pair<const char*, const char*>> cases;
+        for (const auto& uc : info.usecases) {
+            for (const auto& c : uc.cases) {
+                cases.emplace_back(uc.name.c_str(), c.c_str());
+            }
+        }
+
+        if (cases.empty()) {
+            continue;
+        }
+
+        const struct hw_stream* s = openStream(cm, info);
+        if (s == nullptr) {
+            continue;
+        }
+
+        std::string name("apply_use_case");
+        if (!info.name.empty()) {
+            name += ":" + info.name;
+        } else {
+            name += ":" + info.type + "_" + info.dir;
+        }
+
+        CResult result(name, mMixer, mCache);
+        for (unsigned int i = 0; i < mIterations; ++i) {
+            const auto& c = cases[i % cases.size()];
+            const uint64_t start = nowNs();
+            const int ret = apply_use_case(s, c.first, c.second);
+            result.add(nowNs() - start);
+
+            if (ret != 0) {
+                fprintf(stderr, "%s=%s failed (%d)\n", c.first, c.second, ret);
+                release_stream(s);
+                return;
+            }
+        }
+
+        addResult(result);
+        release_stream(s);
+    }
+}
+
+int CBench::run(const std::vector<CStreamInfo>& streams)
+{
+    benchInit();
+
+#ifdef THCM_TEST_HARNESS_BUILD
+    cirrus::harness_reset_alloc_stats();
+#endif
+
+    struct config_mgr* cm = init_audio_config(mConfigFile);
+    if (cm == nullptr) {
+        fprintf(stderr, "Failed to load %s (%d)\n", mConfigFile, -errno);
+        return -EINVAL;
+    }
+
+#ifdef THCM_TEST_HARNESS_BUILD
+    mParseAllocs = cirrus::harness_get_alloc_stats(cirrus::eAllocPhaseParse);
+    mInitAllocs = cirrus::harness_get_alloc_stats(cirrus::eAllocPhaseInit);
+    mLiveBytesAfterInit = cirrus::harness_get_live_bytes();
+    cirrus::harness_reset_alloc_stats();
+#endif
+
+    const uint32_t outDevices = get_supported_output_devices(cm);
+    const uint32_t inDevices = get_supported_input_devices(cm);
+
+    benchRoute(cm, "apply_route_out", 0, outDevices);
+    benchRoute(cm, "apply_route_in", AUDIO_DEVICE_BIT_IN, inDevices);
+    benchChurn(cm, outDevices);
+    benchVolume(cm, outDevices);
+    benchUseCases(cm, streams);
+
+#ifdef THCM_TEST_HARNESS_BUILD
+    mSteadyAllocs = cirrus::harness_get_alloc_stats(cirrus::eAllocPhaseSteady);
+#endif
+
+    free_audio_config(cm);
+    return 0;
+}
+
+void CBench::writeJson(std::ostream& os, const char* controlsFile,
+                       size_t numControls)
+{
+    os << "{\n"
+       << "  \"config\": \"" << mConfigFile << "\",\n"
+       << "  \"controls_file\": \"" << controlsFile << "\",\n"
+       << "  \"controls\": " << numControls << ",\n"
+       << "  \"iterations\": " << mIterations << ",\n"
+       << "  \"ioctl_cost_ns\": [ " << mMixer.ioctlCost().boolNs
+       << ", " << mMixer.ioctlCost().intNs
+       << ", " << mMixer.ioctlCost().enumNs
+       << ", " << mMixer.ioctlCost().byteNs
+       << ", " << mMixer.ioctlCost().perByteNs << " ],\n"
+       << "  \"ioctl_spin\": " << (mMixer.ioctlCost().spin ? "true" : "false")
+       << ",\n"
+       << "  \"cache_counters\": " << (mCache.available() ? "true" : "false")
+       << ",\n"
+       << "  \"results\": [\n";
+
+    for (size_t i = 0; i < mResults.size(); ++i) {
+        mResults[i].writeJson(os);
+        os << ((i + 1 < mResults.size()) ? ",\n" : "\n");
+    }
+
+#ifdef THCM_TEST_HARNESS_BUILD
+    // Memory use of one init_audio_config() and of all the operations
+    // benchmarked after it. Lines are [ source line, count, bytes ].
+    os << "  ],\n"
+       << "  \"memory\": {\n"
+       << "    \"live_bytes_after_init\": " << mLiveBytesAfterInit << ",\n";
+    writeAllocStatsJson(os, "parse", mParseAllocs);
+    os << ",\n";
+    writeAllocStatsJson(os, "init", mInitAllocs);
+    os << ",\n";
+    writeAllocStatsJson(os, "steady", mSteadyAllocs);
+    os << "\n  }\n"
+       << "}\n";
+#else
+    os << "  ]\n"
+       << "}\n";
+#endif
+}
+
+void usage(const char* argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -x <file>   XML config (default %s)\n"
+            "  -c <file>   CAlsaMock controls file (default %s)\n"
+            "  -n <count>  iterations of each operation (default %u)\n"
+            "  -i <count>  iterations of init_audio_config (default %u)\n"
+            "  -o <file>   write JSON results to file instead of stdout\n"
+            "  -C <bool>,<int>,<enum>,<byte>,<per byte>\n"
+            "              simulated ioctl cost in ns of each control type\n"
+            "  -S          spin for the simulated cost so that it is included\n"
+            "              in the measured times\n",
+            argv0, kDefaultConfig, kDefaultControls,
+            kDefaultIterations, kDefaultInitIterations);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const char* configFile = kDefaultConfig;
+    const char* controlsFile = kDefaultControls;
+    const char* outFile = nullptr;
+    unsigned int iterations = kDefaultIterations;
+    unsigned int initIterations = kDefaultInitIterations;
+    cirrus::CMockIoctlCost cost;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "x:c:n:i:o:C:Sh")) != -1) {
+        switch (opt) {
+        case 'x':
+            configFile = optarg;
+            break;
+        case 'c':
+            controlsFile = optarg;
+            break;
+        case 'n':
+            iterations = strtoul(optarg, nullptr, 0);
+            break;
+        case 'i':
+            initIterations = strtoul(optarg, nullptr, 0);
+            break;
+        case 'o':
+            outFile = optarg;
+            break;
+        case 'C':
+            if (sscanf(optarg, "%u,%u,%u,%u,%u", &cost.boolNs, &cost.intNs,
+                       &cost.enumNs, &cost.byteNs, &cost.perByteNs) != 5) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'S':
+            cost.spin = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((iterations == 0) || (initIterations == 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    cirrus::CAlsaMock mixer(0);
+    if (mixer.readFromFile(controlsFile) != 0) {
+        fprintf(stderr, "Failed to read controls from %s\n", controlsFile);
+        return 1;
+    }
+
+    std::vector<CStreamInfo> streams;
+    if (CConfigScanner().scan(configFile, streams) != 0) {
+        fprintf(stderr, "Failed to scan %s\n", configFile);
+        return 1;
+    }
+
+    mixer.setIoctlCost(cost);
+
+    CBench bench(mixer, configFile, iterations, initIterations);
+    if (bench.run(streams) != 0) {
+        return 1;
+    }
+
+    if (outFile != nullptr) {
+        std::ofstream fout(outFile);
+        if (!fout) {
+            fprintf(stderr, "Failed to create %s\n", outFile);
+            return 1;
+        }
+        bench.writeJson(fout, controlsFile, mixer.numControls());
+    } else {
+        std::ostringstream s;
+        bench.writeJson(s, controlsFile, mixer.numControls());
+        fputs(s.str().c_str(), stdout);
+    }
+
+    return 0;
+}
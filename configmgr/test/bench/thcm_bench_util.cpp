@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "thcm_bench_util.h"
+
+namespace cirrus {
+
+uint64_t nowNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL) + ts.tv_nsec;
+}
+
+static int openCacheCounter(uint64_t config)
+{
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+CCacheCounters::CCacheCounters()
+{
+    mReferencesFd = openCacheCounter(PERF_COUNT_HW_CACHE_REFERENCES);
+    if (mReferencesFd < 0) {
+        return;
+    }
+
+    mMissesFd = openCacheCounter(PERF_COUNT_HW_CACHE_MISSES);
+    if (mMissesFd < 0) {
+        close(mReferencesFd);
+        mReferencesFd = -1;
+    }
+}
+
+CCacheCounters::~CCacheCounters()
+{
+    if (mReferencesFd >= 0) {
+        close(mReferencesFd);
+    }
+    if (mMissesFd >= 0) {
+        close(mMissesFd);
+    }
+}
+
+uint64_t CCacheCounters::readCounter(int fd)
+{
+    uint64_t count = 0;
+
+    if ((fd < 0) || (read(fd, &count, sizeof(count)) != sizeof(count))) {
+        return 0;
+    }
+
+    return count;
+}
+
+std::vector<uint32_t> deviceBits(uint32_t devices, uint32_t dirBit)
+{
+    std::vector<uint32_t> bits;
+
+    devices &= ~dirBit;
+    for (uint32_t b = 1; b != 0 && b <= devices; b <<= 1) {
+        if (devices & b) {
+            bits.push_back(b | dirBit);
+        }
+    }
+
+    return bits;
+}
+
+struct audio_config pcmConfig()
+{
+    struct audio_config config;
+
+    memset(&config, 0, sizeof(config));
+    config.sample_rate = 48000;
+    config.format = AUDIO_FORMAT_PCM_16_BIT;
+
+    return config;
+}
+
+const struct hw_stream* openStream(struct config_mgr* cm,
+                                   const CStreamInfo& info)
+{
+    if (!info.name.empty()) {
+        return get_named_stream(cm, info.name.c_str());
+    }
+
+    if (info.type != "pcm") {
+        return nullptr;
+    }
+
+    const struct audio_config config = pcmConfig();
+    std::vector<uint32_t> bits;
+
+    if (info.dir == "in") {
+        bits = deviceBits(get_supported_input_devices(cm), AUDIO_DEVICE_BIT_IN);
+    } else {
+        bits = deviceBits(get_supported_output_devices(cm), 0);
+    }
+
+    if (bits.empty()) {
+        return nullptr;
+    }
+
+    return get_stream(cm, bits[0], AUDIO_OUTPUT_FLAG_NONE, &config);
+}
+
+const char* CConfigScanner::findAttrib(const XML_Char** attribs,
+                                       const char* name)
+{
+    for (; attribs[0] != nullptr; attribs += 2) {
+        if (strcmp(attribs[0], name) == 0) {
+            return attribs[1];
+        }
+    }
+
+    return "";
+}
+
+void XMLCALL CConfigScanner::startElement(void* data, const XML_Char* name,
+                                          const XML_Char** attribs)
+{
+    auto* self = static_cast<CConfigScanner*>(data);
+    auto& streams = *self->mStreams;
+
+    if (strcmp(name, "stream") == 0) {
+        streams.push_back(CStreamInfo());
+        streams.back().name = findAttrib(attribs, "name");
+        streams.back().type = findAttrib(attribs, "type");
+        streams.back().dir = findAttrib(attribs, "dir");
+    } else if ((strcmp(name, "usecase") == 0) && !streams.empty()) {
+        streams.back().usecases.push_back(CUseCase());
+        streams.back().usecases.back().name = findAttrib(attribs, "name");
+    } else if ((strcmp(name, "case") == 0) && !streams.empty()
+               && !streams.back().usecases.empty()) {
+        streams.back().usecases.back().cases.push_back(findAttrib(attribs, "name"));
+    }
+}
+
+int CConfigScanner::scan(const char* fileName, std::vector<CStreamInfo>& streams)
+{
+    std::ifstream fin(fileName);
+    if (!fin) {
+        fprintf(stderr, "Failed to open %s\n", fileName);
+        return -ENOENT;
+    }
+
+    std::stringstream text;
+    text << fin.rdbuf();
+    const std::string s = text.str();
+
+    mStreams = &streams;
+
+    XML_Parser parser = XML_ParserCreate(nullptr);
+    XML_SetUserData(parser, this);
+    XML_SetElementHandler(parser, startElement, nullptr);
+    const int ok = XML_Parse(parser, s.data(), s.size(), 1);
+    XML_ParserFree(parser);
+
+    return (ok == XML_STATUS_OK) ? 0 : -EINVAL;
+}
+
+} // namespace cirrus
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef THCM_BENCH_UTIL_H
+#define THCM_BENCH_UTIL_H
+
+/*
+ * Helpers shared by the native benchmark and stress test.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <expat.h>
+
+#include <tinyhal/audio_config.h>
+
+namespace cirrus {
+
+// CLOCK_MONOTONIC time in nanoseconds
+uint64_t nowNs();
+
+/*
+ * Hardware cache references and misses of the calling thread, counted with
+ * perf events. The kernel may not allow them, for example in a container or
+ * when perf_event_paranoid is too high, so check available().
+ */
+class CCacheCounters
+{
+public:
+    CCacheCounters();
+    ~CCacheCounters();
+
+    CCacheCounters(const CCacheCounters&) = delete;
+    CCacheCounters& operator=(const CCacheCounters&) = delete;
+
+    bool available() const { return mMissesFd >= 0; }
+    uint64_t references() const { return readCounter(mReferencesFd); }
+    uint64_t misses() const { return readCounter(mMissesFd); }
+
+private:
+    static uint64_t readCounter(int fd);
+
+private:
+    int mReferencesFd = -1;
+    int mMissesFd = -1;
+};
+
+// Split a device mask into single devices, each with dirBit added
+std::vector<uint32_t> deviceBits(uint32_t devices, uint32_t dirBit);
+
+// A config suitable for opening an anonymous PCM stream
+struct audio_config pcmConfig();
+
+/*
+ * Stream and use-case names aren't available from the config manager API
+ * so do a quick scan of the XML to find them.
+ */
+struct CUseCase
+{
+    std::string                 name;
+    std::vector<std::string>    cases;
+};
+
+struct CStreamInfo
+{
+    std::string             name;
+    std::string             type;
+    std::string             dir;
+    std::vector<CUseCase>   usecases;
+};
+
+class CConfigScanner
+{
+public:
+    int scan(const char* fileName, std::vector<CStreamInfo>& streams);
+
+private:
+    static void XMLCALL startElement(void* data, const XML_Char* name,
+                                     const XML_Char** attribs);
+    static const char* findAttrib(const XML_Char** attribs, const char* name);
+
+private:
+    std::vector<CStreamInfo>* mStreams = nullptr;
+};
+
+// Open a stream described by info. Anonymous PCM streams are opened on
+// the first supported device. Returns nullptr if it can't be opened.
+const struct hw_stream* openStream(struct config_mgr* cm,
+                                   const CStreamInfo& info);
+
+} // namespace cirrus
+
+#endif // THCM_BENCH_UTIL_H
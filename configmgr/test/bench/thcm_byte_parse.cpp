@@ -0,0 +1,387 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Microbenchmark of loading large inline byte arrays. A config with a
+ * number of BYTE controls is generated with the values written as a
+ * decimal list, a list of 0x hex numbers, a val="hex:" string and a
+ * val="base64:" string, and the time of init_audio_config() is measured
+ * for each. The byte data is parsed when each control is resolved, so the
+ * resolve phase of the boot statistics is the time to parse the data plus
+ * the small cost of looking up the controls by name. The lists are also
+ * parsed by a copy of the original strtok_r() parser of audio_config.c as
+ * a reference.
+ */
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+#include <tinyhal/audio_config.h>
+
+#include "../harness/jni/CAlsaMock.h"
+#include "thcm_bench_util.h"
+
+namespace {
+
+using cirrus::nowNs;
+
+const char* const kControlsFile = "thcm_byte_parse.csv";
+const char* const kConfigFile = "thcm_byte_parse.xml";
+const unsigned int kDefaultControls = 64;
+const unsigned int kDefaultBytes = 4096;
+const unsigned int kDefaultIterations = 20;
+
+enum EForm {
+    eFormDecimal,
+    eFormHexList,
+    eFormHex,
+    eFormBase64,
+
+    eFormCount
+};
+
+const char* const kFormNames[eFormCount] = {
+    "decimal", "hex_list", "hex", "base64"
+};
+
+std::string formatBytes(EForm form, const std::vector<uint8_t>& data)
+{
+    static const char kHex[] = "0123456789abcdef";
+    static const char kBase64[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string s;
+    size_t i;
+
+    switch (form) {
+    case eFormDecimal:
+    case eFormHexList:
+        for (i = 0; i < data.size(); ++i) {
+            char buf[8];
+            snprintf(buf, sizeof(buf), (form == eFormDecimal) ? "%u" : "0x%02x",
+                     data[i]);
+            if (i != 0) {
+                s += ',';
+            }
+            s += buf;
+        }
+        break;
+
+    case eFormHex:
+        s = "hex:";
+        for (uint8_t b : data) {
+            s += kHex[b >> 4];
+            s += kHex[b & 0xf];
+        }
+        break;
+
+    case eFormBase64:
+        s = "base64:";
+        for (i = 0; i + 2 < data.size(); i += 3) {
+            const uint32_t v = (data[i] << 16) | (data[i + 1] << 8) | data[i + 2];
+            s += kBase64[(v >> 18) & 0x3f];
+            s += kBase64[(v >> 12) & 0x3f];
+            s += kBase64[(v >> 6) & 0x3f];
+            s += kBase64[v & 0x3f];
+        }
+        if (i < data.size()) {
+            const uint32_t v = (data[i] << 16)
+                               | ((i + 1 < data.size()) ? (data[i + 1] << 8) : 0);
+            s += kBase64[(v >> 18) & 0x3f];
+            s += kBase64[(v >> 12) & 0x3f];
+            s += (i + 1 < data.size()) ? kBase64[(v >> 6) & 0x3f] : '=';
+            s += '=';
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return s;
+}
+
+/*
+ * The original make_byte_array() of audio_config.c: copy the string, count
+ * the entries with strtok_r(), copy it again and convert each entry with
+ * strtoul(). Returns the number of bytes or -1.
+ */
+int referenceParse(const char* val_str, uint8_t** result)
+{
+    char* str;
+    uint8_t* pdatablock;
+    uint8_t* bytes;
+    int count;
+    char* p;
+    char* savep;
+    char* endptr;
+    unsigned long v;
+
+    str = strdup(val_str);
+    if (!str) {
+        return -1;
+    }
+
+    p = strtok_r(str, ",", &savep);
+    for (count = 0; p != nullptr; count++) {
+        p = strtok_r(nullptr, ",", &savep);
+    }
+
+    pdatablock = static_cast<uint8_t*>(malloc(count));
+    if (!pdatablock) {
+        free(str);
+        return -1;
+    }
+
+    strcpy(str, val_str);
+    bytes = pdatablock;
+
+    for (p = strtok_r(str, ",", &savep); p != nullptr;) {
+        v = strtoul(p, &endptr, 0);
+        if ((endptr[0] != '\0') || (endptr == p) || (v > 0xFFFFFFFF)) {
+            free(pdatablock);
+            free(str);
+            return -1;
+        }
+        *bytes++ = static_cast<uint8_t>(v);
+        p = strtok_r(nullptr, ",", &savep);
+    }
+
+    free(str);
+    *result = pdatablock;
+    return count;
+}
+
+int writeConfig(const std::vector<std::string>& vals)
+{
+    std::ofstream f(kConfigFile);
+    if (!f) {
+        fprintf(stderr, "Failed to create %s\n", kConfigFile);
+        return -EIO;
+    }
+
+    f << "<audiohal>\n<mixer card=\"0\"></mixer>\n"
+      << "<stream name=\"bench\" type=\"hw\" dir=\"out\">\n"
+      << "<usecase name=\"coefs\"><case name=\"all\">\n";
+    for (size_t i = 0; i < vals.size(); ++i) {
+        f << "<ctl name=\"Coef " << i << "\" val=\"" << vals[i] << "\"/>\n";
+    }
+    f << "</case></usecase>\n</stream>\n</audiohal>\n";
+
+    return f ? 0 : -EIO;
+}
+
+struct CLoadTimes
+{
+    uint64_t    loadNs = 0;     // init_audio_config()
+    uint64_t    resolveNs = 0;  // resolve phase, which parses the data
+};
+
+// Median times of init_audio_config(), returns false if it failed
+bool timeLoad(unsigned int iterations, CLoadTimes& result)
+{
+    std::vector<uint64_t> loadTimes;
+    std::vector<uint64_t> resolveTimes;
+    struct config_mgr_boot_stats stats;
+
+    for (unsigned int i = 0; i < iterations; ++i) {
+        const uint64_t start = nowNs();
+        struct config_mgr* cm = init_audio_config(kConfigFile);
+        const uint64_t t = nowNs() - start;
+        if (cm == nullptr) {
+            fprintf(stderr, "Failed to load %s\n", kConfigFile);
+            return false;
+        }
+        get_config_mgr_boot_stats(cm, &stats);
+        free_audio_config(cm);
+        loadTimes.push_back(t);
+        resolveTimes.push_back(stats.resolve.time_ns);
+    }
+
+    std::sort(loadTimes.begin(), loadTimes.end());
+    std::sort(resolveTimes.begin(), resolveTimes.end());
+    result.loadNs = loadTimes[loadTimes.size() / 2];
+    result.resolveNs = resolveTimes[resolveTimes.size() / 2];
+    return true;
+}
+
+// Median time in ns to parse all of vals with referenceParse()
+uint64_t timeReference(const std::vector<std::string>& vals,
+                       unsigned int iterations)
+{
+    std::vector<uint64_t> times;
+
+    for (unsigned int i = 0; i < iterations; ++i) {
+        const uint64_t start = nowNs();
+        for (const std::string& val : vals) {
+            uint8_t* data = nullptr;
+            if (referenceParse(val.c_str(), &data) < 0) {
+                return 0;
+            }
+            free(data);
+        }
+        times.push_back(nowNs() - start);
+    }
+
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+void usage(const char* argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -n <count>  number of BYTE controls (default %u)\n"
+            "  -s <bytes>  bytes per control (default %u)\n"
+            "  -i <count>  iterations of each load (default %u)\n"
+            "  -o <file>   write JSON results to file instead of stdout\n",
+            argv0, kDefaultControls, kDefaultBytes, kDefaultIterations);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    unsigned int controls = kDefaultControls;
+    unsigned int bytes = kDefaultBytes;
+    unsigned int iterations = kDefaultIterations;
+    const char* outFile = nullptr;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:i:o:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            controls = strtoul(optarg, nullptr, 0);
+            break;
+        case 's':
+            bytes = strtoul(optarg, nullptr, 0);
+            break;
+        case 'i':
+            iterations = strtoul(optarg, nullptr, 0);
+            break;
+        case 'o':
+            outFile = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((controls == 0) || (bytes == 0) || (iterations == 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    {
+        std::ofstream f(kControlsFile);
+        for (unsigned int i = 0; i < controls; ++i) {
+            f << "Coef " << i << ",byte," << bytes << ",0,0:255\n";
+        }
+        if (!f) {
+            fprintf(stderr, "Failed to create %s\n", kControlsFile);
+            return 1;
+        }
+    }
+
+    cirrus::CAlsaMock mixer(0);
+    if (mixer.readFromFile(kControlsFile) != 0) {
+        fprintf(stderr, "Failed to read controls from %s\n", kControlsFile);
+        return 1;
+    }
+
+    std::mt19937 rng(1);
+    std::vector<std::vector<uint8_t>> data(controls, std::vector<uint8_t>(bytes));
+    for (auto& d : data) {
+        for (auto& b : d) {
+            b = static_cast<uint8_t>(rng());
+        }
+    }
+
+    std::vector<std::string> vals(controls);
+    const uint64_t totalBytes = static_cast<uint64_t>(controls) * bytes;
+    std::ostringstream os;
+    int ret = 0;
+
+    os << "{\n"
+       << "  \"controls\": " << controls << ",\n"
+       << "  \"bytes_per_control\": " << bytes << ",\n"
+       << "  \"iterations\": " << iterations << ",\n"
+       << "  \"results\": [\n";
+
+    for (int form = 0; form < eFormCount; ++form) {
+        uint64_t valBytes = 0;
+
+        for (unsigned int i = 0; i < controls; ++i) {
+            vals[i] = formatBytes(static_cast<EForm>(form), data[i]);
+            valBytes += vals[i].size();
+        }
+
+        CLoadTimes times;
+        if (writeConfig(vals) != 0) {
+            return 1;
+        }
+        if (!timeLoad(iterations, times)) {
+            ret = 2;
+        }
+
+        os << "    { \"form\": \"" << kFormNames[form] << "\""
+           << ", \"val_bytes\": " << valBytes
+           << ", \"load_ns\": " << times.loadNs
+           << ", \"resolve_ns\": " << times.resolveNs
+           << ", \"resolve_ns_per_byte\": "
+           << static_cast<double>(times.resolveNs) / totalBytes;
+
+        if ((form == eFormDecimal) || (form == eFormHexList)) {
+            const uint64_t refNs = timeReference(vals, iterations);
+            os << ", \"reference_ns\": " << refNs
+               << ", \"reference_ns_per_byte\": "
+               << static_cast<double>(refNs) / totalBytes;
+        }
+
+        os << " }" << ((form + 1 < eFormCount) ? ",\n" : "\n");
+    }
+
+    os << "  ]\n}\n";
+
+    remove(kConfigFile);
+    remove(kControlsFile);
+
+    if (outFile != nullptr) {
+        std::ofstream fout(outFile);
+        if (!fout) {
+            fprintf(stderr, "Failed to create %s\n", outFile);
+            return 1;
+        }
+        fout << os.str();
+    } else {
+        fputs(os.str().c_str(), stdout);
+    }
+
+    return ret;
+}
@@ -0,0 +1,373 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Generates a synthetic XML config and the matching CAlsaMock controls file
+ * with a chosen number of controls, devices, paths, streams and use-cases.
+ * The output is deterministic for a given set of options.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <getopt.h>
+
+namespace {
+
+// The config manager only accepts the device names in its device table
+const char* const kDeviceNames[] = {
+    "speaker", "earpiece", "headset", "headphone", "sco", "a2dp", "usb",
+    "headset_in", "sco_in", "mic", "back mic", "voice", "aux"
+};
+const unsigned int kMaxDevices = sizeof(kDeviceNames) / sizeof(kDeviceNames[0]);
+
+const unsigned int kEnumValues = 4;
+
+struct CParams
+{
+    unsigned int controls = 2000;
+    unsigned int devices = kMaxDevices;
+    unsigned int paths = 4;         // per device, excluding on and off
+    unsigned int ctlsPerPath = 8;
+    unsigned int streams = 8;       // named streams
+    unsigned int usecases = 4;      // per named stream
+    unsigned int cases = 4;         // per use-case
+    unsigned int ctlsPerCase = 4;
+    unsigned int initCtls = 200;
+    unsigned int byteSize = 64;
+    unsigned int bytePercent = 10;
+    unsigned int seed = 1;
+    bool makeBeforeBreak = false;
+    bool netRoutes = false;
+};
+
+class CGenerator
+{
+public:
+    explicit CGenerator(const CParams& params)
+        : mParams(params), mRandom(params.seed) {}
+
+    int write(const std::string& prefix);
+
+private:
+    enum EType { eBool, eInt, eEnum, eByte };
+
+    struct CControl
+    {
+        std::string name;
+        EType       type;
+    };
+
+    unsigned int newControl(const std::string& name);
+    std::vector<unsigned int> newControls(const std::string& prefix,
+                                          unsigned int count);
+    std::string value(const CControl& c, unsigned int n) const;
+    void writeCtls(std::ostream& os, const std::vector<unsigned int>& ctls,
+                   unsigned int n, const char* indent) const;
+    void writeControls(std::ostream& os) const;
+    void writeXml(std::ostream& os);
+
+private:
+    const CParams&          mParams;
+    std::mt19937            mRandom;
+    std::vector<CControl>   mControls;
+};
+
+unsigned int CGenerator::newControl(const std::string& name)
+{
+    CControl c;
+    c.name = name;
+
+    const unsigned int r = mRandom() % 100;
+    if (r < mParams.bytePercent) {
+        c.type = eByte;
+    } else {
+        c.type = static_cast<EType>(r % 3);
+    }
+
+    mControls.push_back(c);
+    return mControls.size() - 1;
+}
+
+std::vector<unsigned int> CGenerator::newControls(const std::string& prefix,
+                                                  unsigned int count)
+{
+    std::vector<unsigned int> ctls;
+
+    for (unsigned int i = 0; i < count; ++i) {
+        ctls.push_back(newControl(prefix + " " + std::to_string(i)));
+    }
+
+    return ctls;
+}
+
+// Return value number n for a control, n = 0 is the "off" value
+std::string CGenerator::value(const CControl& c, unsigned int n) const
+{
+    switch (c.type) {
+    case eBool:
+        return (n == 0) ? "0" : "1";
+    case eInt:
+        return std::to_string(n % 256);
+    case eEnum:
+        return "V" + std::to_string(n % kEnumValues);
+    case eByte:
+    default:
+        {
+            std::ostringstream s;
+            for (unsigned int i = 0; i < mParams.byteSize; ++i) {
+                s << ((i == 0) ? "" : ",") << ((n + i) % 256);
+            }
+            return s.str();
+        }
+    }
+}
+
+void CGenerator::writeCtls(std::ostream& os,
+                           const std::vector<unsigned int>& ctls,
+                           unsigned int n,
+                           const char* indent) const
+{
+    for (auto i : ctls) {
+        const auto& c = mControls[i];
+        os << indent << "<ctl name=\"" << c.name << "\" val=\""
+           << value(c, n) << "\"/>\n";
+    }
+}
+
+void CGenerator::writeControls(std::ostream& os) const
+{
+    for (const auto& c : mControls) {
+        switch (c.type) {
+        case eBool:
+            os << c.name << ",bool,1,0,0:1\n";
+            break;
+        case eInt:
+            os << c.name << ",int,1,0,0:255\n";
+            break;
+        case eEnum:
+            os << c.name << ",enum,1,V0,";
+            for (unsigned int i = 0; i < kEnumValues; ++i) {
+                os << ((i == 0) ? "" : ":") << "V" << i;
+            }
+            os << "\n";
+            break;
+        case eByte:
+            os << c.name << ",byte," << mParams.byteSize << ",0,\n";
+            break;
+        }
+    }
+}
+
+void CGenerator::writeXml(std::ostream& os)
+{
+    const CParams& p = mParams;
+
+    os << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+       << "<!-- Generated by thcm_gen_config -->\n"
+       << "<audiohal>\n";
+
+    // Controls applied by <init>
+    const auto initCtls = newControls("Init", p.initCtls);
+    os << "    <mixer card=\"0\"" << (p.netRoutes ? " route=\"net\"" : "") << ">\n"
+       << "        <init>\n";
+    writeCtls(os, initCtls, 1, "            ");
+    os << "        </init>\n"
+       << "    </mixer>\n";
+
+    // Each device has on/off and a set of extra paths, each path with its
+    // own controls. Paths are used in pairs as stream enable/disable.
+    for (unsigned int d = 0; d < p.devices; ++d) {
+        const std::string dev = std::string("Dev") + std::to_string(d);
+        const auto onOff = newControls(dev + " Power", p.ctlsPerPath);
+
+        os << "    <device name=\"" << kDeviceNames[d] << "\">\n"
+           << "        <path name=\"on\">\n";
+        writeCtls(os, onOff, 1, "            ");
+        os << "        </path>\n"
+           << "        <path name=\"off\">\n";
+        writeCtls(os, onOff, 0, "            ");
+        os << "        </path>\n";
+
+        for (unsigned int i = 0; i < p.paths; ++i) {
+            const auto ctls = newControls(dev + " Path" + std::to_string(i),
+                                          p.ctlsPerPath);
+            os << "        <path name=\"path" << i << "\">\n";
+            writeCtls(os, ctls, i + 1, "            ");
+            os << "        </path>\n";
+        }
+
+        os << "    </device>\n";
+    }
+
+    // Volume controls are always int
+    mControls.push_back({"Out Left Volume", eInt});
+    mControls.push_back({"Out Right Volume", eInt});
+
+    const char* const route = p.makeBeforeBreak ?
+                              " route=\"make_before_break\"" : "";
+
+    os << "    <stream type=\"pcm\" dir=\"out\" card=\"0\" device=\"0\""
+       << route << ">\n"
+       << "        <enable path=\"path0\"/>\n"
+       << "        <disable path=\"path1\"/>\n"
+       << "        <ctl function=\"leftvol\" name=\"Out Left Volume\""
+       << " min=\"0\" max=\"255\"/>\n"
+       << "        <ctl function=\"rightvol\" name=\"Out Right Volume\""
+       << " min=\"0\" max=\"255\"/>\n"
+       << "    </stream>\n"
+       << "    <stream type=\"pcm\" dir=\"in\" card=\"0\" device=\"0\""
+       << route << ">\n"
+       << "        <enable path=\"path0\"/>\n"
+       << "        <disable path=\"path1\"/>\n"
+       << "    </stream>\n";
+
+    for (unsigned int s = 0; s < p.streams; ++s) {
+        const std::string name = std::string("stream") + std::to_string(s);
+        const unsigned int en = (2 * s) % p.paths;
+        const unsigned int dis = (en + 1) % p.paths;
+
+        os << "    <stream name=\"" << name << "\" type=\"hw\" dir=\""
+           << (((s % 2) == 0) ? "out" : "in") << "\">\n"
+           << "        <enable path=\"path" << en << "\"/>\n"
+           << "        <disable path=\"path" << dis << "\"/>\n";
+
+        for (unsigned int u = 0; u < p.usecases; ++u) {
+            const auto ctls = newControls(name + " UC" + std::to_string(u),
+                                          p.ctlsPerCase);
+            os << "        <usecase name=\"uc" << u << "\">\n";
+            for (unsigned int c = 0; c < p.cases; ++c) {
+                os << "            <case name=\"case" << c << "\">\n";
+                writeCtls(os, ctls, c, "                ");
+                os << "            </case>\n";
+            }
+            os << "        </usecase>\n";
+        }
+
+        os << "    </stream>\n";
+    }
+
+    os << "</audiohal>\n";
+
+    // Pad with controls that are not used by the config
+    unsigned int n = 0;
+    while (mControls.size() < p.controls) {
+        newControl("Unused " + std::to_string(n++));
+    }
+}
+
+int CGenerator::write(const std::string& prefix)
+{
+    const std::string xmlName = prefix + ".xml";
+    const std::string csvName = prefix + ".csv";
+
+    std::ofstream xml(xmlName);
+    if (!xml) {
+        fprintf(stderr, "Failed to create %s\n", xmlName.c_str());
+        return -1;
+    }
+    writeXml(xml);
+
+    std::ofstream csv(csvName);
+    if (!csv) {
+        fprintf(stderr, "Failed to create %s\n", csvName.c_str());
+        return -1;
+    }
+    writeControls(csv);
+
+    if (mControls.size() > mParams.controls) {
+        fprintf(stderr, "Config needs %zu controls, more than the %u requested\n",
+                mControls.size(), mParams.controls);
+    }
+
+    return 0;
+}
+
+void usage(const char* argv0)
+{
+    const CParams d;
+
+    fprintf(stderr,
+            "Usage: %s [options] <output prefix>\n"
+            "Writes <output prefix>.xml and <output prefix>.csv\n"
+            "  -c <n>  total number of controls (default %u)\n"
+            "  -d <n>  number of devices, maximum %u (default %u)\n"
+            "  -p <n>  paths per device excluding on/off, minimum 2 (default %u)\n"
+            "  -k <n>  controls per path (default %u)\n"
+            "  -s <n>  named streams (default %u)\n"
+            "  -u <n>  use-cases per named stream (default %u)\n"
+            "  -e <n>  cases per use-case (default %u)\n"
+            "  -q <n>  controls per case (default %u)\n"
+            "  -i <n>  controls in <init> (default %u)\n"
+            "  -b <n>  size of BYTE controls (default %u)\n"
+            "  -B <n>  percentage of controls that are BYTE (default %u)\n"
+            "  -r <n>  random seed (default %u)\n"
+            "  -m      make-before-break route changes on the pcm streams\n"
+            "  -n      net route changes (route=\"net\" on the mixer)\n",
+            argv0, d.controls, kMaxDevices, d.devices, d.paths, d.ctlsPerPath,
+            d.streams, d.usecases, d.cases, d.ctlsPerCase, d.initCtls,
+            d.byteSize, d.bytePercent, d.seed);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    CParams params;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:d:p:k:s:u:e:q:i:b:B:r:mnh")) != -1) {
+        const unsigned int n = strtoul(optarg ? optarg : "0", nullptr, 0);
+
+        switch (opt) {
+        case 'c': params.controls = n; break;
+        case 'd': params.devices = n; break;
+        case 'p': params.paths = n; break;
+        case 'k': params.ctlsPerPath = n; break;
+        case 's': params.streams = n; break;
+        case 'u': params.usecases = n; break;
+        case 'e': params.cases = n; break;
+        case 'q': params.ctlsPerCase = n; break;
+        case 'i': params.initCtls = n; break;
+        case 'b': params.byteSize = n; break;
+        case 'B': params.bytePercent = n; break;
+        case 'r': params.seed = n; break;
+        case 'm': params.makeBeforeBreak = true; break;
+        case 'n': params.netRoutes = true; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((optind != argc - 1) || (params.devices == 0)
+            || (params.devices > kMaxDevices) || (params.paths < 2)
+            || (params.byteSize == 0) || (params.bytePercent > 100)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    CGenerator gen(params);
+    return (gen.write(argv[optind]) == 0) ? 0 : 1;
+}
@@ -0,0 +1,598 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Multi-threaded stress test of the config manager running on CAlsaMock.
+ * Each thread opens, routes, sets the volume of, applies use-cases to, reads
+ * the constants of and releases its own references to streams in a random
+ * order, like the threads of AudioFlinger do, and occasionally reloads the
+ * configuration. A checker thread verifies that the stream and
+ * device reference counts stay consistent. Throughput and, if the config
+ * manager was built with TINYHAL_LOCK_STATS, lock wait and hold times are
+ * written as JSON.
+ */
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <getopt.h>
+
+#include <tinyhal/audio_config.h>
+
+#include "../../thcm_test_harness.h"
+#include "../harness/jni/CAlsaMock.h"
+#include "thcm_bench_util.h"
+
+namespace {
+
+using cirrus::CStreamInfo;
+using cirrus::CConfigScanner;
+using cirrus::deviceBits;
+using cirrus::nowNs;
+using cirrus::pcmConfig;
+
+const char* const kDefaultConfig = "data/bench_phone.xml";
+const char* const kDefaultControls = "data/bench_phone.csv";
+const unsigned int kDefaultThreads = 8;
+const unsigned int kDefaultDurationMs = 2000;
+const unsigned int kDefaultCheckMs = 20;
+
+// Maximum number of stream references held by one thread
+const size_t kMaxHeld = 4;
+
+enum EOp {
+    eOpGetStream,
+    eOpGetNamedStream,
+    eOpReleaseStream,
+    eOpApplyRoute,
+    eOpSetHwVolume,
+    eOpApplyUseCase,
+    eOpTransaction,
+    eOpGetConstant,
+    eOpReload,
+    eOpCount
+};
+
+struct COpInfo
+{
+    const char* name;
+    int         lockApi;    // enum config_lock_api or -1 if it has no lock
+    unsigned    weight;     // relative chance of being chosen
+};
+
+const COpInfo kOps[eOpCount] = {
+    { "get_stream",         e_config_lock_get_stream,       2 },
+    { "get_named_stream",   e_config_lock_get_named_stream, 2 },
+    { "release_stream",     e_config_lock_release_stream,   4 },
+    { "apply_route",        e_config_lock_apply_route,      6 },
+    { "set_hw_volume",      e_config_lock_set_hw_volume,    6 },
+    { "apply_use_case",     e_config_lock_apply_use_case,   4 },
+    { "transaction",        e_config_lock_transaction,      2 },
+    { "get_constant",       e_config_lock_get_constant,     2 },
+    { "reload",             e_config_lock_reload,           1 },
+};
+
+enum EResult {
+    eDone,
+    eFailed,
+    eSkipped    // not possible in the current state, not counted
+};
+
+struct COpStats
+{
+    uint64_t    count = 0;
+    uint64_t    failures = 0;
+    uint64_t    totalNs = 0;
+    uint64_t    maxNs = 0;
+
+    void add(uint64_t ns, bool ok)
+    {
+        ++count;
+        totalNs += ns;
+        if (ns > maxNs) {
+            maxNs = ns;
+        }
+        if (!ok) {
+            ++failures;
+        }
+    }
+
+    void merge(const COpStats& other)
+    {
+        count += other.count;
+        failures += other.failures;
+        totalNs += other.totalNs;
+        if (other.maxNs > maxNs) {
+            maxNs = other.maxNs;
+        }
+    }
+};
+
+struct CHeldStream
+{
+    const struct hw_stream*     stream;
+    const CStreamInfo*          info;
+};
+
+class CStress
+{
+public:
+    CStress(const std::vector<CStreamInfo>& streams, unsigned int threads,
+            unsigned int durationMs, unsigned int checkMs, unsigned int seed)
+        : mStreams(streams),
+          mNumThreads(threads),
+          mDurationMs(durationMs),
+          mCheckMs(checkMs),
+          mSeed(seed)
+    {
+    }
+
+    int run(struct config_mgr* cm);
+    void writeJson(std::ostream& os, const char* configFile);
+    unsigned int errors() const { return mErrors; }
+
+private:
+    void worker(unsigned int index, std::vector<COpStats>& stats);
+    void checker();
+    const std::vector<uint32_t>& routesFor(const CStreamInfo& info) const;
+    EResult doOp(EOp op, std::mt19937& random, std::vector<CHeldStream>& held);
+
+private:
+    const std::vector<CStreamInfo>& mStreams;
+    const unsigned int      mNumThreads;
+    const unsigned int      mDurationMs;
+    const unsigned int      mCheckMs;
+    const unsigned int      mSeed;
+
+    struct config_mgr*      mCm = nullptr;
+    std::vector<uint32_t>   mOutRoutes;
+    std::vector<uint32_t>   mInRoutes;
+    std::vector<const CStreamInfo*> mAnonStreams;
+    std::vector<const CStreamInfo*> mNamedStreams;
+
+    std::atomic<bool>       mStop{false};
+    std::atomic<int>        mHeldRefs{0};
+
+    uint64_t                mElapsedNs = 0;
+    std::vector<COpStats>   mOpStats;
+    bool                    mHaveLockStats = false;
+    struct config_lock_stats mLockStats[e_config_lock_api_count];
+    unsigned int            mChecks = 0;
+    unsigned int            mErrors = 0;
+    unsigned int            mFinalRefs = 0;
+};
+
+const std::vector<uint32_t>& CStress::routesFor(const CStreamInfo& info) const
+{
+    return (info.dir == "in") ? mInRoutes : mOutRoutes;
+}
+
+EResult CStress::doOp(EOp op, std::mt19937& random, std::vector<CHeldStream>& held)
+{
+    const struct hw_stream* s = nullptr;
+    const CStreamInfo* info = nullptr;
+    size_t h = 0;
+
+    switch (op) {
+    case eOpGetStream:
+        if (mAnonStreams.empty() || (held.size() >= kMaxHeld)) {
+            return eSkipped;
+        }
+        info = mAnonStreams[random() % mAnonStreams.size()];
+        {
+            const auto& routes = routesFor(*info);
+            const struct audio_config config = pcmConfig();
+            uint32_t devices = routes[random() % routes.size()];
+            if (info->dir == "in") {
+                devices |= AUDIO_DEVICE_BIT_IN;
+            }
+            s = get_stream(mCm, devices, AUDIO_OUTPUT_FLAG_NONE, &config);
+        }
+        break;
+
+    case eOpGetNamedStream:
+        if (mNamedStreams.empty() || (held.size() >= kMaxHeld)) {
+            return eSkipped;
+        }
+        info = mNamedStreams[random() % mNamedStreams.size()];
+        s = get_named_stream(mCm, info->name.c_str());
+        break;
+
+    // Replaces the use-cases and constants under the other threads
+    case eOpReload:
+        return (reload_audio_config(mCm, nullptr) == 0) ? eDone : eFailed;
+
+    default:
+        if (held.empty()) {
+            return eSkipped;
+        }
+        h = random() % held.size();
+        s = held[h].stream;
+        info = held[h].info;
+        break;
+    }
+
+    switch (op) {
+    case eOpGetStream:
+    case eOpGetNamedStream:
+        if (s == nullptr) {
+            return eFailed;     // stream at its maximum reference count
+        }
+        held.push_back({ s, info });
+        ++mHeldRefs;
+        return eDone;
+
+    case eOpReleaseStream:
+        release_stream(s);
+        held.erase(held.begin() + h);
+        --mHeldRefs;
+        return eDone;
+
+    case eOpApplyRoute:
+        {
+            const auto& routes = routesFor(*info);
+            apply_route(s, routes[random() % routes.size()]);
+        }
+        return eDone;
+
+    case eOpSetHwVolume:
+        switch (set_hw_volume(s, random() % 101, random() % 101)) {
+        case 0:
+            return eDone;
+        case -ENOSYS:
+            return eSkipped;    // stream has no volume controls
+        default:
+            return eFailed;
+        }
+
+    case eOpApplyUseCase:
+        if (info->usecases.empty()) {
+            return eSkipped;
+        }
+        {
+            const auto& uc = info->usecases[random() % info->usecases.size()];
+            if (uc.cases.empty()) {
+                return eSkipped;
+            }
+            const auto& c = uc.cases[random() % uc.cases.size()];
+            return (apply_use_case(s, uc.name.c_str(), c.c_str()) == 0) ?
+                        eDone : eFailed;
+        }
+
+    // Two route changes and a use-case batched into one commit
+    case eOpTransaction:
+        {
+            const auto& routes = routesFor(*info);
+            if (config_begin_transaction(mCm) != 0) {
+                return eFailed;
+            }
+            apply_route(s, routes[random() % routes.size()]);
+            if (!info->usecases.empty()) {
+                const auto& uc = info->usecases[random() % info->usecases.size()];
+                if (!uc.cases.empty()) {
+                    const auto& c = uc.cases[random() % uc.cases.size()];
+                    apply_use_case(s, uc.name.c_str(), c.c_str());
+                }
+            }
+            apply_route(s, routes[random() % routes.size()]);
+            return (config_commit(mCm) == 0) ? eDone : eFailed;
+        }
+
+    case eOpGetConstant:
+        {
+            const char* value = nullptr;
+            switch (get_stream_constant_string(s, "stress", &value)) {
+            case 0:
+                return (value != nullptr) ? eDone : eFailed;
+            case -ENOSYS:
+                return eDone;   // the lookup is still made
+            default:
+                return eFailed;
+            }
+        }
+
+    default:
+        return eSkipped;
+    }
+}
+
+void CStress::worker(unsigned int index, std::vector<COpStats>& stats)
+{
+    std::mt19937 random(mSeed + index);
+    std::vector<CHeldStream> held;
+    unsigned int totalWeight = 0;
+
+    for (const auto& op : kOps) {
+        totalWeight += op.weight;
+    }
+
+    stats.resize(eOpCount);
+
+    while (!mStop.load(std::memory_order_relaxed)) {
+        unsigned int r = random() % totalWeight;
+        int op = 0;
+        while (r >= kOps[op].weight) {
+            r -= kOps[op].weight;
+            ++op;
+        }
+
+        const uint64_t start = nowNs();
+        const EResult result = doOp(static_cast<EOp>(op), random, held);
+        const uint64_t elapsed = nowNs() - start;
+
+        if (result != eSkipped) {
+            stats[op].add(elapsed, result == eDone);
+        }
+    }
+
+    for (const auto& hs : held) {
+        release_stream(hs.stream);
+        --mHeldRefs;
+    }
+}
+
+void CStress::checker()
+{
+    while (!mStop.load(std::memory_order_relaxed)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(mCheckMs));
+
+        const int ret = check_config_mgr_state(mCm, nullptr);
+        ++mChecks;
+        if (ret != 0) {
+            fprintf(stderr, "Inconsistent state after %u checks (%d)\n",
+                    mChecks, ret);
+            ++mErrors;
+        }
+    }
+}
+
+int CStress::run(struct config_mgr* cm)
+{
+    mCm = cm;
+
+    // Routes are single devices or no device. Routing a stream between
+    // devices that share a <device> entry is not exercised.
+    mOutRoutes = deviceBits(get_supported_output_devices(cm), 0);
+    mOutRoutes.push_back(0);
+    mInRoutes = deviceBits(get_supported_input_devices(cm), AUDIO_DEVICE_BIT_IN);
+    mInRoutes.push_back(0);
+
+    for (const auto& info : mStreams) {
+        if (!info.name.empty()) {
+            mNamedStreams.push_back(&info);
+        } else if (info.type == "pcm") {
+            mAnonStreams.push_back(&info);
+        }
+    }
+
+    reset_config_lock_stats(cm);
+
+    std::vector<std::vector<COpStats>> threadStats(mNumThreads);
+    std::vector<std::thread> threads;
+
+    const uint64_t start = nowNs();
+    for (unsigned int i = 0; i < mNumThreads; ++i) {
+        threads.emplace_back(&CStress::worker, this, i, std::ref(threadStats[i]));
+    }
+    std::thread checkThread(&CStress::checker, this);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(mDurationMs));
+    mStop = true;
+
+    for (auto& t : threads) {
+        t.join();
+    }
+    mElapsedNs = nowNs() - start;
+    checkThread.join();
+
+    mOpStats.resize(eOpCount);
+    for (const auto& ts : threadStats) {
+        for (int op = 0; op < eOpCount; ++op) {
+            mOpStats[op].merge(ts[op]);
+        }
+    }
+
+    mHaveLockStats = (get_config_lock_stats(cm, mLockStats,
+                                            e_config_lock_api_count) > 0);
+
+    // All threads have released their references so everything is closed
+    ++mChecks;
+    if ((check_config_mgr_state(cm, &mFinalRefs) != 0) || (mFinalRefs != 0)
+            || (mHeldRefs != 0)) {
+        fprintf(stderr, "Inconsistent final state: %u stream refs, %d held\n",
+                mFinalRefs, mHeldRefs.load());
+        ++mErrors;
+    }
+
+    return 0;
+}
+
+void CStress::writeJson(std::ostream& os, const char* configFile)
+{
+    const double seconds = mElapsedNs / 1e9;
+    uint64_t totalOps = 0;
+
+    for (const auto& s : mOpStats) {
+        totalOps += s.count;
+    }
+
+    os << "{\n"
+       << "  \"config\": \"" << configFile << "\",\n"
+       << "  \"threads\": " << mNumThreads << ",\n"
+       << "  \"elapsed_ns\": " << mElapsedNs << ",\n"
+       << "  \"ops\": " << totalOps << ",\n"
+       << "  \"ops_per_sec\": " << static_cast<uint64_t>(totalOps / seconds)
+       << ",\n"
+       << "  \"lock_stats\": " << (mHaveLockStats ? "true" : "false") << ",\n"
+       << "  \"results\": [\n";
+
+    for (int op = 0; op < eOpCount; ++op) {
+        const COpStats& s = mOpStats[op];
+
+        os << "    { \"name\": \"" << kOps[op].name << "\""
+           << ", \"count\": " << s.count
+           << ", \"failures\": " << s.failures
+           << ", \"ops_per_sec\": " << static_cast<uint64_t>(s.count / seconds)
+           << ", \"mean_ns\": " << (s.count ? s.totalNs / s.count : 0)
+           << ", \"max_ns\": " << s.maxNs;
+
+        if (mHaveLockStats && (kOps[op].lockApi >= 0)) {
+            const struct config_lock_stats& l = mLockStats[kOps[op].lockApi];
+            os << ", \"lock_count\": " << l.count
+               << ", \"lock_wait_mean_ns\": " << (l.count ? l.wait_ns / l.count : 0)
+               << ", \"lock_wait_max_ns\": " << l.max_wait_ns
+               << ", \"lock_hold_mean_ns\": " << (l.count ? l.hold_ns / l.count : 0)
+               << ", \"lock_hold_max_ns\": " << l.max_hold_ns;
+        }
+
+        os << " }" << ((op + 1 < eOpCount) ? ",\n" : "\n");
+    }
+
+    os << "  ],\n"
+       << "  \"consistency\": { \"checks\": " << mChecks
+       << ", \"errors\": " << mErrors
+       << ", \"final_stream_refs\": " << mFinalRefs << " }\n"
+       << "}\n";
+}
+
+void usage(const char* argv0)
+{
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  -x <file>   XML config (default %s)\n"
+            "  -c <file>   CAlsaMock controls file (default %s)\n"
+            "  -t <count>  number of threads (default %u)\n"
+            "  -d <ms>     duration of the test (default %u)\n"
+            "  -k <ms>     interval between consistency checks (default %u)\n"
+            "  -r <seed>   random seed (default 1)\n"
+            "  -o <file>   write JSON results to file instead of stdout\n"
+            "  -C <bool>,<int>,<enum>,<byte>,<per byte>\n"
+            "              simulated ioctl cost in ns of each control type\n"
+            "  -S          spin for the simulated cost\n"
+            "Exits with status 2 if an inconsistent state was found\n",
+            argv0, kDefaultConfig, kDefaultControls, kDefaultThreads,
+            kDefaultDurationMs, kDefaultCheckMs);
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    const char* configFile = kDefaultConfig;
+    const char* controlsFile = kDefaultControls;
+    const char* outFile = nullptr;
+    unsigned int threads = kDefaultThreads;
+    unsigned int durationMs = kDefaultDurationMs;
+    unsigned int checkMs = kDefaultCheckMs;
+    unsigned int seed = 1;
+    cirrus::CMockIoctlCost cost;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "x:c:t:d:k:r:o:C:Sh")) != -1) {
+        switch (opt) {
+        case 'x':
+            configFile = optarg;
+            break;
+        case 'c':
+            controlsFile = optarg;
+            break;
+        case 't':
+            threads = strtoul(optarg, nullptr, 0);
+            break;
+        case 'd':
+            durationMs = strtoul(optarg, nullptr, 0);
+            break;
+        case 'k':
+            checkMs = strtoul(optarg, nullptr, 0);
+            break;
+        case 'r':
+            seed = strtoul(optarg, nullptr, 0);
+            break;
+        case 'o':
+            outFile = optarg;
+            break;
+        case 'C':
+            if (sscanf(optarg, "%u,%u,%u,%u,%u", &cost.boolNs, &cost.intNs,
+                       &cost.enumNs, &cost.byteNs, &cost.perByteNs) != 5) {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'S':
+            cost.spin = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if ((threads == 0) || (durationMs == 0) || (checkMs == 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    cirrus::CAlsaMock mixer(0);
+    if (mixer.readFromFile(controlsFile) != 0) {
+        fprintf(stderr, "Failed to read controls from %s\n", controlsFile);
+        return 1;
+    }
+
+    std::vector<CStreamInfo> streams;
+    if (CConfigScanner().scan(configFile, streams) != 0) {
+        fprintf(stderr, "Failed to scan %s\n", configFile);
+        return 1;
+    }
+
+    mixer.setIoctlCost(cost);
+
+    struct config_mgr* cm = init_audio_config(configFile);
+    if (cm == nullptr) {
+        fprintf(stderr, "Failed to load %s (%d)\n", configFile, -errno);
+        return 1;
+    }
+
+    CStress stress(streams, threads, durationMs, checkMs, seed);
+    stress.run(cm);
+    free_audio_config(cm);
+
+    if (outFile != nullptr) {
+        std::ofstream fout(outFile);
+        if (!fout) {
+            fprintf(stderr, "Failed to create %s\n", outFile);
+            return 1;
+        }
+        stress.writeJson(fout, configFile);
+    } else {
+        std::ostringstream s;
+        stress.writeJson(s, configFile);
+        fputs(s.str().c_str(), stdout);
+    }
+
+    return (stress.errors() == 0) ? 0 : 2;
+}
@@ -55,4 +55,23 @@ public class CAlsaMock
     public native final String getEnum(String controlName);
     public native final byte[] getData(String controlName);
 
+    /*
+     * Simulated ioctl cost. Every control get and set is counted and
+     * charged the cost for the control type. For BYTE controls perByteNs
+     * is charged for each byte. If spin is true the mock busy-waits for the
+     * cost so that it shows up in elapsed time.
+     */
+    public native final void setIoctlCost(int boolNs, int intNs, int enumNs,
+                                          int byteNs, int perByteNs,
+                                          boolean spin);
+    public native final int getReadCount(String controlName);
+    public native final int getWriteCount(String controlName);
+    // Position of the last write to the control among all writes since
+    // clearCounts(), starting at 1. 0 if it has not been written.
+    public native final long getLastWriteSeq(String controlName);
+    public native final long getTotalReadCount();
+    public native final long getTotalWriteCount();
+    public native final long getSimulatedTimeNs();
+    public native final void clearCounts();
+
 };
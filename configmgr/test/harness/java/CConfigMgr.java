@@ -237,6 +237,7 @@ public class CConfigMgr
 
     public native final int init_audio_config(String config_file_name);
     public native final int free_audio_config();
+    public native final int reload_audio_config(String config_file_name);
     public native final long get_mixer();
 
     public native final long get_supported_input_devices();
@@ -265,6 +266,47 @@ public class CConfigMgr
 
     public native final int set_hw_volume(long stream, int left_pc, int right_pc);
 
+    public native final int config_begin_transaction();
+    public native final int config_commit();
+    public native final boolean config_batch_parameters();
+
+    // Phases for get_boot_phase_stats(). The n'th <pre_init> is
+    // BOOT_PHASE_PREINIT_BASE + n
+    public static final int BOOT_PHASE_OPEN = 0;
+    public static final int BOOT_PHASE_PARSE = 1;
+    public static final int BOOT_PHASE_RESOLVE = 2;
+    public static final int BOOT_PHASE_NEW_CTLS = 3;
+    public static final int BOOT_PHASE_INIT = 4;
+    public static final int BOOT_PHASE_PREINIT_BASE = 5;
+
+    // Indexes into array returned by get_boot_phase_stats()
+    public static final int BOOT_STAT_TIME_NS = 0;
+    public static final int BOOT_STAT_CTL_WRITES = 1;
+    public static final int BOOT_STAT_BYTES_WRITTEN = 2;
+    public static final int BOOT_STAT_TOTAL_NS = 3;
+    public static final int BOOT_STAT_CTL_UNCHANGED = 4;
+
+    public native final int get_boot_preinit_count();
+    public native final long[] get_boot_phase_stats(int phase);
+
     // Not part of the configmgr API but convenient to add it here
     public static native final boolean are_allocs_leaked();
+
+    // Phases for get_alloc_stats() and get_alloc_lines()
+    public static final int ALLOC_PHASE_PARSE = 0;
+    public static final int ALLOC_PHASE_INIT = 1;
+    public static final int ALLOC_PHASE_STEADY = 2;
+
+    // Indexes into array returned by get_alloc_stats()
+    public static final int ALLOC_STAT_ALLOCS = 0;
+    public static final int ALLOC_STAT_REALLOCS = 1;
+    public static final int ALLOC_STAT_FREES = 2;
+    public static final int ALLOC_STAT_ALLOC_BYTES = 3;
+    public static final int ALLOC_STAT_PEAK_BYTES = 4;
+    public static final int ALLOC_STAT_LIVE_BYTES = 5;
+
+    // get_alloc_lines() returns triplets of source line, count and bytes
+    public static native final void reset_alloc_stats();
+    public static native final long[] get_alloc_stats(int phase);
+    public static native final long[] get_alloc_lines(int phase);
 };
@@ -19,10 +19,12 @@
 #define LOG_TAG "tinyhal_test_harness"
 
 #include <algorithm>
+#include <ctime>
 #include <fstream>
 #include <limits>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -39,8 +41,12 @@
 
 namespace cirrus {
 
+// The most recently created mock, nullptr if there are none
 CAlsaMock* gAlsaMock = nullptr;
 
+static std::mutex gCardsLock;
+static std::map<unsigned int, CAlsaMock*> gCards;
+
 // Utility function to find the index of an entry in a vector
 template<class T>
 int findIndex(const std::vector<T>& vec, const T& value)
@@ -67,7 +73,10 @@ CMockControl::CMockControl(unsigned int id,
       mIntMin(0),
       mIntMax(0),
       mIntValues(numElements, static_cast<int>(initialValue)),
-      mChanged(false)
+      mChanged(false),
+      mReadCount(0),
+      mWriteCount(0),
+      mLastWriteSeq(0)
 {
 }
 
@@ -84,7 +93,10 @@ CMockControl::CMockControl(unsigned int id,
       mIntMin(min),
       mIntMax(max),
       mIntValues(numElements, static_cast<int>(initialValue)),
-      mChanged(false)
+      mChanged(false),
+      mReadCount(0),
+      mWriteCount(0),
+      mLastWriteSeq(0)
 {
 }
 
@@ -100,7 +112,10 @@ CMockControl::CMockControl(unsigned int id,
       mIntMax(0),
       mEnumStrings(std::move(enumStrings)),
       mIntValues(1, findIndex<std::string>(mEnumStrings, initialValue)),
-      mChanged(false)
+      mChanged(false),
+      mReadCount(0),
+      mWriteCount(0),
+      mLastWriteSeq(0)
 {
 }
 
@@ -114,12 +129,29 @@ CMockControl::CMockControl(unsigned int id,
       mIntMin(0),
       mIntMax(0),
       mData(std::move(initialData)),
-      mChanged(false)
+      mChanged(false),
+      mReadCount(0),
+      mWriteCount(0),
+      mLastWriteSeq(0)
+{
+}
+
+int CMockControl::getInt(size_t index) const
+{
+    std::lock_guard<std::mutex> lock(mLock);
+    return mIntValues[index];
+}
+
+void CMockControl::copyData(uint8_t* dest, size_t count) const
 {
+    std::lock_guard<std::mutex> lock(mLock);
+    std::copy_n(mData.begin(), std::min(count, mData.size()), dest);
 }
 
 int CMockControl::set(size_t index, int value)
 {
+    std::lock_guard<std::mutex> lock(mLock);
+
     if (index >= mIntValues.size()) {
         ALOGE("%s: index %zu out of range (0..%zu)",
               __func__, index, mIntValues.size() - 1);
@@ -134,6 +166,8 @@ int CMockControl::set(size_t index, int value)
 
 int CMockControl::set(const std::string& value)
 {
+    std::lock_guard<std::mutex> lock(mLock);
+
     int index = findIndex(mEnumStrings, value);
     if (index < 0) {
         ALOGE("%s: '%s' not a valid enum", __func__, value.c_str());
@@ -148,6 +182,8 @@ int CMockControl::set(const std::string& value)
 
 int CMockControl::setArray(const std::vector<int>& values)
 {
+    std::lock_guard<std::mutex> lock(mLock);
+
     if (values.size() > mIntValues.size()) {
         ALOGE("%s: size %zu > maximum %zu", __func__, values.size(), mIntValues.size());
         return -EINVAL;
@@ -161,6 +197,8 @@ int CMockControl::setArray(const std::vector<int>& values)
 
 int CMockControl::setArray(const std::vector<uint8_t>& data)
 {
+    std::lock_guard<std::mutex> lock(mLock);
+
     if (data.size() > mData.size()) {
         ALOGE("%s: size %zu > maximum %zu", __func__, data.size(), mData.size());
         return -EINVAL;
@@ -248,13 +286,37 @@ void CMockControl::dump() const
 }
 
 CAlsaMock::CAlsaMock(unsigned int cardNum)
-    : mCardNumber(cardNum)
+    : mCardNumber(cardNum),
+      mTotalReads(0),
+      mTotalWrites(0),
+      mSimulatedNs(0)
 {
+    std::lock_guard<std::mutex> lock(gCardsLock);
+
+    gCards[cardNum] = this;
     gAlsaMock = this;
 }
 
 CAlsaMock::~CAlsaMock()
 {
+    std::lock_guard<std::mutex> lock(gCardsLock);
+
+    auto iter = gCards.find(mCardNumber);
+    if ((iter != gCards.end()) && (iter->second == this)) {
+        gCards.erase(iter);
+    }
+
+    if (gAlsaMock == this) {
+        gAlsaMock = gCards.empty() ? nullptr : gCards.begin()->second;
+    }
+}
+
+CAlsaMock* CAlsaMock::findCard(unsigned int cardNum)
+{
+    std::lock_guard<std::mutex> lock(gCardsLock);
+
+    auto iter = gCards.find(cardNum);
+    return (iter == gCards.end()) ? nullptr : iter->second;
 }
 
 static int getValueSetField(std::istringstream& sstr, std::vector<std::string>& v)
@@ -379,12 +441,78 @@ int CAlsaMock::readFromFile(const std::string& fileName)
     mControlsById.resize(mockControlId);
     for (auto iter : mControls) {
         auto c = iter.second;
+        c->setOwner(this);
         mControlsById[c->id()] = c;
     }
 
     return 0;
 }
 
+uint32_t CAlsaMock::ioctlCostNs(const CMockControl* c, size_t bytes) const
+{
+    if (c->isBool()) {
+        return mCost.boolNs;
+    } else if (c->isInt()) {
+        return mCost.intNs;
+    } else if (c->isEnum()) {
+        return mCost.enumNs;
+    } else {
+        return mCost.byteNs + (mCost.perByteNs * bytes);
+    }
+}
+
+static uint64_t monotonicNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL) + ts.tv_nsec;
+}
+
+static void spinFor(uint32_t ns)
+{
+    const uint64_t end = monotonicNs() + ns;
+
+    while (monotonicNs() < end) {
+    }
+}
+
+void CAlsaMock::chargeRead(CMockControl* c, size_t bytes)
+{
+    const uint32_t ns = ioctlCostNs(c, bytes);
+
+    c->countRead();
+    ++mTotalReads;
+    mSimulatedNs += ns;
+
+    if (mCost.spin && (ns > 0)) {
+        spinFor(ns);
+    }
+}
+
+void CAlsaMock::chargeWrite(CMockControl* c, size_t bytes)
+{
+    const uint32_t ns = ioctlCostNs(c, bytes);
+
+    c->countWrite(++mTotalWrites);
+    mSimulatedNs += ns;
+
+    if (mCost.spin && (ns > 0)) {
+        spinFor(ns);
+    }
+}
+
+void CAlsaMock::clearCounts()
+{
+    for (auto& c : mControlsById) {
+        c->clearCounts();
+    }
+
+    mTotalReads = 0;
+    mTotalWrites = 0;
+    mSimulatedNs = 0;
+}
+
 void CAlsaMock::dump() const
 {
     for (const auto& ctl : mControls) {
@@ -419,14 +547,16 @@ CMockControl* CAlsaMock::getControlById(unsigned int id)
 extern "C" {
 struct mixer *mixer_open(unsigned int card)
 {
-    if (gAlsaMock->cardNumber() != card) {
+    CAlsaMock* mock = CAlsaMock::findCard(card);
+
+    if (mock == nullptr) {
         // tinyalsa would fail to fopen() the controlCn file so would return
         // ENOENT error
         errno = ENOENT;
         return nullptr;
     }
 
-    return reinterpret_cast<struct mixer*>(gAlsaMock);
+    return reinterpret_cast<struct mixer*>(mock);
 }
 
 void mixer_close(struct mixer *mixer)
@@ -434,6 +564,16 @@ void mixer_close(struct mixer *mixer)
     (void)mixer;
 }
 
+#ifndef TINYALSA_NO_ADD_NEW_CTRLS
+int mixer_add_new_ctls(struct mixer *mixer)
+{
+    (void)mixer;
+
+    // The mock controls are all created by readFromFile()
+    return 0;
+}
+#endif
+
 const char *mixer_get_name(struct mixer *mixer)
 {
     (void)mixer;
@@ -443,36 +583,36 @@ const char *mixer_get_name(struct mixer *mixer)
 
 unsigned int mixer_get_num_ctls(struct mixer *mixer)
 {
-    (void)mixer;
+    auto* mock = reinterpret_cast<CAlsaMock*>(mixer);
 
-    if (gAlsaMock == nullptr) {
+    if (mock == nullptr) {
         return 0;
     }
 
-    return gAlsaMock->numControls();
+    return mock->numControls();
 }
 
 struct mixer_ctl *mixer_get_ctl(struct mixer *mixer, unsigned int id)
 {
-    (void)mixer;
+    auto* mock = reinterpret_cast<CAlsaMock*>(mixer);
 
-    if (gAlsaMock == nullptr) {
+    if (mock == nullptr) {
         return nullptr;
     }
 
-    auto* c = gAlsaMock->getControlById(id);
+    auto* c = mock->getControlById(id);
     return reinterpret_cast<struct mixer_ctl*>(c);
 }
 
 struct mixer_ctl *mixer_get_ctl_by_name(struct mixer *mixer, const char *name)
 {
-    (void)mixer;
+    auto* mock = reinterpret_cast<CAlsaMock*>(mixer);
 
-    if (gAlsaMock == nullptr) {
+    if (mock == nullptr) {
         return nullptr;
     }
 
-    auto* c = gAlsaMock->getControlByName(name);
+    auto* c = mock->getControlByName(name);
     return reinterpret_cast<struct mixer_ctl*>(c);
 }
 
@@ -547,6 +687,21 @@ unsigned int mixer_ctl_get_num_enums(struct mixer_ctl *ctl)
     return c->numEnumStrings();
 }
 
+const char *mixer_ctl_get_enum_string(struct mixer_ctl *ctl,
+                                      unsigned int enum_id)
+{
+    if (gAlsaMock == nullptr) {
+        return nullptr;
+    }
+
+    auto* c = reinterpret_cast<CMockControl*>(ctl);
+    if (!c->isEnum() || (enum_id >= c->numEnumStrings())) {
+        return nullptr;
+    }
+
+    return c->enumString(enum_id).c_str();
+}
+
 int mixer_ctl_get_value(struct mixer_ctl *ctl, unsigned int id)
 {
     if (gAlsaMock == nullptr) {
@@ -554,6 +709,7 @@ int mixer_ctl_get_value(struct mixer_ctl *ctl, unsigned int id)
     }
 
     auto* c = reinterpret_cast<CMockControl*>(ctl);
+    c->owner()->chargeRead(c, 0);
     return c->getInt(id);
 }
 
@@ -569,12 +725,11 @@ int mixer_ctl_get_array(struct mixer_ctl *ctl, void *array, size_t count)
         return -EINVAL;
     }
 
+    c->owner()->chargeRead(c, count);
+
 
     if (c->isByte()) {
-        auto* p8 = reinterpret_cast<uint8_t*>(array);
-        size_t num = std::min(count, c->numElements());
-        const auto& src = c->getData();
-        std::copy_n(src.begin(), num, p8);
+        c->copyData(reinterpret_cast<uint8_t*>(array), count);
         return 0;
     }
 
@@ -598,6 +753,7 @@ int mixer_ctl_set_value(struct mixer_ctl *ctl, unsigned int id, int value)
         value = !!value; // emulate tinyalsa
     }
 
+    c->owner()->chargeWrite(c, 0);
     return c->set(id, value);
 }
 
@@ -615,6 +771,7 @@ int mixer_ctl_set_array(struct mixer_ctl *ctl, const void *array, size_t count)
         return -EINVAL;
     }
 
+    c->owner()->chargeWrite(c, count);
 
     if (c->isByte()) {
         auto* p8 = reinterpret_cast<const uint8_t*>(array);
@@ -635,6 +792,7 @@ int mixer_ctl_set_enum_by_string(struct mixer_ctl *ctl, const char *str)
     }
 
     auto* c = reinterpret_cast<CMockControl*>(ctl);
+    c->owner()->chargeWrite(c, 0);
     return c->set(std::string(str));
 }
 
@@ -16,13 +16,18 @@
  * limitations under the License.
  */
 
+#include <atomic>
+#include <cstdint>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
 namespace cirrus {
 
+class CAlsaMock;
+
 class CMockControl
 {
 public:
@@ -53,6 +58,10 @@ public:
 
     const std::string& name() const { return mName; }
 
+    // The mixer that owns this control
+    CAlsaMock* owner() const { return mOwner; }
+    void setOwner(CAlsaMock* owner) { mOwner = owner; }
+
     bool isBool() const { return mType == eBool; }
     bool isInt() const { return mType == eInt; }
     bool isEnum() const { return mType == eEnum; }
@@ -62,9 +71,14 @@ public:
     int min() const { return mIntMin; }
     int max() const { return mIntMax; }
     size_t numEnumStrings() const { return mEnumStrings.size(); }
+    const std::string& enumString(size_t index) const { return mEnumStrings[index]; }
     bool isValidIndex(size_t index) const { return index < mNumElements; }
 
-    int getInt(size_t index) const { return mIntValues[index]; }
+    int getInt(size_t index) const;
+    void copyData(uint8_t* dest, size_t count) const;
+
+    // These return references to the value so must not be used while
+    // another thread can be writing the control
     const std::vector<int>& getIntArray() const { return mIntValues; }
     const std::string& getEnum() const { return mEnumStrings[mIntValues[0]]; }
     const std::vector<uint8_t>& getData() const { return mData; }
@@ -72,6 +86,17 @@ public:
     void clearChangedFlag() { mChanged = false; }
     bool isChanged() const { return mChanged; }
 
+    // Number of tinyalsa get and set calls on this control
+    uint32_t readCount() const { return mReadCount; }
+    uint32_t writeCount() const { return mWriteCount; }
+    void countRead() { ++mReadCount; }
+    void countWrite(uint64_t seq) { ++mWriteCount; mLastWriteSeq = seq; }
+    void clearCounts() { mReadCount = 0; mWriteCount = 0; mLastWriteSeq = 0; }
+
+    // Position of the last write to this control in the sequence of all
+    // writes since the counts were cleared, 0 if not written
+    uint64_t lastWriteSeq() const { return mLastWriteSeq; }
+
     int set(size_t index, int value);
     int set(const std::string& value);
     int setArray(const std::vector<int>& values);
@@ -87,19 +112,43 @@ private:
     const int          mIntMin;
     const int          mIntMax;
     const std::vector<std::string> mEnumStrings;
+    CAlsaMock*         mOwner = nullptr;
+
+    // Serializes get and set like the kernel does for ioctls
+    mutable std::mutex  mLock;
 
     std::vector<int>  mIntValues;
     std::vector<uint8_t> mData;
 
     bool        mChanged;
+
+    std::atomic<uint32_t> mReadCount;
+    std::atomic<uint32_t> mWriteCount;
+    std::atomic<uint64_t> mLastWriteSeq;
 };
 
+// Simulated cost of one control get or set ioctl
+struct CMockIoctlCost
+{
+    uint32_t    boolNs = 0;
+    uint32_t    intNs = 0;
+    uint32_t    enumNs = 0;
+    uint32_t    byteNs = 0;     // fixed cost of a BYTE control access
+    uint32_t    perByteNs = 0;  // added for each byte of a BYTE control
+    bool        spin = false;   // busy-wait so cost appears in elapsed time
+};
+
+// Each CAlsaMock is one card. Several can exist at once if they have
+// different card numbers, mixer_open() returns the one for the card.
 class CAlsaMock
 {
 public:
     CAlsaMock(unsigned int cardNum);
     ~CAlsaMock();
 
+    // The CAlsaMock for a card, or nullptr if there isn't one
+    static CAlsaMock* findCard(unsigned int cardNum);
+
     int readFromFile(const std::string& fileName);
     void dump() const;
 
@@ -108,12 +157,33 @@ public:
     CMockControl* getControlByName(const std::string& name);
     CMockControl* getControlById(unsigned int id);
 
+    void setIoctlCost(const CMockIoctlCost& cost) { mCost = cost; }
+    const CMockIoctlCost& ioctlCost() const { return mCost; }
+
+    // Count a get or set of a control and charge its simulated cost
+    void chargeRead(CMockControl* c, size_t bytes);
+    void chargeWrite(CMockControl* c, size_t bytes);
+
+    uint64_t totalReads() const { return mTotalReads; }
+    uint64_t totalWrites() const { return mTotalWrites; }
+    uint64_t simulatedNs() const { return mSimulatedNs; }
+
+    // Clear the totals, the simulated time and the counts of every control
+    void clearCounts();
+
 private:
     const unsigned int mCardNumber;
     std::map<std::string, std::shared_ptr<CMockControl>> mControls;
     std::vector<std::shared_ptr<CMockControl>> mControlsById;
 
+    CMockIoctlCost          mCost;
+    std::atomic<uint64_t>   mTotalReads;
+    std::atomic<uint64_t>   mTotalWrites;
+    std::atomic<uint64_t>   mSimulatedNs;
+
 private:
+    uint32_t ioctlCostNs(const CMockControl* c, size_t bytes) const;
+
     CAlsaMock();
 };
 
@@ -0,0 +1,546 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "tinyhal_test_harness"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#ifdef ANDROID
+#include <cutils/log.h>
+#else
+#include "../../../audio_logging.h"
+#endif
+
+#include "CCompressMock.h"
+#include "CPcmMock.h"
+
+namespace cirrus {
+
+// Used when the codec does not say what bit rate it has
+static const uint32_t kDefaultBitRate = 128000;
+
+static const unsigned int kDefaultFragmentSize = 4096;
+static const unsigned int kDefaultFragments = 4;
+
+CCompressMockFaults CCompressMock::sFaults;
+std::atomic<uint64_t> CCompressMock::sOpens(0);
+std::atomic<uint64_t> CCompressMock::sWrites(0);
+std::atomic<uint64_t> CCompressMock::sBytes(0);
+std::atomic<uint64_t> CCompressMock::sDrains(0);
+std::atomic<uint64_t> CCompressMock::sTracks(0);
+std::atomic<uint64_t> CCompressMock::sBlockedNs(0);
+
+CCompressMock::CCompressMock(unsigned int card, unsigned int device,
+                             unsigned int flags, struct compr_config& config)
+    : mRunning(false),
+      mPaused(false),
+      mNonblock(false),
+      mMaxPollWaitMs(-1),
+      mQueued(0),
+      mConsumed(0),
+      mMarkNs(0)
+{
+    ++sOpens;
+
+    memset(&mCodec, 0, sizeof(mCodec));
+    memset(&mGapless, 0, sizeof(mGapless));
+
+    // As tinycompress, zero fragment values mean use the driver defaults
+    if ((config.fragment_size == 0) || (config.fragments == 0)) {
+        config.fragment_size = kDefaultFragmentSize;
+        config.fragments = kDefaultFragments;
+    }
+    mFragmentSize = config.fragment_size;
+    mBufferBytes = config.fragment_size * config.fragments;
+
+    if (config.codec != nullptr) {
+        mCodec = *config.codec;
+    }
+
+    mByteRate = ((mCodec.bit_rate != 0) ? mCodec.bit_rate : kDefaultBitRate) / 8;
+
+    if (sFaults.failOpen) {
+        mError = "injected open failure";
+    } else if (flags != COMPRESS_IN) {
+        mError = "capture not supported";
+    } else if (config.codec == nullptr) {
+        mError = "no codec";
+    }
+
+    ALOGV("compress_open(%u,%u) codec=%u rate=%u buffer=%ux%u%s%s",
+          card, device, mCodec.id, mCodec.sample_rate,
+          config.fragment_size, config.fragments,
+          isReady() ? "" : ": ", error());
+}
+
+CCompressMockStats CCompressMock::stats()
+{
+    CCompressMockStats s;
+
+    s.opens = sOpens;
+    s.writes = sWrites;
+    s.bytes = sBytes;
+    s.drains = sDrains;
+    s.tracks = sTracks;
+    s.blockedNs = sBlockedNs;
+    return s;
+}
+
+void CCompressMock::clearStats()
+{
+    sOpens = 0;
+    sWrites = 0;
+    sBytes = 0;
+    sDrains = 0;
+    sTracks = 0;
+    sBlockedNs = 0;
+}
+
+// Consume data up to nowNs
+void CCompressMock::advance(uint64_t nowNs)
+{
+    if (mRunning && !mPaused && (nowNs > mMarkNs)) {
+        const uint64_t n = std::min<uint64_t>(mQueued,
+                                ((nowNs - mMarkNs) * mByteRate) / 1000000000ULL);
+        mQueued -= n;
+        mConsumed += n;
+
+        // Don't let the DSP build up credit while it is starved
+        if (mQueued == 0) {
+            mMarkNs = nowNs;
+        } else {
+            mMarkNs += (n * 1000000000ULL) / mByteRate;
+        }
+    } else {
+        mMarkNs = nowNs;
+    }
+}
+
+uint64_t CCompressMock::timeToConsume(uint64_t bytes) const
+{
+    return mMarkNs + ((bytes * 1000000000ULL) + mByteRate - 1) / mByteRate;
+}
+
+// Sleep without holding the lock so that other calls can be made
+void CCompressMock::sleepUntil(Lock& lock, uint64_t untilNs)
+{
+    const uint64_t now = CSimClock::nowNs();
+
+    if (untilNs > now) {
+        sBlockedNs += untilNs - now;
+        lock.unlock();
+        CSimClock::sleepUntilNs(untilNs);
+        lock.lock();
+    }
+    advance(CSimClock::nowNs());
+}
+
+int CCompressMock::write(const void* buf, unsigned int size)
+{
+    Lock lock(mLock);
+    unsigned int written = 0;
+
+    (void)buf;
+
+    if (!isReady()) {
+        return -EBADFD;
+    }
+
+    ++sWrites;
+
+    if (sFaults.writeLatencyNs > 0) {
+        sleepUntil(lock, CSimClock::nowNs() + sFaults.writeLatencyNs);
+    }
+
+    advance(CSimClock::nowNs());
+
+    while (written < size) {
+        const unsigned int space = mBufferBytes - mQueued;
+
+        if (space == 0) {
+            // A stopped stream will never make space, return what was
+            // written so that the caller can start it
+            if (mNonblock || !mRunning || mPaused) {
+                break;
+            }
+            const uint64_t need = std::min<uint64_t>(size - written, mFragmentSize);
+            sleepUntil(lock, timeToConsume(need));
+            continue;
+        }
+
+        const unsigned int n = std::min(space, size - written);
+        mQueued += n;
+        written += n;
+    }
+
+    sBytes += written;
+    return written;
+}
+
+int CCompressMock::start()
+{
+    Lock lock(mLock);
+
+    if (!isReady()) {
+        return -EBADFD;
+    }
+
+    if (sFaults.startLatencyNs > 0) {
+        sleepUntil(lock, CSimClock::nowNs() + sFaults.startLatencyNs);
+    }
+
+    advance(CSimClock::nowNs());
+    mRunning = true;
+    mPaused = false;
+    return 0;
+}
+
+int CCompressMock::stop()
+{
+    Lock lock(mLock);
+
+    if (!isReady()) {
+        return -EBADFD;
+    }
+
+    // Unplayed data is discarded
+    mRunning = false;
+    mPaused = false;
+    mQueued = 0;
+    return 0;
+}
+
+int CCompressMock::pause()
+{
+    Lock lock(mLock);
+
+    if (!mRunning || mPaused) {
+        return -EPERM;
+    }
+
+    advance(CSimClock::nowNs());
+    mPaused = true;
+    return 0;
+}
+
+int CCompressMock::resume()
+{
+    Lock lock(mLock);
+
+    if (!mRunning || !mPaused) {
+        return -EPERM;
+    }
+
+    mPaused = false;
+    advance(CSimClock::nowNs());
+    return 0;
+}
+
+int CCompressMock::waitEmpty(Lock& lock)
+{
+    advance(CSimClock::nowNs());
+
+    while (mRunning && !mPaused && (mQueued > 0)) {
+        sleepUntil(lock, timeToConsume(mQueued));
+    }
+
+    if (mQueued > 0) {
+        // Stopped or paused by another thread
+        return -EINTR;
+    }
+
+    return 0;
+}
+
+int CCompressMock::drain()
+{
+    Lock lock(mLock);
+    int ret;
+
+    if (!mRunning) {
+        return -EPERM;
+    }
+
+    ++sDrains;
+    ret = waitEmpty(lock);
+    mRunning = false;
+    return ret;
+}
+
+int CCompressMock::partialDrain()
+{
+    Lock lock(mLock);
+    int ret;
+
+    if (!mRunning) {
+        return -EPERM;
+    }
+
+    // The next track follows on without a gap so the model does not need
+    // to separate the tracks, this only waits for the data to be played
+    ++sDrains;
+    ret = waitEmpty(lock);
+    mRunning = false;
+    return ret;
+}
+
+int CCompressMock::nextTrack()
+{
+    Lock lock(mLock);
+
+    if (!mRunning) {
+        return -EPERM;
+    }
+
+    ++sTracks;
+    return 0;
+}
+
+int CCompressMock::setGaplessMetadata(const struct compr_gapless_mdata& mdata)
+{
+    Lock lock(mLock);
+
+    mGapless = mdata;
+    return 0;
+}
+
+int CCompressMock::getTstamp(uint64_t* samples, unsigned int* samplingRate)
+{
+    Lock lock(mLock);
+
+    if (!isReady()) {
+        return -EBADFD;
+    }
+
+    advance(CSimClock::nowNs());
+    *samples = (mConsumed * mCodec.sample_rate) / mByteRate;
+    *samplingRate = mCodec.sample_rate;
+    return 0;
+}
+
+int CCompressMock::getHpointer(unsigned int* avail, struct timespec* tstamp)
+{
+    Lock lock(mLock);
+
+    if (!isReady() || !mRunning) {
+        return -1;
+    }
+
+    advance(CSimClock::nowNs());
+    *avail = mBufferBytes - mQueued;
+    tstamp->tv_sec = (mConsumed / mByteRate);
+    tstamp->tv_nsec = ((mConsumed % mByteRate) * 1000000000ULL) / mByteRate;
+    return 0;
+}
+
+int CCompressMock::wait(int timeoutMs)
+{
+    Lock lock(mLock);
+
+    if (timeoutMs < 0) {
+        timeoutMs = mMaxPollWaitMs;
+    }
+
+    const uint64_t deadline = (timeoutMs < 0) ? UINT64_MAX
+                              : CSimClock::nowNs() + (timeoutMs * 1000000ULL);
+
+    advance(CSimClock::nowNs());
+
+    while ((mBufferBytes - mQueued) < mFragmentSize) {
+        // Waiting forever on a stopped stream would never return
+        if (!mRunning || mPaused) {
+            if (deadline == UINT64_MAX) {
+                return -EPERM;
+            }
+            sleepUntil(lock, deadline);
+            return -ETIME;
+        }
+
+        const uint64_t t = timeToConsume(mFragmentSize - (mBufferBytes - mQueued));
+        if (t > deadline) {
+            sleepUntil(lock, deadline);
+            return -ETIME;
+        }
+        sleepUntil(lock, t);
+    }
+
+    return 0;
+}
+
+bool CCompressMock::isRunning()
+{
+    Lock lock(mLock);
+
+    return mRunning;
+}
+
+void CCompressMock::setNonblock(bool nonblock)
+{
+    Lock lock(mLock);
+
+    mNonblock = nonblock;
+}
+
+void CCompressMock::setMaxPollWait(int ms)
+{
+    Lock lock(mLock);
+
+    mMaxPollWaitMs = ms;
+}
+
+} // namespace cirrus
+
+using cirrus::CCompressMock;
+
+static CCompressMock* toMock(struct compress* compress)
+{
+    return reinterpret_cast<CCompressMock*>(compress);
+}
+
+extern "C" {
+struct compress *compress_open(unsigned int card, unsigned int device,
+                               unsigned int flags, struct compr_config *config)
+{
+    return reinterpret_cast<struct compress*>(new CCompressMock(card, device,
+                                                                flags, *config));
+}
+
+void compress_close(struct compress *compress)
+{
+    delete toMock(compress);
+}
+
+int is_compress_ready(struct compress *compress)
+{
+    return (compress != nullptr) && toMock(compress)->isReady();
+}
+
+int is_compress_running(struct compress *compress)
+{
+    return (compress != nullptr) && toMock(compress)->isRunning();
+}
+
+const char *compress_get_error(struct compress *compress)
+{
+    return toMock(compress)->error();
+}
+
+int compress_get_hpointer(struct compress *compress, unsigned int *avail,
+                          struct timespec *tstamp)
+{
+    return toMock(compress)->getHpointer(avail, tstamp);
+}
+
+#ifdef TINYCOMPRESS_TSTAMP_IS_LONG
+int compress_get_tstamp(struct compress *compress, unsigned long *samples,
+                        unsigned int *sampling_rate)
+#else
+int compress_get_tstamp(struct compress *compress, unsigned int *samples,
+                        unsigned int *sampling_rate)
+#endif
+{
+    uint64_t s;
+    int ret = toMock(compress)->getTstamp(&s, sampling_rate);
+
+    if (ret == 0) {
+        *samples = s;
+    }
+    return ret;
+}
+
+int compress_write(struct compress *compress, const void *buf, unsigned int size)
+{
+    return toMock(compress)->write(buf, size);
+}
+
+int compress_read(struct compress *compress, void *buf, unsigned int size)
+{
+    (void)compress;
+    (void)buf;
+    (void)size;
+    return -ENOSYS;
+}
+
+int compress_start(struct compress *compress)
+{
+    return toMock(compress)->start();
+}
+
+int compress_stop(struct compress *compress)
+{
+    return toMock(compress)->stop();
+}
+
+int compress_pause(struct compress *compress)
+{
+    return toMock(compress)->pause();
+}
+
+int compress_resume(struct compress *compress)
+{
+    return toMock(compress)->resume();
+}
+
+int compress_drain(struct compress *compress)
+{
+    return toMock(compress)->drain();
+}
+
+int compress_next_track(struct compress *compress)
+{
+    return toMock(compress)->nextTrack();
+}
+
+int compress_partial_drain(struct compress *compress)
+{
+    return toMock(compress)->partialDrain();
+}
+
+int compress_set_gapless_metadata(struct compress *compress,
+                                  struct compr_gapless_mdata *mdata)
+{
+    return toMock(compress)->setGaplessMetadata(*mdata);
+}
+
+bool is_codec_supported(unsigned int card, unsigned int device,
+                        unsigned int flags, struct snd_codec *codec)
+{
+    (void)card;
+    (void)device;
+    (void)codec;
+    return flags == COMPRESS_IN;
+}
+
+void compress_set_max_poll_wait(struct compress *compress, int milliseconds)
+{
+    toMock(compress)->setMaxPollWait(milliseconds);
+}
+
+void compress_nonblock(struct compress *compress, int nonblock)
+{
+    toMock(compress)->setNonblock(nonblock != 0);
+}
+
+int compress_wait(struct compress *compress, int timeout_ms)
+{
+    return toMock(compress)->wait(timeout_ms);
+}
+} // extern "C"
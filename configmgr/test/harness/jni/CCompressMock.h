@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CCOMPRESSMOCK_H
+#define CCOMPRESSMOCK_H
+
+/*
+ * Mock of the tinycompress playback API. The DSP is modelled as a buffer
+ * that is drained at the codec bit rate on the CSimClock time base.
+ * Only playback (COMPRESS_IN) streams are supported.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include <sound/compress_params.h>
+#include <tinycompress/tinycompress.h>
+
+namespace cirrus {
+
+// Faults injected into every compressed stream
+struct CCompressMockFaults
+{
+    uint32_t    writeLatencyNs = 0;     // extra time taken by a write
+    uint32_t    startLatencyNs = 0;     // extra time taken by compress_start
+    bool        failOpen = false;       // compress_open() returns a bad stream
+};
+
+// Totals for all compressed streams since the last clearStats()
+struct CCompressMockStats
+{
+    uint64_t    opens = 0;
+    uint64_t    writes = 0;
+    uint64_t    bytes = 0;
+    uint64_t    drains = 0;
+    uint64_t    tracks = 0;         // compress_next_track() calls
+    uint64_t    blockedNs = 0;      // simulated time spent waiting for the DSP
+};
+
+class CCompressMock
+{
+public:
+    CCompressMock(unsigned int card, unsigned int device, unsigned int flags,
+                  struct compr_config& config);
+
+    bool isReady() const { return mError.empty(); }
+    const char* error() const { return mError.c_str(); }
+
+    int write(const void* buf, unsigned int size);
+    int start();
+    int stop();
+    int pause();
+    int resume();
+    int drain();
+    int partialDrain();
+    int nextTrack();
+    int setGaplessMetadata(const struct compr_gapless_mdata& mdata);
+    int getTstamp(uint64_t* samples, unsigned int* samplingRate);
+    int getHpointer(unsigned int* avail, struct timespec* tstamp);
+    int wait(int timeoutMs);
+    bool isRunning();
+    void setNonblock(bool nonblock);
+    void setMaxPollWait(int ms);
+
+    static void setFaults(const CCompressMockFaults& faults) { sFaults = faults; }
+    static const CCompressMockFaults& faults() { return sFaults; }
+    static CCompressMockStats stats();
+    static void clearStats();
+
+private:
+    typedef std::unique_lock<std::mutex> Lock;
+
+    void advance(uint64_t nowNs);
+    uint64_t timeToConsume(uint64_t bytes) const;
+    void sleepUntil(Lock& lock, uint64_t untilNs);
+    int waitEmpty(Lock& lock);
+
+private:
+    std::mutex          mLock;
+    struct snd_codec    mCodec;
+    unsigned int        mFragmentSize;
+    unsigned int        mBufferBytes;
+    uint32_t            mByteRate;
+    std::string         mError;
+
+    bool                mRunning;
+    bool                mPaused;
+    bool                mNonblock;
+    int                 mMaxPollWaitMs;
+    uint64_t            mQueued;        // bytes written and not yet consumed
+    uint64_t            mConsumed;      // bytes consumed since open
+    uint64_t            mMarkNs;        // time of last consumption update
+    struct compr_gapless_mdata mGapless;
+
+    static CCompressMockFaults      sFaults;
+    static std::atomic<uint64_t>    sOpens;
+    static std::atomic<uint64_t>    sWrites;
+    static std::atomic<uint64_t>    sBytes;
+    static std::atomic<uint64_t>    sDrains;
+    static std::atomic<uint64_t>    sTracks;
+    static std::atomic<uint64_t>    sBlockedNs;
+};
+
+} // namespace cirrus
+
+#endif // CCOMPRESSMOCK_H
@@ -0,0 +1,461 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "tinyhal_test_harness"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+
+#include <tinyalsa/asoundlib.h>
+
+#ifdef ANDROID
+#include <cutils/log.h>
+#else
+#include "../../../audio_logging.h"
+#endif
+
+#include "CPcmMock.h"
+
+namespace cirrus {
+
+CSimClock::EMode CSimClock::sMode = CSimClock::eRealtime;
+std::atomic<uint64_t> CSimClock::sVirtualNs(0);
+
+static uint64_t monotonicNs()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL) + ts.tv_nsec;
+}
+
+void CSimClock::setMode(EMode mode)
+{
+    // Virtual time starts from the current time so that timestamps from
+    // the two modes are comparable
+    sVirtualNs = monotonicNs();
+    sMode = mode;
+}
+
+uint64_t CSimClock::nowNs()
+{
+    if (sMode == eVirtual) {
+        return sVirtualNs;
+    }
+
+    return monotonicNs();
+}
+
+void CSimClock::sleepUntilNs(uint64_t ns)
+{
+    if (sMode == eVirtual) {
+        uint64_t now = sVirtualNs;
+        while ((now < ns) && !sVirtualNs.compare_exchange_weak(now, ns)) {
+        }
+        return;
+    }
+
+    struct timespec ts;
+    ts.tv_sec = ns / 1000000000ULL;
+    ts.tv_nsec = ns % 1000000000ULL;
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+    }
+}
+
+CPcmMockFaults CPcmMock::sFaults;
+std::atomic<uint64_t> CPcmMock::sOpens(0);
+std::atomic<uint64_t> CPcmMock::sTransfers(0);
+std::atomic<uint64_t> CPcmMock::sFrames(0);
+std::atomic<uint64_t> CPcmMock::sXruns(0);
+std::atomic<uint64_t> CPcmMock::sBlockedNs(0);
+
+CPcmMock::CPcmMock(unsigned int card, unsigned int device, unsigned int flags,
+                   const struct pcm_config& config)
+    : mFlags(flags),
+      mConfig(config),
+      mFrameBytes(formatBytes(config.format) * config.channels),
+      mRunning(false),
+      mStarted(false),
+      mTransfers(0),
+      mApplFrames(0),
+      mHwBase(0),
+      mStartNs(0)
+{
+    ++sOpens;
+
+    if (sFaults.failOpen) {
+        mError = "injected open failure";
+    } else if ((config.rate == 0) || (config.channels == 0)
+               || (config.period_size == 0) || (config.period_count == 0)) {
+        mError = "invalid config";
+    } else if (formatBytes(config.format) == 0) {
+        mError = "unsupported format";
+    }
+
+    // As tinyalsa, a playback stream starts when the buffer is full unless
+    // a start threshold is given
+    mStartThreshold = config.start_threshold;
+    if ((mStartThreshold == 0) || (mStartThreshold > bufferFrames())) {
+        mStartThreshold = bufferFrames();
+    }
+
+    ALOGV("pcm_open(%u,%u) %s rate=%u channels=%u period=%ux%u%s%s",
+          card, device, isCapture() ? "in" : "out", config.rate,
+          config.channels, config.period_size, config.period_count,
+          isReady() ? "" : ": ", error());
+}
+
+unsigned int CPcmMock::formatBytes(enum pcm_format format)
+{
+    switch (format) {
+    case PCM_FORMAT_S8:
+        return 1;
+    case PCM_FORMAT_S16_LE:
+        return 2;
+    case PCM_FORMAT_S24_3LE:
+        return 3;
+    case PCM_FORMAT_S24_LE:
+    case PCM_FORMAT_S32_LE:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+CPcmMockStats CPcmMock::stats()
+{
+    CPcmMockStats s;
+
+    s.opens = sOpens;
+    s.transfers = sTransfers;
+    s.frames = sFrames;
+    s.xruns = sXruns;
+    s.blockedNs = sBlockedNs;
+    return s;
+}
+
+void CPcmMock::clearStats()
+{
+    sOpens = 0;
+    sTransfers = 0;
+    sFrames = 0;
+    sXruns = 0;
+    sBlockedNs = 0;
+}
+
+uint64_t CPcmMock::hwFrames(uint64_t nowNs) const
+{
+    if (!mRunning || (nowNs <= mStartNs)) {
+        return mHwBase;
+    }
+
+    return mHwBase + ((nowNs - mStartNs) * mConfig.rate) / 1000000000ULL;
+}
+
+// Time at which the device position reaches frame, rounded up
+uint64_t CPcmMock::timeOfFrame(uint64_t frame) const
+{
+    if (frame <= mHwBase) {
+        return mStartNs;
+    }
+
+    return mStartNs + (((frame - mHwBase) * 1000000000ULL) + mConfig.rate - 1)
+                      / mConfig.rate;
+}
+
+void CPcmMock::wait(uint64_t untilNs)
+{
+    const uint64_t now = CSimClock::nowNs();
+
+    if (untilNs > now) {
+        sBlockedNs += untilNs - now;
+        CSimClock::sleepUntilNs(untilNs);
+    }
+}
+
+void CPcmMock::chargeLatency()
+{
+    uint64_t ns = sFaults.transferLatencyNs;
+
+    if (!mStarted) {
+        ns += sFaults.startLatencyNs;
+        mStarted = true;
+    }
+
+    if (ns > 0) {
+        wait(CSimClock::nowNs() + ns);
+    }
+}
+
+void CPcmMock::startAt(uint64_t nowNs)
+{
+    mRunning = true;
+    mStartNs = nowNs;
+}
+
+/*
+ * Returns true if the device has run past the application pointer, or an
+ * xrun is due to be injected. The stream is stopped as the kernel would.
+ */
+bool CPcmMock::checkXrun(uint64_t nowNs)
+{
+    bool xrun = false;
+
+    if (mRunning) {
+        const uint64_t hw = hwFrames(nowNs);
+
+        if (isCapture()) {
+            xrun = (hw - mApplFrames) > bufferFrames();
+        } else {
+            xrun = hw > mApplFrames;
+        }
+    }
+
+    if ((sFaults.xrunInterval != 0) && ((mTransfers % sFaults.xrunInterval) == 0)) {
+        xrun = true;
+    }
+
+    if (xrun) {
+        ++sXruns;
+        mRunning = false;
+        mHwBase = mApplFrames;
+        ALOGV("pcm %s xrun", isCapture() ? "overrun" : "underrun");
+    }
+
+    return xrun;
+}
+
+int CPcmMock::write(const void* data, unsigned int bytes)
+{
+    unsigned int frames = bytesToFrames(bytes);
+
+    if (!isReady() || isCapture()) {
+        return -EBADFD;
+    }
+
+    chargeLatency();
+    ++mTransfers;
+    ++sTransfers;
+
+    // Like tinyalsa, restart after an underrun unless PCM_NORESTART
+    if (checkXrun(CSimClock::nowNs()) && (mFlags & PCM_NORESTART)) {
+        return -EPIPE;
+    }
+
+    while (frames > 0) {
+        const uint64_t now = CSimClock::nowNs();
+        const uint64_t queued = mApplFrames - std::min(hwFrames(now), mApplFrames);
+        const uint64_t space = bufferFrames() - std::min<uint64_t>(queued, bufferFrames());
+
+        if (space == 0) {
+            // Wait for a period, or what is left to write, to be consumed
+            const uint64_t need = std::min<uint64_t>(frames, mConfig.period_size);
+            wait(timeOfFrame(mApplFrames - bufferFrames() + need));
+            continue;
+        }
+
+        const unsigned int n = std::min<uint64_t>(space, frames);
+        mApplFrames += n;
+        frames -= n;
+        sFrames += n;
+
+        if (!mRunning && ((mApplFrames - mHwBase) >= mStartThreshold)) {
+            startAt(now);
+        }
+    }
+
+    (void)data;
+    return 0;
+}
+
+int CPcmMock::read(void* data, unsigned int bytes)
+{
+    const unsigned int frames = bytesToFrames(bytes);
+
+    if (!isReady() || !isCapture()) {
+        return -EBADFD;
+    }
+
+    chargeLatency();
+    ++mTransfers;
+    ++sTransfers;
+
+    if (checkXrun(CSimClock::nowNs()) && (mFlags & PCM_NORESTART)) {
+        return -EPIPE;
+    }
+
+    if (!mRunning) {
+        startAt(CSimClock::nowNs());
+    }
+
+    wait(timeOfFrame(mApplFrames + frames));
+
+    // Produce a sawtooth so that lost or repeated data can be seen
+    if (mConfig.format == PCM_FORMAT_S16_LE) {
+        int16_t* p = static_cast<int16_t*>(data);
+        for (unsigned int f = 0; f < frames; ++f) {
+            const int16_t v = static_cast<int16_t>((mApplFrames + f) << 6);
+            for (unsigned int c = 0; c < mConfig.channels; ++c) {
+                *p++ = v;
+            }
+        }
+    } else {
+        memset(data, 0, framesToBytes(frames));
+    }
+
+    mApplFrames += frames;
+    sFrames += frames;
+    return 0;
+}
+
+int CPcmMock::getHtimestamp(unsigned int* avail, struct timespec* tstamp)
+{
+    if (!isReady() || !mRunning) {
+        return -1;
+    }
+
+    const uint64_t now = CSimClock::nowNs();
+    const uint64_t hw = hwFrames(now);
+
+    if (isCapture()) {
+        *avail = (hw > mApplFrames) ? (hw - mApplFrames) : 0;
+    } else {
+        const uint64_t queued = (mApplFrames > hw) ? (mApplFrames - hw) : 0;
+        *avail = bufferFrames() - std::min<uint64_t>(queued, bufferFrames());
+    }
+
+    tstamp->tv_sec = now / 1000000000ULL;
+    tstamp->tv_nsec = now % 1000000000ULL;
+    return 0;
+}
+
+int CPcmMock::prepare()
+{
+    if (!isReady()) {
+        return -EBADFD;
+    }
+
+    mRunning = false;
+    mHwBase = mApplFrames;
+    return 0;
+}
+
+int CPcmMock::start()
+{
+    if (!isReady()) {
+        return -EBADFD;
+    }
+
+    if (!mRunning) {
+        startAt(CSimClock::nowNs());
+    }
+    return 0;
+}
+
+int CPcmMock::stop()
+{
+    return prepare();
+}
+
+} // namespace cirrus
+
+using cirrus::CPcmMock;
+
+static CPcmMock* toMock(struct pcm* pcm)
+{
+    return reinterpret_cast<CPcmMock*>(pcm);
+}
+
+extern "C" {
+struct pcm *pcm_open(unsigned int card, unsigned int device,
+                     unsigned int flags, struct pcm_config *config)
+{
+    // tinyalsa never returns NULL, errors are reported by pcm_is_ready()
+    return reinterpret_cast<struct pcm*>(new CPcmMock(card, device, flags,
+                                                      *config));
+}
+
+int pcm_close(struct pcm *pcm)
+{
+    delete toMock(pcm);
+    return 0;
+}
+
+int pcm_is_ready(struct pcm *pcm)
+{
+    return (pcm != nullptr) && toMock(pcm)->isReady();
+}
+
+const char *pcm_get_error(struct pcm *pcm)
+{
+    return toMock(pcm)->error();
+}
+
+unsigned int pcm_get_buffer_size(struct pcm *pcm)
+{
+    return toMock(pcm)->bufferFrames();
+}
+
+unsigned int pcm_format_to_bits(enum pcm_format format)
+{
+    return CPcmMock::formatBytes(format) * 8;
+}
+
+unsigned int pcm_frames_to_bytes(struct pcm *pcm, unsigned int frames)
+{
+    return toMock(pcm)->framesToBytes(frames);
+}
+
+unsigned int pcm_bytes_to_frames(struct pcm *pcm, unsigned int bytes)
+{
+    return toMock(pcm)->bytesToFrames(bytes);
+}
+
+int pcm_get_htimestamp(struct pcm *pcm, unsigned int *avail,
+                       struct timespec *tstamp)
+{
+    return toMock(pcm)->getHtimestamp(avail, tstamp);
+}
+
+int pcm_write(struct pcm *pcm, const void *data, unsigned int count)
+{
+    return toMock(pcm)->write(data, count);
+}
+
+int pcm_read(struct pcm *pcm, void *data, unsigned int count)
+{
+    return toMock(pcm)->read(data, count);
+}
+
+int pcm_prepare(struct pcm *pcm)
+{
+    return toMock(pcm)->prepare();
+}
+
+int pcm_start(struct pcm *pcm)
+{
+    return toMock(pcm)->start();
+}
+
+int pcm_stop(struct pcm *pcm)
+{
+    return toMock(pcm)->stop();
+}
+} // extern "C"
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CPCMMOCK_H
+#define CPCMMOCK_H
+
+/*
+ * Mock of the tinyalsa PCM API. Each PCM consumes or produces frames at its
+ * configured rate on a simulated clock so that audio_hw.c can run its
+ * stream paths on the host.
+ */
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <tinyalsa/asoundlib.h>
+
+namespace cirrus {
+
+/*
+ * Time base of the mock PCM and compress devices. In realtime mode a
+ * transfer that must wait for the device sleeps. In virtual mode the
+ * simulated time is moved forward instead, so a stream runs as fast as the
+ * CPU allows and the measured time is only the cost of the code under
+ * test. Virtual time is shared by all devices so is only meaningful when
+ * the streams are driven from one thread.
+ */
+class CSimClock
+{
+public:
+    enum EMode {
+        eRealtime,
+        eVirtual
+    };
+
+public:
+    static void setMode(EMode mode);
+    static EMode mode() { return sMode; }
+
+    static uint64_t nowNs();
+    static void sleepUntilNs(uint64_t ns);
+
+private:
+    static EMode                    sMode;
+    static std::atomic<uint64_t>    sVirtualNs;
+};
+
+// Faults injected into every PCM
+struct CPcmMockFaults
+{
+    unsigned int    xrunInterval = 0;       // force an xrun every n transfers
+    uint32_t        transferLatencyNs = 0;  // extra time taken by a transfer
+    uint32_t        startLatencyNs = 0;     // extra time for first transfer
+    bool            failOpen = false;       // pcm_open() returns a bad PCM
+};
+
+// Totals for all PCMs since the last clearStats()
+struct CPcmMockStats
+{
+    uint64_t    opens = 0;
+    uint64_t    transfers = 0;
+    uint64_t    frames = 0;
+    uint64_t    xruns = 0;
+    uint64_t    blockedNs = 0;  // simulated time spent waiting for the device
+};
+
+class CPcmMock
+{
+public:
+    CPcmMock(unsigned int card, unsigned int device, unsigned int flags,
+             const struct pcm_config& config);
+
+    bool isReady() const { return mError.empty(); }
+    const char* error() const { return mError.c_str(); }
+    const struct pcm_config& config() const { return mConfig; }
+
+    unsigned int bufferFrames() const
+        { return mConfig.period_size * mConfig.period_count; }
+    unsigned int framesToBytes(unsigned int frames) const
+        { return frames * mFrameBytes; }
+    unsigned int bytesToFrames(unsigned int bytes) const
+        { return bytes / mFrameBytes; }
+
+    int write(const void* data, unsigned int bytes);
+    int read(void* data, unsigned int bytes);
+    int getHtimestamp(unsigned int* avail, struct timespec* tstamp);
+    int prepare();
+    int start();
+    int stop();
+
+    static void setFaults(const CPcmMockFaults& faults) { sFaults = faults; }
+    static const CPcmMockFaults& faults() { return sFaults; }
+    static CPcmMockStats stats();
+    static void clearStats();
+
+    static unsigned int formatBytes(enum pcm_format format);
+
+private:
+    bool isCapture() const { return (mFlags & PCM_IN) != 0; }
+    uint64_t hwFrames(uint64_t nowNs) const;
+    uint64_t timeOfFrame(uint64_t frame) const;
+    void chargeLatency();
+    bool checkXrun(uint64_t nowNs);
+    void startAt(uint64_t nowNs);
+    void wait(uint64_t untilNs);
+
+private:
+    const unsigned int  mFlags;
+    struct pcm_config   mConfig;
+    unsigned int        mFrameBytes;
+    unsigned int        mStartThreshold;
+    std::string         mError;
+
+    bool                mRunning;
+    bool                mStarted;       // a transfer has been made
+    uint64_t            mTransfers;
+    uint64_t            mApplFrames;    // frames written or read
+    uint64_t            mHwBase;        // device position at mStartNs
+    uint64_t            mStartNs;
+
+    static CPcmMockFaults           sFaults;
+    static std::atomic<uint64_t>    sOpens;
+    static std::atomic<uint64_t>    sTransfers;
+    static std::atomic<uint64_t>    sFrames;
+    static std::atomic<uint64_t>    sXruns;
+    static std::atomic<uint64_t>    sBlockedNs;
+};
+
+} // namespace cirrus
+
+#endif // CPCMMOCK_H
@@ -37,10 +37,19 @@
 #endif
 
 namespace cirrus {
+struct CAllocInfo {
+    int     line;
+    size_t  size;
+};
+
 static std::mutex gAllocSetMutex;
-static std::map<void*, int> gAllocMap;
+static std::map<void*, CAllocInfo> gAllocMap;
 static bool gSawAlloc;
 
+static size_t gLiveBytes;
+static EAllocPhase gAllocPhase = eAllocPhaseSteady;
+static CAllocStats gAllocStats[eAllocPhaseCount];
+
 std::string gRedirectedProcPath;
 
 void harnessSetRedirectedProcPath(const std::string& name)
@@ -77,7 +86,7 @@ class AllocHooksNotCalledException : public std::exception
 void print_leaked_allocs_l()
 {
     for (auto it : gAllocMap) {
-        ALOGW("Leaked alloc @%p from line %u", it.first, it.second);
+        ALOGW("Leaked alloc @%p from line %u", it.first, it.second.line);
     }
 }
 
@@ -103,6 +112,43 @@ bool harness_are_allocs_leaked()
     return false;
 }
 
+size_t harness_get_live_bytes()
+{
+    std::lock_guard<std::mutex> _l(gAllocSetMutex);
+    return gLiveBytes;
+}
+
+void harness_reset_alloc_stats()
+{
+    std::lock_guard<std::mutex> _l(gAllocSetMutex);
+    for (auto& stats : gAllocStats) {
+        stats = CAllocStats();
+    }
+    gAllocStats[gAllocPhase].peakBytes = gLiveBytes;
+}
+
+CAllocStats harness_get_alloc_stats(EAllocPhase phase)
+{
+    std::lock_guard<std::mutex> _l(gAllocSetMutex);
+    return gAllocStats[phase];
+}
+
+static void count_alloc_l(int line, size_t size)
+{
+    auto& stats = gAllocStats[gAllocPhase];
+    auto& lineStats = stats.lines[line];
+
+    ++stats.allocs;
+    stats.allocBytes += size;
+    ++lineStats.count;
+    lineStats.bytes += size;
+
+    gLiveBytes += size;
+    if (gLiveBytes > stats.peakBytes) {
+        stats.peakBytes = gLiveBytes;
+    }
+}
+
 void remove_address_l(void* p)
 {
     if (p == nullptr) {
@@ -117,10 +163,13 @@ void remove_address_l(void* p)
         throw BadFreeException();
 #endif
     }
+
+    ++gAllocStats[gAllocPhase].frees;
+    gLiveBytes -= found->second.size;
     gAllocMap.erase(found);
 }
 
-void add_address_l(void* p, int line)
+void add_address_l(void* p, int line, size_t size)
 {
     gSawAlloc = true;
 
@@ -128,7 +177,7 @@ void add_address_l(void* p, int line)
         return;
     }
 
-    auto result = gAllocMap.insert(std::pair<void*, int>(p, line));
+    auto result = gAllocMap.insert(std::make_pair(p, CAllocInfo{line, size}));
     if (!result.second) {
 #ifdef ANDROID
         *((int*)0) = 0xBADABADA;
@@ -136,13 +185,49 @@ void add_address_l(void* p, int line)
         throw DoubleAllocException();
 #endif
     }
+
+    count_alloc_l(line, size);
+}
+
+// A realloc that moved the block is counted as a free and a new allocation,
+// one that resized in place only changes the live size
+static void resize_address_l(void* p, int line, size_t size)
+{
+    auto found = gAllocMap.find(p);
+    if (found == gAllocMap.end()) {
+#ifdef ANDROID
+        *((int*)0) = 0xBADABADA;
+#else
+        throw BadFreeException();
+#endif
+    }
+
+    auto& stats = gAllocStats[gAllocPhase];
+    ++stats.reallocs;
+    ++stats.lines[line].count;
+
+    gLiveBytes = gLiveBytes - found->second.size + size;
+    if (gLiveBytes > stats.peakBytes) {
+        stats.peakBytes = gLiveBytes;
+    }
+    found->second.size = size;
 }
 
 extern "C" {
+void harness_set_alloc_phase(int phase)
+{
+    std::lock_guard<std::mutex> _l(gAllocSetMutex);
+    gAllocPhase = static_cast<EAllocPhase>(phase);
+    if (gLiveBytes > gAllocStats[gAllocPhase].peakBytes) {
+        gAllocStats[gAllocPhase].peakBytes = gLiveBytes;
+    }
+}
+
 void* harness_malloc(size_t n, int line)
 {
+    std::lock_guard<std::mutex> _l(gAllocSetMutex);
     void* p = malloc(n);
-    add_address_l(p, line);
+    add_address_l(p, line, n);
 
     return p;
 }
@@ -151,7 +236,7 @@ void* harness_calloc(size_t n, size_t m, int line)
 {
     std::lock_guard<std::mutex> _l(gAllocSetMutex);
     void* p = calloc(n, m);
-    add_address_l(p, line);
+    add_address_l(p, line, n * m);
 
     return p;
 }
@@ -163,7 +248,9 @@ void* harness_realloc(void* oldp, size_t n, int line)
     if ((p != nullptr) && (p != oldp)) {
         // Allocated address was changed or this is a new alloc (oldp was NULL)
         remove_address_l(oldp);
-        add_address_l(p, line);
+        add_address_l(p, line, n);
+    } else if (p != nullptr) {
+        resize_address_l(p, line, n);
     }
 
     return p;
@@ -173,7 +260,7 @@ char* harness_strdup(const char* olds, int line)
 {
     std::lock_guard<std::mutex> _l(gAllocSetMutex);
     char* s = strdup(olds);
-    add_address_l(s, line);
+    add_address_l(s, line, strlen(olds) + 1);
 
     return s;
 }
@@ -183,7 +270,7 @@ int harness_asprintf(char** dest, const char* fmt, int c, const char* s1, const
     std::lock_guard<std::mutex> _l(gAllocSetMutex);
     int ret = asprintf(dest, fmt, c, s1, s2);
     if (ret >= 0) {
-        add_address_l(*dest, line);
+        add_address_l(*dest, line, ret + 1);
     }
 
     return ret;
@@ -210,7 +297,7 @@ FILE* harness_fopen(const char* name, const char* attr, int line)
     int err = errno;
 
     std::lock_guard<std::mutex> _l(gAllocSetMutex);
-    add_address_l(fp, line);
+    add_address_l(fp, line, 0);
 
     errno = err;
 
@@ -239,7 +326,7 @@ DIR* harness_opendir(const char* name, int line)
     int err = errno;
 
     std::lock_guard<std::mutex> _l(gAllocSetMutex);
-    add_address_l(dir, line);
+    add_address_l(dir, line, 0);
 
     errno = err;
 
@@ -16,10 +16,45 @@
  * limitations under the License.
  */
 
+#include <cstddef>
+#include <cstdint>
+#include <map>
 #include <string>
 
 namespace cirrus {
 
+// Phases of config manager activity that allocations are counted against.
+// The values must match THCM_ALLOC_PHASE_* in thcm_test_harness.h
+enum EAllocPhase {
+    eAllocPhaseParse = 0,   // init_audio_config() except applying <init>
+    eAllocPhaseInit = 1,    // applying <init>
+    eAllocPhaseSteady = 2,  // after init_audio_config() has returned
+    eAllocPhaseCount
+};
+
+struct CAllocLineStats {
+    uint32_t    count = 0;
+    size_t      bytes = 0;
+};
+
+struct CAllocStats {
+    uint64_t    allocs = 0;     // new allocations, including fopen/opendir
+    uint64_t    reallocs = 0;   // resizes of an existing allocation
+    uint64_t    frees = 0;
+    uint64_t    allocBytes = 0; // total bytes requested
+    size_t      peakBytes = 0;  // highest live bytes while in the phase
+    std::map<int, CAllocLineStats> lines;   // by source line number
+};
+
 bool harness_are_allocs_leaked();
 void harnessSetRedirectedProcPath(const std::string& name);
+
+// Bytes currently allocated through the hooks
+size_t harness_get_live_bytes();
+
+// Clear the statistics of all phases. The peak of the current phase
+// restarts from the current live bytes.
+void harness_reset_alloc_stats();
+
+CAllocStats harness_get_alloc_stats(EAllocPhase phase);
 } // namespace cirrus
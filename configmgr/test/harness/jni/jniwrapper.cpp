@@ -341,6 +341,123 @@ Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_getData(JNIEnv *env,
     return result;
 }
 
+JNIEXPORT void JNICALL
+Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_setIoctlCost(JNIEnv *env,
+                                                         jobject thiz,
+                                                         jint boolNs,
+                                                         jint intNs,
+                                                         jint enumNs,
+                                                         jint byteNs,
+                                                         jint perByteNs,
+                                                         jboolean spin)
+{
+    cirrus::CAlsaMock* mocker = getMockPointer(env, thiz);
+    if (mocker == nullptr) {
+        throwRuntimeException(env, "null mock pointer");
+        return;
+    }
+
+    cirrus::CMockIoctlCost cost;
+    cost.boolNs = boolNs;
+    cost.intNs = intNs;
+    cost.enumNs = enumNs;
+    cost.byteNs = byteNs;
+    cost.perByteNs = perByteNs;
+    cost.spin = spin;
+    mocker->setIoctlCost(cost);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_getReadCount(JNIEnv *env,
+                                                         jobject thiz,
+                                                         jstring name)
+{
+    const auto* c = findControl(env, thiz, name);
+    if (c == nullptr) {
+        return -EINVAL;
+    }
+
+    return c->readCount();
+}
+
+JNIEXPORT jint JNICALL
+Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_getWriteCount(JNIEnv *env,
+                                                          jobject thiz,
+                                                          jstring name)
+{
+    const auto* c = findControl(env, thiz, name);
+    if (c == nullptr) {
+        return -EINVAL;
+    }
+
+    return c->writeCount();
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_getLastWriteSeq(JNIEnv *env,
+                                                            jobject thiz,
+                                                            jstring name)
+{
+    const auto* c = findControl(env, thiz, name);
+    if (c == nullptr) {
+        return -EINVAL;
+    }
+
+    return c->lastWriteSeq();
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_getTotalReadCount(JNIEnv *env,
+                                                              jobject thiz)
+{
+    const cirrus::CAlsaMock* mocker = getMockPointer(env, thiz);
+    if (mocker == nullptr) {
+        throwRuntimeException(env, "null mock pointer");
+        return -EINVAL;
+    }
+
+    return mocker->totalReads();
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_getTotalWriteCount(JNIEnv *env,
+                                                               jobject thiz)
+{
+    const cirrus::CAlsaMock* mocker = getMockPointer(env, thiz);
+    if (mocker == nullptr) {
+        throwRuntimeException(env, "null mock pointer");
+        return -EINVAL;
+    }
+
+    return mocker->totalWrites();
+}
+
+JNIEXPORT jlong JNICALL
+Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_getSimulatedTimeNs(JNIEnv *env,
+                                                               jobject thiz)
+{
+    const cirrus::CAlsaMock* mocker = getMockPointer(env, thiz);
+    if (mocker == nullptr) {
+        throwRuntimeException(env, "null mock pointer");
+        return -EINVAL;
+    }
+
+    return mocker->simulatedNs();
+}
+
+JNIEXPORT void JNICALL
+Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_clearCounts(JNIEnv *env,
+                                                        jobject thiz)
+{
+    cirrus::CAlsaMock* mocker = getMockPointer(env, thiz);
+    if (mocker == nullptr) {
+        throwRuntimeException(env, "null mock pointer");
+        return;
+    }
+
+    mocker->clearCounts();
+}
+
 JNIEXPORT void JNICALL
 Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_native_1setup(JNIEnv *env __unused,
                                                            jobject thiz __unused)
@@ -621,6 +738,29 @@ Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_free_1audio_1config(JNIEnv *env,
     return 0;
 }
 
+JNIEXPORT jint JNICALL
+Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_reload_1audio_1config(JNIEnv *env,
+                                                                   jobject thiz,
+                                                                   jstring fileName)
+{
+    auto* ptr = getMgrPointer(env, thiz);
+    if (!ptr) {
+        return -EINVAL;
+    }
+
+    // null reloads the file passed to init_audio_config()
+    if (fileName == nullptr) {
+        return reload_audio_config(ptr, nullptr);
+    }
+
+    TStringUtfAutoReleased c_fileName(env, fileName);
+    if (!c_fileName.isOk()) {
+        return -EINVAL;
+    }
+
+    return reload_audio_config(ptr, c_fileName.c_str());
+}
+
 JNIEXPORT jlong JNICALL
 Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_get_1mixer(JNIEnv *env,
                                                         jobject thiz)
@@ -936,6 +1076,113 @@ Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_set_1hw_1volume(JNIEnv *env,
     return set_hw_volume(s, left_pc, right_pc);
 }
 
+JNIEXPORT jint JNICALL
+Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_config_1begin_1transaction(JNIEnv *env,
+                                                                        jobject thiz)
+{
+    auto* ptr = getMgrPointer(env, thiz);
+    if (!ptr) {
+        return -EINVAL;
+    }
+
+    return config_begin_transaction(ptr);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_config_1commit(JNIEnv *env,
+                                                            jobject thiz)
+{
+    auto* ptr = getMgrPointer(env, thiz);
+    if (!ptr) {
+        return -EINVAL;
+    }
+
+    return config_commit(ptr);
+}
+
+JNIEXPORT jboolean JNICALL
+Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_config_1batch_1parameters(JNIEnv *env,
+                                                                       jobject thiz)
+{
+    auto* ptr = getMgrPointer(env, thiz);
+    if (!ptr) {
+        return false;
+    }
+
+    return config_batch_parameters(ptr);
+}
+
+JNIEXPORT jint JNICALL
+Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_get_1boot_1preinit_1count(JNIEnv *env,
+                                                                      jobject thiz)
+{
+    auto* ptr = getMgrPointer(env, thiz);
+    if (!ptr) {
+        return -EINVAL;
+    }
+
+    struct config_mgr_boot_stats stats;
+    int ret = get_config_mgr_boot_stats(ptr, &stats);
+    if (ret != 0) {
+        return ret;
+    }
+
+    return stats.preinit_count;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_get_1boot_1phase_1stats(JNIEnv *env,
+                                                                    jobject thiz,
+                                                                    jint phase)
+{
+    auto* ptr = getMgrPointer(env, thiz);
+    if (!ptr) {
+        return nullptr;
+    }
+
+    struct config_mgr_boot_stats stats;
+    if (get_config_mgr_boot_stats(ptr, &stats) != 0) {
+        throwRuntimeException(env, "get_config_mgr_boot_stats failed");
+        return nullptr;
+    }
+
+    // Phase numbering must match the BOOT_PHASE_ constants in CConfigMgr.java
+    const struct config_phase_stats* p;
+    switch (phase) {
+    case 0: p = &stats.open; break;
+    case 1: p = &stats.parse; break;
+    case 2: p = &stats.resolve; break;
+    case 3: p = &stats.new_ctls; break;
+    case 4: p = &stats.init; break;
+    default:
+        if ((phase < 5) || (phase >= 5 + CONFIG_MGR_MAX_PREINIT_STATS)) {
+            throwRuntimeException(env, "Invalid boot phase");
+            return nullptr;
+        }
+        p = &stats.preinit[phase - 5];
+        break;
+    }
+
+    const jlong values[] = {
+        static_cast<jlong>(p->time_ns),
+        static_cast<jlong>(p->ctl_writes),
+        static_cast<jlong>(p->bytes_written),
+        static_cast<jlong>(stats.total_ns),
+        static_cast<jlong>(p->ctl_unchanged)
+    };
+    const jsize count = sizeof(values) / sizeof(values[0]);
+
+    jlongArray result = env->NewLongArray(count);
+    if (result == nullptr) {
+        throwOomException(env, "get_boot_phase_stats: failed to alloc array");
+        return nullptr;
+    }
+
+    env->SetLongArrayRegion(result, 0, count, values);
+
+    return result;
+}
+
 JNIEXPORT jboolean JNICALL
 Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_are_1allocs_1leaked(JNIEnv *env __unused,
                                                                  jclass clazz __unused)
@@ -943,6 +1190,89 @@ Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_are_1allocs_1leaked(JNIEnv *env __u
     return cirrus::harness_are_allocs_leaked();
 }
 
+JNIEXPORT void JNICALL
+Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_reset_1alloc_1stats(JNIEnv *env __unused,
+                                                                 jclass clazz __unused)
+{
+    cirrus::harness_reset_alloc_stats();
+}
+
+static bool getAllocPhase(JNIEnv *env, jint phase, cirrus::EAllocPhase* out)
+{
+    if ((phase < 0) || (phase >= cirrus::eAllocPhaseCount)) {
+        throwRuntimeException(env, "Invalid alloc phase");
+        return false;
+    }
+
+    *out = static_cast<cirrus::EAllocPhase>(phase);
+    return true;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_get_1alloc_1stats(JNIEnv *env,
+                                                               jclass clazz __unused,
+                                                               jint phase)
+{
+    cirrus::EAllocPhase p;
+    if (!getAllocPhase(env, phase, &p)) {
+        return nullptr;
+    }
+
+    const cirrus::CAllocStats stats = cirrus::harness_get_alloc_stats(p);
+
+    // Order must match the ALLOC_STAT_ constants in CConfigMgr.java
+    const jlong values[] = {
+        static_cast<jlong>(stats.allocs),
+        static_cast<jlong>(stats.reallocs),
+        static_cast<jlong>(stats.frees),
+        static_cast<jlong>(stats.allocBytes),
+        static_cast<jlong>(stats.peakBytes),
+        static_cast<jlong>(cirrus::harness_get_live_bytes())
+    };
+    const jsize count = sizeof(values) / sizeof(values[0]);
+
+    jlongArray result = env->NewLongArray(count);
+    if (result == nullptr) {
+        throwOomException(env, "get_alloc_stats: failed to alloc array");
+        return nullptr;
+    }
+
+    env->SetLongArrayRegion(result, 0, count, values);
+
+    return result;
+}
+
+JNIEXPORT jlongArray JNICALL
+Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_get_1alloc_1lines(JNIEnv *env,
+                                                               jclass clazz __unused,
+                                                               jint phase)
+{
+    cirrus::EAllocPhase p;
+    if (!getAllocPhase(env, phase, &p)) {
+        return nullptr;
+    }
+
+    const cirrus::CAllocStats stats = cirrus::harness_get_alloc_stats(p);
+
+    // Triplets of line number, count and bytes
+    std::vector<jlong> values;
+    for (const auto& it : stats.lines) {
+        values.push_back(it.first);
+        values.push_back(it.second.count);
+        values.push_back(it.second.bytes);
+    }
+
+    jlongArray result = env->NewLongArray(values.size());
+    if (result == nullptr) {
+        throwOomException(env, "get_alloc_lines: failed to alloc array");
+        return nullptr;
+    }
+
+    env->SetLongArrayRegion(result, 0, values.size(), values.data());
+
+    return result;
+}
+
 #ifdef ANDROID
 static const char kAlsaMockClassPathName[] = "com.cirrus.tinyhal.test.thcm.CAlsaMock";
 
@@ -991,6 +1321,38 @@ static const JNINativeMethod kAlsaMockMethods[] = {
       "(Ljava/lang/String;)[B",
       (void *)Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_getData
     },
+    { "setIoctlCost",
+      "(IIIIIZ)V",
+      (void *)Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_setIoctlCost
+    },
+    { "getReadCount",
+      "(Ljava/lang/String;)I",
+      (void *)Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_getReadCount
+    },
+    { "getWriteCount",
+      "(Ljava/lang/String;)I",
+      (void *)Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_getWriteCount
+    },
+    { "getLastWriteSeq",
+      "(Ljava/lang/String;)J",
+      (void *)Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_getLastWriteSeq
+    },
+    { "getTotalReadCount",
+      "()J",
+      (void *)Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_getTotalReadCount
+    },
+    { "getTotalWriteCount",
+      "()J",
+      (void *)Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_getTotalWriteCount
+    },
+    { "getSimulatedTimeNs",
+      "()J",
+      (void *)Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_getSimulatedTimeNs
+    },
+    { "clearCounts",
+      "()V",
+      (void *)Java_com_cirrus_tinyhal_test_thcm_CAlsaMock_clearCounts
+    },
 };
 
 static const char kConfigMgrClassPathName[] = "com.cirrus.tinyhal.test.thcm.CConfigMgr";
@@ -1060,6 +1422,10 @@ static const JNINativeMethod kConfigMgrMethods[] = {
       "()I",
       (void *)Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_free_1audio_1config
     },
+    { "reload_audio_config",
+      "(Ljava/lang/String;)I",
+      (void *)Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_reload_1audio_1config
+    },
     { "get_mixer",
       "()J",
       (void *)Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_get_1mixer
@@ -1116,10 +1482,42 @@ static const JNINativeMethod kConfigMgrMethods[] = {
       "(JII)I",
       (void *)Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_set_1hw_1volume
     },
+    { "config_begin_transaction",
+      "()I",
+      (void *)Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_config_1begin_1transaction
+    },
+    { "config_commit",
+      "()I",
+      (void *)Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_config_1commit
+    },
+    { "config_batch_parameters",
+      "()Z",
+      (void *)Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_config_1batch_1parameters
+    },
+    { "get_boot_preinit_count",
+      "()I",
+      (void *)Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_get_1boot_1preinit_1count
+    },
+    { "get_boot_phase_stats",
+      "(I)[J",
+      (void *)Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_get_1boot_1phase_1stats
+    },
     { "are_allocs_leaked",
       "()Z",
       (void *)Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_are_1allocs_1leaked
     },
+    { "reset_alloc_stats",
+      "()V",
+      (void *)Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_reset_1alloc_1stats
+    },
+    { "get_alloc_stats",
+      "(I)[J",
+      (void *)Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_get_1alloc_1stats
+    },
+    { "get_alloc_lines",
+      "(I)[J",
+      (void *)Java_com_cirrus_tinyhal_test_thcm_CConfigMgr_get_1alloc_1lines
+    },
 };
 
 jint JNI_OnLoad(JavaVM* vm, void* reserved __unused)
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.cirrus.tinyhal.test.thcm;
+
+import java.io.File;
+import java.io.FileWriter;
+import java.io.IOException;
+import org.junit.After;
+import org.junit.AfterClass;
+import org.junit.Before;
+import org.junit.BeforeClass;
+import org.junit.Test;
+import static org.junit.Assert.*;
+
+import com.cirrus.tinyhal.test.thcm.CAlsaMock;
+import com.cirrus.tinyhal.test.thcm.CConfigMgr;
+import com.cirrus.tinyhal.test.thcm.ThcmPlatform;
+
+/**
+ * Tests the per-phase allocation statistics of the test harness and checks
+ * that the configmgr does not allocate memory once it has been initialized.
+ */
+public class ThcmAllocStatsTest
+{
+    private static final File sWorkFilesPath = ThcmPlatform.workFilesPath();
+    private static final File sControlsFile =
+        new File(sWorkFilesPath, "thcm_alloc_stats_controls.csv");
+    private static final File sXmlFile =
+        new File(sWorkFilesPath, "thcm_alloc_stats.xml");
+
+    private CAlsaMock mAlsaMock;
+    private CConfigMgr mConfigMgr;
+
+    @BeforeClass
+    public static void setUpClass() throws IOException
+    {
+        FileWriter writer = new FileWriter(sControlsFile);
+        writer.write("init1,int,1,0,0:100\n");
+        writer.write("spk,bool,1,0,0:1\n");
+        writer.write("ep,bool,1,0,0:1\n");
+        writer.write("vol,int,1,0,0:100\n");
+        writer.write("mux,enum,1,A,A:B\n");
+        writer.write("coeffs,byte,16,0,\n");
+        writer.close();
+
+        writer = new FileWriter(sXmlFile);
+        writer.write("<audiohal>\n<mixer card=\"0\">\n");
+        writer.write("<init><ctl name=\"init1\" val=\"5\"/></init>\n");
+        writer.write("</mixer>\n");
+        writer.write("<device name=\"speaker\">\n");
+        writer.write("<path name=\"on\"><ctl name=\"spk\" val=\"1\"/></path>\n");
+        writer.write("<path name=\"off\"><ctl name=\"spk\" val=\"0\"/></path>\n");
+        writer.write("</device>\n");
+        writer.write("<device name=\"earpiece\">\n");
+        writer.write("<path name=\"on\"><ctl name=\"ep\" val=\"1\"/></path>\n");
+        writer.write("<path name=\"off\"><ctl name=\"ep\" val=\"0\"/></path>\n");
+        writer.write("</device>\n");
+        writer.write("<stream type=\"pcm\" dir=\"out\">\n");
+        writer.write("<ctl function=\"leftvol\" name=\"vol\"/>\n");
+        writer.write("<usecase name=\"mode\">\n");
+        writer.write("<case name=\"a\"><ctl name=\"mux\" val=\"A\"/>");
+        writer.write("<ctl name=\"coeffs\" val=\"1,2,3,4\"/></case>\n");
+        writer.write("<case name=\"b\"><ctl name=\"mux\" val=\"B\"/>");
+        writer.write("<ctl name=\"coeffs\" val=\"5,6,7,8\"/></case>\n");
+        writer.write("</usecase>\n");
+        writer.write("</stream>\n");
+        writer.write("</audiohal>\n");
+        writer.close();
+    }
+
+    @AfterClass
+    public static void tearDownClass()
+    {
+        sControlsFile.delete();
+        sXmlFile.delete();
+    }
+
+    @Before
+    public void setUp()
+    {
+        mAlsaMock = new CAlsaMock();
+        assertEquals("Failed to create CAlsaMock",
+                     0,
+                     mAlsaMock.createMixer(sControlsFile.toPath().toString()));
+
+        CConfigMgr.reset_alloc_stats();
+
+        mConfigMgr = new CConfigMgr();
+        assertEquals("Failed to open CConfigMgr",
+                     0,
+                     mConfigMgr.init_audio_config(sXmlFile.toPath().toString()));
+    }
+
+    @After
+    public void tearDown()
+    {
+        if (mConfigMgr != null) {
+            mConfigMgr.free_audio_config();
+            mConfigMgr = null;
+            assertFalse("Configmgr leaked memory", CConfigMgr.are_allocs_leaked());
+        }
+
+        if (mAlsaMock != null) {
+            mAlsaMock.closeMixer();
+            mAlsaMock = null;
+        }
+    }
+
+    private long openPcmStream(long device)
+    {
+        CConfigMgr.AudioConfig config = new CConfigMgr.AudioConfig();
+        config.sample_rate = 48000;
+        config.channel_mask = CConfigMgr.AUDIO_CHANNEL_OUT_FRONT_LEFT;
+        config.format = CConfigMgr.AUDIO_FORMAT_PCM;
+
+        return mConfigMgr.get_stream(device, 0, config);
+    }
+
+    /**
+     * Parsing allocates, and what is left allocated after init_audio_config()
+     * cannot exceed the peak.
+     */
+    @Test
+    public void testParse()
+    {
+        long[] stats = CConfigMgr.get_alloc_stats(CConfigMgr.ALLOC_PHASE_PARSE);
+
+        assertTrue("No allocations during parse",
+                   stats[CConfigMgr.ALLOC_STAT_ALLOCS] > 0);
+        assertTrue("No bytes allocated during parse",
+                   stats[CConfigMgr.ALLOC_STAT_ALLOC_BYTES] > 0);
+        assertTrue("Live bytes exceed peak",
+                   stats[CConfigMgr.ALLOC_STAT_LIVE_BYTES] <=
+                   stats[CConfigMgr.ALLOC_STAT_PEAK_BYTES]);
+    }
+
+    /**
+     * Every allocation is attributed to a source line.
+     */
+    @Test
+    public void testLines()
+    {
+        long[] stats = CConfigMgr.get_alloc_stats(CConfigMgr.ALLOC_PHASE_PARSE);
+        long[] lines = CConfigMgr.get_alloc_lines(CConfigMgr.ALLOC_PHASE_PARSE);
+
+        assertEquals("Lines array not triplets", 0, lines.length % 3);
+
+        long count = 0;
+        long bytes = 0;
+        for (int i = 0; i < lines.length; i += 3) {
+            assertTrue("Invalid line number " + lines[i], lines[i] > 0);
+            count += lines[i + 1];
+            bytes += lines[i + 2];
+        }
+
+        assertEquals("Line counts don't match allocs and reallocs",
+                     stats[CConfigMgr.ALLOC_STAT_ALLOCS] +
+                     stats[CConfigMgr.ALLOC_STAT_REALLOCS],
+                     count);
+        assertEquals("Line bytes don't match",
+                     stats[CConfigMgr.ALLOC_STAT_ALLOC_BYTES],
+                     bytes);
+    }
+
+    /**
+     * Applying &lt;init&gt; doesn't allocate.
+     */
+    @Test
+    public void testInitApply()
+    {
+        long[] stats = CConfigMgr.get_alloc_stats(CConfigMgr.ALLOC_PHASE_INIT);
+
+        assertEquals("Allocations while applying init",
+                     0,
+                     stats[CConfigMgr.ALLOC_STAT_ALLOCS] +
+                     stats[CConfigMgr.ALLOC_STAT_REALLOCS]);
+    }
+
+    /**
+     * Opening streams, routing, volume and use-cases don't allocate.
+     */
+    @Test
+    public void testSteadyState()
+    {
+        CConfigMgr.reset_alloc_stats();
+
+        for (int i = 0; i < 10; ++i) {
+            long stream = openPcmStream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+            assertTrue("Failed to get stream", stream > 0);
+
+            mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_EARPIECE);
+            mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER |
+                                           CConfigMgr.AUDIO_DEVICE_OUT_EARPIECE);
+            assertEquals("set_hw_volume failed",
+                         0,
+                         mConfigMgr.set_hw_volume(stream, i * 10, i * 10));
+            assertEquals("apply_use_case failed",
+                         0,
+                         mConfigMgr.apply_use_case(stream, "mode",
+                                                   ((i & 1) == 0) ? "a" : "b"));
+            mConfigMgr.release_stream(stream);
+        }
+
+        long[] stats = CConfigMgr.get_alloc_stats(CConfigMgr.ALLOC_PHASE_STEADY);
+        assertEquals("Allocations in steady state",
+                     0,
+                     stats[CConfigMgr.ALLOC_STAT_ALLOCS] +
+                     stats[CConfigMgr.ALLOC_STAT_REALLOCS]);
+        assertEquals("Frees in steady state",
+                     0,
+                     stats[CConfigMgr.ALLOC_STAT_FREES]);
+    }
+};
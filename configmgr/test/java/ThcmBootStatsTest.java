@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.cirrus.tinyhal.test.thcm;
+
+import java.io.File;
+import java.io.FileWriter;
+import java.io.IOException;
+import org.junit.After;
+import org.junit.AfterClass;
+import org.junit.Before;
+import org.junit.BeforeClass;
+import org.junit.Test;
+import static org.junit.Assert.*;
+
+import com.cirrus.tinyhal.test.thcm.CAlsaMock;
+import com.cirrus.tinyhal.test.thcm.CConfigMgr;
+import com.cirrus.tinyhal.test.thcm.ThcmPlatform;
+
+/**
+ * Tests the boot phase timing and write counts recorded by
+ * <code>init_audio_config()</code>.
+ */
+public class ThcmBootStatsTest
+{
+    private static final File sWorkFilesPath = ThcmPlatform.workFilesPath();
+    private static final File sControlsFile =
+        new File(sWorkFilesPath, "thcm_boot_stats_controls.csv");
+    private static final File sXmlFile =
+        new File(sWorkFilesPath, "thcm_boot_stats.xml");
+
+    private static final int INT_CONTROL_VALUES = 4;
+    private static final int BYTE_CONTROL_BYTES = 8;
+
+    private CAlsaMock mAlsaMock;
+    private CConfigMgr mConfigMgr;
+
+    @BeforeClass
+    public static void setUpClass() throws IOException
+    {
+        FileWriter writer = new FileWriter(sControlsFile);
+        writer.write("bool1,bool,1,0,0:1\n");
+        writer.write("bool2,bool,1,0,0:1\n");
+        writer.write("int4,int," + INT_CONTROL_VALUES + ",0,0:100\n");
+        writer.write("bytes,byte," + BYTE_CONTROL_BYTES + ",0,0:255\n");
+        writer.close();
+
+        writer = new FileWriter(sXmlFile);
+        writer.write("<audiohal>\n<mixer card=\"0\">\n");
+        writer.write("<pre_init><ctl name=\"bool1\" val=\"1\"/></pre_init>\n");
+        writer.write("<pre_init><ctl name=\"bool2\" val=\"1\"/></pre_init>\n");
+        writer.write("<init>\n");
+        writer.write("<ctl name=\"int4\" val=\"5\"/>\n");
+        writer.write("<ctl name=\"bytes\" val=\"1,2,3,4,5,6,7,8\"/>\n");
+        writer.write("</init>\n</mixer>\n</audiohal>\n");
+        writer.close();
+    }
+
+    @AfterClass
+    public static void tearDownClass()
+    {
+        sControlsFile.delete();
+        sXmlFile.delete();
+    }
+
+    @Before
+    public void setUp()
+    {
+        mAlsaMock = new CAlsaMock();
+        assertEquals("Failed to create CAlsaMock",
+                     0,
+                     mAlsaMock.createMixer(sControlsFile.toPath().toString()));
+
+        mConfigMgr = new CConfigMgr();
+        assertEquals("Failed to open CConfigMgr",
+                     0,
+                     mConfigMgr.init_audio_config(sXmlFile.toPath().toString()));
+    }
+
+    @After
+    public void tearDown()
+    {
+        if (mConfigMgr != null) {
+            mConfigMgr.free_audio_config();
+            mConfigMgr = null;
+            assertFalse("Configmgr leaked memory", CConfigMgr.are_allocs_leaked());
+        }
+
+        if (mAlsaMock != null) {
+            mAlsaMock.closeMixer();
+            mAlsaMock = null;
+        }
+    }
+
+    /**
+     * Each &lt;pre_init&gt; block is counted separately.
+     */
+    @Test
+    public void testPreinitCount()
+    {
+        assertEquals("Wrong pre_init count", 2, mConfigMgr.get_boot_preinit_count());
+
+        for (int i = 0; i < 2; ++i) {
+            long[] stats = mConfigMgr.get_boot_phase_stats(
+                                CConfigMgr.BOOT_PHASE_PREINIT_BASE + i);
+            assertEquals("Wrong pre_init[" + i + "] write count",
+                         1,
+                         stats[CConfigMgr.BOOT_STAT_CTL_WRITES]);
+        }
+    }
+
+    /**
+     * Writes and bytes written by &lt;init&gt; are counted in the init phase.
+     */
+    @Test
+    public void testInitWrites()
+    {
+        long[] stats = mConfigMgr.get_boot_phase_stats(CConfigMgr.BOOT_PHASE_INIT);
+
+        // An int control without an index writes every value individually
+        assertEquals("Wrong init write count",
+                     INT_CONTROL_VALUES + 1,
+                     stats[CConfigMgr.BOOT_STAT_CTL_WRITES]);
+        assertEquals("Wrong init bytes written",
+                     (INT_CONTROL_VALUES * 4) + BYTE_CONTROL_BYTES,
+                     stats[CConfigMgr.BOOT_STAT_BYTES_WRITTEN]);
+    }
+
+    /**
+     * Phases that do not apply controls must not count any writes.
+     */
+    @Test
+    public void testNoWritesOutsideApply()
+    {
+        final int[] phases = {
+            CConfigMgr.BOOT_PHASE_OPEN,
+            CConfigMgr.BOOT_PHASE_PARSE,
+            CConfigMgr.BOOT_PHASE_RESOLVE,
+            CConfigMgr.BOOT_PHASE_NEW_CTLS
+        };
+
+        for (int phase : phases) {
+            long[] stats = mConfigMgr.get_boot_phase_stats(phase);
+            assertEquals("Writes counted in phase " + phase,
+                         0,
+                         stats[CConfigMgr.BOOT_STAT_CTL_WRITES]);
+        }
+    }
+
+    /**
+     * Phases do not overlap so their total cannot exceed the total time.
+     */
+    @Test
+    public void testPhaseTimesWithinTotal()
+    {
+        long sum = 0;
+        long total = 0;
+
+        for (int phase = CConfigMgr.BOOT_PHASE_OPEN;
+             phase < CConfigMgr.BOOT_PHASE_PREINIT_BASE + 2;
+             ++phase) {
+            long[] stats = mConfigMgr.get_boot_phase_stats(phase);
+            sum += stats[CConfigMgr.BOOT_STAT_TIME_NS];
+            total = stats[CConfigMgr.BOOT_STAT_TOTAL_NS];
+        }
+
+        assertTrue("No time recorded", sum > 0);
+        assertTrue("Phase times " + sum + " exceed total " + total, sum <= total);
+    }
+};
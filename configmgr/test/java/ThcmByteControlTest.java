@@ -28,6 +28,7 @@ import java.nio.file.Files;
 import java.nio.file.Path;
 import java.nio.file.StandardOpenOption;
 import java.util.ArrayList;
+import java.util.Base64;
 import java.util.Collection;
 import java.util.HashMap;
 import java.util.List;
@@ -60,8 +61,15 @@ public class ThcmByteControlTest
     };
 
     private static String PREFIX_DIRECT = "bytes_";
+    private static String PREFIX_HEX = "hexbytes_";
+    private static String PREFIX_BASE64 = "base64bytes_";
     private static String PREFIX_FILE = "filebytes_";
 
+    // Prefixes of the paths with data in the xml, and the val form of each
+    private static final String[] DIRECT_PREFIXES = {
+        PREFIX_DIRECT, PREFIX_HEX, PREFIX_BASE64
+    };
+
     private static final File sWorkFilesPath = ThcmPlatform.workFilesPath();
     private static final File sControlsFile = new File(sWorkFilesPath, "thcm_byte_controls.csv");
     private static final File sXmlFile = new File(sWorkFilesPath, "thcm_byte_controls.xml");
@@ -213,10 +221,13 @@ public class ThcmByteControlTest
             for (int writeSize : SIZES) {
                 // xml load will fail for in-xml data >control length
                 if (writeSize <= ctlSize) {
-                    writePathDataEntry(writer,
-                                       i,
-                                       streamNameForSize(PREFIX_DIRECT, ctlSize, writeSize),
-                                       sDirectDataMap.get(writeSize));
+                    for (String prefix : DIRECT_PREFIXES) {
+                        writePathDataEntry(writer,
+                                           i,
+                                           prefix,
+                                           streamNameForSize(prefix, ctlSize, writeSize),
+                                           sDirectDataMap.get(writeSize));
+                    }
                 }
 
                 // but files >control length are handled
@@ -235,7 +246,9 @@ public class ThcmByteControlTest
         for (int ctlSize : SIZES) {
             for (int writeSize : SIZES) {
                 if (writeSize <= ctlSize) {
-                    writeStreamEntry(writer, streamNameForSize(PREFIX_DIRECT, ctlSize, writeSize));
+                    for (String prefix : DIRECT_PREFIXES) {
+                        writeStreamEntry(writer, streamNameForSize(prefix, ctlSize, writeSize));
+                    }
                 }
 
                 writeStreamEntry(writer, streamNameForSize(PREFIX_FILE, ctlSize, writeSize));
@@ -252,20 +265,30 @@ public class ThcmByteControlTest
 
     private static void writePathDataEntry(FileWriter writer,
                                            int controlNum,
+                                           String prefix,
                                            String pathName,
                                            byte[] data) throws IOException
     {
             writer.write("<path name=\"" + pathName + "\">\n");
             writer.write("<ctl name=\"Coeff " + controlNum + "\" val=\"");
 
-            boolean comma = false;
-            for (byte b : data) {
-                int value = b & 0xff;
-                if (comma) {
-                    writer.write(",0x" + Integer.toHexString(value));
-                } else {
-                    writer.write("0x" + Integer.toHexString(value));
-                    comma = true;
+            if (prefix.equals(PREFIX_HEX)) {
+                writer.write("hex:");
+                for (byte b : data) {
+                    writer.write(String.format("%02x", b & 0xff));
+                }
+            } else if (prefix.equals(PREFIX_BASE64)) {
+                writer.write("base64:" + Base64.getEncoder().encodeToString(data));
+            } else {
+                boolean comma = false;
+                for (byte b : data) {
+                    int value = b & 0xff;
+                    if (comma) {
+                        writer.write(",0x" + Integer.toHexString(value));
+                    } else {
+                        writer.write("0x" + Integer.toHexString(value));
+                        comma = true;
+                    }
                 }
             }
             writer.write("\" />\n</path>\n");
@@ -304,6 +327,29 @@ public class ThcmByteControlTest
      */
     @Test
     public void testWriteDataInXml()
+    {
+        checkWriteDataInXml(PREFIX_DIRECT);
+    }
+
+    /**
+     * Write a control from data defined in the xml as val="hex:...".
+     */
+    @Test
+    public void testWriteHexInXml()
+    {
+        checkWriteDataInXml(PREFIX_HEX);
+    }
+
+    /**
+     * Write a control from data defined in the xml as val="base64:...".
+     */
+    @Test
+    public void testWriteBase64InXml()
+    {
+        checkWriteDataInXml(PREFIX_BASE64);
+    }
+
+    private void checkWriteDataInXml(String prefix)
     {
         byte[] expected = new byte[mTestSize];
 
@@ -313,7 +359,7 @@ public class ThcmByteControlTest
 
         for (int writeSize : SIZES) {
             if (writeSize <= mTestSize) {
-                String streamName = streamNameForSize(PREFIX_DIRECT, mTestSize, writeSize);
+                String streamName = streamNameForSize(prefix, mTestSize, writeSize);
                 long stream = mConfigMgr.get_named_stream(streamName);
                 assertFalse("Failed to get " + streamName + " stream", stream < 0);
 
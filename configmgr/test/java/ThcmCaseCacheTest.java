@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+package com.cirrus.tinyhal.test.thcm;
+
+import java.io.File;
+import java.io.FileOutputStream;
+import java.io.FileWriter;
+import java.io.IOException;
+import org.junit.After;
+import org.junit.AfterClass;
+import org.junit.Before;
+import org.junit.BeforeClass;
+import org.junit.Test;
+import static org.junit.Assert.*;
+
+import com.cirrus.tinyhal.test.thcm.CAlsaMock;
+import com.cirrus.tinyhal.test.thcm.CConfigMgr;
+import com.cirrus.tinyhal.test.thcm.ThcmPlatform;
+
+/**
+ * Tests that the byte data of cases is loaded when the case is selected
+ * and freed again when it is over the &lt;mixer&gt; case_cache budget.
+ */
+public class ThcmCaseCacheTest
+{
+    private static final File sWorkFilesPath = ThcmPlatform.workFilesPath();
+    private static final File sControlsFile =
+        new File(sWorkFilesPath, "thcm_case_cache_controls.csv");
+    private static final File sXmlFile =
+        new File(sWorkFilesPath, "thcm_case_cache.xml");
+    private static final File sDataFile =
+        new File(sWorkFilesPath, "thcm_case_cache.bin");
+
+    // Each case holds its data plus a work buffer the size of the control
+    private static final int CASE_B_BYTES = 4 + 8;
+    private static final int CASE_C_BYTES = 2 + 16;
+
+    private CAlsaMock mAlsaMock;
+    private CConfigMgr mConfigMgr;
+    private long mStream;
+
+    @BeforeClass
+    public static void setUpClass() throws IOException
+    {
+        FileWriter writer = new FileWriter(sControlsFile);
+        writer.write("CoefA,byte,8,0,0:255\n");
+        writer.write("CoefB,byte,8,0,0:255\n");
+        writer.write("CoefC,byte,16,0,0:255\n");
+        writer.write("Gain,int,1,0,0:100\n");
+        writer.close();
+    }
+
+    @AfterClass
+    public static void tearDownClass()
+    {
+        sControlsFile.delete();
+        sXmlFile.delete();
+        sDataFile.delete();
+    }
+
+    private int openConfig(String mixerAttribs) throws IOException
+    {
+        FileWriter writer = new FileWriter(sXmlFile);
+        writer.write("<audiohal>\n<mixer card=\"0\" " + mixerAttribs + "></mixer>\n");
+        writer.write("<stream name=\"dsp\" type=\"hw\" dir=\"out\">\n");
+        writer.write("<usecase name=\"eq\">\n");
+        writer.write("<case name=\"a\"><ctl name=\"CoefA\" val=\"1,2,3\"/></case>\n");
+        writer.write("<case name=\"b\"><ctl name=\"CoefB\" file=\"" +
+                     sDataFile.toPath().toString() + "\"/></case>\n");
+        writer.write("<case name=\"c\">");
+        writer.write("<ctl name=\"Gain\" val=\"4\"/>");
+        writer.write("<ctl name=\"CoefC\" index=\"2\" val=\"5,6\"/>");
+        writer.write("</case>\n");
+        writer.write("</usecase>\n");
+        writer.write("</stream>\n");
+        writer.write("</audiohal>\n");
+        writer.close();
+
+        int ret = mConfigMgr.init_audio_config(sXmlFile.toPath().toString());
+        if (ret == 0) {
+            mStream = mConfigMgr.get_named_stream("dsp");
+            assertTrue("Failed to get stream", mStream >= 0);
+        }
+        return ret;
+    }
+
+    private void writeData(int first) throws IOException
+    {
+        FileOutputStream out = new FileOutputStream(sDataFile);
+        out.write(new byte[] { (byte)first, 1, 2, 3 });
+        out.close();
+    }
+
+    @Before
+    public void setUp()
+    {
+        mAlsaMock = new CAlsaMock();
+        assertEquals("Failed to create CAlsaMock",
+                     0,
+                     mAlsaMock.createMixer(sControlsFile.toPath().toString()));
+
+        mConfigMgr = new CConfigMgr();
+        mStream = -1;
+        sDataFile.delete();
+    }
+
+    @After
+    public void tearDown()
+    {
+        if (mConfigMgr != null) {
+            if (mStream >= 0) {
+                mConfigMgr.release_stream(mStream);
+            }
+            mConfigMgr.free_audio_config();
+            mConfigMgr = null;
+            assertFalse("Configmgr leaked memory", CConfigMgr.are_allocs_leaked());
+        }
+
+        if (mAlsaMock != null) {
+            mAlsaMock.closeMixer();
+            mAlsaMock = null;
+        }
+    }
+
+    /**
+     * Without case_cache a file that cannot be read fails the boot.
+     */
+    @Test
+    public void testMissingFileAtBoot() throws IOException
+    {
+        assertFalse(openConfig("") == 0);
+    }
+
+    /**
+     * With case_cache the file of a case is not read until the case is
+     * selected.
+     */
+    @Test
+    public void testLoadOnSelect() throws IOException
+    {
+        assertEquals(0, openConfig("case_cache=\"1024\""));
+
+        assertFalse(mConfigMgr.apply_use_case(mStream, "eq", "b") == 0);
+        assertEquals("CoefB written", 0, mAlsaMock.getWriteCount("CoefB"));
+
+        writeData(7);
+        assertEquals(0, mConfigMgr.apply_use_case(mStream, "eq", "b"));
+        assertEquals("CoefB", 7, mAlsaMock.getData("CoefB")[0]);
+
+        assertEquals(0, mConfigMgr.apply_use_case(mStream, "eq", "c"));
+        assertEquals("Gain", 4, mAlsaMock.getInt("Gain", 0));
+        assertEquals("CoefC[2]", 5, mAlsaMock.getData("CoefC")[2]);
+        assertEquals("CoefC[3]", 6, mAlsaMock.getData("CoefC")[3]);
+    }
+
+    /**
+     * A case within the budget keeps its data, the least recently selected
+     * case is freed when the budget is exceeded and loaded again when it
+     * is selected.
+     */
+    @Test
+    public void testEviction() throws IOException
+    {
+        final int budget = CASE_B_BYTES + CASE_C_BYTES;
+        assertEquals(0, openConfig("case_cache=\"" + budget + "\""));
+
+        writeData(7);
+        assertEquals(0, mConfigMgr.apply_use_case(mStream, "eq", "b"));
+        assertEquals(0, mConfigMgr.apply_use_case(mStream, "eq", "a"));
+
+        // b is still loaded so the changed file is not read
+        writeData(8);
+        assertEquals(0, mConfigMgr.apply_use_case(mStream, "eq", "b"));
+        assertEquals("CoefB", 7, mAlsaMock.getData("CoefB")[0]);
+
+        // a is the least recently used so loading c frees only a
+        assertEquals(0, mConfigMgr.apply_use_case(mStream, "eq", "c"));
+        assertEquals(0, mConfigMgr.apply_use_case(mStream, "eq", "b"));
+        assertEquals("CoefB", 7, mAlsaMock.getData("CoefB")[0]);
+
+        // now loading a frees c, then loading c frees b
+        assertEquals(0, mConfigMgr.apply_use_case(mStream, "eq", "a"));
+        assertEquals("CoefA", 1, mAlsaMock.getData("CoefA")[0]);
+        assertEquals(0, mConfigMgr.apply_use_case(mStream, "eq", "c"));
+        assertEquals(0, mConfigMgr.apply_use_case(mStream, "eq", "b"));
+        assertEquals("CoefB", 8, mAlsaMock.getData("CoefB")[0]);
+    }
+
+    /**
+     * A case that is over the budget on its own is still applied.
+     */
+    @Test
+    public void testOverBudget() throws IOException
+    {
+        assertEquals(0, openConfig("case_cache=\"1\""));
+
+        writeData(7);
+        assertEquals(0, mConfigMgr.apply_use_case(mStream, "eq", "b"));
+        assertEquals("CoefB", 7, mAlsaMock.getData("CoefB")[0]);
+
+        writeData(8);
+        assertEquals(0, mConfigMgr.apply_use_case(mStream, "eq", "a"));
+        assertEquals(0, mConfigMgr.apply_use_case(mStream, "eq", "b"));
+        assertEquals("CoefB", 8, mAlsaMock.getData("CoefB")[0]);
+    }
+
+    /**
+     * Cases selected in a transaction are not freed before the commit.
+     */
+    @Test
+    public void testTransaction() throws IOException
+    {
+        assertEquals(0, openConfig("case_cache=\"1\""));
+        writeData(7);
+
+        assertEquals(0, mConfigMgr.config_begin_transaction());
+        assertEquals(0, mConfigMgr.apply_use_case(mStream, "eq", "b"));
+        assertEquals(0, mConfigMgr.apply_use_case(mStream, "eq", "a"));
+        assertEquals(0, mConfigMgr.apply_use_case(mStream, "eq", "c"));
+        assertEquals(0, mConfigMgr.config_commit());
+
+        assertEquals("CoefA", 1, mAlsaMock.getData("CoefA")[0]);
+        assertEquals("CoefB", 7, mAlsaMock.getData("CoefB")[0]);
+        assertEquals("CoefC[2]", 5, mAlsaMock.getData("CoefC")[2]);
+    }
+
+    /**
+     * The case_cache budget must be a number.
+     */
+    @Test
+    public void testBadBudget() throws IOException
+    {
+        assertFalse(openConfig("case_cache=\"big\"") == 0);
+    }
+}
@@ -0,0 +1,255 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.cirrus.tinyhal.test.thcm;
+
+import java.io.File;
+import java.io.FileWriter;
+import java.io.IOException;
+import org.junit.After;
+import org.junit.AfterClass;
+import org.junit.Before;
+import org.junit.BeforeClass;
+import org.junit.Test;
+import static org.junit.Assert.*;
+
+import com.cirrus.tinyhal.test.thcm.CAlsaMock;
+import com.cirrus.tinyhal.test.thcm.CConfigMgr;
+import com.cirrus.tinyhal.test.thcm.ThcmPlatform;
+
+/**
+ * Test waiting for the <code>&lt;codec_probe&gt;</code> file to appear.
+ * This tests the <code>timeout</code> attribute of the
+ * <code>&lt;codec_probe&gt;</code> element.
+ */
+public class ThcmCodecProbeTimeoutTest
+{
+    private static final String TEST_STREAM_NAME = "probetest";
+    private static final String TEST_CONST_NAME = "file";
+    private static final String ROOT_XML_CONST_VALUE = "root";
+    private static final String CASE_XML_CONST_VALUE = "case";
+    private static final String CASE_NAME = "CODEC42";
+
+    private static final int TEST_TIMEOUT_MS = 300;
+    private static final int CREATE_DELAY_MS = 100;
+
+    private static final File sWorkFilesPath = ThcmPlatform.workFilesPath();
+    private static final File sControlsFile =
+        new File(sWorkFilesPath, "thcm_codec_probe_timeout_controls.csv");
+    private static final File sRootXmlFile =
+        new File(sWorkFilesPath, "thcm_codec_probe_timeout_root.xml");
+    private static final File sCaseXmlFile =
+        new File(sWorkFilesPath, "thcm_codec_probe_timeout_case.xml");
+    private static final File sProbeDir =
+        new File(sWorkFilesPath, "thcm_codec_probe_timeout_dir");
+    private static final File sProbeFile = new File(sProbeDir, "id");
+
+    private CAlsaMock mAlsaMock;
+    private CConfigMgr mConfigMgr;
+
+    @BeforeClass
+    public static void setUpClass() throws IOException
+    {
+        FileWriter writer = new FileWriter(sControlsFile);
+        writer.write("dummy,bool,1,0,0:1\n");
+        writer.close();
+
+        createXmlFile(sCaseXmlFile, null, CASE_XML_CONST_VALUE);
+    }
+
+    @AfterClass
+    public static void tearDownClass()
+    {
+        sControlsFile.delete();
+        sCaseXmlFile.delete();
+    }
+
+    @Before
+    public void setUp()
+    {
+        removeProbeFile();
+
+        mAlsaMock = new CAlsaMock();
+        assertEquals("Failed to create CAlsaMock",
+                     0,
+                     mAlsaMock.createMixer(sControlsFile.toPath().toString()));
+
+        mConfigMgr = new CConfigMgr();
+    }
+
+    @After
+    public void tearDown()
+    {
+        if (mConfigMgr != null) {
+            mConfigMgr.free_audio_config();
+            mConfigMgr = null;
+            assertFalse("Configmgr leaked memory", CConfigMgr.are_allocs_leaked());
+        }
+
+        if (mAlsaMock != null) {
+            mAlsaMock.closeMixer();
+            mAlsaMock = null;
+        }
+
+        sRootXmlFile.delete();
+        removeProbeFile();
+    }
+
+    private static void removeProbeFile()
+    {
+        sProbeFile.delete();
+        sProbeDir.delete();
+    }
+
+    private static void createProbeFile() throws IOException
+    {
+        sProbeDir.mkdirs();
+        FileWriter writer = new FileWriter(sProbeFile);
+        writer.write(CASE_NAME);
+        writer.close();
+    }
+
+    private static void createXmlFile(File xmlFile,
+                                      String timeoutAttr,
+                                      String constValue) throws IOException
+    {
+        FileWriter writer = new FileWriter(xmlFile);
+
+        writer.write("<audiohal>\n");
+
+        if (xmlFile == sRootXmlFile) {
+            writer.write("<codec_probe file=\"" + sProbeFile.toPath().toString() +
+                         "\"");
+            if (timeoutAttr != null) {
+                writer.write(" timeout=\"" + timeoutAttr + "\"");
+            }
+            writer.write(">\n");
+            writer.write("<case name=\"" + CASE_NAME + "\" file=\"" +
+                         sCaseXmlFile.toPath().toString() + "\"/>\n");
+            writer.write("</codec_probe>\n");
+        }
+
+        writer.write("<mixer card=\"0\" />\n");
+        writer.write("<stream name=\"" + TEST_STREAM_NAME + "\" type=\"hw\">\n");
+        writer.write("<set name=\"" + TEST_CONST_NAME + "\" val=\"" +
+                     constValue + "\"/>\n");
+        writer.write("</stream>\n");
+        writer.write("</audiohal>\n");
+
+        writer.close();
+    }
+
+    private String getSelectedConst()
+    {
+        long stream = mConfigMgr.get_named_stream(TEST_STREAM_NAME);
+        assertTrue("Failed to open global stream", stream >= 0);
+
+        String constVal = mConfigMgr.get_stream_constant_string(stream,
+                                                                TEST_CONST_NAME);
+        mConfigMgr.release_stream(stream);
+        return constVal;
+    }
+
+    /**
+     * A probe file that already exists is used immediately.
+     *
+     * @throws IOException If XML or probe file cannot be created.
+     */
+    @Test
+    public void testFileExists() throws IOException
+    {
+        createProbeFile();
+        createXmlFile(sRootXmlFile,
+                      Integer.toString(TEST_TIMEOUT_MS),
+                      ROOT_XML_CONST_VALUE);
+
+        assertEquals("Failed to open CConfigMgr",
+                     0,
+                     mConfigMgr.init_audio_config(sRootXmlFile.toPath().toString()));
+        assertEquals("Wrong file selected", CASE_XML_CONST_VALUE, getSelectedConst());
+    }
+
+    /**
+     * If the probe file never appears, config loading must fail once the
+     * timeout has expired instead of waiting forever.
+     *
+     * @throws IOException If XML file cannot be created.
+     */
+    @Test
+    public void testTimeout() throws IOException
+    {
+        createXmlFile(sRootXmlFile,
+                      Integer.toString(TEST_TIMEOUT_MS),
+                      ROOT_XML_CONST_VALUE);
+
+        long start = System.nanoTime();
+        assertTrue("Expected CConfigMgr open to fail",
+                   mConfigMgr.init_audio_config(sRootXmlFile.toPath().toString()) < 0);
+        long elapsedMs = (System.nanoTime() - start) / 1000000;
+
+        assertTrue("Returned before timeout (" + elapsedMs + "ms)",
+                   elapsedMs >= TEST_TIMEOUT_MS);
+    }
+
+    /**
+     * A probe file that is created, along with its parent directory, while
+     * TinyHAL is waiting must be picked up before the timeout expires.
+     *
+     * @throws Exception If XML file cannot be created or the creating thread
+     *                   fails.
+     */
+    @Test
+    public void testFileCreatedLater() throws Exception
+    {
+        createXmlFile(sRootXmlFile, "5000", ROOT_XML_CONST_VALUE);
+
+        Thread creator = new Thread(new Runnable() {
+            public void run() {
+                try {
+                    Thread.sleep(CREATE_DELAY_MS);
+                    createProbeFile();
+                } catch (Exception e) {
+                    fail("Failed to create probe file: " + e);
+                }
+            }
+        });
+        creator.start();
+
+        assertEquals("Failed to open CConfigMgr",
+                     0,
+                     mConfigMgr.init_audio_config(sRootXmlFile.toPath().toString()));
+        creator.join();
+
+        assertEquals("Wrong file selected", CASE_XML_CONST_VALUE, getSelectedConst());
+    }
+
+    /**
+     * A timeout value that is not a number is rejected.
+     *
+     * @throws IOException If XML file cannot be created.
+     */
+    @Test
+    public void testInvalidTimeout() throws IOException
+    {
+        createProbeFile();
+        createXmlFile(sRootXmlFile, "soon", ROOT_XML_CONST_VALUE);
+
+        assertTrue("Expected CConfigMgr open to fail",
+                   mConfigMgr.init_audio_config(sRootXmlFile.toPath().toString()) < 0);
+    }
+};
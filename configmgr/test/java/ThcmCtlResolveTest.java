@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.cirrus.tinyhal.test.thcm;
+
+import java.io.BufferedWriter;
+import java.io.File;
+import java.io.FileWriter;
+import java.io.IOException;
+import org.junit.After;
+import org.junit.AfterClass;
+import org.junit.Before;
+import org.junit.BeforeClass;
+import org.junit.Test;
+import static org.junit.Assert.*;
+
+import com.cirrus.tinyhal.test.thcm.CAlsaMock;
+import com.cirrus.tinyhal.test.thcm.CConfigMgr;
+import com.cirrus.tinyhal.test.thcm.ThcmPlatform;
+
+/**
+ * Tests that controls are resolved by name through the index of control
+ * names when the card has many controls, and the refresh attribute of
+ * &lt;mixer&gt;.
+ */
+public class ThcmCtlResolveTest
+{
+    private static final File sWorkFilesPath = ThcmPlatform.workFilesPath();
+    private static final File sControlsFile =
+        new File(sWorkFilesPath, "thcm_ctl_resolve_controls.csv");
+    private static final File sXmlFile =
+        new File(sWorkFilesPath, "thcm_ctl_resolve.xml");
+    private static final File sEmptyControlsFile =
+        new File(sWorkFilesPath, "thcm_ctl_resolve_empty.csv");
+
+    // Enough controls that the index has to grow several times
+    private static final int NUM_CTLS = 1000;
+
+    private CAlsaMock mAlsaMock;
+    private CConfigMgr mConfigMgr;
+
+    @BeforeClass
+    public static void setUpClass() throws IOException
+    {
+        BufferedWriter writer = new BufferedWriter(new FileWriter(sControlsFile));
+        for (int i = 0; i < NUM_CTLS; ++i) {
+            writer.write("Ctl " + i + ",int,1,0,0:" + NUM_CTLS + "\n");
+        }
+        writer.write("Preload,bool,1,0,0:1\n");
+        writer.close();
+
+        new FileWriter(sEmptyControlsFile).close();
+    }
+
+    @AfterClass
+    public static void tearDownClass()
+    {
+        sControlsFile.delete();
+        sXmlFile.delete();
+        sEmptyControlsFile.delete();
+    }
+
+    @Before
+    public void setUp()
+    {
+        mAlsaMock = new CAlsaMock();
+        assertEquals("Failed to create CAlsaMock",
+                     0,
+                     mAlsaMock.createMixer(sControlsFile.toPath().toString()));
+
+        mConfigMgr = new CConfigMgr();
+    }
+
+    @After
+    public void tearDown()
+    {
+        if (mConfigMgr != null) {
+            mConfigMgr.free_audio_config();
+            mConfigMgr = null;
+            assertFalse("Configmgr leaked memory", CConfigMgr.are_allocs_leaked());
+        }
+
+        if (mAlsaMock != null) {
+            mAlsaMock.closeMixer();
+            mAlsaMock = null;
+        }
+    }
+
+    private int openConfig(String mixerAttribs) throws IOException
+    {
+        BufferedWriter writer = new BufferedWriter(new FileWriter(sXmlFile));
+        writer.write("<audiohal>\n<mixer card=\"0\" " + mixerAttribs + ">\n");
+        writer.write("<pre_init><ctl name=\"Preload\" val=\"1\"/></pre_init>\n");
+        writer.write("<init><ctl name=\"Ctl 0\" val=\"" + NUM_CTLS + "\"/></init>\n");
+        writer.write("</mixer>\n");
+
+        // Every control except Ctl 0 is set to its number, in reverse order
+        writer.write("<device name=\"speaker\">\n<path name=\"on\">\n");
+        for (int i = NUM_CTLS - 1; i > 0; --i) {
+            writer.write("<ctl name=\"Ctl " + i + "\" val=\"" + i + "\"/>\n");
+        }
+        writer.write("</path>\n</device>\n");
+
+        writer.write("<stream type=\"pcm\" dir=\"out\">\n");
+        writer.write("<ctl name=\"Ctl " + (NUM_CTLS - 1) + "\" function=\"leftvol\"/>\n");
+        writer.write("</stream>\n");
+        writer.write("</audiohal>\n");
+        writer.close();
+
+        return mConfigMgr.init_audio_config(sXmlFile.toPath().toString());
+    }
+
+    private void checkAllControls()
+    {
+        assertEquals("Preload", 1, mAlsaMock.getBool("Preload", 0));
+        assertEquals("Ctl 0", NUM_CTLS, mAlsaMock.getInt("Ctl 0", 0));
+
+        CConfigMgr.AudioConfig config = new CConfigMgr.AudioConfig();
+        config.sample_rate = 48000;
+        config.channel_mask = CConfigMgr.AUDIO_CHANNEL_OUT_FRONT_LEFT;
+        config.format = CConfigMgr.AUDIO_FORMAT_PCM;
+
+        long stream = mConfigMgr.get_stream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER,
+                                            0, config);
+        assertTrue("Failed to get stream", stream >= 0);
+
+        for (int i = 1; i < NUM_CTLS; ++i) {
+            assertEquals("Ctl " + i, i, mAlsaMock.getInt("Ctl " + i, 0));
+        }
+
+        mConfigMgr.set_hw_volume(stream, 0, 0);
+        assertEquals("volume control", 0, mAlsaMock.getInt("Ctl " + (NUM_CTLS - 1), 0));
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * Every control resolves to the control with the same name.
+     */
+    @Test
+    public void testManyControls() throws IOException
+    {
+        assertEquals(0, openConfig(""));
+        checkAllControls();
+    }
+
+    /**
+     * With refresh="add" the controls added by a &lt;pre_init&gt; are
+     * fetched without re-opening the mixer.
+     */
+    @Test
+    public void testRefreshAdd() throws IOException
+    {
+        assertEquals(0, openConfig("refresh=\"add\""));
+        checkAllControls();
+    }
+
+    /**
+     * refresh="reopen" is the default.
+     */
+    @Test
+    public void testRefreshReopen() throws IOException
+    {
+        assertEquals(0, openConfig("refresh=\"reopen\""));
+        checkAllControls();
+    }
+
+    /**
+     * A card with no controls boots, the controls of &lt;init&gt; and the
+     * paths are not found.
+     */
+    @Test
+    public void testEmptyCard() throws IOException
+    {
+        mAlsaMock.closeMixer();
+        assertEquals("Failed to create CAlsaMock",
+                     0,
+                     mAlsaMock.createMixer(sEmptyControlsFile.toPath().toString()));
+
+        BufferedWriter writer = new BufferedWriter(new FileWriter(sXmlFile));
+        writer.write("<audiohal>\n<mixer card=\"0\">\n");
+        writer.write("<init><ctl name=\"Ctl 0\" val=\"1\"/></init>\n");
+        writer.write("</mixer>\n");
+        writer.write("<device name=\"speaker\">\n");
+        writer.write("<path name=\"on\"><ctl name=\"Ctl 1\" val=\"1\"/></path>\n");
+        writer.write("</device>\n");
+        writer.write("<stream type=\"pcm\" dir=\"out\"/>\n");
+        writer.write("</audiohal>\n");
+        writer.close();
+
+        assertEquals(0, mConfigMgr.init_audio_config(sXmlFile.toPath().toString()));
+    }
+
+    /**
+     * refresh must be "reopen" or "add".
+     */
+    @Test
+    public void testBadRefresh() throws IOException
+    {
+        assertFalse(openConfig("refresh=\"sometimes\"") == 0);
+    }
+};
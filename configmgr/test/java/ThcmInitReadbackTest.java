@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.cirrus.tinyhal.test.thcm;
+
+import java.io.File;
+import java.io.FileWriter;
+import java.io.IOException;
+import org.junit.After;
+import org.junit.AfterClass;
+import org.junit.Before;
+import org.junit.BeforeClass;
+import org.junit.Test;
+import static org.junit.Assert.*;
+
+import com.cirrus.tinyhal.test.thcm.CAlsaMock;
+import com.cirrus.tinyhal.test.thcm.CConfigMgr;
+import com.cirrus.tinyhal.test.thcm.ThcmPlatform;
+
+/**
+ * Tests &lt;init write="changed"&gt; and &lt;pre_init write="changed"&gt;.
+ * Loading the configuration a second time on the same CAlsaMock models a
+ * restart of the HAL, when the controls already hold the values.
+ */
+public class ThcmInitReadbackTest
+{
+    private static final File sWorkFilesPath = ThcmPlatform.workFilesPath();
+    private static final File sControlsFile =
+        new File(sWorkFilesPath, "thcm_init_readback_controls.csv");
+    private static final File sXmlFile =
+        new File(sWorkFilesPath, "thcm_init_readback.xml");
+    private static final File sChangeXmlFile =
+        new File(sWorkFilesPath, "thcm_init_readback_change.xml");
+    private static final File sBadXmlFile =
+        new File(sWorkFilesPath, "thcm_init_readback_bad.xml");
+
+    // Number of <ctl> elements in the <pre_init> and <init> of sXmlFile
+    private static final int PREINIT_CTLS = 1;
+    private static final int INIT_CTLS = 4;
+
+    private CAlsaMock mAlsaMock;
+    private CConfigMgr mConfigMgr;
+
+    @BeforeClass
+    public static void setUpClass() throws IOException
+    {
+        FileWriter writer = new FileWriter(sControlsFile);
+        writer.write("bool1,bool,1,0,0:1\n");
+        writer.write("int4,int,4,0,0:100\n");
+        writer.write("mode,enum,1,A,A:B:C\n");
+        writer.write("bytes,byte,8,0,0:255\n");
+        writer.write("bytes2,byte,8,0,0:255\n");
+        writer.close();
+
+        writer = new FileWriter(sXmlFile);
+        writer.write("<audiohal>\n<mixer card=\"0\">\n");
+        writer.write("<pre_init write=\"changed\"><ctl name=\"bool1\" val=\"1\"/></pre_init>\n");
+        writer.write("<init write=\"changed\">\n");
+        writer.write("<ctl name=\"int4\" val=\"5\"/>\n");
+        writer.write("<ctl name=\"mode\" val=\"B\"/>\n");
+        writer.write("<ctl name=\"bytes\" val=\"1,2,3,4,5,6,7,8\"/>\n");
+        writer.write("<ctl name=\"bytes2\" index=\"4\" val=\"9,9\"/>\n");
+        writer.write("</init>\n</mixer>\n</audiohal>\n");
+        writer.close();
+
+        // Writes every control, changing one value of int4 and one byte
+        writer = new FileWriter(sChangeXmlFile);
+        writer.write("<audiohal>\n<mixer card=\"0\">\n<init>\n");
+        writer.write("<ctl name=\"int4\" index=\"2\" val=\"6\"/>\n");
+        writer.write("<ctl name=\"bytes\" index=\"7\" val=\"0\"/>\n");
+        writer.write("</init>\n</mixer>\n</audiohal>\n");
+        writer.close();
+
+        writer = new FileWriter(sBadXmlFile);
+        writer.write("<audiohal>\n<mixer card=\"0\">\n");
+        writer.write("<init write=\"sometimes\"><ctl name=\"int4\" val=\"5\"/></init>\n");
+        writer.write("</mixer>\n</audiohal>\n");
+        writer.close();
+    }
+
+    @AfterClass
+    public static void tearDownClass()
+    {
+        sControlsFile.delete();
+        sXmlFile.delete();
+        sChangeXmlFile.delete();
+        sBadXmlFile.delete();
+    }
+
+    @Before
+    public void setUp()
+    {
+        mAlsaMock = new CAlsaMock();
+        assertEquals("Failed to create CAlsaMock",
+                     0,
+                     mAlsaMock.createMixer(sControlsFile.toPath().toString()));
+    }
+
+    @After
+    public void tearDown()
+    {
+        closeConfig();
+
+        if (mAlsaMock != null) {
+            mAlsaMock.closeMixer();
+            mAlsaMock = null;
+        }
+    }
+
+    private void openConfig(File file)
+    {
+        mConfigMgr = new CConfigMgr();
+        assertEquals("Failed to open CConfigMgr",
+                     0,
+                     mConfigMgr.init_audio_config(file.toPath().toString()));
+    }
+
+    private void closeConfig()
+    {
+        if (mConfigMgr != null) {
+            mConfigMgr.free_audio_config();
+            mConfigMgr = null;
+            assertFalse("Configmgr leaked memory", CConfigMgr.are_allocs_leaked());
+        }
+    }
+
+    /**
+     * On the first start the controls don't have the values so they are
+     * all written.
+     */
+    @Test
+    public void testColdStart()
+    {
+        openConfig(sXmlFile);
+
+        assertEquals("bool1", 1, mAlsaMock.getBool("bool1", 0));
+        assertEquals("int4", 5, mAlsaMock.getInt("int4", 3));
+        assertEquals("mode", "B", mAlsaMock.getEnum("mode"));
+        assertEquals("bytes", 8, mAlsaMock.getData("bytes")[7]);
+        assertEquals("bytes2", 9, mAlsaMock.getData("bytes2")[5]);
+
+        long[] stats = mConfigMgr.get_boot_phase_stats(CConfigMgr.BOOT_PHASE_INIT);
+        assertEquals("init unchanged", 0, stats[CConfigMgr.BOOT_STAT_CTL_UNCHANGED]);
+    }
+
+    /**
+     * On a restart every control already has its value so nothing is
+     * written.
+     */
+    @Test
+    public void testWarmRestart()
+    {
+        openConfig(sXmlFile);
+        closeConfig();
+
+        mAlsaMock.clearCounts();
+        openConfig(sXmlFile);
+
+        assertEquals("writes", 0, mAlsaMock.getTotalWriteCount());
+
+        long[] stats = mConfigMgr.get_boot_phase_stats(CConfigMgr.BOOT_PHASE_INIT);
+        assertEquals("init writes", 0, stats[CConfigMgr.BOOT_STAT_CTL_WRITES]);
+        assertEquals("init unchanged", INIT_CTLS,
+                     stats[CConfigMgr.BOOT_STAT_CTL_UNCHANGED]);
+
+        stats = mConfigMgr.get_boot_phase_stats(CConfigMgr.BOOT_PHASE_PREINIT_BASE);
+        assertEquals("pre_init unchanged", PREINIT_CTLS,
+                     stats[CConfigMgr.BOOT_STAT_CTL_UNCHANGED]);
+    }
+
+    /**
+     * Only the controls that don't have their value are written. An INT
+     * control that differs in one value has all its values written, and a
+     * BYTE control that differs in one byte is written in full.
+     */
+    @Test
+    public void testRestartAfterChange()
+    {
+        openConfig(sXmlFile);
+        closeConfig();
+        openConfig(sChangeXmlFile);
+        closeConfig();
+
+        mAlsaMock.clearCounts();
+        openConfig(sXmlFile);
+
+        assertEquals("writes", 5, mAlsaMock.getTotalWriteCount());
+        assertEquals("int4 writes", 4, mAlsaMock.getWriteCount("int4"));
+        assertEquals("bytes writes", 1, mAlsaMock.getWriteCount("bytes"));
+        assertEquals("int4", 5, mAlsaMock.getInt("int4", 2));
+        assertEquals("bytes", 8, mAlsaMock.getData("bytes")[7]);
+    }
+
+    /**
+     * write must be "always" or "changed".
+     */
+    @Test
+    public void testBadWrite()
+    {
+        mConfigMgr = new CConfigMgr();
+        assertFalse(mConfigMgr.init_audio_config(sBadXmlFile.toPath().toString()) == 0);
+        mConfigMgr = null;
+    }
+};
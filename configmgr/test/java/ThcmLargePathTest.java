@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.cirrus.tinyhal.test.thcm;
+
+import java.io.BufferedWriter;
+import java.io.File;
+import java.io.FileWriter;
+import java.io.IOException;
+import org.junit.After;
+import org.junit.AfterClass;
+import org.junit.Before;
+import org.junit.BeforeClass;
+import org.junit.Test;
+import static org.junit.Assert.*;
+
+import com.cirrus.tinyhal.test.thcm.CAlsaMock;
+import com.cirrus.tinyhal.test.thcm.CConfigMgr;
+import com.cirrus.tinyhal.test.thcm.ThcmPlatform;
+
+/**
+ * Tests paths containing more &lt;ctl&gt; elements than fit in a 16-bit
+ * count, and that the arrays holding them grow geometrically.
+ */
+public class ThcmLargePathTest
+{
+    private static final File sWorkFilesPath = ThcmPlatform.workFilesPath();
+    private static final File sControlsFile =
+        new File(sWorkFilesPath, "thcm_large_path_controls.csv");
+    private static final File sXmlFile =
+        new File(sWorkFilesPath, "thcm_large_path.xml");
+
+    private static final int INIT_CTLS = 100000;
+    private static final int PATH_CTLS = 70000;
+
+    // Growing by doubling from 16 needs 13 reallocs to hold 100000
+    // entries. Growing by a fixed 16 would need thousands.
+    private static final long MAX_GROWTH_ALLOCS = 64;
+
+    private CAlsaMock mAlsaMock;
+    private CConfigMgr mConfigMgr;
+
+    @BeforeClass
+    public static void setUpClass() throws IOException
+    {
+        FileWriter writer = new FileWriter(sControlsFile);
+        writer.write("init1,int,1,0,0:" + INIT_CTLS + "\n");
+        writer.write("spk,int,1,0,0:" + PATH_CTLS + "\n");
+        writer.close();
+
+        // Each <ctl> writes a different value so that the final value
+        // shows that the last element was applied
+        BufferedWriter bw = new BufferedWriter(new FileWriter(sXmlFile));
+        bw.write("<audiohal>\n<mixer card=\"0\">\n<init>\n");
+        for (int i = 1; i <= INIT_CTLS; ++i) {
+            bw.write("<ctl name=\"init1\" val=\"" + i + "\"/>\n");
+        }
+        bw.write("</init>\n</mixer>\n");
+
+        bw.write("<device name=\"speaker\">\n<path name=\"on\">\n");
+        for (int i = 1; i <= PATH_CTLS; ++i) {
+            bw.write("<ctl name=\"spk\" val=\"" + i + "\"/>\n");
+        }
+        bw.write("</path>\n");
+        // An empty path is shrunk to no allocation at all
+        bw.write("<path name=\"off\"></path>\n");
+        bw.write("</device>\n");
+
+        bw.write("<stream type=\"pcm\" dir=\"out\"/>\n");
+        bw.write("</audiohal>\n");
+        bw.close();
+    }
+
+    @AfterClass
+    public static void tearDownClass()
+    {
+        sControlsFile.delete();
+        sXmlFile.delete();
+    }
+
+    @Before
+    public void setUp()
+    {
+        mAlsaMock = new CAlsaMock();
+        assertEquals("Failed to create CAlsaMock",
+                     0,
+                     mAlsaMock.createMixer(sControlsFile.toPath().toString()));
+
+        CConfigMgr.reset_alloc_stats();
+
+        mConfigMgr = new CConfigMgr();
+        assertEquals("Failed to open CConfigMgr",
+                     0,
+                     mConfigMgr.init_audio_config(sXmlFile.toPath().toString()));
+    }
+
+    @After
+    public void tearDown()
+    {
+        if (mConfigMgr != null) {
+            mConfigMgr.free_audio_config();
+            mConfigMgr = null;
+            assertFalse("Configmgr leaked memory", CConfigMgr.are_allocs_leaked());
+        }
+
+        if (mAlsaMock != null) {
+            mAlsaMock.closeMixer();
+            mAlsaMock = null;
+        }
+    }
+
+    /**
+     * Every &lt;ctl&gt; of a 100000 element &lt;init&gt; is applied.
+     */
+    @Test
+    public void testLargeInit()
+    {
+        assertEquals("init1 writes", INIT_CTLS, mAlsaMock.getWriteCount("init1"));
+        assertEquals("init1 value", INIT_CTLS, mAlsaMock.getInt("init1", 0));
+    }
+
+    /**
+     * Every &lt;ctl&gt; of a device path larger than 65535 elements is
+     * applied when the device is enabled.
+     */
+    @Test
+    public void testLargeDevicePath()
+    {
+        CConfigMgr.AudioConfig config = new CConfigMgr.AudioConfig();
+        config.sample_rate = 48000;
+        config.channel_mask = CConfigMgr.AUDIO_CHANNEL_OUT_FRONT_LEFT;
+        config.format = CConfigMgr.AUDIO_FORMAT_PCM;
+
+        mAlsaMock.clearCounts();
+        long stream = mConfigMgr.get_stream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER,
+                                            0, config);
+        assertTrue("Failed to get stream", stream >= 0);
+
+        assertEquals("spk writes", PATH_CTLS, mAlsaMock.getWriteCount("spk"));
+        assertEquals("spk value", PATH_CTLS, mAlsaMock.getInt("spk", 0));
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * Building the large arrays only needs a few reallocs. Each source line
+     * either allocates for every &lt;ctl&gt; or only a few times.
+     */
+    @Test
+    public void testParseReallocs()
+    {
+        long[] lines = CConfigMgr.get_alloc_lines(CConfigMgr.ALLOC_PHASE_PARSE);
+
+        for (int i = 0; i < lines.length; i += 3) {
+            final long count = lines[i + 1];
+            assertTrue("Line " + lines[i] + " allocated " + count + " times",
+                       (count <= MAX_GROWTH_ALLOCS) || (count >= PATH_CTLS));
+        }
+    }
+};
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.cirrus.tinyhal.test.thcm;
+
+import java.io.File;
+import java.io.FileWriter;
+import java.io.IOException;
+import org.junit.After;
+import org.junit.AfterClass;
+import org.junit.Before;
+import org.junit.BeforeClass;
+import org.junit.Test;
+import static org.junit.Assert.*;
+
+import com.cirrus.tinyhal.test.thcm.CAlsaMock;
+import com.cirrus.tinyhal.test.thcm.CConfigMgr;
+import com.cirrus.tinyhal.test.thcm.ThcmPlatform;
+
+/**
+ * Tests the control access counting and simulated ioctl cost of
+ * <code>CAlsaMock</code>.
+ */
+public class ThcmMockIoctlCostTest
+{
+    private static final File sWorkFilesPath = ThcmPlatform.workFilesPath();
+    private static final File sControlsFile =
+        new File(sWorkFilesPath, "thcm_mock_ioctl_controls.csv");
+    private static final File sXmlFile =
+        new File(sWorkFilesPath, "thcm_mock_ioctl.xml");
+
+    private static final int INT_CONTROL_VALUES = 4;
+    private static final int BYTE_CONTROL_BYTES = 8;
+
+    private static final int BOOL_COST_NS = 10;
+    private static final int INT_COST_NS = 100;
+    private static final int ENUM_COST_NS = 1000;
+    private static final int BYTE_COST_NS = 10000;
+    private static final int PER_BYTE_COST_NS = 3;
+
+    private CAlsaMock mAlsaMock;
+    private CConfigMgr mConfigMgr;
+
+    @BeforeClass
+    public static void setUpClass() throws IOException
+    {
+        FileWriter writer = new FileWriter(sControlsFile);
+        writer.write("bool1,bool,1,0,0:1\n");
+        writer.write("int4,int," + INT_CONTROL_VALUES + ",0,0:100\n");
+        writer.write("mux,enum,1,A,A:B:C\n");
+        writer.write("bytes,byte," + BYTE_CONTROL_BYTES + ",0,0:255\n");
+        writer.close();
+
+        writer = new FileWriter(sXmlFile);
+        writer.write("<audiohal>\n<mixer card=\"0\">\n<init>\n");
+        writer.write("<ctl name=\"bool1\" val=\"1\"/>\n");
+        writer.write("<ctl name=\"int4\" val=\"5\"/>\n");
+        writer.write("<ctl name=\"mux\" val=\"B\"/>\n");
+        writer.write("<ctl name=\"bytes\" val=\"1,2,3,4,5,6,7,8\"/>\n");
+        writer.write("</init>\n</mixer>\n</audiohal>\n");
+        writer.close();
+    }
+
+    @AfterClass
+    public static void tearDownClass()
+    {
+        sControlsFile.delete();
+        sXmlFile.delete();
+    }
+
+    @Before
+    public void setUp()
+    {
+        mAlsaMock = new CAlsaMock();
+        assertEquals("Failed to create CAlsaMock",
+                     0,
+                     mAlsaMock.createMixer(sControlsFile.toPath().toString()));
+
+        mConfigMgr = new CConfigMgr();
+    }
+
+    @After
+    public void tearDown()
+    {
+        if (mConfigMgr != null) {
+            mConfigMgr.free_audio_config();
+            mConfigMgr = null;
+            assertFalse("Configmgr leaked memory", CConfigMgr.are_allocs_leaked());
+        }
+
+        if (mAlsaMock != null) {
+            mAlsaMock.closeMixer();
+            mAlsaMock = null;
+        }
+    }
+
+    private void openConfig()
+    {
+        assertEquals("Failed to open CConfigMgr",
+                     0,
+                     mConfigMgr.init_audio_config(sXmlFile.toPath().toString()));
+    }
+
+    /**
+     * Every set call on a control is counted against that control.
+     */
+    @Test
+    public void testWriteCounts()
+    {
+        openConfig();
+
+        assertEquals("bool1 writes", 1, mAlsaMock.getWriteCount("bool1"));
+        // An int control without an index writes every value individually
+        assertEquals("int4 writes",
+                     INT_CONTROL_VALUES,
+                     mAlsaMock.getWriteCount("int4"));
+        assertEquals("mux writes", 1, mAlsaMock.getWriteCount("mux"));
+        assertEquals("bytes writes", 1, mAlsaMock.getWriteCount("bytes"));
+        assertEquals("Total writes",
+                     INT_CONTROL_VALUES + 3,
+                     mAlsaMock.getTotalWriteCount());
+    }
+
+    /**
+     * Each access is charged the cost of its control type, BYTE controls
+     * are also charged for each byte.
+     */
+    @Test
+    public void testSimulatedTime()
+    {
+        mAlsaMock.setIoctlCost(BOOL_COST_NS, INT_COST_NS, ENUM_COST_NS,
+                               BYTE_COST_NS, PER_BYTE_COST_NS, false);
+        openConfig();
+
+        final long expected = BOOL_COST_NS
+                              + (INT_CONTROL_VALUES * INT_COST_NS)
+                              + ENUM_COST_NS
+                              + BYTE_COST_NS
+                              + (BYTE_CONTROL_BYTES * PER_BYTE_COST_NS);
+        assertEquals("Simulated time", expected, mAlsaMock.getSimulatedTimeNs());
+    }
+
+    /**
+     * With spin enabled the simulated cost is spent in real time.
+     */
+    @Test
+    public void testSpin()
+    {
+        final int costNs = 2000000;
+
+        mAlsaMock.setIoctlCost(costNs, costNs, costNs, costNs, 0, true);
+
+        final long start = System.nanoTime();
+        openConfig();
+        final long elapsed = System.nanoTime() - start;
+
+        assertTrue("Elapsed " + elapsed + " less than simulated",
+                   elapsed >= mAlsaMock.getSimulatedTimeNs());
+    }
+
+    /**
+     * clearCounts() resets all counts and the simulated time.
+     */
+    @Test
+    public void testClearCounts()
+    {
+        mAlsaMock.setIoctlCost(BOOL_COST_NS, INT_COST_NS, ENUM_COST_NS,
+                               BYTE_COST_NS, PER_BYTE_COST_NS, false);
+        openConfig();
+        assertTrue("No writes counted", mAlsaMock.getTotalWriteCount() > 0);
+
+        mAlsaMock.clearCounts();
+
+        assertEquals("int4 writes", 0, mAlsaMock.getWriteCount("int4"));
+        assertEquals("int4 reads", 0, mAlsaMock.getReadCount("int4"));
+        assertEquals("Total writes", 0, mAlsaMock.getTotalWriteCount());
+        assertEquals("Total reads", 0, mAlsaMock.getTotalReadCount());
+        assertEquals("Simulated time", 0, mAlsaMock.getSimulatedTimeNs());
+    }
+};
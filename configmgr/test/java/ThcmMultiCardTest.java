@@ -0,0 +1,274 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+package com.cirrus.tinyhal.test.thcm;
+
+import java.io.File;
+import java.io.FileWriter;
+import java.io.IOException;
+import org.junit.After;
+import org.junit.AfterClass;
+import org.junit.Before;
+import org.junit.BeforeClass;
+import org.junit.Test;
+import static org.junit.Assert.*;
+
+import com.cirrus.tinyhal.test.thcm.CAlsaMock;
+import com.cirrus.tinyhal.test.thcm.CConfigMgr;
+import com.cirrus.tinyhal.test.thcm.ThcmPlatform;
+
+/**
+ * Tests controls on a second card, selected by the card attribute of
+ * &lt;ctl&gt;. Both cards have a control called Amp so that a write to the
+ * wrong card is seen.
+ */
+public class ThcmMultiCardTest
+{
+    private static final File sWorkFilesPath = ThcmPlatform.workFilesPath();
+    private static final File sControlsFile0 =
+        new File(sWorkFilesPath, "thcm_multi_card_controls0.csv");
+    private static final File sControlsFile1 =
+        new File(sWorkFilesPath, "thcm_multi_card_controls1.csv");
+    private static final File sXmlFile =
+        new File(sWorkFilesPath, "thcm_multi_card.xml");
+
+    private static final int CARD0 = 0;
+    private static final int CARD1 = 1;
+
+    private CAlsaMock mAlsaMock0;
+    private CAlsaMock mAlsaMock1;
+    private CConfigMgr mConfigMgr;
+
+    @BeforeClass
+    public static void setUpClass() throws IOException
+    {
+        FileWriter writer = new FileWriter(sControlsFile0);
+        writer.write("Amp,bool,1,0,0:1\n");
+        writer.write("Mux,enum,1,None,None:Spk\n");
+        writer.close();
+
+        writer = new FileWriter(sControlsFile1);
+        writer.write("Amp,bool,1,0,0:1\n");
+        writer.write("Gain,int,1,0,0:100\n");
+        writer.close();
+    }
+
+    @AfterClass
+    public static void tearDownClass()
+    {
+        sControlsFile0.delete();
+        sControlsFile1.delete();
+        sXmlFile.delete();
+    }
+
+    private int openConfig(String card) throws IOException
+    {
+        FileWriter writer = new FileWriter(sXmlFile);
+        writer.write("<audiohal>\n<mixer card=\"0\">\n");
+        writer.write("<init><ctl name=\"Gain\" card=\"" + card + "\" val=\"7\"/></init>\n");
+        writer.write("</mixer>\n");
+
+        writer.write("<device name=\"speaker\">\n");
+        writer.write("<path name=\"on\">");
+        writer.write("<ctl name=\"Mux\" val=\"Spk\"/>");
+        writer.write("<ctl name=\"Amp\" val=\"1\"/>");
+        writer.write("<ctl name=\"Amp\" card=\"" + card + "\" val=\"1\"/>");
+        writer.write("</path>\n");
+        writer.write("<path name=\"off\">");
+        writer.write("<ctl name=\"Amp\" card=\"" + card + "\" val=\"0\"/>");
+        writer.write("<ctl name=\"Amp\" val=\"0\"/>");
+        writer.write("<ctl name=\"Mux\" val=\"None\"/>");
+        writer.write("</path>\n");
+        writer.write("</device>\n");
+
+        writer.write("<device name=\"headphone\">\n");
+        writer.write("<path name=\"on\"><ctl name=\"Amp\" card=\"" + card + "\" val=\"1\"/></path>\n");
+        writer.write("<path name=\"off\"><ctl name=\"Amp\" card=\"" + card + "\" val=\"0\"/></path>\n");
+        writer.write("</device>\n");
+
+        writer.write("<stream type=\"pcm\" dir=\"out\">\n");
+        writer.write("<ctl name=\"Gain\" card=\"" + card + "\" function=\"leftvol\"/>\n");
+        writer.write("</stream>\n");
+        writer.write("</audiohal>\n");
+        writer.close();
+
+        return mConfigMgr.init_audio_config(sXmlFile.toPath().toString());
+    }
+
+    @Before
+    public void setUp()
+    {
+        mAlsaMock0 = new CAlsaMock();
+        assertEquals("Failed to create CAlsaMock card 0",
+                     0,
+                     mAlsaMock0.createMixer(sControlsFile0.toPath().toString(),
+                                            CARD0));
+
+        mAlsaMock1 = new CAlsaMock();
+        assertEquals("Failed to create CAlsaMock card 1",
+                     0,
+                     mAlsaMock1.createMixer(sControlsFile1.toPath().toString(),
+                                            CARD1));
+
+        mConfigMgr = new CConfigMgr();
+    }
+
+    @After
+    public void tearDown()
+    {
+        if (mConfigMgr != null) {
+            mConfigMgr.free_audio_config();
+            mConfigMgr = null;
+            assertFalse("Configmgr leaked memory", CConfigMgr.are_allocs_leaked());
+        }
+
+        if (mAlsaMock1 != null) {
+            mAlsaMock1.closeMixer();
+            mAlsaMock1 = null;
+        }
+
+        if (mAlsaMock0 != null) {
+            mAlsaMock0.closeMixer();
+            mAlsaMock0 = null;
+        }
+    }
+
+    private long openSpeakerStream()
+    {
+        CConfigMgr.AudioConfig config = new CConfigMgr.AudioConfig();
+        config.sample_rate = 48000;
+        config.channel_mask = CConfigMgr.AUDIO_CHANNEL_OUT_FRONT_LEFT;
+        config.format = CConfigMgr.AUDIO_FORMAT_PCM;
+
+        long stream = mConfigMgr.get_stream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER,
+                                            0, config);
+        assertTrue("Failed to get stream", stream >= 0);
+        return stream;
+    }
+
+    /**
+     * The &lt;init&gt; control and the device path controls are written to
+     * the card given by their card attribute.
+     */
+    @Test
+    public void testPathOnTwoCards() throws IOException
+    {
+        assertEquals(0, openConfig("1"));
+        assertEquals("card 1 Gain init", 7, mAlsaMock1.getInt("Gain", 0));
+
+        long stream = openSpeakerStream();
+
+        assertEquals("card 0 Mux", "Spk", mAlsaMock0.getEnum("Mux"));
+        assertEquals("card 0 Amp", 1, mAlsaMock0.getBool("Amp", 0));
+        assertEquals("card 1 Amp", 1, mAlsaMock1.getBool("Amp", 0));
+
+        mConfigMgr.release_stream(stream);
+
+        assertEquals("card 0 Mux off", "None", mAlsaMock0.getEnum("Mux"));
+        assertEquals("card 0 Amp off", 0, mAlsaMock0.getBool("Amp", 0));
+        assertEquals("card 1 Amp off", 0, mAlsaMock1.getBool("Amp", 0));
+    }
+
+    /**
+     * A route change writes both cards, and the writes to each card are
+     * made in the order of the paths.
+     */
+    @Test
+    public void testRouteOnTwoCards() throws IOException
+    {
+        assertEquals(0, openConfig("1"));
+
+        long stream = openSpeakerStream();
+        mAlsaMock0.clearCounts();
+        mAlsaMock1.clearCounts();
+
+        mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_WIRED_HEADPHONE);
+
+        assertEquals("card 0 writes", 2, mAlsaMock0.getTotalWriteCount());
+        assertEquals("card 0 Amp order", 1, mAlsaMock0.getLastWriteSeq("Amp"));
+        assertEquals("card 0 Mux order", 2, mAlsaMock0.getLastWriteSeq("Mux"));
+        assertEquals("card 0 Amp", 0, mAlsaMock0.getBool("Amp", 0));
+
+        // Speaker off then headphone on
+        assertEquals("card 1 writes", 2, mAlsaMock1.getTotalWriteCount());
+        assertEquals("card 1 Amp", 1, mAlsaMock1.getBool("Amp", 0));
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * A transaction commit writes both cards.
+     */
+    @Test
+    public void testTransactionOnTwoCards() throws IOException
+    {
+        assertEquals(0, openConfig("1"));
+
+        long stream = openSpeakerStream();
+        mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_WIRED_HEADPHONE);
+        mAlsaMock0.clearCounts();
+        mAlsaMock1.clearCounts();
+
+        assertEquals(0, mConfigMgr.config_begin_transaction());
+        mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+        assertEquals("card 0 deferred", 0, mAlsaMock0.getTotalWriteCount());
+        assertEquals("card 1 deferred", 0, mAlsaMock1.getTotalWriteCount());
+        assertEquals(0, mConfigMgr.config_commit());
+
+        assertEquals("card 0 Mux", "Spk", mAlsaMock0.getEnum("Mux"));
+        assertEquals("card 0 Amp", 1, mAlsaMock0.getBool("Amp", 0));
+        assertEquals("card 1 Amp", 1, mAlsaMock1.getBool("Amp", 0));
+        assertEquals("card 1 Amp writes", 1, mAlsaMock1.getWriteCount("Amp"));
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * A stream volume control can be on another card.
+     */
+    @Test
+    public void testVolumeOnSecondCard() throws IOException
+    {
+        assertEquals(0, openConfig("1"));
+
+        long stream = openSpeakerStream();
+        mConfigMgr.set_hw_volume(stream, 100, 100);
+        assertEquals("card 1 Gain", 100, mAlsaMock1.getInt("Gain", 0));
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * A card that can't be opened is an error.
+     */
+    @Test
+    public void testMissingCard() throws IOException
+    {
+        assertFalse(openConfig("2") == 0);
+    }
+
+    /**
+     * The card must be a number.
+     */
+    @Test
+    public void testBadCard() throws IOException
+    {
+        assertFalse(openConfig("one") == 0);
+    }
+};
@@ -0,0 +1,227 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+package com.cirrus.tinyhal.test.thcm;
+
+import java.io.File;
+import java.io.FileWriter;
+import java.io.IOException;
+import org.junit.After;
+import org.junit.AfterClass;
+import org.junit.Before;
+import org.junit.BeforeClass;
+import org.junit.Test;
+import static org.junit.Assert.*;
+
+import com.cirrus.tinyhal.test.thcm.CAlsaMock;
+import com.cirrus.tinyhal.test.thcm.CConfigMgr;
+import com.cirrus.tinyhal.test.thcm.ThcmPlatform;
+
+/**
+ * Tests &lt;mixer route="net"&gt;. A route change only writes the controls
+ * whose final value is different, so controls shared by the paths of the
+ * old and new device are not turned off and on again.
+ */
+public class ThcmNetRouteTest
+{
+    private static final File sWorkFilesPath = ThcmPlatform.workFilesPath();
+    private static final File sControlsFile =
+        new File(sWorkFilesPath, "thcm_net_route_controls.csv");
+    private static final File sXmlFile =
+        new File(sWorkFilesPath, "thcm_net_route.xml");
+
+    private CAlsaMock mAlsaMock;
+    private CConfigMgr mConfigMgr;
+
+    @BeforeClass
+    public static void setUpClass() throws IOException
+    {
+        FileWriter writer = new FileWriter(sControlsFile);
+        writer.write("Asp,bool,1,0,0:1\n");
+        writer.write("Mux,enum,1,None,None:Spk:Hp\n");
+        writer.write("SpkOn,bool,1,0,0:1\n");
+        writer.write("HpOn,bool,1,0,0:1\n");
+        writer.close();
+    }
+
+    @AfterClass
+    public static void tearDownClass()
+    {
+        sControlsFile.delete();
+        sXmlFile.delete();
+    }
+
+    private static void writeDevice(FileWriter writer, String device,
+                                    String mux, String control)
+        throws IOException
+    {
+        writer.write("<device name=\"" + device + "\">\n");
+        writer.write("<path name=\"on\">\n");
+        writer.write("<ctl name=\"Asp\" val=\"1\"/>\n");
+        writer.write("<ctl name=\"Mux\" val=\"" + mux + "\"/>\n");
+        writer.write("<ctl name=\"" + control + "\" val=\"1\"/>\n");
+        writer.write("</path>\n");
+        writer.write("<path name=\"off\">\n");
+        writer.write("<ctl name=\"" + control + "\" val=\"0\"/>\n");
+        writer.write("<ctl name=\"Mux\" val=\"None\"/>\n");
+        writer.write("<ctl name=\"Asp\" val=\"0\"/>\n");
+        writer.write("</path>\n");
+        writer.write("</device>\n");
+    }
+
+    private int openConfig(String route) throws IOException
+    {
+        FileWriter writer = new FileWriter(sXmlFile);
+        writer.write("<audiohal>\n");
+        writer.write("<mixer card=\"0\" route=\"" + route + "\"/>\n");
+        writeDevice(writer, "speaker", "Spk", "SpkOn");
+        writeDevice(writer, "headphone", "Hp", "HpOn");
+        writer.write("<stream type=\"pcm\" dir=\"out\"/>\n");
+        writer.write("</audiohal>\n");
+        writer.close();
+
+        return mConfigMgr.init_audio_config(sXmlFile.toPath().toString());
+    }
+
+    @Before
+    public void setUp()
+    {
+        mAlsaMock = new CAlsaMock();
+        assertEquals("Failed to create CAlsaMock",
+                     0,
+                     mAlsaMock.createMixer(sControlsFile.toPath().toString()));
+
+        mConfigMgr = new CConfigMgr();
+    }
+
+    @After
+    public void tearDown()
+    {
+        if (mConfigMgr != null) {
+            mConfigMgr.free_audio_config();
+            mConfigMgr = null;
+            assertFalse("Configmgr leaked memory", CConfigMgr.are_allocs_leaked());
+        }
+
+        if (mAlsaMock != null) {
+            mAlsaMock.closeMixer();
+            mAlsaMock = null;
+        }
+    }
+
+    private long openPcmStream(long device)
+    {
+        CConfigMgr.AudioConfig config = new CConfigMgr.AudioConfig();
+        config.sample_rate = 48000;
+        config.channel_mask = CConfigMgr.AUDIO_CHANNEL_OUT_FRONT_LEFT;
+        config.format = CConfigMgr.AUDIO_FORMAT_PCM;
+
+        long stream = mConfigMgr.get_stream(device, 0, config);
+        assertTrue("Failed to get stream", stream >= 0);
+        return stream;
+    }
+
+    private void checkRoute(String step, boolean asp, String mux,
+                            boolean spk, boolean hp)
+    {
+        assertEquals(step + ": Asp", asp ? 1 : 0, mAlsaMock.getBool("Asp", 0));
+        assertEquals(step + ": Mux", mux, mAlsaMock.getEnum("Mux"));
+        assertEquals(step + ": SpkOn", spk ? 1 : 0, mAlsaMock.getBool("SpkOn", 0));
+        assertEquals(step + ": HpOn", hp ? 1 : 0, mAlsaMock.getBool("HpOn", 0));
+    }
+
+    /**
+     * By default the off path of the old device and the on path of the
+     * new device are applied in full.
+     */
+    @Test
+    public void testSequentialRoute() throws IOException
+    {
+        assertEquals(0, openConfig("sequential"));
+        long stream = openPcmStream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+        mAlsaMock.clearCounts();
+
+        mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_WIRED_HEADPHONE);
+        checkRoute("speaker to headphone", true, "Hp", false, true);
+        assertEquals("Asp writes", 2, mAlsaMock.getWriteCount("Asp"));
+        assertEquals("Mux writes", 2, mAlsaMock.getWriteCount("Mux"));
+        assertEquals("total writes", 6, mAlsaMock.getTotalWriteCount());
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * A shared control that ends with the value it started with is not
+     * written. Controls that change are written once.
+     */
+    @Test
+    public void testNetRoute() throws IOException
+    {
+        assertEquals(0, openConfig("net"));
+        long stream = openPcmStream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+        checkRoute("open", true, "Spk", true, false);
+        mAlsaMock.clearCounts();
+
+        mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_WIRED_HEADPHONE);
+        checkRoute("speaker to headphone", true, "Hp", false, true);
+        assertEquals("Asp writes", 0, mAlsaMock.getWriteCount("Asp"));
+        assertEquals("Mux writes", 1, mAlsaMock.getWriteCount("Mux"));
+        assertEquals("SpkOn writes", 1, mAlsaMock.getWriteCount("SpkOn"));
+        assertEquals("HpOn writes", 1, mAlsaMock.getWriteCount("HpOn"));
+        assertEquals("total writes", 3, mAlsaMock.getTotalWriteCount());
+
+        // Only the shared controls are read to compare them
+        assertEquals("Asp reads", 1, mAlsaMock.getReadCount("Asp"));
+        assertEquals("Mux reads", 1, mAlsaMock.getReadCount("Mux"));
+        assertEquals("total reads", 2, mAlsaMock.getTotalReadCount());
+
+        mConfigMgr.release_stream(stream);
+        checkRoute("close", false, "None", false, false);
+    }
+
+    /**
+     * A transaction that ends on the route it started from writes nothing.
+     */
+    @Test
+    public void testNetTransaction() throws IOException
+    {
+        assertEquals(0, openConfig("net"));
+        long stream = openPcmStream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+        mAlsaMock.clearCounts();
+
+        assertEquals(0, mConfigMgr.config_begin_transaction());
+        mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_WIRED_HEADPHONE);
+        mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+        assertEquals(0, mConfigMgr.config_commit());
+
+        checkRoute("toggle", true, "Spk", true, false);
+        assertEquals("total writes", 0, mAlsaMock.getTotalWriteCount());
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * An unknown route mode is rejected.
+     */
+    @Test
+    public void testBadRoute() throws IOException
+    {
+        assertFalse(openConfig("fast") == 0);
+    }
+};
@@ -51,6 +51,9 @@ public class ThcmOpenMixerTest
     private static String[] TEST_NOCARD_NAMES = {
         "leek", "onion", "chive"
     };
+    private static final String TEST_LATE_CARD_NAME = "kiwi";
+    private static final int TEST_LATE_CARD_NUMBER = 9;
+    private static final int TEST_LATE_CARD_DELAY_MS = 100;
 
     private static final File sWorkFilesPath = ThcmPlatform.workFilesPath();
     private static final File sDummyProcPath = new File(sWorkFilesPath, "proc");
@@ -259,6 +262,80 @@ public class ThcmOpenMixerTest
         }
     }
 
+    /**
+     * Open mixer by <code>name</code> for a card that is registered while
+     * TinyHAL is waiting for it.
+     *
+     * @throws Exception If XML file cannot be created or deleted, or the
+     *                   card creating thread fails.
+     */
+    @Test
+    public void testWaitForName() throws Exception
+    {
+        assertEquals("Failed to create CAlsaMock",
+                     0,
+                     mAlsaMock.createMixer(sControlsFile.toPath().toString(),
+                                           TEST_LATE_CARD_NUMBER));
+        createXmlFile(new String[] {
+            "name=\"" + TEST_LATE_CARD_NAME + "\"",
+            "timeout=\"5000\""
+        });
+
+        Thread creator = new Thread(new Runnable() {
+            public void run() {
+                try {
+                    Thread.sleep(TEST_LATE_CARD_DELAY_MS);
+                    createCard(TEST_LATE_CARD_NAME, TEST_LATE_CARD_NUMBER);
+                } catch (Exception e) {
+                    fail("Failed to create card: " + e);
+                }
+            }
+        });
+        creator.start();
+
+        assertEquals("Failed to open CConfigMgr",
+                     0,
+                     mConfigMgr.init_audio_config(sXmlFile.toPath().toString()));
+        creator.join();
+
+        mConfigMgr.free_audio_config();
+        sXmlFile.delete();
+        mAlsaMock.closeMixer();
+        deleteAllUnder(new File(sDummyProcPath, "/asound/card" + TEST_LATE_CARD_NUMBER));
+        new File(sDummyProcPath, "/asound/card" + TEST_LATE_CARD_NUMBER).delete();
+    }
+
+    /**
+     * A card given by <code>name</code> that never appears must fail after
+     * the <code>timeout</code> has expired.
+     *
+     * @throws IOException If XML file cannot be created or deleted.
+     */
+    @Test
+    public void testWaitForNameTimeout() throws IOException
+    {
+        final int timeoutMs = 200;
+
+        assertEquals("Failed to create CAlsaMock",
+                     0,
+                     mAlsaMock.createMixer(sControlsFile.toPath().toString(),
+                                           TEST_NAMED_CARD_NUMBERS[0]));
+        createXmlFile(new String[] {
+            "name=\"" + TEST_NOCARD_NAMES[0] + "\"",
+            "timeout=\"" + timeoutMs + "\""
+        });
+
+        long start = System.nanoTime();
+        assertTrue("Expected CConfigMgr open to fail",
+                   mConfigMgr.init_audio_config(sXmlFile.toPath().toString()) < 0);
+        long elapsedMs = (System.nanoTime() - start) / 1000000;
+        assertTrue("Returned before timeout (" + elapsedMs + "ms)",
+                   elapsedMs >= timeoutMs);
+
+        sXmlFile.delete();
+        mAlsaMock.closeMixer();
+    }
+
     /**
      * Test that <code>card</code> and <code>name</code> cannot both be given.
      * The XML should be rejected if both attributes are given in the
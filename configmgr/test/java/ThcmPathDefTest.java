@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+package com.cirrus.tinyhal.test.thcm;
+
+import java.io.File;
+import java.io.FileWriter;
+import java.io.IOException;
+import org.junit.After;
+import org.junit.AfterClass;
+import org.junit.Before;
+import org.junit.BeforeClass;
+import org.junit.Test;
+import static org.junit.Assert.*;
+
+import com.cirrus.tinyhal.test.thcm.CAlsaMock;
+import com.cirrus.tinyhal.test.thcm.CConfigMgr;
+import com.cirrus.tinyhal.test.thcm.ThcmPlatform;
+
+/**
+ * Tests &lt;path_def&gt; blocks of controls referenced by &lt;path_ref&gt;
+ * from paths, cases and other &lt;path_def&gt; elements.
+ */
+public class ThcmPathDefTest
+{
+    private static final File sWorkFilesPath = ThcmPlatform.workFilesPath();
+    private static final File sControlsFile =
+        new File(sWorkFilesPath, "thcm_path_def_controls.csv");
+    private static final File sXmlFile =
+        new File(sWorkFilesPath, "thcm_path_def.xml");
+
+    private CAlsaMock mAlsaMock;
+    private CConfigMgr mConfigMgr;
+
+    @BeforeClass
+    public static void setUpClass() throws IOException
+    {
+        FileWriter writer = new FileWriter(sControlsFile);
+        writer.write("Amp,bool,1,0,0:1\n");
+        writer.write("Hp,bool,1,0,0:1\n");
+        writer.write("Mux,enum,1,None,None:DSP\n");
+        writer.write("Eq,byte,8,0,0:255\n");
+        writer.write("Gain,int,1,0,0:100\n");
+        writer.close();
+    }
+
+    @AfterClass
+    public static void tearDownClass()
+    {
+        sControlsFile.delete();
+        sXmlFile.delete();
+    }
+
+    private void writeConfig(int eq, String extra) throws IOException
+    {
+        FileWriter writer = new FileWriter(sXmlFile);
+        writer.write("<audiohal>\n<mixer card=\"0\"></mixer>\n");
+        writer.write("<path_def name=\"mux\"><ctl name=\"Mux\" val=\"DSP\"/></path_def>\n");
+        writer.write("<path_def name=\"dsp\">");
+        writer.write("<path_ref name=\"mux\"/>");
+        writer.write("<ctl name=\"Eq\" val=\"" + eq + ",2,3\"/>");
+        writer.write("</path_def>\n");
+        writer.write(extra);
+
+        writer.write("<device name=\"speaker\">\n");
+        writer.write("<path name=\"on\"><path_ref name=\"dsp\"/><ctl name=\"Amp\" val=\"1\"/></path>\n");
+        writer.write("<path name=\"off\"><ctl name=\"Amp\" val=\"0\"/></path>\n");
+        writer.write("</device>\n");
+
+        writer.write("<device name=\"headphone\">\n");
+        writer.write("<path name=\"on\">");
+        writer.write("<ctl name=\"Hp\" val=\"1\"/>");
+        writer.write("<path_ref name=\"dsp\"/>");
+        writer.write("<ctl name=\"Gain\" val=\"5\"/>");
+        writer.write("</path>\n");
+        writer.write("<path name=\"off\"><ctl name=\"Hp\" val=\"0\"/></path>\n");
+        writer.write("</device>\n");
+
+        writer.write("<stream type=\"pcm\" dir=\"out\"/>\n");
+        writer.write("<stream name=\"dsp\" type=\"hw\" dir=\"out\">\n");
+        writer.write("<usecase name=\"eq\">");
+        writer.write("<case name=\"on\"><path_ref name=\"dsp\"/></case>");
+        writer.write("<case name=\"gain\">");
+        writer.write("<ctl name=\"Gain\" val=\"9\"/>");
+        writer.write("<path_ref name=\"mux\"/>");
+        writer.write("<ctl name=\"Gain\" val=\"10\"/>");
+        writer.write("</case>");
+        writer.write("</usecase>\n");
+        writer.write("</stream>\n");
+        writer.write("</audiohal>\n");
+        writer.close();
+    }
+
+    private int openConfig(int eq, String extra) throws IOException
+    {
+        writeConfig(eq, extra);
+        return mConfigMgr.init_audio_config(sXmlFile.toPath().toString());
+    }
+
+    @Before
+    public void setUp()
+    {
+        mAlsaMock = new CAlsaMock();
+        assertEquals("Failed to create CAlsaMock",
+                     0,
+                     mAlsaMock.createMixer(sControlsFile.toPath().toString()));
+
+        mConfigMgr = new CConfigMgr();
+    }
+
+    @After
+    public void tearDown()
+    {
+        if (mConfigMgr != null) {
+            mConfigMgr.free_audio_config();
+            mConfigMgr = null;
+            assertFalse("Configmgr leaked memory", CConfigMgr.are_allocs_leaked());
+        }
+
+        if (mAlsaMock != null) {
+            mAlsaMock.closeMixer();
+            mAlsaMock = null;
+        }
+    }
+
+    private long openSpeakerStream()
+    {
+        CConfigMgr.AudioConfig config = new CConfigMgr.AudioConfig();
+        config.sample_rate = 48000;
+        config.channel_mask = CConfigMgr.AUDIO_CHANNEL_OUT_FRONT_LEFT;
+        config.format = CConfigMgr.AUDIO_FORMAT_PCM;
+
+        long stream = mConfigMgr.get_stream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER,
+                                            0, config);
+        assertTrue("Failed to get stream", stream >= 0);
+        return stream;
+    }
+
+    /**
+     * The controls of a &lt;path_def&gt;, including those of a nested
+     * &lt;path_ref&gt;, are written at the position of the
+     * &lt;path_ref&gt; in the path.
+     */
+    @Test
+    public void testPathRefOrder() throws IOException
+    {
+        assertEquals(0, openConfig(7, ""));
+
+        mAlsaMock.clearCounts();
+        long stream = openSpeakerStream();
+
+        assertEquals("Mux", "DSP", mAlsaMock.getEnum("Mux"));
+        assertEquals("Eq", 7, mAlsaMock.getData("Eq")[0]);
+        assertEquals("Amp", 1, mAlsaMock.getBool("Amp", 0));
+        assertEquals("Mux order", 1, mAlsaMock.getLastWriteSeq("Mux"));
+        assertEquals("Eq order", 2, mAlsaMock.getLastWriteSeq("Eq"));
+        assertEquals("Amp order", 3, mAlsaMock.getLastWriteSeq("Amp"));
+        assertEquals("writes", 3, mAlsaMock.getTotalWriteCount());
+
+        // Speaker off, then headphone on with the same path_def between
+        // its own controls
+        mAlsaMock.clearCounts();
+        mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_WIRED_HEADPHONE);
+
+        assertEquals("Amp order", 1, mAlsaMock.getLastWriteSeq("Amp"));
+        assertEquals("Hp order", 2, mAlsaMock.getLastWriteSeq("Hp"));
+        assertEquals("Mux order", 3, mAlsaMock.getLastWriteSeq("Mux"));
+        assertEquals("Eq order", 4, mAlsaMock.getLastWriteSeq("Eq"));
+        assertEquals("Gain order", 5, mAlsaMock.getLastWriteSeq("Gain"));
+        assertEquals("Gain", 5, mAlsaMock.getInt("Gain", 0));
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * The controls of a &lt;path_def&gt; used by a path and a case in the
+     * same transaction are written once.
+     */
+    @Test
+    public void testPathRefTransaction() throws IOException
+    {
+        assertEquals(0, openConfig(7, ""));
+
+        long stream = openSpeakerStream();
+        mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_WIRED_HEADPHONE);
+        long dspStream = mConfigMgr.get_named_stream("dsp");
+        assertTrue("Failed to get stream", dspStream >= 0);
+        mAlsaMock.clearCounts();
+
+        assertEquals(0, mConfigMgr.config_begin_transaction());
+        mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+        assertEquals(0, mConfigMgr.apply_use_case(dspStream, "eq", "on"));
+        assertEquals(0, mConfigMgr.config_commit());
+
+        assertEquals("Mux writes", 1, mAlsaMock.getWriteCount("Mux"));
+        assertEquals("Eq writes", 1, mAlsaMock.getWriteCount("Eq"));
+        assertEquals("Amp", 1, mAlsaMock.getBool("Amp", 0));
+        assertEquals("Hp", 0, mAlsaMock.getBool("Hp", 0));
+
+        mConfigMgr.release_stream(dspStream);
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * A case can refer to a &lt;path_def&gt;.
+     */
+    @Test
+    public void testPathRefCase() throws IOException
+    {
+        assertEquals(0, openConfig(7, ""));
+
+        long stream = mConfigMgr.get_named_stream("dsp");
+        assertTrue("Failed to get stream", stream >= 0);
+
+        mAlsaMock.clearCounts();
+        assertEquals(0, mConfigMgr.apply_use_case(stream, "eq", "gain"));
+        assertEquals("Gain", 10, mAlsaMock.getInt("Gain", 0));
+        assertEquals("Gain writes", 2, mAlsaMock.getWriteCount("Gain"));
+        assertEquals("Mux order", 2, mAlsaMock.getLastWriteSeq("Mux"));
+
+        mAlsaMock.clearCounts();
+        assertEquals(0, mConfigMgr.apply_use_case(stream, "eq", "on"));
+        assertEquals("Eq", 7, mAlsaMock.getData("Eq")[0]);
+        assertEquals("writes", 2, mAlsaMock.getTotalWriteCount());
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * A reload writes a changed control of a &lt;path_def&gt; used by an
+     * active path, and the paths use the new &lt;path_def&gt;.
+     */
+    @Test
+    public void testPathRefReload() throws IOException
+    {
+        assertEquals(0, openConfig(7, ""));
+
+        long stream = openSpeakerStream();
+        mAlsaMock.clearCounts();
+
+        writeConfig(9, "");
+        assertEquals(0, mConfigMgr.reload_audio_config(null));
+        assertEquals("writes", 1, mAlsaMock.getTotalWriteCount());
+        assertEquals("Eq", 9, mAlsaMock.getData("Eq")[0]);
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * A &lt;path_def&gt; must have a unique name and be defined before it
+     * is used.
+     */
+    @Test
+    public void testBadPathDef() throws IOException
+    {
+        assertFalse(openConfig(7, "<path_def name=\"mux\"/>\n") == 0);
+        assertFalse(openConfig(7, "<path_def name=\"x\"><path_ref name=\"x\"/></path_def>\n") == 0);
+        assertFalse(openConfig(7, "<path_def name=\"x\"><path_ref name=\"y\"/></path_def>\n") == 0);
+    }
+}
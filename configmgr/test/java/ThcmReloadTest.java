@@ -0,0 +1,241 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.cirrus.tinyhal.test.thcm;
+
+import java.io.File;
+import java.io.FileWriter;
+import java.io.IOException;
+import org.junit.After;
+import org.junit.AfterClass;
+import org.junit.Before;
+import org.junit.BeforeClass;
+import org.junit.Test;
+import static org.junit.Assert.*;
+
+import com.cirrus.tinyhal.test.thcm.CAlsaMock;
+import com.cirrus.tinyhal.test.thcm.CConfigMgr;
+import com.cirrus.tinyhal.test.thcm.ThcmPlatform;
+
+/**
+ * Tests reload_audio_config() with a stream open. Only the controls of
+ * enabled paths that have changed are written, and the stream keeps its
+ * route.
+ */
+public class ThcmReloadTest
+{
+    private static final File sWorkFilesPath = ThcmPlatform.workFilesPath();
+    private static final File sControlsFile =
+        new File(sWorkFilesPath, "thcm_reload_controls.csv");
+    private static final File sXmlFile =
+        new File(sWorkFilesPath, "thcm_reload.xml");
+
+    private CAlsaMock mAlsaMock;
+    private CConfigMgr mConfigMgr;
+
+    @BeforeClass
+    public static void setUpClass() throws IOException
+    {
+        FileWriter writer = new FileWriter(sControlsFile);
+        writer.write("Amp,bool,1,0,0:1\n");
+        writer.write("Vol,int,1,0,0:100\n");
+        writer.write("Mode,enum,1,A,A:B:C\n");
+        writer.write("Eq,int,1,0,0:100\n");
+        writer.write("Hp,int,1,0,0:100\n");
+        writer.close();
+    }
+
+    @AfterClass
+    public static void tearDownClass()
+    {
+        sControlsFile.delete();
+        sXmlFile.delete();
+    }
+
+    private void writeConfig(int vol, String mode, int eq, int hp,
+                             String extra) throws IOException
+    {
+        FileWriter writer = new FileWriter(sXmlFile);
+        writer.write("<audiohal>\n<mixer card=\"0\">\n");
+        writer.write("<init><ctl name=\"Hp\" val=\"99\"/></init>\n");
+        writer.write("</mixer>\n");
+
+        writer.write("<device name=\"speaker\">\n");
+        writer.write("<path name=\"on\">");
+        writer.write("<ctl name=\"Amp\" val=\"1\"/>");
+        writer.write("<ctl name=\"Vol\" val=\"" + vol + "\"/>");
+        writer.write("<ctl name=\"Mode\" val=\"" + mode + "\"/>");
+        writer.write("</path>\n");
+        writer.write("<path name=\"off\"><ctl name=\"Amp\" val=\"0\"/></path>\n");
+        writer.write("<path name=\"eq\"><ctl name=\"Eq\" val=\"" + eq + "\"/></path>\n");
+        writer.write("</device>\n");
+
+        writer.write("<device name=\"headphone\">\n");
+        writer.write("<path name=\"on\"><ctl name=\"Hp\" val=\"" + hp + "\"/></path>\n");
+        writer.write("<path name=\"off\"><ctl name=\"Hp\" val=\"0\"/></path>\n");
+        writer.write("</device>\n");
+
+        writer.write("<stream type=\"pcm\" dir=\"out\"><enable path=\"eq\"/></stream>\n");
+        writer.write(extra);
+        writer.write("</audiohal>\n");
+        writer.close();
+    }
+
+    @Before
+    public void setUp() throws IOException
+    {
+        mAlsaMock = new CAlsaMock();
+        assertEquals("Failed to create CAlsaMock",
+                     0,
+                     mAlsaMock.createMixer(sControlsFile.toPath().toString()));
+
+        writeConfig(50, "A", 5, 10, "");
+
+        mConfigMgr = new CConfigMgr();
+        assertEquals("Failed to open CConfigMgr",
+                     0,
+                     mConfigMgr.init_audio_config(sXmlFile.toPath().toString()));
+    }
+
+    @After
+    public void tearDown()
+    {
+        if (mConfigMgr != null) {
+            mConfigMgr.free_audio_config();
+            mConfigMgr = null;
+            assertFalse("Configmgr leaked memory", CConfigMgr.are_allocs_leaked());
+        }
+
+        if (mAlsaMock != null) {
+            mAlsaMock.closeMixer();
+            mAlsaMock = null;
+        }
+    }
+
+    private long openSpeakerStream()
+    {
+        CConfigMgr.AudioConfig config = new CConfigMgr.AudioConfig();
+        config.sample_rate = 48000;
+        config.channel_mask = CConfigMgr.AUDIO_CHANNEL_OUT_FRONT_LEFT;
+        config.format = CConfigMgr.AUDIO_FORMAT_PCM;
+
+        long stream = mConfigMgr.get_stream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER,
+                                            0, config);
+        assertTrue("Failed to get stream", stream >= 0);
+        return stream;
+    }
+
+    /**
+     * Reloading an unchanged file writes nothing.
+     */
+    @Test
+    public void testUnchanged()
+    {
+        long stream = openSpeakerStream();
+        mAlsaMock.clearCounts();
+
+        assertEquals(0, mConfigMgr.reload_audio_config(null));
+        assertEquals("writes", 0, mAlsaMock.getTotalWriteCount());
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * Only the changed controls of enabled paths are written. The stream
+     * enable path is matched by name, and the paths of a device that is not
+     * enabled and &lt;init&gt; are not written.
+     */
+    @Test
+    public void testChangedControls() throws IOException
+    {
+        long stream = openSpeakerStream();
+        mAlsaMock.clearCounts();
+
+        writeConfig(60, "B", 7, 20, "");
+        assertEquals(0, mConfigMgr.reload_audio_config(sXmlFile.toPath().toString()));
+
+        assertEquals("writes", 3, mAlsaMock.getTotalWriteCount());
+        assertEquals("Vol", 60, mAlsaMock.getInt("Vol", 0));
+        assertEquals("Mode", "B", mAlsaMock.getEnum("Mode"));
+        assertEquals("Eq", 7, mAlsaMock.getInt("Eq", 0));
+        assertEquals("Amp writes", 0, mAlsaMock.getWriteCount("Amp"));
+        assertEquals("Hp writes", 0, mAlsaMock.getWriteCount("Hp"));
+
+        mConfigMgr.release_stream(stream);
+        assertEquals("Amp off", 0, mAlsaMock.getBool("Amp", 0));
+    }
+
+    /**
+     * The stream keeps its reference count and route, and later route
+     * changes use the new configuration.
+     */
+    @Test
+    public void testRouteAfterReload() throws IOException
+    {
+        long stream = openSpeakerStream();
+
+        writeConfig(50, "A", 5, 20, "");
+        assertEquals(0, mConfigMgr.reload_audio_config(null));
+
+        mAlsaMock.clearCounts();
+        mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_WIRED_HEADPHONE);
+        assertEquals("Amp off", 0, mAlsaMock.getBool("Amp", 0));
+        assertEquals("Hp", 20, mAlsaMock.getInt("Hp", 0));
+
+        mConfigMgr.release_stream(stream);
+        assertEquals("Hp off", 0, mAlsaMock.getInt("Hp", 0));
+    }
+
+    /**
+     * A file that declares different streams is rejected and nothing is
+     * written.
+     */
+    @Test
+    public void testStreamsChanged() throws IOException
+    {
+        long stream = openSpeakerStream();
+        mAlsaMock.clearCounts();
+
+        writeConfig(60, "A", 5, 10, "<stream type=\"pcm\" dir=\"in\"/>\n");
+        assertFalse(mConfigMgr.reload_audio_config(null) == 0);
+        assertEquals("writes", 0, mAlsaMock.getTotalWriteCount());
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * A file that can't be parsed is rejected.
+     */
+    @Test
+    public void testBadFile() throws IOException
+    {
+        writeConfig(50, "A", 5, 10, "<bad");
+        assertFalse(mConfigMgr.reload_audio_config(null) == 0);
+    }
+
+    /**
+     * Reloading inside a transaction is not allowed.
+     */
+    @Test
+    public void testInTransaction()
+    {
+        assertEquals(0, mConfigMgr.config_begin_transaction());
+        assertFalse(mConfigMgr.reload_audio_config(null) == 0);
+        assertEquals(0, mConfigMgr.config_commit());
+    }
+};
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+package com.cirrus.tinyhal.test.thcm;
+
+import java.io.File;
+import java.io.FileWriter;
+import java.io.IOException;
+import org.junit.After;
+import org.junit.AfterClass;
+import org.junit.Before;
+import org.junit.BeforeClass;
+import org.junit.Test;
+import static org.junit.Assert.*;
+
+import com.cirrus.tinyhal.test.thcm.CAlsaMock;
+import com.cirrus.tinyhal.test.thcm.CConfigMgr;
+import com.cirrus.tinyhal.test.thcm.ThcmPlatform;
+
+/**
+ * Tests the order in which a route change disables the old devices and
+ * enables the new devices, set by the route attribute of &lt;stream&gt;.
+ */
+public class ThcmRouteOrderTest
+{
+    private static final File sWorkFilesPath = ThcmPlatform.workFilesPath();
+    private static final File sControlsFile =
+        new File(sWorkFilesPath, "thcm_route_order_controls.csv");
+    private static final File sXmlFile =
+        new File(sWorkFilesPath, "thcm_route_order.xml");
+
+    private CAlsaMock mAlsaMock;
+    private CConfigMgr mConfigMgr;
+
+    @BeforeClass
+    public static void setUpClass() throws IOException
+    {
+        FileWriter writer = new FileWriter(sControlsFile);
+        writer.write("SpkOn,bool,1,0,0:1\n");
+        writer.write("SpkPcm,bool,1,0,0:1\n");
+        writer.write("HpOn,bool,1,0,0:1\n");
+        writer.write("HpPcm,bool,1,0,0:1\n");
+        writer.close();
+    }
+
+    @AfterClass
+    public static void tearDownClass()
+    {
+        sControlsFile.delete();
+        sXmlFile.delete();
+    }
+
+    private static void writeSwitchPath(FileWriter writer, String path,
+                                        String control, int value)
+        throws IOException
+    {
+        writer.write("<path name=\"" + path + "\">");
+        writer.write("<ctl name=\"" + control + "\" val=\"" + value + "\"/>");
+        writer.write("</path>\n");
+    }
+
+    private static void writeDevice(FileWriter writer, String device,
+                                    String prefix)
+        throws IOException
+    {
+        writer.write("<device name=\"" + device + "\">\n");
+        writeSwitchPath(writer, "on", prefix + "On", 1);
+        writeSwitchPath(writer, "off", prefix + "On", 0);
+        writeSwitchPath(writer, "pcm_out_en", prefix + "Pcm", 1);
+        writeSwitchPath(writer, "pcm_out_dis", prefix + "Pcm", 0);
+        writer.write("</device>\n");
+    }
+
+    private int openConfig(String route) throws IOException
+    {
+        FileWriter writer = new FileWriter(sXmlFile);
+        writer.write("<audiohal>\n<mixer card=\"0\"/>\n");
+        writeDevice(writer, "speaker", "Spk");
+        writeDevice(writer, "headphone", "Hp");
+        writer.write("<stream type=\"pcm\" dir=\"out\"");
+        if (route != null) {
+            writer.write(" route=\"" + route + "\"");
+        }
+        writer.write(">\n");
+        writer.write("<enable path=\"pcm_out_en\"/>\n");
+        writer.write("<disable path=\"pcm_out_dis\"/>\n");
+        writer.write("</stream>\n");
+        writer.write("</audiohal>\n");
+        writer.close();
+
+        return mConfigMgr.init_audio_config(sXmlFile.toPath().toString());
+    }
+
+    @Before
+    public void setUp()
+    {
+        mAlsaMock = new CAlsaMock();
+        assertEquals("Failed to create CAlsaMock",
+                     0,
+                     mAlsaMock.createMixer(sControlsFile.toPath().toString()));
+
+        mConfigMgr = new CConfigMgr();
+    }
+
+    @After
+    public void tearDown()
+    {
+        if (mConfigMgr != null) {
+            mConfigMgr.free_audio_config();
+            mConfigMgr = null;
+            assertFalse("Configmgr leaked memory", CConfigMgr.are_allocs_leaked());
+        }
+
+        if (mAlsaMock != null) {
+            mAlsaMock.closeMixer();
+            mAlsaMock = null;
+        }
+    }
+
+    /**
+     * Switch from speaker to headphone and check the final values.
+     */
+    private void switchToHeadphone()
+    {
+        CConfigMgr.AudioConfig config = new CConfigMgr.AudioConfig();
+        config.sample_rate = 48000;
+        config.channel_mask = CConfigMgr.AUDIO_CHANNEL_OUT_FRONT_LEFT;
+        config.format = CConfigMgr.AUDIO_FORMAT_PCM;
+
+        long stream = mConfigMgr.get_stream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER,
+                                            0, config);
+        assertTrue("Failed to get stream", stream >= 0);
+        mAlsaMock.clearCounts();
+
+        mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_WIRED_HEADPHONE);
+
+        assertEquals("SpkOn", 0, mAlsaMock.getBool("SpkOn", 0));
+        assertEquals("SpkPcm", 0, mAlsaMock.getBool("SpkPcm", 0));
+        assertEquals("HpOn", 1, mAlsaMock.getBool("HpOn", 0));
+        assertEquals("HpPcm", 1, mAlsaMock.getBool("HpPcm", 0));
+        assertEquals("total writes", 4, mAlsaMock.getTotalWriteCount());
+    }
+
+    /**
+     * By default the old device is disabled before the new device is
+     * enabled.
+     */
+    @Test
+    public void testBreakBeforeMake() throws IOException
+    {
+        assertEquals(0, openConfig(null));
+        switchToHeadphone();
+
+        assertEquals("SpkPcm order", 1, mAlsaMock.getLastWriteSeq("SpkPcm"));
+        assertEquals("SpkOn order", 2, mAlsaMock.getLastWriteSeq("SpkOn"));
+        assertEquals("HpOn order", 3, mAlsaMock.getLastWriteSeq("HpOn"));
+        assertEquals("HpPcm order", 4, mAlsaMock.getLastWriteSeq("HpPcm"));
+    }
+
+    /**
+     * The default order can be given explicitly.
+     */
+    @Test
+    public void testExplicitBreakBeforeMake() throws IOException
+    {
+        assertEquals(0, openConfig("break_before_make"));
+        switchToHeadphone();
+
+        assertTrue("Speaker disabled first",
+                   mAlsaMock.getLastWriteSeq("SpkOn") < mAlsaMock.getLastWriteSeq("HpOn"));
+    }
+
+    /**
+     * With make_before_break the new device is enabled before the old
+     * device is disabled.
+     */
+    @Test
+    public void testMakeBeforeBreak() throws IOException
+    {
+        assertEquals(0, openConfig("make_before_break"));
+        switchToHeadphone();
+
+        assertEquals("HpOn order", 1, mAlsaMock.getLastWriteSeq("HpOn"));
+        assertEquals("HpPcm order", 2, mAlsaMock.getLastWriteSeq("HpPcm"));
+        assertEquals("SpkPcm order", 3, mAlsaMock.getLastWriteSeq("SpkPcm"));
+        assertEquals("SpkOn order", 4, mAlsaMock.getLastWriteSeq("SpkOn"));
+    }
+
+    /**
+     * An unknown route order is rejected.
+     */
+    @Test
+    public void testBadRoute() throws IOException
+    {
+        assertFalse(openConfig("net") == 0);
+    }
+};
@@ -0,0 +1,356 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+package com.cirrus.tinyhal.test.thcm;
+
+import java.io.File;
+import java.io.FileWriter;
+import java.io.IOException;
+import org.junit.After;
+import org.junit.AfterClass;
+import org.junit.Before;
+import org.junit.BeforeClass;
+import org.junit.Test;
+import static org.junit.Assert.*;
+
+import com.cirrus.tinyhal.test.thcm.CAlsaMock;
+import com.cirrus.tinyhal.test.thcm.CConfigMgr;
+import com.cirrus.tinyhal.test.thcm.ThcmPlatform;
+
+/**
+ * Tests config_begin_transaction() and config_commit().
+ * Writes made between them are deferred until the commit and each
+ * control value is written only once, with its final value.
+ */
+public class ThcmTransactionTest
+{
+    private static final File sWorkFilesPath = ThcmPlatform.workFilesPath();
+    private static final File sControlsFile =
+        new File(sWorkFilesPath, "thcm_transaction_controls.csv");
+    private static final File sXmlFile =
+        new File(sWorkFilesPath, "thcm_transaction.xml");
+    private static final File sMixerXmlFile =
+        new File(sWorkFilesPath, "thcm_transaction_mixer.xml");
+
+    private static final String[] ALL_CONTROLS = {
+        "GlobalOn", "GlobalPcm", "SpkOn", "SpkPcm",
+        "HpOn", "HpGain", "HpPcm", "Mode", "Eq"
+    };
+
+    private static final int HP_GAIN_VALUES = 2;
+
+    private static final int EBUSY = 16;
+    private static final int EINVAL = 22;
+
+    private CAlsaMock mAlsaMock;
+    private CConfigMgr mConfigMgr;
+
+    @BeforeClass
+    public static void setUpClass() throws IOException
+    {
+        FileWriter writer = new FileWriter(sControlsFile);
+        writer.write("GlobalOn,bool,1,0,0:1\n");
+        writer.write("GlobalPcm,bool,1,0,0:1\n");
+        writer.write("SpkOn,bool,1,0,0:1\n");
+        writer.write("SpkPcm,bool,1,0,0:1\n");
+        writer.write("HpOn,bool,1,0,0:1\n");
+        writer.write("HpGain,int," + HP_GAIN_VALUES + ",0,0:63\n");
+        writer.write("HpPcm,bool,1,0,0:1\n");
+        writer.write("Mode,enum,1,Off,Off:Low:High\n");
+        writer.write("Eq,byte,8,0,0:255\n");
+        writer.close();
+
+        writer = new FileWriter(sXmlFile);
+        writer.write("<audiohal>\n<mixer card=\"0\"/>\n");
+
+        writer.write("<device name=\"global\">\n");
+        writeSwitchPath(writer, "on", "GlobalOn", 1);
+        writeSwitchPath(writer, "off", "GlobalOn", 0);
+        writeSwitchPath(writer, "pcm_out_en", "GlobalPcm", 1);
+        writeSwitchPath(writer, "pcm_out_dis", "GlobalPcm", 0);
+        writer.write("</device>\n");
+
+        writer.write("<device name=\"speaker\">\n");
+        writeSwitchPath(writer, "on", "SpkOn", 1);
+        writeSwitchPath(writer, "off", "SpkOn", 0);
+        writeSwitchPath(writer, "pcm_out_en", "SpkPcm", 1);
+        writeSwitchPath(writer, "pcm_out_dis", "SpkPcm", 0);
+        writer.write("</device>\n");
+
+        writer.write("<device name=\"headphone\">\n");
+        writer.write("<path name=\"on\">\n");
+        writer.write("<ctl name=\"HpOn\" val=\"1\"/>\n");
+        writer.write("<ctl name=\"HpGain\" val=\"40\"/>\n");
+        writer.write("</path>\n");
+        writeSwitchPath(writer, "off", "HpOn", 0);
+        writeSwitchPath(writer, "pcm_out_en", "HpPcm", 1);
+        writeSwitchPath(writer, "pcm_out_dis", "HpPcm", 0);
+        writer.write("</device>\n");
+
+        writer.write("<stream type=\"pcm\" dir=\"out\" card=\"0\" device=\"0\">\n");
+        writer.write("<enable path=\"pcm_out_en\"/>\n");
+        writer.write("<disable path=\"pcm_out_dis\"/>\n");
+        writer.write("</stream>\n");
+
+        writer.write("<stream name=\"uc\" type=\"hw\" dir=\"out\">\n");
+        writer.write("<usecase name=\"mode\">\n");
+        writer.write("<case name=\"low\">\n");
+        writer.write("<ctl name=\"Mode\" val=\"Low\"/>\n");
+        writer.write("<ctl name=\"Eq\" index=\"2\" val=\"7,8\"/>\n");
+        writer.write("</case>\n");
+        writer.write("<case name=\"high\">\n");
+        writer.write("<ctl name=\"Mode\" val=\"High\"/>\n");
+        writer.write("<ctl name=\"Eq\" val=\"1,2,3,4,5,6,7,8\"/>\n");
+        writer.write("</case>\n");
+        writer.write("</usecase>\n");
+        writer.write("</stream>\n");
+
+        writer.write("</audiohal>\n");
+        writer.close();
+    }
+
+    private static void writeSwitchPath(FileWriter writer, String path,
+                                        String control, int value)
+        throws IOException
+    {
+        writer.write("<path name=\"" + path + "\">");
+        writer.write("<ctl name=\"" + control + "\" val=\"" + value + "\"/>");
+        writer.write("</path>\n");
+    }
+
+    @AfterClass
+    public static void tearDownClass()
+    {
+        sControlsFile.delete();
+        sXmlFile.delete();
+        sMixerXmlFile.delete();
+    }
+
+    @Before
+    public void setUp()
+    {
+        mAlsaMock = new CAlsaMock();
+        assertEquals("Failed to create CAlsaMock",
+                     0,
+                     mAlsaMock.createMixer(sControlsFile.toPath().toString()));
+
+        mConfigMgr = new CConfigMgr();
+        assertEquals("Failed to open CConfigMgr",
+                     0,
+                     mConfigMgr.init_audio_config(sXmlFile.toPath().toString()));
+        mAlsaMock.clearCounts();
+    }
+
+    @After
+    public void tearDown()
+    {
+        if (mConfigMgr != null) {
+            mConfigMgr.free_audio_config();
+            mConfigMgr = null;
+            assertFalse("Configmgr leaked memory", CConfigMgr.are_allocs_leaked());
+        }
+
+        if (mAlsaMock != null) {
+            mAlsaMock.closeMixer();
+            mAlsaMock = null;
+        }
+    }
+
+    private long openPcmStream(long device)
+    {
+        CConfigMgr.AudioConfig config = new CConfigMgr.AudioConfig();
+        config.sample_rate = 48000;
+        config.channel_mask = CConfigMgr.AUDIO_CHANNEL_OUT_FRONT_LEFT;
+        config.format = CConfigMgr.AUDIO_FORMAT_PCM;
+
+        long stream = mConfigMgr.get_stream(device, 0, config);
+        assertTrue("Failed to get stream", stream >= 0);
+        return stream;
+    }
+
+    /**
+     * Check the write count of every control, a missing entry in
+     * <code>expected</code> means 0 writes.
+     */
+    private void checkWrites(String step, String[] names, int[] expected,
+                             long expectedReads)
+    {
+        int total = 0;
+
+        for (String name : ALL_CONTROLS) {
+            int count = 0;
+            for (int i = 0; i < names.length; ++i) {
+                if (names[i].equals(name)) {
+                    count = expected[i];
+                }
+            }
+
+            assertEquals(step + ": " + name + " writes",
+                         count,
+                         mAlsaMock.getWriteCount(name));
+            total += count;
+        }
+
+        assertEquals(step + ": total writes", total, mAlsaMock.getTotalWriteCount());
+        assertEquals(step + ": total reads", expectedReads,
+                     mAlsaMock.getTotalReadCount());
+
+        mAlsaMock.clearCounts();
+    }
+
+    /**
+     * Nothing is written until the commit.
+     */
+    @Test
+    public void testDeferredUntilCommit()
+    {
+        long stream = openPcmStream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+        mAlsaMock.clearCounts();
+
+        assertEquals(0, mConfigMgr.config_begin_transaction());
+        mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_WIRED_HEADPHONE);
+        checkWrites("before commit", new String[] {}, new int[] {}, 0);
+
+        assertEquals(0, mConfigMgr.config_commit());
+        checkWrites("commit",
+                    new String[] { "SpkOn", "SpkPcm", "HpOn", "HpGain", "HpPcm" },
+                    new int[] { 1, 1, 1, HP_GAIN_VALUES, 1 },
+                    0);
+        assertEquals(0, mAlsaMock.getBool("SpkOn", 0));
+        assertEquals(1, mAlsaMock.getBool("HpOn", 0));
+        assertEquals(40, mAlsaMock.getInt("HpGain", 1));
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * Switching to headphone and back to speaker in one transaction writes
+     * each control once with its final value, instead of twice.
+     */
+    @Test
+    public void testToggleWritesOnce()
+    {
+        long stream = openPcmStream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+        mAlsaMock.clearCounts();
+
+        assertEquals(0, mConfigMgr.config_begin_transaction());
+        mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_WIRED_HEADPHONE);
+        mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+        assertEquals(0, mConfigMgr.config_commit());
+
+        checkWrites("toggle",
+                    new String[] { "SpkOn", "SpkPcm", "HpOn", "HpGain", "HpPcm" },
+                    new int[] { 1, 1, 1, HP_GAIN_VALUES, 1 },
+                    0);
+        assertEquals(1, mAlsaMock.getBool("SpkOn", 0));
+        assertEquals(1, mAlsaMock.getBool("SpkPcm", 0));
+        assertEquals(0, mAlsaMock.getBool("HpOn", 0));
+        assertEquals(0, mAlsaMock.getBool("HpPcm", 0));
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * Repeated use-case selection writes each control once. The partial
+     * write of Eq reads it only once, and the final value is the result of
+     * applying the cases in order.
+     */
+    @Test
+    public void testRepeatedUseCase()
+    {
+        long stream = mConfigMgr.get_named_stream("uc");
+        assertTrue("Failed to get stream", stream >= 0);
+        mAlsaMock.clearCounts();
+
+        assertEquals(0, mConfigMgr.config_begin_transaction());
+        assertEquals(0, mConfigMgr.apply_use_case(stream, "mode", "low"));
+        assertEquals(0, mConfigMgr.apply_use_case(stream, "mode", "low"));
+        assertEquals(0, mConfigMgr.config_commit());
+
+        checkWrites("low twice",
+                    new String[] { "Mode", "Eq" },
+                    new int[] { 1, 1 },
+                    1);
+        assertEquals("Low", mAlsaMock.getEnum("Mode"));
+
+        // A full write followed by a partial write needs no read
+        assertEquals(0, mConfigMgr.config_begin_transaction());
+        assertEquals(0, mConfigMgr.apply_use_case(stream, "mode", "high"));
+        assertEquals(0, mConfigMgr.apply_use_case(stream, "mode", "low"));
+        assertEquals(0, mConfigMgr.config_commit());
+
+        checkWrites("high then low",
+                    new String[] { "Mode", "Eq" },
+                    new int[] { 1, 1 },
+                    0);
+        assertEquals("Low", mAlsaMock.getEnum("Mode"));
+        assertArrayEquals(new byte[] { 1, 2, 7, 8, 5, 6, 7, 8 },
+                          mAlsaMock.getData("Eq"));
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * Transactions cannot be nested and a commit needs a transaction.
+     */
+    @Test
+    public void testBadCalls()
+    {
+        assertEquals(-EINVAL, mConfigMgr.config_commit());
+
+        assertEquals(0, mConfigMgr.config_begin_transaction());
+        assertEquals(-EBUSY, mConfigMgr.config_begin_transaction());
+        assertEquals(0, mConfigMgr.config_commit());
+
+        assertEquals(-EINVAL, mConfigMgr.config_commit());
+    }
+
+    private int openMixerConfig(String mixerAttribs) throws IOException
+    {
+        mConfigMgr.free_audio_config();
+
+        FileWriter writer = new FileWriter(sMixerXmlFile);
+        writer.write("<audiohal>\n<mixer card=\"0\" " + mixerAttribs + "/>\n");
+        writer.write("<stream type=\"pcm\" dir=\"out\" card=\"0\" device=\"0\"/>\n");
+        writer.write("</audiohal>\n");
+        writer.close();
+
+        return mConfigMgr.init_audio_config(sMixerXmlFile.toPath().toString());
+    }
+
+    /**
+     * The HAL only batches the changes of a set_parameters() call if the
+     * config asks for it.
+     *
+     * @throws IOException If XML file cannot be created.
+     */
+    @Test
+    public void testBatchParameters() throws IOException
+    {
+        assertFalse(mConfigMgr.config_batch_parameters());
+
+        assertEquals(0, openMixerConfig("parameters=\"sequential\""));
+        assertFalse(mConfigMgr.config_batch_parameters());
+
+        assertEquals(0, openMixerConfig("parameters=\"batch\""));
+        assertTrue(mConfigMgr.config_batch_parameters());
+
+        assertFalse(openMixerConfig("parameters=\"sometimes\"") == 0);
+    }
+};
@@ -49,8 +49,23 @@ import org.junit.runners.Suite;
     ThcmStreamConstantsTest.class,
     ThcmStreamInstanceTest.class,
     ThcmCodecProbeTest.class,
+    ThcmCodecProbeTimeoutTest.class,
     ThcmRootXmlPathTest.class,
-    ThcmOpenMixerTest.class
+    ThcmOpenMixerTest.class,
+    ThcmBootStatsTest.class,
+    ThcmMockIoctlCostTest.class,
+    ThcmAllocStatsTest.class,
+    ThcmWriteCountTest.class,
+    ThcmLargePathTest.class,
+    ThcmTransactionTest.class,
+    ThcmNetRouteTest.class,
+    ThcmRouteOrderTest.class,
+    ThcmMultiCardTest.class,
+    ThcmReloadTest.class,
+    ThcmInitReadbackTest.class,
+    ThcmCtlResolveTest.class,
+    ThcmPathDefTest.class,
+    ThcmCaseCacheTest.class
 })
 public class ThcmUnitTest {
 }
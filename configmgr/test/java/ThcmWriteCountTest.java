@@ -0,0 +1,399 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.cirrus.tinyhal.test.thcm;
+
+import java.io.File;
+import java.io.FileWriter;
+import java.io.IOException;
+import org.junit.After;
+import org.junit.AfterClass;
+import org.junit.Before;
+import org.junit.BeforeClass;
+import org.junit.Test;
+import static org.junit.Assert.*;
+
+import com.cirrus.tinyhal.test.thcm.CAlsaMock;
+import com.cirrus.tinyhal.test.thcm.CConfigMgr;
+import com.cirrus.tinyhal.test.thcm.ThcmPlatform;
+
+/**
+ * Tests the exact number of control reads and writes made for stream
+ * open and close, route changes and use-case selection.
+ * Other tests only check the final control values so would not fail if
+ * redundant writes or extra read-modify-write cycles were introduced.
+ */
+public class ThcmWriteCountTest
+{
+    private static final File sWorkFilesPath = ThcmPlatform.workFilesPath();
+    private static final File sControlsFile =
+        new File(sWorkFilesPath, "thcm_write_count_controls.csv");
+    private static final File sXmlFile =
+        new File(sWorkFilesPath, "thcm_write_count.xml");
+
+    private static final String[] ALL_CONTROLS = {
+        "GlobalOn", "GlobalPcm", "SpkOn", "SpkPcm",
+        "HpOn", "HpGain", "HpPcm", "Mode", "Eq"
+    };
+
+    // HpGain has no index in the on path so each value is written
+    private static final int HP_GAIN_VALUES = 2;
+
+    private CAlsaMock mAlsaMock;
+    private CConfigMgr mConfigMgr;
+
+    @BeforeClass
+    public static void setUpClass() throws IOException
+    {
+        FileWriter writer = new FileWriter(sControlsFile);
+        writer.write("GlobalOn,bool,1,0,0:1\n");
+        writer.write("GlobalPcm,bool,1,0,0:1\n");
+        writer.write("SpkOn,bool,1,0,0:1\n");
+        writer.write("SpkPcm,bool,1,0,0:1\n");
+        writer.write("HpOn,bool,1,0,0:1\n");
+        writer.write("HpGain,int," + HP_GAIN_VALUES + ",0,0:63\n");
+        writer.write("HpPcm,bool,1,0,0:1\n");
+        writer.write("Mode,enum,1,Off,Off:Low:High\n");
+        writer.write("Eq,byte,8,0,0:255\n");
+        writer.close();
+
+        writer = new FileWriter(sXmlFile);
+        writer.write("<audiohal>\n<mixer card=\"0\"/>\n");
+
+        writer.write("<device name=\"global\">\n");
+        writeSwitchPath(writer, "on", "GlobalOn", 1);
+        writeSwitchPath(writer, "off", "GlobalOn", 0);
+        writeSwitchPath(writer, "pcm_out_en", "GlobalPcm", 1);
+        writeSwitchPath(writer, "pcm_out_dis", "GlobalPcm", 0);
+        writer.write("</device>\n");
+
+        writer.write("<device name=\"speaker\">\n");
+        writeSwitchPath(writer, "on", "SpkOn", 1);
+        writeSwitchPath(writer, "off", "SpkOn", 0);
+        writeSwitchPath(writer, "pcm_out_en", "SpkPcm", 1);
+        writeSwitchPath(writer, "pcm_out_dis", "SpkPcm", 0);
+        writer.write("</device>\n");
+
+        writer.write("<device name=\"headphone\">\n");
+        writer.write("<path name=\"on\">\n");
+        writer.write("<ctl name=\"HpOn\" val=\"1\"/>\n");
+        writer.write("<ctl name=\"HpGain\" val=\"40\"/>\n");
+        writer.write("</path>\n");
+        writeSwitchPath(writer, "off", "HpOn", 0);
+        writeSwitchPath(writer, "pcm_out_en", "HpPcm", 1);
+        writeSwitchPath(writer, "pcm_out_dis", "HpPcm", 0);
+        writer.write("</device>\n");
+
+        // Two single-instance streams so that two can share a device
+        for (int i = 0; i < 2; ++i) {
+            writer.write("<stream type=\"pcm\" dir=\"out\" card=\"0\" device=\"" + i +
+                         "\" instances=\"1\">\n");
+            writer.write("<enable path=\"pcm_out_en\"/>\n");
+            writer.write("<disable path=\"pcm_out_dis\"/>\n");
+            writer.write("</stream>\n");
+        }
+
+        writer.write("<stream name=\"uc\" type=\"hw\" dir=\"out\">\n");
+        writer.write("<usecase name=\"mode\">\n");
+        // Partial write of Eq must read the current value first
+        writer.write("<case name=\"low\">\n");
+        writer.write("<ctl name=\"Mode\" val=\"Low\"/>\n");
+        writer.write("<ctl name=\"Eq\" index=\"2\" val=\"7,8\"/>\n");
+        writer.write("</case>\n");
+        writer.write("<case name=\"high\">\n");
+        writer.write("<ctl name=\"Mode\" val=\"High\"/>\n");
+        writer.write("<ctl name=\"Eq\" val=\"1,2,3,4,5,6,7,8\"/>\n");
+        writer.write("</case>\n");
+        writer.write("</usecase>\n");
+        writer.write("</stream>\n");
+
+        writer.write("</audiohal>\n");
+        writer.close();
+    }
+
+    private static void writeSwitchPath(FileWriter writer, String path,
+                                        String control, int value)
+        throws IOException
+    {
+        writer.write("<path name=\"" + path + "\">");
+        writer.write("<ctl name=\"" + control + "\" val=\"" + value + "\"/>");
+        writer.write("</path>\n");
+    }
+
+    @AfterClass
+    public static void tearDownClass()
+    {
+        sControlsFile.delete();
+        sXmlFile.delete();
+    }
+
+    @Before
+    public void setUp()
+    {
+        mAlsaMock = new CAlsaMock();
+        assertEquals("Failed to create CAlsaMock",
+                     0,
+                     mAlsaMock.createMixer(sControlsFile.toPath().toString()));
+
+        mConfigMgr = new CConfigMgr();
+        assertEquals("Failed to open CConfigMgr",
+                     0,
+                     mConfigMgr.init_audio_config(sXmlFile.toPath().toString()));
+        mAlsaMock.clearCounts();
+    }
+
+    @After
+    public void tearDown()
+    {
+        if (mConfigMgr != null) {
+            mConfigMgr.free_audio_config();
+            mConfigMgr = null;
+            assertFalse("Configmgr leaked memory", CConfigMgr.are_allocs_leaked());
+        }
+
+        if (mAlsaMock != null) {
+            mAlsaMock.closeMixer();
+            mAlsaMock = null;
+        }
+    }
+
+    private long openPcmStream(long device)
+    {
+        CConfigMgr.AudioConfig config = new CConfigMgr.AudioConfig();
+        config.sample_rate = 48000;
+        config.channel_mask = CConfigMgr.AUDIO_CHANNEL_OUT_FRONT_LEFT;
+        config.format = CConfigMgr.AUDIO_FORMAT_PCM;
+
+        long stream = mConfigMgr.get_stream(device, 0, config);
+        assertTrue("Failed to get stream", stream >= 0);
+        return stream;
+    }
+
+    /**
+     * Check the write count of every control, a missing entry in
+     * <code>expected</code> means 0 writes. No reads are expected.
+     */
+    private void checkWrites(String step, String[] names, int[] expected)
+    {
+        int total = 0;
+
+        for (String name : ALL_CONTROLS) {
+            int count = 0;
+            for (int i = 0; i < names.length; ++i) {
+                if (names[i].equals(name)) {
+                    count = expected[i];
+                }
+            }
+
+            assertEquals(step + ": " + name + " writes",
+                         count,
+                         mAlsaMock.getWriteCount(name));
+            total += count;
+        }
+
+        assertEquals(step + ": total writes", total, mAlsaMock.getTotalWriteCount());
+        assertEquals(step + ": total reads", 0, mAlsaMock.getTotalReadCount());
+
+        mAlsaMock.clearCounts();
+    }
+
+    /**
+     * Opening a stream applies the global on and enable paths and the on
+     * and enable paths of its initial device once each.
+     */
+    @Test
+    public void testStreamOpen()
+    {
+        openPcmStream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+
+        checkWrites("open",
+                    new String[] { "GlobalOn", "GlobalPcm", "SpkOn", "SpkPcm" },
+                    new int[] { 1, 1, 1, 1 });
+    }
+
+    /**
+     * Closing a stream applies the global and device off and disable paths
+     * once each.
+     */
+    @Test
+    public void testStreamClose()
+    {
+        long stream = openPcmStream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+        mAlsaMock.clearCounts();
+
+        mConfigMgr.release_stream(stream);
+
+        checkWrites("close",
+                    new String[] { "GlobalOn", "GlobalPcm", "SpkOn", "SpkPcm" },
+                    new int[] { 1, 1, 1, 1 });
+    }
+
+    /**
+     * Every open and close cycle of a stream costs the same writes.
+     */
+    @Test
+    public void testRepeatedOpenClose()
+    {
+        final String[] names = { "GlobalOn", "GlobalPcm", "SpkOn", "SpkPcm" };
+        final int[] counts = { 1, 1, 1, 1 };
+
+        for (int i = 0; i < 3; ++i) {
+            long stream = openPcmStream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+            checkWrites("open " + i, names, counts);
+
+            mConfigMgr.release_stream(stream);
+            checkWrites("close " + i, names, counts);
+        }
+    }
+
+    /**
+     * A second stream on a device that is already on only applies its
+     * enable paths, and releasing it only applies its disable paths.
+     */
+    @Test
+    public void testSharedDevice()
+    {
+        long stream1 = openPcmStream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+        mAlsaMock.clearCounts();
+
+        long stream2 = openPcmStream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+        assertTrue("Same stream returned twice", stream1 != stream2);
+        checkWrites("open second",
+                    new String[] { "GlobalPcm", "SpkPcm" },
+                    new int[] { 1, 1 });
+
+        mConfigMgr.release_stream(stream2);
+        checkWrites("close second",
+                    new String[] { "GlobalPcm", "SpkPcm" },
+                    new int[] { 1, 1 });
+
+        mConfigMgr.release_stream(stream1);
+        checkWrites("close first",
+                    new String[] { "GlobalOn", "GlobalPcm", "SpkOn", "SpkPcm" },
+                    new int[] { 1, 1, 1, 1 });
+    }
+
+    /**
+     * Switching route disables the old device and enables the new device
+     * with one pass of each path.
+     */
+    @Test
+    public void testRouteSwitch()
+    {
+        long stream = openPcmStream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+        mAlsaMock.clearCounts();
+
+        mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_WIRED_HEADPHONE);
+        checkWrites("speaker to headphone",
+                    new String[] { "SpkOn", "SpkPcm", "HpOn", "HpGain", "HpPcm" },
+                    new int[] { 1, 1, 1, HP_GAIN_VALUES, 1 });
+
+        mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+        checkWrites("headphone to speaker",
+                    new String[] { "SpkOn", "SpkPcm", "HpOn", "HpPcm" },
+                    new int[] { 1, 1, 1, 1 });
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * Applying the current route again does not write any controls.
+     */
+    @Test
+    public void testSameRoute()
+    {
+        long stream = openPcmStream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+        mAlsaMock.clearCounts();
+
+        for (int i = 0; i < 3; ++i) {
+            mConfigMgr.apply_route(stream, CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+            checkWrites("same route " + i, new String[] {}, new int[] {});
+        }
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * Adding a device to a route only applies the paths of the added
+     * device.
+     */
+    @Test
+    public void testAddDevice()
+    {
+        long stream = openPcmStream(CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER);
+        mAlsaMock.clearCounts();
+
+        mConfigMgr.apply_route(stream,
+                               CConfigMgr.AUDIO_DEVICE_OUT_SPEAKER |
+                               CConfigMgr.AUDIO_DEVICE_OUT_WIRED_HEADPHONE);
+        checkWrites("add headphone",
+                    new String[] { "HpOn", "HpGain", "HpPcm" },
+                    new int[] { 1, HP_GAIN_VALUES, 1 });
+
+        mConfigMgr.release_stream(stream);
+        checkWrites("close",
+                    new String[] { "GlobalOn", "GlobalPcm", "SpkOn", "SpkPcm",
+                                   "HpOn", "HpPcm" },
+                    new int[] { 1, 1, 1, 1, 1, 1 });
+    }
+
+    /**
+     * Each selection of a case writes its controls once. A partial write
+     * of a BYTE control costs exactly one read of that control.
+     */
+    @Test
+    public void testRepeatedUseCase()
+    {
+        long stream = mConfigMgr.get_named_stream("uc");
+        assertTrue("Failed to get named stream", stream >= 0);
+        mAlsaMock.clearCounts();
+
+        for (int i = 0; i < 3; ++i) {
+            assertEquals("apply_use_case failed",
+                         0,
+                         mConfigMgr.apply_use_case(stream, "mode", "low"));
+
+            assertEquals("Mode writes", 1, mAlsaMock.getWriteCount("Mode"));
+            assertEquals("Eq writes", 1, mAlsaMock.getWriteCount("Eq"));
+            assertEquals("Eq reads", 1, mAlsaMock.getReadCount("Eq"));
+            assertEquals("Total writes", 2, mAlsaMock.getTotalWriteCount());
+            assertEquals("Total reads", 1, mAlsaMock.getTotalReadCount());
+            mAlsaMock.clearCounts();
+        }
+
+        mConfigMgr.release_stream(stream);
+    }
+
+    /**
+     * A write of the whole of a BYTE control does not read it first.
+     */
+    @Test
+    public void testFullByteWriteNoRead()
+    {
+        long stream = mConfigMgr.get_named_stream("uc");
+        assertTrue("Failed to get named stream", stream >= 0);
+        mAlsaMock.clearCounts();
+
+        assertEquals("apply_use_case failed",
+                     0,
+                     mConfigMgr.apply_use_case(stream, "mode", "high"));
+        checkWrites("high", new String[] { "Mode", "Eq" }, new int[] { 1, 1 });
+
+        mConfigMgr.release_stream(stream);
+    }
+};
@@ -17,6 +17,7 @@
  */
 
 #ifndef THCM_TEST_HARNESS_H
+#define THCM_TEST_HARNESS_H
 
 #ifdef THCM_TEST_HARNESS_BUILD
 extern void* harness_malloc(size_t n, int line);
@@ -41,6 +42,37 @@ extern void harness_closedir(DIR* dir);
 #define fclose(f) harness_fclose(f)
 #define opendir(n) harness_opendir(n, __LINE__)
 #define closedir(d) harness_closedir(d)
+
+/* Phases for allocation statistics, must match EAllocPhase in alloc_hooks.h */
+#define THCM_ALLOC_PHASE_PARSE  0
+#define THCM_ALLOC_PHASE_INIT   1
+#define THCM_ALLOC_PHASE_STEADY 2
+
+extern void harness_set_alloc_phase(int phase);
+#define HARNESS_SET_ALLOC_PHASE(p) harness_set_alloc_phase(THCM_ALLOC_PHASE_##p)
+#else
+#define HARNESS_SET_ALLOC_PHASE(p) do { } while (0)
 #endif /* ifdef THCM_TEST_HARNESS_BUILD */
 
+#ifdef THCM_TEST_HARNESS_CHECKS
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+struct config_mgr;
+
+/* Check that the reference counts of streams and devices are consistent
+ * with the routes of the open streams. Only devices that have both an "on"
+ * and an "off" path are checked because the other devices do not use their
+ * reference count. Inconsistencies are logged. If stream_refs is not NULL
+ * the total of the stream reference counts is returned in it.
+ * Returns the number of inconsistencies found, or -EINVAL if cm is NULL.
+ */
+extern int check_config_mgr_state(struct config_mgr *cm, unsigned int *stream_refs);
+
+#if defined(__cplusplus)
+}  /* extern "C" */
+#endif
+#endif /* ifdef THCM_TEST_HARNESS_CHECKS */
+
 #endif /* ifndef THCM_TEST_HARNESS_H */
@@ -24,6 +24,8 @@
 #include <tinyhal/audio_defs.h>
 #endif
 
+#include "config_trace.h"
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
@@ -115,6 +117,22 @@ struct config_mgr *init_audio_config(const char *config_file_name);
 /** Delete audio config layer */
 void free_audio_config( struct config_mgr *cm );
 
+/** Reload the configuration file while streams are open
+ * The new file is parsed and the controls of the paths that are enabled
+ * and have changed are written. Open streams keep their reference counts
+ * and routes. <pre_init> and <init> are not applied again.
+ * If config_file_name is NULL the file passed to init_audio_config() is
+ * reloaded. The replaced constant values are kept until free_audio_config()
+ * because callers can still hold them.
+ *
+ * @return      0 on success
+ * @return      -EINVAL if the file can't be parsed or the streams it
+ *              declares are not the same as the current configuration
+ * @return      -EBUSY if called inside a transaction
+ * @return      -ENOMEM if out of memory
+ */
+int reload_audio_config(struct config_mgr *cm, const char *config_file_name);
+
 /** Get libtinyalsa mixer backing this config_mgr instance */
 struct mixer *get_mixer( const struct config_mgr *cm );
 
@@ -139,6 +157,8 @@ const struct hw_stream *get_named_stream(struct config_mgr *cm,
                                    const char *name);
 
 /** Return the value of a constant defined by a <set> element as a string
+ * The string remains valid until free_audio_config(), even if the
+ * configuration is reloaded.
  * @return      0 on success
  * @return      -ENOSYS if the constant does not exist
  */
@@ -175,7 +195,10 @@ uint32_t get_current_routes( const struct hw_stream *stream );
 /** Apply new device routing to a stream */
 void apply_route( const struct hw_stream *stream, uint32_t devices );
 
-/** Apply hardware volume */
+/** Apply hardware volume
+ * Takes the config_mgr lock so that a reload_audio_config() cannot
+ * replace the volume controls while they are written.
+ */
 int set_hw_volume( const struct hw_stream *stream, int left_pc, int right_pc);
 
 /** Apply a custom use-case
@@ -187,6 +210,166 @@ int apply_use_case( const struct hw_stream* stream,
                     const char *setting,
                     const char *case_name);
 
+/** Start batching control writes
+ * Until config_commit() the calling thread holds the config_mgr lock, so
+ * other threads calling the routing, use-case and volume APIs wait for the
+ * commit.
+ * apply_route(), apply_use_case(), get_stream(), get_named_stream() and
+ * release_stream() called by this thread update the routing state as
+ * normal but their control writes are queued. set_hw_volume() is not
+ * batched. A control written more than once is only written with its last
+ * value, so paths that rely on a control being toggled, for example to
+ * restart a DSP, must not be applied inside a transaction. Writes are
+ * moved to the position of the last write to the same control, so a
+ * sequence such as disabling an interface, changing its rate and enabling
+ * it again is not kept.
+ *
+ * @return      0 on success
+ * @return      -EINVAL if cm is NULL
+ * @return      -EBUSY if this thread already has a transaction open
+ */
+int config_begin_transaction(struct config_mgr *cm);
+
+/** Write the net result of the writes queued since
+ * config_begin_transaction() and release the config_mgr lock. Each control
+ * value is written once with the last value queued for it, in the order of
+ * the last write queued to each control. All queued writes are attempted
+ * even if some fail.
+ *
+ * @return      0 on success
+ * @return      -EINVAL if cm is NULL or this thread has no open transaction
+ * @return      the error of the first failed write
+ */
+int config_commit(struct config_mgr *cm);
+
+/** Test whether the configuration asks for the route and use-case changes
+ * of each set_parameters() call to be made in one transaction, with
+ * <mixer parameters="batch">. This is fixed when the configuration is
+ * first loaded, a reload does not change it.
+ */
+bool config_batch_parameters(const struct config_mgr *cm);
+
+/** Number of <pre_init> blocks that are timed individually. Any further
+ * <pre_init> blocks are added to the last entry.
+ */
+#define CONFIG_MGR_MAX_PREINIT_STATS 4
+
+/** Time and control writes for one phase of init_audio_config() */
+struct config_phase_stats {
+    uint64_t        time_ns;        /**< monotonic time spent in phase */
+    uint32_t        ctl_writes;     /**< number of control writes */
+    uint32_t        bytes_written;  /**< payload bytes written to controls */
+    uint32_t        ctl_unchanged;  /**< writes skipped by write="changed"
+                                         because the control held the value */
+};
+
+/** Breakdown of where init_audio_config() spent its time.
+ * Phases do not overlap, for example the time to open a file redirected
+ * by <codec_probe> is only counted in open, not in parse.
+ */
+struct config_mgr_boot_stats {
+    uint64_t                    total_ns;   /**< whole of init_audio_config() */
+    struct config_phase_stats   open;       /**< open files and codec_probe */
+    struct config_phase_stats   parse;      /**< XML parsing */
+    struct config_phase_stats   resolve;    /**< lookup of controls by name */
+    struct config_phase_stats   new_ctls;   /**< refresh of tinyalsa controls */
+    unsigned int                preinit_count;
+    struct config_phase_stats   preinit[CONFIG_MGR_MAX_PREINIT_STATS];
+    struct config_phase_stats   init;       /**< apply of <init> */
+};
+
+/** Get the timing breakdown of init_audio_config()
+ *
+ * @return      0 on success
+ * @return      -EINVAL if cm or stats is NULL
+ */
+int get_config_mgr_boot_stats(const struct config_mgr *cm,
+                              struct config_mgr_boot_stats *stats);
+
+/** Number of buckets in the control write latency histogram */
+#define CTL_WRITE_HIST_BUCKETS 24
+
+/** Write statistics for one mixer control */
+struct ctl_write_stats {
+    const char  *name;      /**< valid until free_audio_config() */
+    uint32_t    writes;     /**< number of writes */
+    uint64_t    total_ns;   /**< total time spent writing */
+    uint64_t    max_ns;     /**< slowest write */
+    /** hist[0] counts writes that took less than 1us. For n > 0 hist[n]
+     * counts writes that took from 2^(n-1) to less than 2^n us. The last
+     * bucket also counts all slower writes.
+     */
+    uint32_t    hist[CTL_WRITE_HIST_BUCKETS];
+};
+
+/** Get per-control write statistics
+ * Only available if built with TINYHAL_CTL_WRITE_STATS.
+ * Copies the statistics of up to max_count controls that have been written
+ * since the last reset into stats. stats can be NULL to get the number of
+ * controls.
+ *
+ * @return      number of controls written, which can be greater than
+ *              max_count
+ * @return      -ENOSYS if not built with TINYHAL_CTL_WRITE_STATS
+ */
+int get_ctl_write_stats(struct config_mgr *cm,
+                        struct ctl_write_stats *stats,
+                        unsigned int max_count);
+
+/** Reset all per-control write statistics to zero */
+void reset_ctl_write_stats(struct config_mgr *cm);
+
+/** Copy the most recent trace records, oldest first
+ * Up to CONFIG_TRACE_RECORDS are kept. Records that are being written
+ * while this is called are skipped.
+ *
+ * @return      number of records copied
+ * @return      -EINVAL if cm or records is NULL
+ */
+int get_config_trace(struct config_mgr *cm,
+                     struct config_trace_record *records,
+                     unsigned int max_count);
+
+/** APIs that take the config_mgr lock. The lock taken by get_stream() to
+ * apply the initial route is counted under apply_route.
+ */
+enum config_lock_api {
+    e_config_lock_get_stream,
+    e_config_lock_get_named_stream,
+    e_config_lock_release_stream,
+    e_config_lock_apply_route,
+    e_config_lock_apply_use_case,
+    e_config_lock_transaction,      /**< held from begin to commit */
+    e_config_lock_reload,
+    e_config_lock_set_hw_volume,
+    e_config_lock_get_constant,
+    e_config_lock_api_count
+};
+
+/** Lock statistics for one API */
+struct config_lock_stats {
+    uint32_t    count;          /**< number of times the lock was taken */
+    uint64_t    wait_ns;        /**< total time waiting for the lock */
+    uint64_t    max_wait_ns;    /**< longest wait */
+    uint64_t    hold_ns;        /**< total time the lock was held */
+    uint64_t    max_hold_ns;    /**< longest hold */
+};
+
+/** Get lock statistics, indexed by enum config_lock_api
+ * Only available if built with TINYHAL_LOCK_STATS.
+ * Copies up to max_count entries into stats.
+ *
+ * @return      number of entries copied
+ * @return      -EINVAL if cm or stats is NULL
+ * @return      -ENOSYS if not built with TINYHAL_LOCK_STATS
+ */
+int get_config_lock_stats(struct config_mgr *cm,
+                          struct config_lock_stats *stats,
+                          unsigned int max_count);
+
+/** Reset all lock statistics to zero */
+void reset_config_lock_stats(struct config_mgr *cm);
+
 #if defined(__cplusplus)
 }  /* extern "C" */
 #endif
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CONFIG_TRACE_H
+#define CONFIG_TRACE_H
+
+/*
+ * Binary format of the config manager trace records. This header is shared
+ * with the host-side decoder so must not depend on anything except stdint.
+ */
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+/** Version of the record format, increment if the record layout changes */
+#define CONFIG_TRACE_VERSION 1
+
+/** Number of records kept, must be a power of 2 */
+#define CONFIG_TRACE_RECORDS 512
+
+/** Tag used to mark the start and end of the trace in the dump output */
+#define CONFIG_TRACE_DUMP_TAG "TINYHAL_TRACE"
+
+/** Stream field value for events that are not associated with a stream */
+#define CONFIG_TRACE_NO_STREAM 0xFFFF
+
+/** Set in the stream field for named streams */
+#define CONFIG_TRACE_NAMED_STREAM 0x8000
+
+/** Ctl id for a control that has no tinyalsa id */
+#define CONFIG_TRACE_NO_CTL 0xFFFFFFFFU
+
+enum config_trace_event {
+    e_config_trace_route = 1,       /**< arg[0]=old devices arg[1]=new devices
+                                         arg[2]=ns until new devices enabled */
+    e_config_trace_use_case,        /**< arg[0]=usecase index arg[1]=case index
+                                         arg[2]=result */
+    e_config_trace_volume,          /**< arg[0]=left % arg[1]=right %
+                                         arg[2]=result */
+    e_config_trace_get_stream,      /**< arg[0]=devices arg[1]=new refcount */
+    e_config_trace_release_stream,  /**< arg[1]=new refcount */
+    e_config_trace_ctl_write,       /**< arg[0]=ctl id arg[1]=value or byte
+                                         count arg[2]=result
+                                         arg[3]=card */
+    e_config_trace_commit,          /**< arg[0]=writes queued
+                                         arg[1]=writes made arg[2]=result */
+    e_config_trace_reload,          /**< arg[0]=controls written
+                                         arg[2]=result */
+};
+
+/** One trace record, 40 bytes in host byte order */
+struct config_trace_record {
+    uint64_t    timestamp_ns;   /**< CLOCK_MONOTONIC time at start of event */
+    uint32_t    seq;            /**< sequence number of this record */
+    uint32_t    tid;            /**< kernel thread id of caller */
+    uint32_t    duration_ns;    /**< saturates at UINT32_MAX */
+    uint16_t    event;          /**< enum config_trace_event */
+    uint16_t    stream;         /**< index of stream in the config */
+    uint32_t    arg[4];         /**< event-specific */
+};
+
+#if defined(__cplusplus)
+}  /* extern "C" */
+#endif
+
+#endif  /* ifndef CONFIG_TRACE_H */
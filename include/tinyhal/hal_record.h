@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HAL_RECORD_H
+#define HAL_RECORD_H
+
+/*
+ * Binary format of a recording of the calls made to the HAL. This header is
+ * shared with the host-side replayer so must not depend on anything except
+ * stdint.
+ *
+ * A recording is a struct hal_record_file_header followed by records. Each
+ * record is a struct hal_record followed by str_len bytes of string
+ * argument, without a terminating NUL. All values are in host byte order.
+ */
+
+#include <stdint.h>
+
+#if defined(__cplusplus)
+extern "C" {
+#endif
+
+#define HAL_RECORD_MAGIC "THRC"
+
+/** Version of the format, increment if the layout changes */
+#define HAL_RECORD_VERSION 1
+
+/** Stream field value for calls that are not made on a stream */
+#define HAL_RECORD_NO_STREAM 0xFFFF
+
+struct hal_record_file_header {
+    char        magic[4];       /**< HAL_RECORD_MAGIC */
+    uint32_t    version;        /**< HAL_RECORD_VERSION */
+    uint32_t    record_size;    /**< sizeof(struct hal_record) */
+    uint32_t    reserved;
+};
+
+/*
+ * Float arguments are stored as their IEEE-754 bit pattern. Streams are
+ * identified by a number that is unique within the recording, assigned
+ * when the stream is opened.
+ */
+enum hal_record_call {
+    e_hal_record_adev_open = 1,         /**< string=config file */
+    e_hal_record_adev_close,
+    e_hal_record_adev_set_parameters,   /**< string=kvpairs */
+    e_hal_record_adev_set_voice_volume, /**< arg[0]=volume (float) */
+    e_hal_record_adev_set_master_volume,/**< arg[0]=volume (float) */
+    e_hal_record_adev_set_mode,         /**< arg[0]=mode */
+    e_hal_record_adev_set_mic_mute,     /**< arg[0]=state */
+    e_hal_record_adev_open_output_stream,
+                                        /**< stream=new stream
+                                             arg[0]=devices arg[1]=flags
+                                             arg[2]=format arg[3]=rate
+                                             arg[4]=channel mask
+                                             arg[5]=io handle */
+    e_hal_record_adev_close_output_stream,
+    e_hal_record_adev_open_input_stream,
+                                        /**< stream=new stream
+                                             arg[0]=devices arg[1]=flags
+                                             arg[2]=format arg[3]=rate
+                                             arg[4]=channel mask
+                                             arg[5]=io handle */
+    e_hal_record_adev_close_input_stream,
+    e_hal_record_out_set_parameters,    /**< string=kvpairs */
+    e_hal_record_out_set_volume,        /**< arg[0]=left arg[1]=right (float) */
+    e_hal_record_out_write,             /**< arg[0]=bytes */
+    e_hal_record_out_standby,
+    e_hal_record_out_pause,
+    e_hal_record_out_resume,
+    e_hal_record_out_drain,             /**< arg[0]=drain type */
+    e_hal_record_out_flush,
+    e_hal_record_in_set_parameters,     /**< string=kvpairs */
+    e_hal_record_in_read,               /**< arg[0]=bytes */
+    e_hal_record_in_standby,
+    e_hal_record_in_set_gain,           /**< arg[0]=gain (float) */
+    e_hal_record_call_count
+};
+
+/** Fixed part of one record, 48 bytes */
+struct hal_record {
+    uint64_t    timestamp_ns;   /**< CLOCK_MONOTONIC time at entry */
+    uint32_t    duration_ns;    /**< saturates at UINT32_MAX */
+    uint16_t    call;           /**< enum hal_record_call */
+    uint16_t    stream;         /**< stream number or HAL_RECORD_NO_STREAM */
+    int32_t     ret;            /**< return value, 0 for void calls */
+    uint32_t    arg[6];         /**< call-specific */
+    uint32_t    str_len;        /**< length of the string that follows */
+};
+
+#if defined(__cplusplus)
+}  /* extern "C" */
+#endif
+
+#endif  /* ifndef HAL_RECORD_H */
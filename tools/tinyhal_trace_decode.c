@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2020 Cirrus Logic, Inc. and
+ *                    Cirrus Logic International Semiconductor Ltd.
+ *                    All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host-side decoder for the config manager trace. Reads the output of
+ * "dumpsys media.audio_flinger" (or a bugreport) on stdin and prints the
+ * trace records as a timeline.
+ *
+ * The records are in the byte order of the device, which is assumed to be
+ * the same as the host.
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tinyhal/config_trace.h>
+
+#define LINE_MAX_LEN 1024
+
+static const char *event_name(unsigned int event)
+{
+    switch (event) {
+    case e_config_trace_route:          return "route";
+    case e_config_trace_use_case:       return "use_case";
+    case e_config_trace_volume:         return "volume";
+    case e_config_trace_get_stream:     return "get_stream";
+    case e_config_trace_release_stream: return "release_stream";
+    case e_config_trace_ctl_write:      return "ctl_write";
+    case e_config_trace_commit:         return "commit";
+    case e_config_trace_reload:         return "reload";
+    default:                            return "?";
+    }
+}
+
+static void format_stream(unsigned int stream, char *buf, size_t len)
+{
+    if (stream == CONFIG_TRACE_NO_STREAM) {
+        snprintf(buf, len, "-");
+    } else if (stream & CONFIG_TRACE_NAMED_STREAM) {
+        snprintf(buf, len, "named[%u]", stream & ~CONFIG_TRACE_NAMED_STREAM);
+    } else {
+        snprintf(buf, len, "anon[%u]", stream);
+    }
+}
+
+static void print_args(const struct config_trace_record *rec)
+{
+    const int result = (int)rec->arg[2];
+
+    switch (rec->event) {
+    case e_config_trace_route:
+        printf("devices 0x%x -> 0x%x enabled after %uns",
+               rec->arg[0], rec->arg[1], rec->arg[2]);
+        break;
+    case e_config_trace_use_case:
+        if (result == 0) {
+            printf("usecase %u case %u", rec->arg[0], rec->arg[1]);
+        } else {
+            printf("not found (%d)", result);
+        }
+        break;
+    case e_config_trace_volume:
+        printf("L=%u%% R=%u%% (%d)", rec->arg[0], rec->arg[1], result);
+        break;
+    case e_config_trace_get_stream:
+        printf("devices 0x%x refcount %u", rec->arg[0], rec->arg[1]);
+        break;
+    case e_config_trace_release_stream:
+        printf("refcount %u", rec->arg[1]);
+        break;
+    case e_config_trace_ctl_write:
+        if (rec->arg[0] == CONFIG_TRACE_NO_CTL) {
+            printf("card %u ctl ? ", rec->arg[3]);
+        } else {
+            printf("card %u ctl #%u ", rec->arg[3], rec->arg[0]);
+        }
+        printf("val/len %u (%d)", rec->arg[1], result);
+        break;
+    case e_config_trace_commit:
+        printf("queued %u written %u (%d)", rec->arg[0], rec->arg[1], result);
+        break;
+    case e_config_trace_reload:
+        printf("written %u (%d)", rec->arg[0], result);
+        break;
+    default:
+        printf("%08x %08x %08x %08x",
+               rec->arg[0], rec->arg[1], rec->arg[2], rec->arg[3]);
+        break;
+    }
+}
+
+static int decode_hex(const char *hex, void *out, size_t len)
+{
+    unsigned char *p = out;
+    unsigned int byte;
+    size_t i;
+
+    for (i = 0; i < len; ++i) {
+        if (sscanf(hex + (i * 2), "%2x", &byte) != 1) {
+            return -EINVAL;
+        }
+        p[i] = (unsigned char)byte;
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    char line[LINE_MAX_LEN];
+    const size_t tag_len = strlen(CONFIG_TRACE_DUMP_TAG);
+    struct config_trace_record rec;
+    unsigned long long now_ns = 0;
+    uint64_t first_ns = 0;
+    unsigned int version;
+    size_t rec_size;
+    int in_trace = 0;
+    int count = 0;
+    char stream[16];
+
+    while (fgets(line, sizeof(line), stdin) != NULL) {
+        if (!in_trace) {
+            const char *tag = strstr(line, CONFIG_TRACE_DUMP_TAG " ");
+            if (tag == NULL) {
+                continue;
+            }
+
+            if (sscanf(tag + tag_len, "%u %zu %llu",
+                       &version, &rec_size, &now_ns) != 3) {
+                continue;
+            }
+
+            if ((version != CONFIG_TRACE_VERSION) || (rec_size != sizeof(rec))) {
+                fprintf(stderr, "Unsupported trace version %u size %zu\n",
+                        version, rec_size);
+                return 1;
+            }
+
+            in_trace = 1;
+            continue;
+        }
+
+        if (strncmp(line, CONFIG_TRACE_DUMP_TAG, tag_len) == 0) {
+            break;
+        }
+
+        if ((strlen(line) < sizeof(rec) * 2)
+                || (decode_hex(line, &rec, sizeof(rec)) != 0)) {
+            fprintf(stderr, "Bad record: %s", line);
+            continue;
+        }
+
+        if (count++ == 0) {
+            first_ns = rec.timestamp_ns;
+        }
+
+        format_stream(rec.stream, stream, sizeof(stream));
+        printf("%6u %12.6f %6u %-14s %-10s %8.1fus  ",
+               rec.seq,
+               (double)(rec.timestamp_ns - first_ns) / 1e9,
+               rec.tid,
+               event_name(rec.event),
+               stream,
+               (double)rec.duration_ns / 1e3);
+        print_args(&rec);
+        printf("\n");
+    }
+
+    if (!in_trace) {
+        fprintf(stderr, "No trace found\n");
+        return 1;
+    }
+
+    if (count > 0) {
+        printf("%d records, last %.6f s before dump\n", count,
+               (double)(now_ns - rec.timestamp_ns) / 1e9);
+    }
+
+    return 0;
+}